@@ -0,0 +1,203 @@
+#include "bench.h"
+#include <base/animation.h>
+#include <base/animationstate.h>
+#include <base/skeleton.h>
+#include <base/model.h>
+#include <base/mesh.h>
+#include <base/hardwarebuffer.h>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+
+using namespace base;
+using namespace bench;
+
+// Baked clip against keyframe sampling. 100 bones, 120 frames, keys on every frame
+static void clip() {
+	const int bones = 100, frames = 120;
+	Animation anim;
+	size_t keyMemory = 0;
+	char name[16];
+	for(int b=0; b<bones; ++b) {
+		snprintf(name, 16, "b%d", b);
+		anim.addKeySet(name);
+		vec3 axis = vec3(sin(b*1.f), cos(b*2.f), 0.5f).normalised();
+		for(int f=0; f<=frames; ++f) {
+			anim.addRotationKey(b, f, Quaternion(axis, f*0.05f + b));
+			anim.addPositionKey(b, f, b%3? vec3(1,2,3): vec3(f*0.1f, sin(f*0.1f), 0));
+			anim.addScaleKey(b, f, vec3(1,1,1));
+		}
+		keyMemory += 64 + (frames+1) * (20+16+16);
+	}
+	AnimationClip clip(&anim);
+	report("clip memory, 100 bones x 120 frames", clip.getMemoryUsage() / 1024.0, "KB");
+	report("  source keyframes", keyMemory / 1024.0, "KB");
+
+	std::vector<AnimationClip::Transform> out(bones);
+	float rotationError = 0, positionError = 0;
+	for(float f=0; f<frames; f+=0.37f) {
+		clip.sampleAll(f, out.data());
+		for(int b=0; b<bones; ++b) {
+			Quaternion q;
+			vec3 p;
+			anim.getRotation(b, f, 0, q);
+			anim.getPosition(b, f, 0, p);
+			const Quaternion& r = out[b].rotation;
+			rotationError = fmax(rotationError, 1 - fabs(q.w*r.w + q.x*r.x + q.y*r.y + q.z*r.z));
+			positionError = fmax(positionError, p.distance(out[b].position));
+		}
+	}
+	report("  worst rotation error (1-|dot|)", rotationError * 1e6, "x 1e-6");
+	report("  worst position error", positionError * 1e6, "x 1e-6");
+
+	const int samples = 20000;
+	float sink = 0;
+	Timer timer;
+	for(int i=0; i<samples; ++i) {
+		clip.sampleAll(fmod(i*0.37f, frames), out.data());
+		sink += out[5].rotation.x;
+	}
+	report("clip sampleAll, 100 bones", timer.us() / samples, "us");
+	std::vector<int> hints(bones * 3, 0);
+	timer.reset();
+	for(int i=0; i<samples; ++i) {
+		float f = fmod(i*0.37f, frames);
+		for(int b=0; b<bones; ++b) {
+			Quaternion q;
+			vec3 p, s;
+			hints[b*3]   = anim.getRotation(b, f, hints[b*3], q);
+			hints[b*3+1] = anim.getPosition(b, f, hints[b*3+1], p);
+			hints[b*3+2] = anim.getScale(b, f, hints[b*3+2], s);
+			sink += q.x;
+		}
+	}
+	report("keyframe sampling, 100 bones", timer.us() / samples, "us");
+	if(sink == 12345) printf(" ");
+}
+
+// 800 animated copies of a 60 bone skeleton
+static void skeletons() {
+	const int bones = 60, count = 800, frames = 60;
+	Skeleton proto;
+	Animation anim;
+	anim.setSpeed(30);
+	char name[16];
+	for(int b=0; b<bones; ++b) {
+		snprintf(name, 16, "bone%d", b);
+		Matrix m;
+		m.setTranslation(vec3(0, 1, 0.1f*b));
+		proto.addBone(b? proto.getBone(b/2): 0, name, m);
+		anim.addKeySet(name);
+		for(int f=0; f<=frames; f+=2) {
+			anim.addRotationKey(b, f, Quaternion(vec3(0,0.6f,0.8f), f*0.02f + b));
+			anim.addPositionKey(b, f, vec3(0, f*0.01f, 0));
+			anim.addScaleKey(b, f, vec3(1, 1+f*0.001f, 1));
+		}
+	}
+	proto.setRestPose();
+	proto.update();
+
+	std::vector<Skeleton*> skeletons;
+	std::vector<AnimationState*> states;
+	for(int i=0; i<count; ++i) {
+		skeletons.push_back(new Skeleton(proto));
+		states.push_back(new AnimationState(skeletons.back()));
+		states.back()->play(&anim, 1 + i*0.001f);
+	}
+	for(int baked=0; baked<2; ++baked) {
+		if(baked) anim.bake();
+		Timer timer;
+		for(int f=0; f<50; ++f) {
+			for(AnimationState* s: states) {
+				s->getSkeleton()->resetPose();
+				s->update(0.016f);
+			}
+		}
+		report(baked? "800 x 60 bones, animation update, baked clip": "800 x 60 bones, animation update", timer.ms() / 50, "ms/frame");
+	}
+	Timer timer;
+	for(int f=0; f<200; ++f) {
+		for(Skeleton* s: skeletons) {
+			s->getBone(0)->setPosition(vec3(f, 0, 0));
+			s->update();
+		}
+	}
+	report("800 x 60 bones, hierarchy only", timer.ms() / 200, "ms/frame");
+	for(AnimationState* s: states) delete s;
+	for(Skeleton* s: skeletons) delete s;
+}
+
+// Software skinning of 50k vertices, 40 bones, 3 weights per vertex
+static void skinning() {
+	const int bones = 40, vertices = 50000;
+	Skeleton* skeleton = new Skeleton;
+	char name[16];
+	for(int b=0; b<bones; ++b) {
+		snprintf(name, 16, "b%d", b);
+		Matrix m;
+		m.setTranslation(vec3(0, 1, 0.1f*b));
+		skeleton->addBone(b? skeleton->getBone(b/2): 0, name, m);
+	}
+	skeleton->setRestPose();
+	for(int b=0; b<bones; ++b) skeleton->getBone(b)->setAngle(Quaternion(vec3(0.3f, 0.6f, 0.1f*b)));
+	skeleton->update();
+
+	struct SkinVertex { float weight[4]; IndexType index[4]; };
+	float* vertexData = new float[vertices * 10];
+	SkinVertex* skinData = new SkinVertex[vertices];
+	srand(1);
+	for(int i=0; i<vertices*10; ++i) vertexData[i] = (rand()%1000) / 500.f - 1;
+	for(int i=0; i<vertices; ++i) {
+		float total = 0;
+		for(int j=0; j<4; ++j) {
+			skinData[i].weight[j] = j<3? rand()%100 + 1: 0;
+			skinData[i].index[j] = rand() % bones;
+			total += skinData[i].weight[j];
+		}
+		for(int j=0; j<4; ++j) skinData[i].weight[j] /= total;
+	}
+
+	for(int full=0; full<2; ++full) {
+		Mesh* mesh = new Mesh();
+		HardwareVertexBuffer* vb = new HardwareVertexBuffer();
+		vb->setData(vertexData, vertices, 40);
+		vb->attributes.add(VA_VERTEX, VA_FLOAT3);
+		if(full) {
+			vb->attributes.add(VA_NORMAL, VA_FLOAT3);
+			vb->attributes.add(VA_TANGENT, VA_FLOAT4);
+		}
+		mesh->setVertexBuffer(vb);
+		HardwareVertexBuffer* sb = new HardwareVertexBuffer();
+		sb->setData(skinData, vertices, sizeof(SkinVertex));
+		sb->attributes.add(VA_SKINWEIGHT, VA_FLOAT4);
+		sb->attributes.add(VA_SKININDEX, VA_SHORT4);
+		mesh->setSkinBuffer(sb);
+		mesh->initialiseSkinData(bones, 4);
+		for(int b=0; b<bones; ++b) {
+			snprintf(name, 16, "b%d", b);
+			mesh->setSkinName(b, name);
+		}
+		int* map = Model::createSkinMap(skeleton, mesh);
+		Mesh* target = Model::createTargetMesh(mesh);
+		double best = 1e9;
+		for(int r=0; r<100; ++r) {
+			Timer timer;
+			Model::skinMesh(mesh, skeleton, map, target, 1);
+			best = fmin(best, timer.ms());
+		}
+		report(full? "skin positions, normals, tangents": "skin positions", vertices / best / 1000, "M vertices/s");
+		delete [] map;
+		delete target;
+		delete mesh;
+	}
+	delete [] vertexData;
+	delete [] skinData;
+	delete skeleton;
+}
+
+void bench::animation() {
+	group("Animation");
+	clip();
+	skeletons();
+	skinning();
+}
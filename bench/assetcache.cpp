@@ -0,0 +1,58 @@
+#include "bench.h"
+#include <base/assetcache.h>
+#include <base/thread.h>
+#include <vector>
+#include <atomic>
+
+using namespace base;
+
+namespace {
+	struct Writer {
+		AssetCache* cache;
+		int index;
+		std::atomic<int>* failed;
+		std::atomic<int>* bad;
+		void run() {
+			std::vector<unsigned char> payload(20000 + index * 3001, (unsigned char)index);
+			for(int i=0; i<200; ++i) {
+				if(!cache->put("shared", 42ull, 1, payload.data(), payload.size())) ++*failed;
+				File f = cache->get("shared", 42ull, 1);
+				if(!f) continue;
+				unsigned char v = f.data()[0];
+				bool ok = f.size() == 20000u + v * 3001;
+				for(size_t k=0; ok && k<f.size(); ++k) ok = (unsigned char)f.data()[k] == v;
+				if(!ok) ++*bad;
+			}
+		}
+	};
+}
+
+void bench::assetCache() {
+	group("Asset cache");
+	AssetCache cache("bench_cache");
+	cache.clear();
+
+	// Single thread round trip of image sized entries
+	std::vector<char> data(1024 * 1024);
+	for(size_t i=0; i<data.size(); ++i) data[i] = (char)(i * 7);
+	Timer timer;
+	for(int i=0; i<50; ++i) cache.put("bench", (unsigned long long)i, 1, data.data(), data.size());
+	report("put 1MB entry", timer.ms() / 50, "ms");
+	timer.reset();
+	for(int i=0; i<50; ++i) cache.get("bench", (unsigned long long)i, 1);
+	report("get 1MB entry", timer.ms() / 50, "ms");
+
+	// Several threads writing and reading back the same key
+	std::atomic<int> failed(0), bad(0);
+	Writer writers[8];
+	Thread threads[8];
+	for(int i=0; i<8; ++i) {
+		writers[i] = { &cache, i, &failed, &bad };
+		threads[i].begin(&writers[i], &Writer::run);
+	}
+	for(Thread& t: threads) t.join();
+	report("one key, 8 threads x 200 writes: failed puts", failed, "");
+	report("one key, 8 threads x 200 writes: bad reads", bad, "");
+	cache.clear();
+}
+
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+
+/** Benchmark program. Built when BUILD_BENCHMARKS is enabled in CMake.
+ *  Each group sets up the same scenario as the measurements quoted when the code it covers
+ *  was optimised, and prints the current numbers. Where the old code path is still available
+ *  behind a switch, both are timed.
+ */
+namespace bench {
+	class Timer {
+		public:
+		typedef std::chrono::steady_clock Clock;
+		Timer() : m_start(Clock::now()) {}
+		void   reset() { m_start = Clock::now(); }
+		double ms() const { return std::chrono::duration<double, std::milli>(Clock::now() - m_start).count(); }
+		double us() const { return ms() * 1000; }
+		private:
+		Clock::time_point m_start;
+	};
+
+	void   group(const char* name);
+	void   report(const char* name, double value, const char* unit);
+	size_t residentMemory();	// Bytes, or 0 where not supported
+
+	extern const char* fontFile;	// TrueType font passed with --font
+
+	// Groups
+	void assetCache();
+	void script();
+	void variables();
+	void animation();
+	void threads();
+	void particles();
+	void foliage();
+	void gui();	// Needs a GL context
+	void fonts();	// Needs a GL context and --font
+}
+
@@ -0,0 +1,55 @@
+#include "bench.h"
+#include <base/world/foliage.h>
+#include <cmath>
+
+using namespace base;
+
+namespace {
+	// Procedural height so only the default per-point resolve path is measured
+	class BenchFoliage : public FoliageSystem {
+		public:
+		static float height(const vec3& p) { return sinf(p.x*0.05f)*20 + cosf(p.z*0.07f)*15 + sinf((p.x+p.z)*0.3f)*2; }
+		void resolvePosition(const vec3& p, vec3& out, float& h) const override {
+			h = height(p);
+			out.set(p.x, h, p.z);
+		}
+		void resolveNormal(const vec3& p, vec3& out) const override {
+			vec3 a(2, height(p+vec3(1,0,0)) - height(p-vec3(1,0,0)), 0);
+			vec3 b(0, height(p+vec3(0,0,1)) - height(p-vec3(0,0,1)), 2);
+			out = b.cross(a).normalised();
+		}
+	};
+	class BenchLayer : public GrassLayer {
+		public:
+		BenchLayer() : GrassLayer(64, 100) {}
+		int generate(const Point& chunk) {
+			PointList points;
+			vec3 up;
+			return generatePoints(chunk, points, up);
+		}
+	};
+}
+
+void bench::foliage() {
+	group("Foliage");
+	BenchFoliage system;
+	BenchLayer* layer = new BenchLayer;
+	system.addLayer(layer);
+	layer->setDensity(40);
+	layer->setHeightRange(-10, 25);
+	layer->setSlopeRange(0, 0.2f);
+	unsigned char map[64*64];
+	for(int i=0; i<64*64; ++i) map[i] = (i*37) & 255;
+	layer->setDensityMap(new FoliageMap(64, 64, map));
+	layer->setMapBounds(BoundingBox2D(0, 0, 1024, 1024));
+
+	// 48 chunks of 64x64 units at density 40
+	long points = 0;
+	Timer timer;
+	for(int r=0; r<3; ++r) for(int i=0; i<4; ++i) for(int j=0; j<4; ++j) points += layer->generate(Point(i, j));
+	double ms = timer.ms();
+	report("48 chunks, height, slope and density rejection", ms, "ms");
+	report("  candidates", 48 * 64 * 64 * 40 / ms / 1000, "M/s");
+	report("  points kept", points, "");
+}
+
@@ -0,0 +1,70 @@
+#include "bench.h"
+#include <base/opengl.h>
+#include <base/gui/font.h>
+#include <base/gui/freetype.h>
+
+using namespace gui;
+
+static Point getTextureSize(const Font& font) {
+	Point size;
+	glBindTexture(GL_TEXTURE_2D, font.getTexture());
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &size.x);
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &size.y);
+	return size;
+}
+
+// Four sizes of a TrueType font: fixed code point ranges against glyphs rendered on demand
+void bench::fonts() {
+	group("Fonts");
+	const char* ttf = fontFile;
+	if(!ttf) {
+		printf("  Pass --font file.ttf to run\n");
+		return;
+	}
+	const int sizes[] = { 12, 16, 24, 32 };
+
+	Font fixed;
+	Timer timer;
+	for(int size: sizes) {
+		FreeTypeFont loader(ttf);
+		loader.addRange(32, 0x24f);	// Latin
+		loader.addRange(0x370, 0x3ff);	// Greek
+		loader.addRange(0x400, 0x4ff);	// Cyrillic
+		loader.addRange(0x2000, 0x206f);	// Punctuation
+		fixed.addFace(loader, size);
+	}
+	glFinish();
+	report("fixed ranges, load", timer.ms(), "ms");
+	Point texture = getTextureSize(fixed);
+	if(texture.x == 0) {
+		printf("  Failed to load %s\n", ttf);
+		return;
+	}
+	report("  texture", texture.x * texture.y * 4 / 1048576.0, "MB");
+
+	Font dynamic;
+	timer.reset();
+	for(int size: sizes) {
+		FreeTypeFont loader(ttf);
+		loader.setDynamic(true);
+		dynamic.addFace(loader, size);
+	}
+	glFinish();
+	report("dynamic, load", timer.ms(), "ms");
+
+	const char* text[] = { "File Edit View Help", "The quick brown fox jumps over the lazy dog 0123456789", "Ελληνικά κείμενο", "Русский текст — “quotes”", "Ünïcödé àçcèntš" };
+	Point pos;
+	Rect clip(0, 0, 1280, 720);
+	auto vertex = [](float, float, float, float) {};
+	auto index = [](int) {};
+	timer.reset();
+	for(int s: sizes) for(const char* t: text) dynamic.buildVertexArray(t, -1, s, pos, clip, vertex, index);
+	dynamic.uploadGlyphs();
+	glFinish();
+	report("dynamic, first use of UI strings", timer.ms(), "ms");
+	Font::AtlasStats stats = dynamic.getAtlasStats();
+	report("  pages in use", stats.pages, "");
+	report("  glyphs rendered", stats.glyphs, "");
+	report("  texture reserved for all pages", stats.memory / 1048576.0, "MB");
+}
+
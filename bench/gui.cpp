@@ -0,0 +1,296 @@
+#include "bench.h"
+#include <base/opengl.h>
+#include <base/gui/gui.h>
+#include <base/gui/renderer.h>
+#include <base/gui/widgets.h>
+#include <base/gui/lists.h>
+#include <base/gui/tree.h>
+#include <base/gui/font.h>
+#include <base/gui/skin.h>
+#include <vector>
+#include <string>
+#include <cstdlib>
+
+using namespace gui;
+using namespace bench;
+
+namespace {
+	// Fixed width glyphs on a blank image, so font loading does not depend on files
+	class BenchFont : public FontLoader {
+		public:
+		BenchFont(bool extended=false) : m_extended(extended) {}
+		bool build(int size) override {
+			addRange(32, 126);
+			if(m_extended) {
+				addRange(160, 255);
+				addRange(0x4e00, 0x4fff);
+			}
+			createFace(size, m_extended? size + size/3: size);
+			allocateGlyphs();
+			std::vector<unsigned char> pixels(256*256*4, 255);
+			addImage(256, 256, pixels.data());
+			for(int c=32; c<=126; ++c) setGlyph(c, Rect((c%16)*16, (c/16)*16, m_extended? 4+c%7: 8, size));
+			if(m_extended) {
+				for(int c=160; c<=255; ++c) setGlyph(c, Rect((c%16)*16, (c/16)*16, 4+c%7, size));
+				for(int c=0x4e00; c<=0x4fff; c+=3) setGlyph(c, Rect(c%200, 3, 12, size));
+			}
+			return true;
+		}
+		private:
+		bool m_extended;
+	};
+
+	struct Hud {
+		Renderer* renderer;
+		Root* root;
+		std::vector<Label*> labels;
+		std::vector<Button*> buttons;
+		Hud(bool cache) {
+			renderer = new Renderer();
+			renderer->setCaching(cache);
+			root = new Root(1280, 720, renderer);
+			Font* font = new Font();
+			BenchFont loader;
+			font->addFace(loader, 12);
+			Skin* skin = renderer->createDefaultSkin();
+			skin->setFont(font, 12, 5);
+			root->getRootWidget()->setSkin(nullptr);
+			for(int p=0; p<8; ++p) {
+				Widget* pane = new Widget(300, 340);
+				pane->setSkin(skin);
+				pane->setPosition((p%4)*310, (p/4)*350);
+				root->getRootWidget()->add(pane);
+				for(int i=0; i<20; ++i) {
+					Widget* w;
+					if(i%2) {
+						buttons.push_back(new Button("Button"));
+						w = buttons.back();
+						w->setSize(120, 14);
+					}
+					else {
+						labels.push_back(new Label("Some static label text"));
+						w = labels.back();
+						w->setSize(280, 14);
+					}
+					w->setSkin(skin);
+					w->setPosition(10, i*16+4);
+					pane->add(w);
+				}
+			}
+		}
+		~Hud() { delete root; }
+		void frame(int i, bool animate) {
+			if(animate) {
+				char buffer[64];
+				snprintf(buffer, 64, "Score %d", i);
+				labels[0]->setCaption(buffer);
+				labels[1]->setPosition(10 + i%20, labels[1]->getPosition().y);
+				buttons[5]->setAlpha(0.5f + 0.5f*((i%10)/10.f));
+			}
+			root->draw();
+		}
+	};
+
+	Skin* createSkin(Renderer* renderer) {
+		Font* font = new Font();
+		BenchFont loader;
+		font->addFace(loader, 12);
+		Skin* skin = renderer->createDefaultSkin();
+		skin->setFont(font, 12, 5);
+		return skin;
+	}
+}
+
+// Frame times include the GL draw calls, so they are only comparable on a hardware driver
+
+// 8 panels of 20 labels and buttons, static and with three widgets animated
+static void retainedGeometry() {
+	for(int animate=0; animate<2; ++animate) {
+		for(int cache=0; cache<2; ++cache) {
+			Hud hud(cache);
+			for(int i=0; i<50; ++i) hud.frame(i, animate);
+			glFinish();
+			hud.renderer->resetStats();
+			const int frames = 2000;
+			Timer timer;
+			for(int i=0; i<frames; ++i) hud.frame(i, animate);
+			glFinish();
+			double us = timer.us() / frames;
+			size_t uploaded = hud.renderer->getStats().uploaded / frames;
+			char name[64];
+			snprintf(name, 64, "%s HUD, %s", animate? "animated": "static", cache? "cached": "uncached");
+			report(name, us, "us/frame");
+			report("  uploaded", uploaded / 1024.0, "KB/frame");
+		}
+	}
+}
+
+// 5000 buttons in a 1280x720 view, about 260 visible
+static void hitTest() {
+	Renderer* renderer = new Renderer();
+	Root* root = new Root(1280, 720, renderer);
+	Skin* skin = createSkin(renderer);
+	Widget* view = new Widget(1280, 720);
+	view->setSkin(skin);
+	root->getRootWidget()->add(view);
+	Widget* content = new Widget(6000, 3000);
+	content->setSkin(skin);
+	view->add(content);
+	for(int i=0; i<5000; ++i) {
+		Button* b = new Button("Item");
+		b->setSkin(skin);
+		b->setSize(110, 24);
+		b->setPosition((i%50)*120, (i/50)*28);
+		content->add(b);
+	}
+	const int queries = 200000;
+	for(int grid=0; grid<2; ++grid) {
+		content->useHitTestGrid(grid);
+		srand(7);
+		size_t sink = 0;
+		Timer timer;
+		for(int i=0; i<queries; ++i) {
+			Point p(rand()%1400 - 60, rand()%800 - 40);
+			sink ^= (size_t)root->getRootWidget()->getWidget(p);
+		}
+		report(grid? "hit test, 5000 buttons, grid": "hit test, 5000 buttons, linear", timer.us() / queries, "us");
+		if(sink == 1) printf(" ");
+	}
+	for(int i=0; i<20; ++i) root->draw();
+	glFinish();
+	Timer timer;
+	for(int i=0; i<200; ++i) root->draw();
+	glFinish();
+	report("draw 5000 buttons, 260 visible", timer.us() / 200, "us/frame");
+	delete root;
+}
+
+static const char* listTemplates = R"(<gui>
+<template name="scroll" class="Scrollbar" rect="0 0 12 100"><widget name="_block" rect="0 0 12 20"/></template>
+<template name="list" class="Listbox" rect="0 0 200 300">
+ <widget name="_client" rect="0 0 188 300" anchor="tlrb"/>
+ <widget name="_scroll" template="scroll" rect="188 0 12 300" anchor="trb"/>
+ <widget name="_item" class="Label" rect="0 0 188 16" anchor="lrt"/>
+</template>
+<template name="tree" class="TreeView" rect="0 0 200 300">
+ <widget name="_client" rect="0 0 188 300" anchor="tlrb"/>
+ <widget name="_scroll" template="scroll" rect="188 0 12 300" anchor="trb"/>
+ <widget name="_expand" rect="0 0 10 10"/>
+ <widget name="_item" class="Label" rect="0 0 150 16"/>
+</template>
+<template name="pane" class="Scrollpane" rect="0 0 300 300">
+ <widget name="_vscroll" template="scroll" rect="288 0 12 288" anchor="trb"/>
+ <widget name="_hscroll" template="scroll" rect="0 288 288 12" anchor="lrb" orientation="horizontal"/>
+ <widget name="_client" rect="0 0 288 288" anchor="tlrb"/>
+</template>
+<template name="table" class="Table" rect="0 0 300 320">
+ <widget name="_header" rect="0 0 300 20" anchor="tlr"/>
+ <widget name="_headeritem" class="Button" rect="0 0 50 20"/>
+ <widget name="_data" template="pane" rect="0 20 300 300" anchor="tlrb"/>
+</template>
+<template name="cellbtn" class="Button" rect="0 0 40 16"/>
+<widget name="list" template="list" rect="0 0 200 300"/>
+<widget name="tree" template="tree" rect="210 0 200 300"/>
+<widget name="table" template="table" rect="420 0 300 320"/>
+</gui>)";
+
+// Listbox, Table and TreeView with 20k rows of 16 pixels
+static void lists() {
+	const int rows = 20000;
+	Renderer* renderer = new Renderer();
+	Root* root = new Root(1280, 720, renderer);
+	Skin* skin = createSkin(renderer);
+	root->addFont("default", skin->getFont());
+	root->addSkin("default", skin);
+	root->parse(listTemplates);
+	Listbox* list = root->getWidget<Listbox>("list");
+	TreeView* tree = root->getWidget<TreeView>("tree");
+	Table* table = root->getWidget<Table>("table");
+	if(!list || !tree || !table) {
+		printf("  Failed to create list widgets\n");
+		delete root;
+		return;
+	}
+
+	for(int i=0; i<rows; ++i) list->addItem("x");
+	Scrollbar* listScroll = list->getTemplateWidget<Scrollbar>("_scroll");
+	Timer timer;
+	for(int i=0; i<1000; ++i) listScroll->setValue((i*7919*37) % (rows*15));
+	report("listbox 20k rows, 1000 scroll jumps", timer.ms(), "ms");
+
+	table->addColumn("a", "A", 60);
+	table->addColumn("b", "B", 80, "cellbtn");
+	table->addColumn("c", "C", 70);
+	timer.reset();
+	for(int i=0; i<rows; ++i) table->setValue(table->addRow(), 0, i);
+	report("table add 20k rows", timer.ms(), "ms");
+	timer.reset();
+	table->setColumnWidth(0, 90);
+	table->addColumn("d", "D", 50);
+	report("table column change", timer.ms(), "ms");
+
+	TreeNode* node = tree->getRootNode()->add("big");
+	for(int i=0; i<rows; ++i) node->add("leaf");
+	tree->getRootNode()->expand(true);
+	root->draw();
+	timer.reset();
+	for(int i=0; i<100; ++i) {
+		node->expand(true);
+		root->draw();
+		node->expand(false);
+		root->draw();
+	}
+	report("tree 20k children, expand+collapse+draw", timer.ms() / 100, "ms");
+	node->expand(true);
+	Scrollbar* treeScroll = tree->getTemplateWidget<Scrollbar>("_scroll");
+	timer.reset();
+	for(int i=0; i<1000; ++i) {
+		treeScroll->setValue((i*7919*37) % (rows*15));
+		root->draw();
+	}
+	report("tree 20k children, scroll+draw", timer.ms() / 1000, "ms");
+	delete root;
+}
+
+// 500 labels measured and built every frame, with and without the layout cache
+static void textLayout() {
+	std::vector<std::string> labels;
+	char buffer[64];
+	for(int i=0; i<500; ++i) {
+		snprintf(buffer, 64, "Label number %d with some text", i);
+		labels.push_back(buffer);
+	}
+	size_t sink = 0;
+	auto vertex = [&](float x, float y, float u, float v) { sink += (size_t)x; };
+	auto index = [&](int i) { sink += i; };
+	Rect clip(0, 0, 1280, 720);
+	for(int cache=1; cache>=0; --cache) {
+		Font font;
+		BenchFont small(true), large(true);
+		font.addFace(small, 12);
+		font.addFace(large, 24);
+		if(!cache) font.setCacheCapacity(0);
+		Timer timer;
+		for(int f=0; f<1000; ++f) {
+			for(size_t i=0; i<labels.size(); ++i) {
+				Point p(10, (int)i);
+				sink += font.getSize(labels[i].c_str(), 12).x;
+				font.buildVertexArray(labels[i].c_str(), -1, 12, p, clip, vertex, index);
+			}
+		}
+		report(cache? "500 labels x 1000 frames, layout cache": "500 labels x 1000 frames, no cache", timer.ms(), "ms");
+		timer.reset();
+		for(int f=0; f<1000; ++f) for(const std::string& s: labels) sink += font.getSize(s.c_str(), 12).x;
+		report("  getSize only", timer.ms(), "ms");
+	}
+	if(sink == 1) printf(" ");
+}
+
+void bench::gui() {
+	group("GUI");
+	retainedGeometry();
+	hitTest();
+	lists();
+	textLayout();
+}
+
@@ -0,0 +1,93 @@
+#include "bench.h"
+#include <base/opengl.h>
+#include <cstring>
+
+#ifdef WIN32
+#include <base/window_win32.h>
+#endif
+#ifdef LINUX
+#include <base/window_x11.h>
+#include <unistd.h>
+#endif
+
+const char* bench::fontFile = nullptr;
+
+void bench::group(const char* name) {
+	printf("\n== %s\n", name);
+}
+
+void bench::report(const char* name, double value, const char* unit) {
+	printf("  %-44s %10.3f %s\n", name, value, unit);
+	fflush(stdout);
+}
+
+size_t bench::residentMemory() {
+	#ifdef LINUX
+	long pages = 0, resident = 0;
+	FILE* fp = fopen("/proc/self/statm", "r");
+	if(!fp) return 0;
+	if(fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = 0;
+	fclose(fp);
+	return resident * sysconf(_SC_PAGESIZE);
+	#else
+	return 0;
+	#endif
+}
+
+static bool createContext() {
+	base::Window* window = nullptr;
+	#ifdef WIN32
+	window = new base::Win32Window(64, 64);
+	#endif
+	#ifdef LINUX
+	window = new base::X11Window(64, 64);
+	#endif
+	if(!window || !window->createWindow()) return false;
+	window->makeCurrent();
+	return true;
+}
+
+struct Group {
+	const char* name;
+	void (*run)();
+	bool needsContext;
+};
+
+static const Group groups[] = {
+	{ "cache", bench::assetCache, false },
+	{ "script", bench::script, false },
+	{ "variables", bench::variables, false },
+	{ "animation", bench::animation, false },
+	{ "threads", bench::threads, false },
+	{ "particles", bench::particles, false },
+	{ "foliage", bench::foliage, false },
+	{ "gui", bench::gui, true },
+	{ "fonts", bench::fonts, true },
+	{ nullptr, nullptr, false }
+};
+
+int main(int argc, char** argv) {
+	// benchmarks [group ...] [--font file.ttf]
+	const char* selected[16];
+	int count = 0;
+	for(int i=1; i<argc; ++i) {
+		if(strcmp(argv[i], "--font")==0 && i+1<argc) bench::fontFile = argv[++i];
+		else if(count < 16) selected[count++] = argv[i];
+		else printf("Too many groups\n");
+	}
+
+	int context = 0;	// 0 untried, 1 created, -1 failed
+	for(const Group* g = groups; g->name; ++g) {
+		bool run = count == 0;
+		for(int i=0; i<count && !run; ++i) run = strcmp(selected[i], g->name)==0;
+		if(!run) continue;
+		if(g->needsContext && context == 0) {
+			context = createContext()? 1: -1;
+			if(context < 0) printf("\nNo OpenGL context, skipping groups that draw\n");
+		}
+		if(g->needsContext && context < 0) continue;
+		g->run();
+	}
+	return 0;
+}
+
@@ -0,0 +1,70 @@
+#include "bench.h"
+#include "../src/particles/emitters.h"
+#include "../src/particles/renderers.h"
+#include <vector>
+#include <cmath>
+
+using namespace particle;
+using namespace bench;
+
+namespace {
+	class BenchInstance : public Instance {
+		public:
+		BenchInstance(System* s) : Instance(s) {}
+		const Matrix& getTransform() const override { return m_transform; }
+		void updateGeometry() override {}
+		private:
+		Matrix m_transform;
+	};
+}
+
+// 8 instances of short lived sparks, optionally triggering a sub-emitter when each dies
+static double churn(bool dieEvents, int threads) {
+	System system;
+	system.setPoolSize(20000);
+	PointEmitter* sparks = new PointEmitter;
+	sparks->rate = 40000;
+	sparks->life = Value(0.02f, 0.2f);
+	sparks->velocity = 5;
+	sparks->cone = 180;
+	sparks->limit = 20000;
+	sparks->setRenderer(new SpriteRenderer);
+	system.addEmitter(sparks);
+	if(dieEvents) {
+		PointEmitter* burst = new PointEmitter;
+		burst->eventOnly = true;
+		burst->rate = 0;
+		burst->life = 0.05f;
+		burst->limit = 5000;
+		burst->setRenderer(sparks->getRenderer());
+		system.addEmitter(burst);
+		sparks->addEvent(new Event(Event::Type::DIE, Event::Effect::TRIGGER, burst));
+	}
+
+	Manager manager;
+	if(threads) manager.startThreads(threads);
+	std::vector<BenchInstance*> instances;
+	for(int i=0; i<8; ++i) {
+		instances.push_back(new BenchInstance(&system));
+		manager.add(instances.back());
+	}
+	for(int f=0; f<60; ++f) manager.update(1/60.f, Matrix());
+	double best = 1e9;
+	for(int r=0; r<5; ++r) {
+		Timer timer;
+		for(int f=0; f<60; ++f) manager.update(1/60.f, Matrix());
+		best = fmin(best, timer.ms() / 60);
+	}
+	manager.stopThreads();
+	for(BenchInstance* i: instances) delete i;
+	return best;
+}
+
+void bench::particles() {
+	group("Particles");
+	report("8 x 20k sparks, no events", churn(false, 0), "ms/frame");
+	report("8 x 20k sparks, die events", churn(true, 0), "ms/frame");
+	report("8 x 20k sparks, no events, threaded", churn(false, 4), "ms/frame");
+	report("8 x 20k sparks, die events, threaded", churn(true, 4), "ms/frame");
+}
+
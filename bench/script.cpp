@@ -0,0 +1,21 @@
+#include "bench.h"
+#include <base/script.h>
+
+using namespace script;
+
+void bench::script() {
+	group("Script");
+
+	// Simple arithmetic block, tree interpreter against compiled program
+	const char* source = "x = 0; y = 1.5; i = 0; r = x * y + y / 2 - (3 + 4) * 2; q = r > 3 ? r : -r; z = (1,2,3) * q;";
+	for(int compiled=0; compiled<2; ++compiled) {
+		Script s(source);
+		if(compiled) s.compile();
+		Variable context;
+		context.makeObject();
+		Timer timer;
+		for(int i=0; i<200000; ++i) s.run(context);
+		report(compiled? "arithmetic block x200k, compiled": "arithmetic block x200k, interpreted", timer.ms(), "ms");
+	}
+}
+
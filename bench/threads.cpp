@@ -0,0 +1,41 @@
+#include "bench.h"
+#include <base/thread.h>
+#include <vector>
+#include <cmath>
+
+using namespace base;
+
+void bench::threads() {
+	group("Threads");
+	int cores = Thread::cores();
+	report("cores", cores, "");
+
+	// Dispatch cost of a small job, 4 ranges over 4096 items
+	std::vector<int> values(4096, 0);
+	const int calls = 2000;
+	Timer timer;
+	for(int n=0; n<calls; ++n) parallelFor(4096, [&](int i) { values[i] += i; }, 4);
+	report("parallelFor dispatch, 4096 items, 4 ranges", timer.us() / calls, "us/call");
+
+	// Scaling of a compute bound job over all cores against one thread
+	const int count = 1 << 16;
+	std::vector<float> out(count);
+	auto work = [&](int i) {
+		float x = i * 0.001f;
+		for(int k=0; k<200; ++k) x = sinf(x) * 0.9f + cosf(x * 0.5f);
+		out[i] = x;
+	};
+	double serial = 1e9, pooled = 1e9;
+	for(int r=0; r<5; ++r) {
+		timer.reset();
+		parallelFor(count, work, 1);
+		serial = fmin(serial, timer.ms());
+		timer.reset();
+		parallelFor(count, work, cores);
+		pooled = fmin(pooled, timer.ms());
+	}
+	report("compute job, 1 thread", serial, "ms");
+	report("compute job, all cores", pooled, "ms");
+	report("  speedup", serial / pooled, "x");
+}
+
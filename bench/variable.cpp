@@ -0,0 +1,32 @@
+#include "bench.h"
+#include <base/variable.h>
+#include <vector>
+
+using namespace script;
+
+// Deep copies of small objects while many names are interned
+void bench::variables() {
+	group("Variables");
+	char name[32];
+	for(int i=0; i<2000; ++i) {
+		snprintf(name, 32, "name%d", i);
+		Variable::lookupName(name);
+	}
+	Variable object;
+	object.makeObject();
+	object.set("hp", 10);
+	object.set("pos", vec3(1,2,3));
+	object.set("name", "orc");
+	size_t memory = residentMemory();
+	std::vector<Variable> objects(100000);
+	Timer timer;
+	for(Variable& v: objects) v = object.copy(2);
+	report("deep copy 100k 3-field objects", timer.ms(), "ms");
+	if(memory) report("  resident memory added", (residentMemory() - memory) / 1048576.0, "MB");
+	timer.reset();
+	float sum = 0;
+	for(int k=0; k<10; ++k) for(Variable& v: objects) sum += (float)v.get("hp");
+	report("1M field lookups", timer.ms(), "ms");
+	if(sum != 10000000) printf("  Unexpected lookup result %g\n", sum);
+}
+
@@ -6,6 +6,7 @@
 namespace base {
 
 	class Skeleton;
+	class AnimationClip;
 
 
 	/** Model animation class. */
@@ -31,6 +32,9 @@ namespace base {
 
 		const unsigned char* getMap(const Skeleton* s) const;		// Get bone->keyset map
 
+		void bake(float step=1);							/**< Sample through a baked clip from now on. Dropped when keys change */
+		const AnimationClip* getClip() const;				/**< Baked clip, or null */
+
 		void addPositionKey(int set, int frame, const vec3& position);	/**< Add a position keyframe */
 		void addRotationKey(int set, int frame, const Quaternion& q);	/**< Add a rotation keyframe */
 		void addScaleKey   (int set, int frame, const vec3& scale);	/**< Add a scale keyframe */
@@ -59,6 +63,8 @@ namespace base {
 		int      m_length;			// Animation length in frames
 		float    m_fps;				// Animation speed
 		bool     m_loop;			// Does animation loop
+		AnimationClip* m_clip;		// Baked clip used for sampling
+		void dropClip();
 
 		template<int N> void addKey(    std::vector< Keyframe<N> >&, int frame, const float* value);
 		template<int N> bool removeKey( std::vector< Keyframe<N> >&, int frame);
@@ -73,6 +79,58 @@ namespace base {
 		mutable std::vector<SkeletonMap> m_maps;
 	};
 
+	/** Baked animation clip.
+	 * Resampled at a fixed rate with all bone keys for a sample stored together in one block.
+	 * Rotations use smallest-three quantisation, positions and scales are quantised to 16 bit
+	 * over the range of each track. Tracks that do not change are stored once as constants.
+	 * Keysets have the same indices as the source animation so Animation::getMap can be used.
+	 * Animation::bake attaches a clip to its source so Skeleton::applyPose samples it instead.
+	 */
+	class AnimationClip {
+		public:
+		struct Transform {
+			Quaternion rotation;
+			vec3       position;
+			vec3       scale;
+		};
+
+		AnimationClip(const Animation* source, float step=1);	/**< Bake animation, sampling every step frames */
+		~AnimationClip();
+
+		void        sampleAll(float frame, Transform* out) const;	/**< Sample all keysets at a frame. out must have getSize() elements */
+		void        sample(int set, float frame, Transform& out) const;	/**< Sample a single keyset */
+		int         getSize() const;							/**< Get number of keysets */
+		const char* getName(int set) const;						/**< Get keyset name */
+		int         getBoneID(const char* name) const;			/**< Get keyset index from name */
+		float       getLength() const;							/**< Animation length in frames */
+		float       getSpeed() const;							/**< Animation speed in frames per second */
+		bool        isLoop() const;								/**< Is this animation looped */
+		size_t      getMemoryUsage() const;						/**< Bytes used by clip data */
+
+		private:
+		struct Track {
+			int        rotation;	// Offset into sample block, or -1 if constant
+			int        position;	// Offset into sample block, or -1 if constant
+			int        scale;		// Offset into sample block, or -1 if constant
+			Quaternion constRotation;
+			vec3       positionMin, positionRange;	// Dequantisation. Min is the value of constant tracks
+			vec3       scaleMin, scaleRange;
+			char       name[64];
+		};
+		std::vector<Track>  m_tracks;
+		std::vector<uint16> m_data;		// Sample blocks: [sample][track channels]
+		int      m_stride;				// uint16 values per sample block
+		int      m_samples;				// Number of sample blocks
+		float    m_step;				// Frames between samples
+		float    m_length;
+		float    m_fps;
+		bool     m_loop;
+
+		friend class Animation;
+		void getBlocks(float frame, const uint16*& a, const uint16*& b, float& t) const;
+		void sampleTrack(const Track&, const uint16* a, const uint16* b, float t, Transform& out) const;
+	};
+
 	// Interpolation functors
 	struct LerpFunc {
 		inline void operator()( float* r, const float* a, const float* b, float t) {
@@ -104,13 +162,20 @@ namespace base {
 	// Inline implementation
 	inline int         Animation::getLength() const      { return m_length; }
 	inline float       Animation::getSpeed() const       { return m_fps; }
-	inline void        Animation::setSpeed(float fps)    { m_fps = fps; }
-	inline void        Animation::setLoop(bool loop)     { m_loop = loop; }
+	inline void        Animation::setSpeed(float fps)    { m_fps = fps; if(m_clip) m_clip->m_fps = fps; }
+	inline void        Animation::setLoop(bool loop)     { m_loop = loop; if(m_clip) m_clip->m_loop = loop; }
 	inline bool        Animation::isLoop() const         { return m_loop; }
 	inline const char* Animation::getName() const        { return m_name; }
 	inline void        Animation::setName(const char* n) { m_name = n; }
 	inline int         Animation::getSize() const        { return m_animations.size(); }
 	inline const char* Animation::getName(int i) const   { return m_animations[i]->name; }
+	inline const AnimationClip* Animation::getClip() const { return m_clip; }
+
+	inline int         AnimationClip::getSize() const         { return m_tracks.size(); }
+	inline const char* AnimationClip::getName(int i) const    { return m_tracks[i].name; }
+	inline float       AnimationClip::getLength() const       { return m_length; }
+	inline float       AnimationClip::getSpeed() const        { return m_fps; }
+	inline bool        AnimationClip::isLoop() const          { return m_loop; }
 
 	
 }
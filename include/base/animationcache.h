@@ -0,0 +1,82 @@
+#pragma once
+
+#include <base/thread.h>
+#include <base/skeleton.h>
+#include <vector>
+
+namespace base {
+
+class Animation;
+
+/** Shares sampled poses between skeletons playing the same animation at the same time.
+ * Entries are keyed by animation, skeleton map and quantised frame. Cached poses are the
+ * local bone transforms, plus the final skin matrices once an instance has calculated them.
+ * Thread safe, so it can be used by controllers updated from AnimationSystem.
+ */
+class AnimationCache {
+	public:
+	struct Key {
+		const Animation*     animation;
+		const unsigned char* keyMap;	// Animation keyset map for the skeleton
+		int                  frame;		// Quantised frame index
+		int                  variant;	// Anything else affecting the pose, such as LOD level
+		bool operator==(const Key& k) const { return animation==k.animation && keyMap==k.keyMap && frame==k.frame && variant==k.variant; }
+	};
+	struct Stats {
+		int lookups;		// Cache queries
+		int hits;			// Queries that found a local pose
+		int matrixHits;		// Queries that also reused final matrices
+		int entries;		// Number of cached poses
+		int memory;			// Bytes used by cached poses
+		float getHitRate() const { return lookups? (float)hits / lookups: 0; }
+	};
+
+	AnimationCache(float frameStep=1, int capacity=256);
+	~AnimationCache();
+
+	void  setFrameStep(float step);		// Frame quantisation. Larger steps give more hits but coarser motion
+	float getFrameStep() const { return m_frameStep; }
+	void  setCapacity(int entries);		// Least recently used entries are dropped over this
+	void  setCrowdPhases(int phases);	// Number of shared phases per loop for crowd instances
+	int   getCrowdPhases() const { return m_phases; }
+
+	void  update(float time);			// Advance shared clock. Call once per frame before updating controllers
+	double getTime() const { return m_time; }
+
+	Key   makeKey(const Animation*, const unsigned char* keyMap, float frame, int variant=0) const;
+	float getFrame(const Key& key) const { return key.frame * m_frameStep; }	// Frame to sample for a key
+
+	/// Copy cached pose into skeleton. Returns 0 on a miss, 1 for a local pose, 2 if final matrices were also copied
+	int  fetch(const Key&, Skeleton*, bool matrices=false);
+	void store(const Key&, const Skeleton*, bool matrices=false);	// Store pose. Matrices must be valid if set
+
+	void clear();
+	void resetStats();
+	const Stats& getStats() const { return m_stats; }
+
+	private:
+	struct Entry {
+		Key             key;
+		Skeleton::Pose* pose;
+		int             used;	// Frame last used
+	};
+	Entry* find(const Key&);
+	void   clearEntries();
+	void   updateSize();
+	size_t hash(const Key&) const;
+	void   rebuild();
+	void   evict();
+
+	std::vector<Entry> m_entries;
+	std::vector<int>   m_table;		// Open addressed hash table of entry indices
+	float  m_frameStep;
+	double m_time;		// Shared clock for crowd phases
+	int    m_capacity;
+	int    m_phases;
+	int    m_frame;		// Update counter for least recently used eviction
+	Stats  m_stats;
+	Mutex  m_mutex;
+};
+
+}
+
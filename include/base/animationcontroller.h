@@ -3,6 +3,7 @@
 #include <base/math.h>
 #include <base/hashmap.h>
 #include <vector>
+#include <initializer_list>
 
 namespace base {
 
@@ -11,6 +12,7 @@ class Bone;
 class Skeleton;
 class Animation;
 class AnimationState;
+class AnimationCache;
 
 
 /// Name lookup for animations
@@ -75,9 +77,23 @@ class AnimationBank {
 	const char* getRootBone() const { return m_rootBone; }
 	float getFastestMoveSpeed(int group=-1) const;
 
+	/// Animation level of detail for distant characters
+	struct LODLevel {
+		float threshold;					// Distance, or screen size, where this level starts
+		int   interval;						// Evaluate animations every n frames, interpolating in between
+		std::vector<const char*> truncate;	// Descendants of these bones are not animated
+	};
+	void addLOD(float threshold, int interval=1, std::initializer_list<const char*> truncate={});
+	void setLODScreenSize(bool screenSize);		// LOD thresholds are screen sizes rather than distances
+	int  getLODLevel(float value) const;		// Select level for a distance or screen size. -1 is full detail
+	int  getLODCount() const { return m_lods.size(); }
+	const LODLevel& getLOD(int level) const { return m_lods[level]; }
+
 	private:
 	std::vector<AnimationInfo*> m_animations;
 	std::vector<AnimationInfo*> m_movement;
+	std::vector<LODLevel> m_lods;
+	bool m_lodScreenSize;
 	const char* m_rootBone;
 	vec3 m_forward;
 };
@@ -138,6 +154,15 @@ class AnimationController {
 
 	float deriveMoveSpeed() const;
 
+	void setLODValue(float value);		// Set camera distance or screen size used to select animation LOD
+	int  getLOD() const					{ return m_lod; }
+	int  getEvaluatedBones() const		{ return m_evaluated; }	// Bone samples taken in last update
+
+	/// Share sampled poses with other instances. Crowd instances snap looping animations to the cache's shared phases
+	void setPoseCache(AnimationCache*, bool crowd=false);
+	AnimationCache* getPoseCache() const { return m_cache; }
+	bool isCrowd() const				{ return m_crowd; }
+
 	protected:
 	enum MetaType { IDLE, ACTION, MOVEMENT, OVERRIDE, OVERRIDE_IN, OVERRIDE_OUT };
 	void setMeta(uint track, const AnimationInfo*, MetaType type, ActionMode end);
@@ -177,6 +202,31 @@ class AnimationController {
 		Quaternion lastRot;				// Last orientation for root motion
 	};
 	std::vector<Meta> m_meta;
+
+	// Level of detail
+	struct LODPose {
+		Quaternion rotation;
+		vec3 position;
+		vec3 scale;
+	};
+	const unsigned char* getLODMask(int level);
+	void storeLODPose();
+	void applyLODPose(float t);
+	float m_lodValue;		// Distance or screen size
+	int   m_lod;			// Current level
+	int   m_lodFrame;		// Frame counter for reduced update rate
+	int   m_lodPhase;		// Offset to stagger updates between controllers
+	bool  m_lodValid;		// Stored poses are valid for interpolation
+	int   m_evaluated;		// Bones sampled in last update
+	std::vector<std::vector<unsigned char>> m_lodMasks;	// Animated bones for each level
+	std::vector<int> m_lodBones;						// Number of animated bones for each level
+	std::vector<LODPose> m_lodPose[2];					// Previous and latest evaluated poses
+
+	// Pose cache
+	int  getCacheTrack() const;		// Track that can use the pose cache, or -1
+	void snapCrowdPhase();
+	AnimationCache* m_cache;
+	bool m_crowd;
 };
 
 }
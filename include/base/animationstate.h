@@ -47,6 +47,7 @@ class AnimationState {
 	float getFrameNormalised(int track=0) const;
 	float getSpeed(int track=0) const;
 	float getWeight(int track=0) const;
+	int   getBone(int track=0) const;				// Starting bone. -1 for the whole skeleton
 	bool  isEnded(int track=0) const;
 
 	bool getLoop(int track=0) const;
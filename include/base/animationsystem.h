@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+namespace base {
+
+class Skeleton;
+class AnimationState;
+class AnimationController;
+class AnimationCache;
+
+/** Updates all animated skeletons for a frame in one pass.
+ * Controllers and states are queued with add() as they are found, then update() advances
+ * animations, applies poses and calculates skin matrices on worker threads.
+ * Anything sharing a skeleton is processed in the same job.
+ * Call update() before drawing so DrawableMesh picks up the new matrices.
+ * An optional AnimationCache is advanced by update() so crowd instances share its clock.
+ */
+class AnimationSystem {
+	public:
+	struct Stats {
+		int skeletons;		// Skeletons updated last frame
+		int bones;			// Bones in updated skeletons
+		int evaluated;		// Bone samples taken. Reduced by animation LOD
+	};
+
+	AnimationSystem(int threads=0);		// threads: maximum worker threads, 0 uses all cores
+	void add(AnimationController*);		// Queue controller for next update
+	void add(AnimationState*);			// Queue animation state for next update
+	void update(float time);			// Update everything queued, then clear the queue
+	void clear();						// Clear queue without updating
+
+	void setThreads(int threads) { m_threads = threads; }
+	void setPoseCache(AnimationCache* cache) { m_cache = cache; }
+	AnimationCache* getPoseCache() const { return m_cache; }
+	const Stats& getStats() const { return m_stats; }
+
+	private:
+	struct Job {
+		Skeleton*            skeleton;
+		AnimationController* controller;
+		AnimationState*      state;
+	};
+	int  run(const Job&, float time) const;
+
+	std::vector<Job> m_jobs;
+	std::vector<int> m_groups;		// First job of each skeleton group
+	std::vector<int> m_evaluated;	// Bone samples per group
+	Stats m_stats;
+	int   m_threads;
+	AnimationCache* m_cache;
+};
+
+}
+
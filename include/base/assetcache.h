@@ -0,0 +1,50 @@
+#pragma once
+
+#include <base/virtualfilesystem.h>
+#include <base/thread.h>
+
+namespace base {
+	/** On-disk cache of processed asset data.
+	 *  Entries are keyed by a source file or a content hash, and tagged with a loader version.
+	 *  File entries are validated by size and modification time first, then by content hash,
+	 *  so touching a file without changing it does not invalidate the entry.
+	 *  Safe to use from the resource loading thread. */
+	class AssetCache {
+		public:
+		struct Stats { unsigned hits, misses, stale, writes; };
+
+		AssetCache(const char* directory);
+		const char* getDirectory() const { return m_directory; }
+
+		/** Get cached data derived from a source file. Returns an empty file if missing or stale
+		 * @param type    Data type, such as "image". Used to separate entries from the same source
+		 * @param source  Source file in the virtual file system
+		 * @param version Loader version. Change this when the processed format changes */
+		File get(const char* type, const VirtualFileSystem::File& source, unsigned version);
+		bool put(const char* type, const VirtualFileSystem::File& source, unsigned version, const void* data, size_t size);
+
+		/** Get cached data by content key, for data that does not come from a single file */
+		File get(const char* type, unsigned long long key, unsigned version);
+		bool put(const char* type, unsigned long long key, unsigned version, const void* data, size_t size);
+
+		/** Delete all cache entries */
+		void clear();
+
+		const Stats& getStats() const { return m_stats; }
+
+		/** 64 bit FNV-1a hash for cache keys */
+		static unsigned long long hash(const void* data, size_t size, unsigned long long seed=0xcbf29ce484222325ull);
+		static unsigned long long hashString(const char* string, unsigned long long seed=0xcbf29ce484222325ull);
+
+		private:
+		struct Header;
+		String getEntryPath(const char* type, unsigned long long key) const;
+		File readEntry(const String& path, Header& header) const;
+		bool writeEntry(const String& path, const Header& header, const void* data, size_t size);
+		void count(unsigned Stats::*stat);
+
+		String m_directory;
+		Stats  m_stats = {0,0,0,0};
+		Mutex  m_mutex;
+	};
+}
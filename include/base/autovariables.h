@@ -34,6 +34,7 @@ namespace base {
 		AUTO_CAMERA_DIRECTION,				// vec3
 
 		AUTO_SKIN_MATRICES,					// mat3x4[]
+		AUTO_SKIN_OFFSET,					// float - base index into a SkinPalette
 
 		AUTO_CUSTOM,						// Custom vec4 - somes from drawable data
 	};
@@ -49,6 +50,7 @@ namespace base {
 		virtual void setCamera(const base::Camera*);
 		virtual void setModelMatrix(const Matrix&);
 		virtual void setSkinMatrices(int count, const Matrix* data, int* map=0);
+		virtual void setSkinOffset(int offset);
 		virtual void setCustom(const float*);
 		virtual const char* getString(int key) const; // Lower case, no prefix.
 		static const char* getKeyString(int key);
@@ -76,6 +78,7 @@ namespace base {
 		int m_skinCapacity;
 		Matrix* m_skinMatrixVector;
 		const Matrix* m_skinMatrices;
+		float m_skinOffset;
 		
 
 		// Other stuff
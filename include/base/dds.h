@@ -8,6 +8,15 @@ namespace base {
 		static Image load(const char* file);
 		static Image parse(const char* data, unsigned size);
 		static bool  save(const Image& image, const char* filename);
+
+		/** Convert a png file to a dds file with a full mipmap chain
+		 * @param source      png file to load
+		 * @param target      dds file to write
+		 * @param format      Output format, usually block compressed
+		 * @param filter      Mipmap filter
+		 * @param srgb        Source colours are sRGB, so filter in linear space
+		 * @param highQuality Use slower, higher quality block compression */
+		static bool  convert(const char* source, const char* target, Image::Format format, Image::MipFilter filter=Image::BOX, bool srgb=false, bool highQuality=false);
 	};
 };
 
@@ -5,6 +5,7 @@
 namespace base {
 	class Skeleton;
 	class Mesh;
+	class SkinPalette;
 
 	class DrawableMesh : public Drawable {
 		public:
@@ -18,6 +19,10 @@ namespace base {
 
 		void setMesh(base::Mesh* mesh);
 		void setupSkinData(const base::Skeleton*);
+		int  writeSkinPalette(SkinPalette&);	// Append skin matrices to a shared palette and read them from there when drawn
+		void setSkinOffset(int offset);			// Palette offset for skin matrices. -1 uses skin_matrices uniforms.
+												// Ignored if the instance buffer has a SkinPalette instance attribute
+		int  getSkinOffset() const { return m_skinOffset; }
 
 		void                        setInstanceCount(unsigned);
 		void                        setInstanceBuffer(base::HardwareVertexBuffer*);
@@ -32,6 +37,7 @@ namespace base {
 		base::Mesh*     			m_mesh;			// mesh data
 		const base::Skeleton* 		m_skeleton;		// skeleton data
 		int*                    	m_skinMap;		// Map of bones to skin indices
+		int                         m_skinOffset;	// Offset into skin palette, or -1
 		unsigned					m_instances;	// Instance count
 		base::HardwareVertexBuffer*	m_instanceBuffer;
 	};
@@ -39,6 +39,7 @@ class GradientBox : public gui::Widget {
 	// Set the key of a node, returns new index if node index changes
 	int setKey(int index, float key) {
 		gradient.data[index].key = key;
+		invalidate();
 		int end = gradient.data.size()-1;
 		while(index>0 && key < gradient.data[index-1].key) { std::swap(gradient.data[index], gradient.data[index-1]); --index; }
 		while(index<end && key > gradient.data[index+1].key) { std::swap(gradient.data[index], gradient.data[index+1]); ++index; }
@@ -60,6 +61,7 @@ class GradientBox : public gui::Widget {
 	}
 	void setColour(int index, uint colour) {
 		gradient.data[index].value = colour;
+		invalidate();
 		// Update marker colour
 		int k = (colour&0xff) + ((colour>>8)&0xff)*2 + ((colour>>16)&0xff);
 		uint c = k < 512? 0xffffffff: 0xff000000;
@@ -79,6 +81,7 @@ class GradientBox : public gui::Widget {
 			max = fmax(1, key);
 		}
 		if(min!=oldMin || max!=oldMax) {
+			invalidate();
 			refreshLayout();
 			if(eventRangeChanged) eventRangeChanged(min, max);
 		}
@@ -112,6 +115,7 @@ class GradientBox : public gui::Widget {
 	void onMouseButton(const Point& p, int d, int u) override {
 		Super::onMouseButton(p, d, u);
 		if(!editable) return;
+		invalidate();
 		if(held>=0 && u==1) resetRange();
 
 		held = -1;
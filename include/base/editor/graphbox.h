@@ -46,6 +46,7 @@ class GraphBox : public gui::Widget {
 	int setKey(int index, const vec2& p) {
 		graph.data[index].key = p.x;
 		graph.data[index].value = p.y;
+		invalidate();
 		int end = graph.data.size() - 1;
 		while(index>0 && p.x < graph.data[index-1].key) { std::swap(graph.data[index], graph.data[index-1]); --index; }
 		while(index<end && p.x > graph.data[index+1].key) { std::swap(graph.data[index], graph.data[index+1]); ++index; }
@@ -65,6 +66,7 @@ class GraphBox : public gui::Widget {
 		vec2 e = getNode(Point(8,8)) - getNode(Point(0,0));
 		bounds.min -= e;
 		bounds.max += e;
+		if(old != bounds) invalidate();
 		if(old != bounds && eventRangeChanged) eventRangeChanged(bounds);
 	}
 	// Get closest node in pixels
@@ -84,6 +86,7 @@ class GraphBox : public gui::Widget {
 	void onMouseButton(const Point& p, int d, int u) override {
 		Super::onMouseButton(p, d, u);
 		if(!editable) return;
+		invalidate();
 		if(dragging && u==1) resetRange();
 		dragging = false;
 		int index = getClosestNode(p, 10);
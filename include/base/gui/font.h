@@ -1,17 +1,41 @@
 #pragma once
 
 #include <base/point.h>
+#include <unordered_map>
 #include <vector>
 
 namespace gui {
+
+/** Renders single glyphs on demand for faces using the dynamic glyph atlas */
+class GlyphSource {
+	public:
+	virtual ~GlyphSource() {}
+	/// Render glyph coverage into a cell one line high. Returns false if there is no such glyph
+	virtual bool render(unsigned code, int& width, std::vector<unsigned char>& alpha) = 0;
+};
+
 class Font {
 	public:
 	struct Range { unsigned start, end; };
 	using GlyphRangeVector = std::vector<Range>;
+	struct CacheStats {
+		int lookups;	// Layout cache queries
+		int hits;		// Queries that reused a cached layout
+		int entries;	// Number of cached layouts
+		float getHitRate() const { return lookups? (float)hits / lookups: 0; }
+	};
+	struct AtlasStats {
+		int    pages;		// Atlas pages allocated
+		int    glyphs;		// Glyphs rendered on demand
+		int    evictions;	// Pages cleared to make room
+		int    uploads;		// Texture updates
+		unsigned memory;	// Texture memory in bytes
+	};
 
 	public:
 	Font();
 	Font(const char* source, int size=24);
+	Font(const Font&) = delete;
 	~Font();
 	
 	// Add a new face to this font
@@ -26,26 +50,76 @@ class Font {
 	int buildVertexArray(const char* string, int len, float size, Point& pos, const Rect& clip, const VxFunc& vfunc, const IxFunc& ifunc) const;
 	unsigned getTexture() const { return m_texture; }
 
+	/// Text layout cache. Measured sizes and glyph quads of short strings are reused while unchanged
+	void setCacheCapacity(int entries);	// Least recently used layouts are dropped over this. 0 disables
+	void clearCache();
+	void resetCacheStats();
+	const CacheStats& getCacheStats() const { return m_stats; }
+
+	/// Dynamic glyph atlas, used by faces with a glyph source. Glyphs are rendered when first used
+	/// into shelves of fixed height pages. The texture holds every page from the start; once all are in use the
+	/// least recently used page not drawn this frame is cleared. Glyphs that find no page are retried next frame.
+	void setAtlasSize(int width, int pageHeight, int maxPages);	// Set before adding dynamic faces. Default 1024x256, 4 pages
+	bool isDynamic() const;
+	void uploadGlyphs() const;		// Send glyphs rendered since the last call to the texture. Called by the renderer each frame
+	AtlasStats getAtlasStats() const;
+	static unsigned getAtlasVersion();	// Changes whenever cached glyph texture coordinates become invalid
+
 	static int readUTF8Character(const char*& text);
 
 	private:
 	friend class FontLoader;
 	
-	struct GlyphRange {
-		unsigned start;
-		std::vector<Rect> glyphs;
-	};
 	struct Face {
 		int size;
 		int height;
-		std::vector<GlyphRange> groups;
+		std::vector<Rect> glyphs;						// Glyph rects in texture. First one is empty for missing glyphs
+		unsigned latin[256];							// Glyph index of the first 256 code points
+		std::unordered_map<unsigned, unsigned> other;	// Glyph index of everything else
+		GlyphSource* source = nullptr;					// Renders glyphs on demand. Owned by the font
+		Face(int size, int height);
+	};
+	struct GlyphAtlas;
+	struct LayoutGlyph {
+		Rect dst;	// Position relative to text origin
+		Rect src;	// Texture rect
+	};
+	struct LayoutLine {
+		unsigned first;	// First glyph after a line break
+		int y;			// Line offset
+	};
+	struct Layout {
+		unsigned hash;
+		int      length;	// Bytes
+		float    size;
+		unsigned used;		// Lookup counter when last used
+		std::vector<char> text;
+		std::vector<LayoutGlyph> glyphs;
+		std::vector<LayoutLine> lines;
+		Point extent;		// Measured size
+		Point end;			// Pen position after the last character
+		unsigned pages;		// Atlas pages used
 	};
 	std::vector<Face> m_faces;
 	unsigned m_texture = 0;
 	Point m_textureSize;
+	GlyphAtlas* m_atlas = nullptr;
+
+	mutable std::vector<Layout> m_layouts;
+	mutable std::vector<int>    m_layoutTable;	// Open addressed hash table of layout indices
+	mutable CacheStats m_stats = {0,0,0};
+	mutable unsigned m_counter = 0;
+	int m_capacity = 512;
 
 	const Face* selectFace(int size) const;
 	const Rect& getGlyph(const Face& face, unsigned character) const;
+	const Rect& renderGlyph(const Face& face, unsigned character, unsigned index) const;
+	void evictPage(int page);
+	static unsigned addGlyph(Face& face, unsigned character);
+	const Layout* getLayout(const Face& face, const char* string, int len, float size) const;
+	bool buildLayout(Layout& out, const Face& face, const char* string, const char* end, float size) const;	// False if a glyph is missing this frame
+	void rebuildLayoutTable() const;
+	void evictLayouts() const;
 };
 
 
@@ -54,6 +128,7 @@ class FontLoader {
 	FontLoader() {}
 	virtual ~FontLoader() {}
 	virtual bool build(int size) = 0;
+	void setDynamic(bool d) { m_dynamic = d; }	// Render glyphs on demand if supported. Ranges are then ignored
 	void addRange(int start, int end);
 	bool build(Font* parent, int size);
 	int countGlyphs() const;
@@ -62,10 +137,12 @@ class FontLoader {
 	void addImage(int w, int h, const unsigned char* pixels);
 	bool setGlyph(unsigned code, const Rect& rect);
 	void allocateGlyphs();
+	bool createDynamicFace(int size, int lineHeight, GlyphSource* source);
 	Point selectImageSize(int size, int count) const;
 	protected:
 	struct Range { int start, end; };
 	std::vector<Range> m_glyphs;
+	bool m_dynamic = false;
 	private:
 	Font::Face* m_face = 0;
 	Font* m_font = 0;
@@ -107,9 +184,9 @@ class BitmapFont : public FontLoader {
 inline int gui::Font::readUTF8Character(const char*& text) {
 	const char* c = text;
 	if((*c&0x80)==0)    { text+=1; return c[0]; }
-	if((*c&0xe0)==0xc0) { text+=2; return (c[0]&0x1f<<6)  | (c[1]&0x3f); }
-	if((*c&0xf0)==0xe0) { text+=3; return (c[0]&0x0f<<12) | (c[1]&0x3f<<6)  | (c[2]&0x3f); }
-	if((*c&0xf8)==0xf0) { text+=4; return (c[0]&0x07<<18) | (c[1]&0x3f<<12) | (c[2]&0x3f<<6) | (c[3]&0x3f); }
+	if((*c&0xe0)==0xc0) { text+=2; return (c[0]&0x1f)<<6  | (c[1]&0x3f); }
+	if((*c&0xf0)==0xe0) { text+=3; return (c[0]&0x0f)<<12 | (c[1]&0x3f)<<6  | (c[2]&0x3f); }
+	if((*c&0xf8)==0xf0) { text+=4; return (c[0]&0x07)<<18 | (c[1]&0x3f)<<12 | (c[2]&0x3f)<<6 | (c[3]&0x3f); }
 	++text;
 	return 0; // Error: Invalid utf-8 character
 }
@@ -123,11 +200,47 @@ int gui::Font::buildVertexArray(const char* text, int len, float size, Point& po
 	const Face* face = selectFace(size);
 	if(!face || !text) return 0;
 
-	float scale = (float)size / face->size;
 	float ix = 1.f / m_textureSize.x;
 	float iy = 1.f / m_textureSize.y;
-	Rect dst = pos;
 	unsigned k = 0;
+	auto addQuad = [&](const Rect& dst, const Rect& src) {
+		vfunc(dst.x,       dst.y,        src.x*ix,       src.y*iy);
+		vfunc(dst.right(), dst.y,        src.right()*ix, src.y*iy);
+		vfunc(dst.x,       dst.bottom(), src.x*ix,       src.bottom()*iy);
+		vfunc(dst.right(), dst.bottom(), src.right()*ix, src.bottom()*iy);
+		ifunc(k);
+		ifunc(k+2);
+		ifunc(k+1);
+		ifunc(k+1);
+		ifunc(k+2);
+		ifunc(k+3);
+		k+=4;
+	};
+
+	// Replay cached layout
+	if(const Layout* layout = getLayout(*face, text, len, size)) {
+		unsigned glyph = 0;
+		auto addGlyphs = [&](unsigned end) {
+			for(; glyph<end; ++glyph) {
+				const LayoutGlyph& g = layout->glyphs[glyph];
+				Rect dst(pos.x + g.dst.x, pos.y + g.dst.y, g.dst.width, g.dst.height);
+				if(rect.intersects(dst)) addQuad(dst, g.src);
+			}
+		};
+		for(const LayoutLine& line: layout->lines) {
+			addGlyphs(line.first);
+			if(pos.y + line.y >= rect.bottom()) {
+				pos.y += line.y;
+				return k/4;
+			}
+		}
+		addGlyphs(layout->glyphs.size());
+		pos += layout->end;
+		return k/4;
+	}
+
+	float scale = (float)size / face->size;
+	Rect dst = pos;
 	unsigned code = 0;
 	if(len<0) len = 1<<24;
 	while(*text && len) {
@@ -143,19 +256,7 @@ int gui::Font::buildVertexArray(const char* text, int len, float size, Point& po
 			if(src.width) {
 				dst.width = src.width * scale;
 				dst.height = src.height * scale;
-				if(rect.intersects(dst)) {
-					vfunc(dst.x,       dst.y,        src.x*ix,       src.y*iy);
-					vfunc(dst.right(), dst.y,        src.right()*ix, src.y*iy);
-					vfunc(dst.x,       dst.bottom(), src.x*ix,       src.bottom()*iy);
-					vfunc(dst.right(), dst.bottom(), src.right()*ix, src.bottom()*iy);
-					ifunc(k);
-					ifunc(k+2);
-					ifunc(k+1);
-					ifunc(k+1);
-					ifunc(k+2);
-					ifunc(k+3);
-					k+=4;
-				}
+				if(rect.intersects(dst)) addQuad(dst, src);
 				dst.x += dst.width;
 			}
 		}
@@ -27,6 +27,7 @@ class Root;
 class Renderer;
 class Layout;
 class Animator;
+struct WidgetGeometry;
 
 using base::String;
 
@@ -76,6 +77,7 @@ class PropertyMap : public base::HashMap<const char*> {
 class Widget {
 	friend class Root;
 	friend class Layout;
+	friend class Renderer;
 	RTTI_BASE(Widget);
 
 	public:
@@ -97,6 +99,7 @@ class Widget {
 	void setSizeAnchored(const Point& s);	// Set size, and adjust position based on anchor. Skips if anchored to both sides
 	void setPositionFloat(float x, float y, float w, float h);
 	void useRelativePositioning(bool);
+	void useHitTestGrid(bool);			// Spatial index for hit testing containers with many children
 
 	const Point& getPosition() const;
 	const Point& getSize() const;
@@ -110,13 +113,13 @@ class Widget {
 	bool isRelative() const;			// Do we use relative positioning
 
 	// Widget colour. Note: ARGB==0 to use skin default
-	void     setColourARGB(unsigned argb)         { m_colour=argb; m_overrideColour=3; }
+	void     setColourARGB(unsigned argb)         { m_colour=argb; m_overrideColour=3; invalidate(); }
 	int      getColour() const                    { return m_colour&0xffffff; }
 	unsigned getColourARGB() const                { return m_colour; }
 	void     setColour(unsigned rgb, float a=1.0) { m_colour=rgb; setAlpha(a); m_overrideColour=3; }
 	void     setColour(float r, float g, float b, float a=1.0) { setColour((int(r*255)&0xff)<<16 | (int(g*255)&0xff)<<8 | (int(b*255)&0xff), a); }
-	void     resetColour()                        { m_colour = 0xffffffff; m_overrideColour=0; }
-	void     setAlpha(float a)                    { a=a>0?a<1?a:1:0; m_colour = (m_colour&0xffffff) | int(a*255)<<24; m_overrideColour|=2; }
+	void     resetColour()                        { m_colour = 0xffffffff; m_overrideColour=0; invalidate(); }
+	void     setAlpha(float a)                    { a=a>0?a<1?a:1:0; m_colour = (m_colour&0xffffff) | int(a*255)<<24; m_overrideColour|=2; invalidate(); }
 	float    getAlpha() const                     { return (m_colour>>24)/255.0; }
 
 	const char* getToolTip() const { return m_tip; }
@@ -136,6 +139,7 @@ class Widget {
 	bool isSelected() const;	// Is this widget's state selected
 	bool isTemplate() const;	// Is this a template sub-widget
 	void setAsTemplate();		// Flag this widget as part of a template
+	void invalidate(bool children=false) const;	// Mark cached geometry as changed. Call from draw() for widgets that change every frame
 
 	int     getWidgetCount() const { return m_client->m_children.size() - m_client->m_skipTemplate; }
 	int     getIndex() const;
@@ -221,6 +225,8 @@ class Widget {
 	unsigned m_overrideColour:2; // rgb, alpha
 	unsigned m_layoutPaused:1;
 	unsigned m_hasAnimatior:1;
+	mutable unsigned m_dirty:1;			// Cached geometry needs rebuilding
+	mutable unsigned m_dirtyChildren:1;	// Something below this widget is dirty
 
 	char     m_skipTemplate;	// Templates in client widget to skip
 	Layout*  m_layout;			// Automatic layouts
@@ -231,6 +237,9 @@ class Widget {
 	String   m_name;			// Widget name for lookups.
 	String   m_tip;				// Tool tip data
 	Transform m_derivedTransform; // Full transform to draw children
+	mutable WidgetGeometry* m_geometry; // Cached geometry for retained mode rendering
+	struct HitTestGrid;
+	HitTestGrid* m_hitGrid;		// Optional spatial index of children
 
 	std::vector<Widget*>  m_children;
 
@@ -253,6 +262,7 @@ class Widget {
 	void drawChildren() const;
 	void setRoot(Root*);
 	void notifyChange();
+	void childrenChanged();
 	void updateRelativeFromRect();
 	void shiftTransforms(float x, float y);
 	void updateChildTransforms();
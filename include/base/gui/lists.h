@@ -2,6 +2,7 @@
 
 #include "widgets.h"
 #include "any.h"
+#include <algorithm>
 
 namespace gui {
 
@@ -151,6 +152,41 @@ class ItemList {
 };
 
 
+/** Virtualised list core. Binds the visible range of rows to a fixed pool of recycled slots.
+ * Slots are used as a circular buffer, so scrolling only rebinds rows entering the view.
+ * Cost depends on the number of visible rows, not the size of the list.
+ */
+class VirtualList {
+	public:
+	void reset() { m_first = m_count = m_offset = 0; }	// Unbind all rows
+	uint getFirst() const { return m_first; }
+	uint getCount() const { return m_count; }
+	int  getSlot(uint row) const { return row-m_first < m_count? (m_offset + row - m_first) % m_slots: -1; }
+	int  getRow(uint slot) const { if(slot>=m_slots) return -1; uint r = (slot + m_slots - m_offset) % m_slots; return r<m_count? m_first + r: -1; }
+	/// Set visible rows. Calls bind(row, slot) for rows that were not already bound. Requires slots >= count
+	template<class F> void update(uint first, uint count, uint slots, const F& bind);
+	private:
+	uint m_first = 0;	// First bound row
+	uint m_count = 0;	// Number of bound rows
+	uint m_offset = 0;	// Slot of first bound row
+	uint m_slots = 0;	// Pool size
+};
+
+template<class F> void VirtualList::update(uint first, uint count, uint slots, const F& bind) {
+	if(slots != m_slots) reset();
+	m_slots = slots;
+	// Bound rows that stay in view keep their slots
+	uint keepFirst = std::max(first, m_first);
+	uint keepLast = std::min(first + count, m_first + m_count);
+	if(keepFirst < keepLast) m_offset = (getSlot(keepFirst) + slots - (keepFirst - first)) % slots;
+	else m_offset = 0, keepFirst = keepLast = first + count;
+	m_first = first;
+	m_count = count;
+	for(uint i=first; i<keepFirst; ++i) bind(i, (uint)getSlot(i));
+	for(uint i=keepLast; i<first+count; ++i) bind(i, (uint)getSlot(i));
+}
+
+
 /** Listbox - setup from template. Needs _scroll, _client, itemSkin */
 class Listbox : public Widget, public ItemList {
 	WIDGET_TYPE(Listbox);
@@ -198,10 +234,8 @@ class Listbox : public Widget, public ItemList {
 	int m_itemHeight;
 	int m_tileWidth = 0;
 	Widget* m_itemWidget = nullptr;
-	std::vector<Widget*> m_cache;
-	uint m_cacheOffset = 0;
-	uint m_cacheFirst = 0;
-	uint m_cacheSize = 0;
+	std::vector<Widget*> m_cache;	// Item widget pool
+	VirtualList m_rows;				// Items bound to pool widgets
 };
 
 /** Dropdown list */
@@ -307,7 +341,7 @@ class Table : public Widget {
 	Delegate<void(Table*, int column)> eventColummPressed;						// Clicked on column header
 
 	protected:
-	void scrollChanged(Scrollbar*, int);
+	void scrollChanged(Scrollpane*);
 	void onMouseButton(const Point&, int, int) override;
 	void onAdded() override;
 	void columnPressed(Button*);
@@ -327,16 +361,15 @@ class Table : public Widget {
 	struct Column { Widget* header; String name; String widgets; int pos; int width; };
 	std::vector<Column> m_columns;
 
-	// Cell widget cache
-	uint m_cacheOffset = 0;
-	uint m_cacheSize = 0;
+	// Cell widget cache. Only visible rows have widgets
 	typedef std::vector<Widget*> RowCache;
-	std::vector<RowCache> m_cellCache;
+	std::vector<RowCache> m_cellCache;	// Recycled row widgets
+	VirtualList m_rows;					// Rows bound to m_cellCache
 	void clearCache();
 	void cacheRow(uint index);
 	void cacheItem(uint row, uint col);
 	void cacheAll();
-	void cachePositions(uint fromRow=0, uint fromCol=0);
+	void updateCache(bool full);
 	void updateScrollSize();
 };
 
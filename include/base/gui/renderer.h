@@ -23,6 +23,7 @@ struct ImageGenerator {
 
 /** Renderer class - Cannot be shared any more */
 class Renderer {
+	friend struct WidgetGeometry;
 	protected:
 	struct Image {
 		String name;
@@ -94,8 +95,25 @@ class Renderer {
 	void  pushNew(const Rect& rect);
 	void  pop();
 
-	void setTransform(const Transform& t) { m_transform=t; }
+	void setTransform(const Transform& t);
 	const Transform& getTransform() const { return m_transform; }
+	const Rect& getClipRect() const { return m_scissor.back(); }	// Active clip rect, after transform
+
+	// Retained mode. Widgets keep their geometry between frames until invalidated
+	struct Stats {
+		int    recorded;		// Widgets that rebuilt their geometry
+		int    replayed;		// Widgets drawn from cached geometry
+		int    reusedFrames;	// Frames where nothing changed
+		size_t uploaded;		// Bytes sent to vertex buffers
+	};
+	void  setCaching(bool);
+	bool  isCaching() const { return m_caching; }
+	void  invalidateCache() { ++m_cacheVersion; }	// Rebuild all cached geometry, such as after a texture change
+	void  drawWidget(const Widget*);				// Draw widget, using cached geometry if unchanged
+	bool  isFrameValid() const;						// False if a font atlas changed under geometry drawn this frame
+	void  restartFrame();							// Drop this frame's geometry so it can be drawn again
+	const Stats& getStats() const { return m_stats; }
+	void  resetStats();
 
 	protected:
 	int createTexture(int w, int h, int channels, void* data, bool clamp);
@@ -128,6 +146,18 @@ class Renderer {
 		unsigned vx = 0;
 		unsigned ix = 0;
 		int size = 0;
+		int vertexCapacity = 0;
+		int indexCapacity = 0;
+		std::vector<Vertex> vertices;			// Uploaded data, so only changes are sent
+		std::vector<unsigned short> indices;
+	};
+	// Range of a batch being written by the widget currently recording
+	struct Slice {
+		Batch* batch = 0;
+		size_t vertex, index;
+		Rect box;
+		int texture;
+		float line;
 	};
 
 	unsigned m_shader = 0;
@@ -138,9 +168,28 @@ class Renderer {
 	Point  m_viewport;
 	Batch* m_batches = 0;
 	Batch* m_head = 0;
+	std::vector<Batch*> m_freeBatches;
 	Batch* getBatch(const Rect& rect, int image, float line=0);
+	Batch* findBatch(const Rect& box, int texture, float line);
 	unsigned createShader();
 	void buildRenderBatches();
+	void freeBatches();
+
+	bool     m_caching = false;
+	bool     m_reuse = false;		// Nothing changed, so last frame's buffers are drawn again
+	bool     m_unrecorded = false;	// Something was drawn outside of a widget this frame
+	int      m_replaying = 0;
+	int      m_topLevel = 0;		// Widgets drawn directly this frame
+	unsigned m_cacheVersion = 1;
+	unsigned m_fontVersion = 0;		// Font::getAtlasVersion() when geometry was last valid
+	std::vector<const Font*> m_fontUploads;	// Fonts drawn this frame that render glyphs on demand
+	const Widget*   m_frameRoot = 0;
+	const Widget*   m_lastRoot = 0;
+	WidgetGeometry* m_recording = 0;
+	Slice    m_slice;
+	Stats    m_stats;
+	void flushSlice();
+	void replay(const WidgetGeometry&);
 
 	void  drawBox(const Rect& rect, int image, const Rect& src, const unsigned* colour, bool gradient=false);
 	void  drawNineSlice(const Rect& rect, int image, const Rect& src, const Skin::Border& border, unsigned colour);
@@ -154,5 +203,30 @@ class Renderer {
 	Point drawText(const Point& pos, const Font* font, int size, unsigned colour, const char* text, unsigned len=0);
 };
 
+/** Geometry recorded while drawing a widget. Replayed as long as the widget is not invalidated
+ * and is drawn with the same transform and clip rect. Child widgets are referenced, not copied */
+struct WidgetGeometry {
+	enum Type { DRAW, PUSH, POP, TRANSFORM, WIDGET };
+	struct Command {
+		Type     type;
+		Rect     rect;			// Transformed bounds for DRAW, clip rect for PUSH
+		int      value;			// Texture for DRAW, transform index for TRANSFORM
+		float    line;
+		unsigned vertex, vertexCount;
+		unsigned index, indexCount;
+		const Widget* widget;
+	};
+	std::vector<Command>            commands;
+	std::vector<Renderer::Vertex>   vertices;
+	std::vector<unsigned short>     indices;	// Relative to the start of each command
+	std::vector<Transform>          transforms;
+	const Renderer* renderer = 0;
+	unsigned        version = 0;
+	Transform       transform;		// State the geometry is valid for
+	Rect            scissor;
+	void clear() { commands.clear(); vertices.clear(); indices.clear(); transforms.clear(); }
+	Command& add(Type t) { commands.push_back(Command{t, Rect(), 0, 0, 0, 0, 0, 0, nullptr}); return commands.back(); }
+};
+
 }
 
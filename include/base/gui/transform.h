@@ -10,6 +10,8 @@ class Transform {
 	public:
 	struct Pos { float x, y; };
 	float& operator[](int i) { return m[i]; }
+	bool operator==(const Transform& t) const { for(int i=0; i<6; ++i) if(m[i]!=t.m[i]) return false; return true; }
+	bool operator!=(const Transform& t) const { return !(*this==t); }
 
 	template<typename T>
 	inline Pos transformf(T x, T y) const {
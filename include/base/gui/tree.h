@@ -18,11 +18,14 @@ class TreeNode {
 	bool      m_expanded;
 	int       m_depth;			// tree depth
 	int       m_displayed;		// derived height of this plus visible child nodes
+	int       m_childDisplayed;	// Sum of m_displayed of child nodes, even if collapsed
 	Widget*   m_cached;			// Cached widget
 	std::vector<Any> m_data;
 	std::vector<TreeNode*> m_children;
+	std::vector<int> m_offsets;	// Row offset of each child node, built on demand
 	void setParentNode(TreeNode* parent);
 	void changeDisplayed(int newValue);
+	const std::vector<int>& getChildOffsets();
 
 	public:
 	TreeNode(const char* text=0);
@@ -145,6 +148,7 @@ class TreeView : public Widget {
 	mutable bool                    m_needsUpdating;
 	void                            updateCache() const;
 	int                             buildCache(TreeNode* n, int y, int top, int bottom) const;
+	int                             buildChildCache(TreeNode* n, int y, int top, int bottom) const;
 
 	protected:
 	void bindEvents(Widget* item);
@@ -56,7 +56,7 @@ class Image : public Widget {
 	const char* getImageName() const;
 	IconList* getGroup() const;
 
-	void  setAngle(float a) { m_angle=a; }
+	void  setAngle(float a) { m_angle=a; invalidate(); }
 	float getAngle() const { return m_angle; }
 	void  draw() const override;
 	Point getPreferredSize(const Point& hint=Point()) const override;
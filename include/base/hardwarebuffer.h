@@ -24,8 +24,9 @@ namespace base {
 		bool  isBuffer() const;	/// Is this a hardware buffer object
 		void  createBuffer();	/// Create hardware buffer
 		void  destroyBuffer();	/// Destroy hardware buffer
-		void  writeBuffer();	/// Write data to hardware buffer
+		void  writeBuffer();	/// Write data to hardware buffer. Non-stream buffers reuse existing storage if the data fits
 		void  readBuffer();		/// Read data from hardware buffer
+		void  reserve(size_t bytes) { m_reserved = bytes; }	/// Minimum storage allocated for non-stream buffers, so writes up to this size reuse it
 
 		bool setKeepLocal(bool keepLocalCopy);	/// Keep a local copy of data when buffer created
 
@@ -69,6 +70,8 @@ namespace base {
 		unsigned m_target;
 		unsigned m_usage;
 		size_t   m_size;
+		size_t   m_bufferSize;	// Allocated size of hardware buffer
+		size_t   m_reserved;	// Minimum allocation size
 		void*    m_data;
 		bool     m_keepCopy;
 		bool     m_ownsData;
@@ -102,6 +105,7 @@ namespace base {
 		Attribute& add(AttributeSemantic, AttributeType, const char* name=0, unsigned divisor=0);
 		Attribute& add(AttributeSemantic, AttributeType, unsigned offset, const char* name=0, unsigned divisor=0);
 		Attribute& get(AttributeSemantic, int index=0);
+		const Attribute& get(AttributeSemantic, int index=0) const;
 		Attribute& get(unsigned index);
 		const Attribute& get(unsigned index) const;
 		int hasAttrribute(AttributeSemantic) const;
@@ -153,6 +157,7 @@ namespace base {
 		}
 
 		size_t getVertexCount() const { return m_vertexCount; }
+		void   setVertexCount(size_t count) { m_vertexCount = count; m_size = count * m_vertexSize; } // Local data must hold count vertices
 		size_t getVertexSize() const { return m_vertexSize / sizeof(float); }
 		size_t getStride() const { return m_vertexSize; }
 		
@@ -191,6 +196,10 @@ namespace base {
 			static const int bytes[] = { 1, 2, 4 };
 			return m_size / bytes[(int)m_type];
 		}
+		void setIndexCount(size_t count) { // Local data must hold count indices
+			static const int bytes[] = { 1, 2, 4 };
+			m_size = count * bytes[(int)m_type];
+		}
 		unsigned getDataType() const;
 		protected:
 		IndexSize m_type;
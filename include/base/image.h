@@ -1,11 +1,14 @@
 #pragma once
 
+#include <cstddef>
+
 namespace base {
 	class Image {
 		public:
 		enum Mode { FLAT, CUBE, VOLUME, ARRAY };
 		enum Format { INVALID, R8, RG8, RGB8, RGBA8, BC1, BC2, BC3, BC4, BC5, R16, R16F, R32F };
 		enum PixelType { UNKNOWN, BYTE, WORD, HALFFLOAT, FLOAT };
+		enum MipFilter { BOX, KAISER };
 		typedef unsigned char byte;
 
 		~Image();
@@ -43,12 +46,28 @@ namespace base {
 		static int getChannels(Format f)      { constexpr const int c[]={0,1,2,3,4,3,4,4,1,2,1,1,1}; return c[f]; }
 		static int getBytesPerPixel(Format f) { constexpr const int b[]={0,1,2,3,4,0,0,0,0,0,2,2,4}; return b[f]; }
 		static PixelType getPixelType(Format f);
+		static size_t getSurfaceSize(Format f, int w, int h, int d=1);	// Bytes in one mipmap of one face
 
 		void flip();
 		Image convert(Format, const char* swizzle=nullptr) const;
+
+		/** Generate a full mipmap chain from the top level, replacing any existing mipmaps.
+		 *  Only uncompressed 8 bit flat or cube images are supported.
+		 * @param filter  Downsampling filter
+		 * @param srgb    Filter colour channels in linear space. Alpha is always linear
+		 * @param threads Number of threads to use. 0 uses all cores */
+		bool generateMips(MipFilter filter=BOX, bool srgb=false, int threads=0);
+
+		/** Compress an uncompressed 8 bit image to a block compressed format (BC1~BC5).
+		 * @param to          Target format
+		 * @param highQuality Use slower endpoint fitting for lower error
+		 * @param threads     Number of threads to use. 0 uses all cores */
+		Image compress(Format to, bool highQuality=false, int threads=0) const;
+
 		private:
 		void flipSurface(byte* data, int w, int h, int d);
 		byte* convertSurface(const byte* data, int w, int h, int d, Format to, const char* swizzle) const;
+		byte* compressSurface(const byte* data, int w, int h, int d, Format to, bool highQuality, int threads) const;
 		protected:
 		Mode m_mode = FLAT;
 		Format m_format = INVALID;
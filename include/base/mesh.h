@@ -64,6 +64,7 @@ class Mesh {
 	HardwareVertexBuffer* getSkinBuffer();
 
 	int getMorphIndex(const char* name) const;
+	int getMorphCount() const;
 	
 	protected:
 	int calculateNormals();
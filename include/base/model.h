@@ -71,7 +71,9 @@ class Model {
 	void update(float time=1/60.f);
 
 	static Mesh* createTargetMesh(const Mesh* src);									// Create a new mesh to use for software skinning or morphs
-	static void skinMesh(Mesh* in, const Skeleton*, int* map, Mesh* out);		// Software skinning - deform a mesh
+	/** Software skinning. Deforms positions, normals and tangents into a target mesh with the same layout.
+	 * @param threads Maximum threads. Large meshes are split into batches of at least 4096 vertices. 0 uses all cores */
+	static void skinMesh(Mesh* in, const Skeleton*, int* map, Mesh* out, int threads=0);
 	static int* createSkinMap(const Skeleton*, const Mesh*);					// Create Bone->Skin map
 
 	static void resetTargetMesh(Mesh* target, const Mesh* source);
@@ -64,6 +64,11 @@ extern const char* glTranslateError(GLuint error);
 #define GL_DEPTH_STENCIL_ATTACHMENT 0x821A
 #define GL_DEPTH24_STENCIL8         0x88F0
 
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH           0x8741
+#endif
+
 extern PFNGLTEXIMAGE3DPROC              glTexImage3D;
 extern PFNGLTEXSUBIMAGE3DPROC           glTexSubImage3D;
 extern PFNGLGENERATEMIPMAPPROC          glGenerateMipmap;
@@ -97,6 +102,9 @@ extern PFNGLGETUNIFORMLOCATIONPROC   glGetUniformLocation;
 extern PFNGLGETATTRIBLOCATIONPROC    glGetAttribLocation;
 extern PFNGLBINDFRAGDATALOCATIONPROC glBindFragDataLocation;
 extern PFNGLBINDATTRIBLOCATIONPROC   glBindAttribLocation;
+extern PFNGLGETPROGRAMBINARYPROC     glGetProgramBinary;
+extern PFNGLPROGRAMBINARYPROC        glProgramBinary;
+extern PFNGLPROGRAMPARAMETERIPROC    glProgramParameteri;
 
 extern PFNGLUNIFORM1IVPROC         glUniform1iv;
 extern PFNGLUNIFORM2IVPROC         glUniform2iv;
@@ -123,11 +131,13 @@ extern PFNGLBINDVERTEXARRAYPROC       glBindVertexArray;
 extern PFNGLDELETEVERTEXARRAYSPROC    glDeleteVertexArrays;
 extern PFNGLDRAWELEMENTSINSTANCEDPROC glDrawElementsInstanced;
 extern PFNGLDRAWARRAYSINSTANCEDPROC   glDrawArraysInstanced;
+extern PFNGLTEXBUFFERPROC             glTexBuffer;
 
 extern PFNGLBINDBUFFERPROC     glBindBuffer;
 extern PFNGLDELETEBUFFERSPROC  glDeleteBuffers;
 extern PFNGLGENBUFFERSPROC     glGenBuffers;
 extern PFNGLBUFFERDATAPROC     glBufferData;
+extern PFNGLBUFFERSUBDATAPROC  glBufferSubData;
 
 extern PFNGLBINDRENDERBUFFERPROC        glBindRenderbuffer;
 extern PFNGLDELETERENDERBUFFERSPROC     glDeleteRenderbuffers;
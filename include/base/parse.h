@@ -1,6 +1,8 @@
 #ifndef _BASE_PARSE_
 #define _BASE_PARSE_
 
+#include <cmath>
+
 namespace base {
 	/** Generic parsing functions. Regex would be so nice at this point */
 	int  parseSpace       (const char* in);						/** Parse whitespace 			     [\s]*                         */
@@ -43,30 +45,37 @@ namespace base {
 		return t;
 	}
 	inline int parseFloat(const char* in, float& v) {
-		int iv=0, m=1, t=0;
+		static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+		const char* s = in;
+		bool negative = false;
+		unsigned long long mantissa = 0;
+		int digits = 0, scale = 0;
 		// Sign
-		if(*in=='+' || *in=='-') { ++t; m = 0x2c-*in; }
-		t += parseInt(in+t,iv);
-		in += t;
+		if(*s=='+' || *s=='-') { negative = *s=='-'; ++s; }
+		// Integer part. Digits beyond 64 bit precision only affect scale
+		for(; is09(s); ++s) {
+			if(digits < 19) { mantissa = mantissa*10 + (*s - '0'); if(mantissa) ++digits; }
+			else ++scale;
+		}
 		// Fraction
-		if(*in=='.') {
-			++in; ++t;
-			if(*in=='-' || *in=='+') { v=iv; return t; } // Invalid +/- accepted by parseInt()
-			int frac;
-			int ft = parseInt(in, frac);
-			v = iv + frac * pow(10, -ft);
-			t += ft;
-			in += ft;
+		if(*s=='.') {
+			++s;
+			for(; is09(s); ++s) {
+				if(digits < 19) { mantissa = mantissa*10 + (*s - '0'); if(mantissa) ++digits; --scale; }
+			}
 		}
 		// Exponent
-		if(*in == 'e') {
-			++in;
+		if(*s=='e' || *s=='E') {
+			++s;
 			int exp;
-			t += parseInt(in, exp);
-			v = v * pow(10, exp);
+			s += parseInt(s, exp);
+			scale += exp;
 		}
-		v *= m;
-		return t;
+		double value = (double)mantissa;
+		if(scale > 0) value *= scale < 23? powers[scale]: pow(10.0, scale);
+		else if(scale < 0) value /= scale > -23? powers[-scale]: pow(10.0, -scale);
+		v = negative? -value: value;
+		return s - in;
 	}
 	inline int parseAlphaNumeric(const char* in, char* s, int lim) {
 		int t=0;
@@ -4,7 +4,9 @@
 #include <base/thread.h>
 #include <base/math.h>
 #include <vector>
+#include <atomic>
 
+namespace base { class Camera; }
 
 namespace particle {
 
@@ -25,6 +27,14 @@ struct Particle {
 };
 
 
+/// Xorshift generator. Instances own one each so spawning on worker threads doesn't share state
+struct Random {
+	uint state;
+	Random(uint seed=1) : state(seed? seed: 1) {}
+	uint next() { state ^= state << 13; state ^= state >> 17; state ^= state << 5; return state; }
+	float getFloat() { return (next() >> 8) * (1.f / 16777216.f); }
+};
+
 class Object {
 	public:
 	Object() : m_system(0), m_index(-1) {}
@@ -32,7 +42,7 @@ class Object {
 	virtual void trigger(Instance*, Particle&) const {}
 	int getDataIndex() const { return m_index; }
 	System* getSystem() { return m_system; }
-	static inline float random() { return (float)rand()/(float)RAND_MAX; }
+	static float random();	// [0,1] from the generator of the instance being updated, or a per thread generator
 	protected:
 	private:
 	friend class System;
@@ -105,8 +115,11 @@ class RenderData : public Object {
 	private:
 	friend class Instance;
 	void setCount(Instance*, size_t count, int threadCount) const;
-	void updateT(int threadIndex, int threadCount, Instance*, int emitterIndex, const Matrix& view) const;
+	void updateT(int threadIndex, int threadCount, Instance*, int emitterIndex, const Matrix& view, float extrapolate) const;
 	virtual void setParticleVertices(void* output, const Particle& particle, const Matrix& view) const = 0;
+	/// Write vertices for a list of particles. Positions are moved by velocity * extrapolate.
+	/// Default implementation calls setParticleVertices for each particle.
+	virtual void setVertices(char* output, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const;
 
 	protected:
 	base::VertexAttributes m_attributes;
@@ -152,6 +165,7 @@ class Emitter : public Object {
 	virtual void spawnParticle(Particle&, const Matrix& m, float key) const = 0;
 	void update(Instance*, float) const;	// update spawns
 	void updateT(int threadIndex, int threadCount, Instance*, float) const;	// update affectors
+	void fastForward(Instance*, float) const;	// spawn particles that would still be alive after skipping time
 
 	void trigger(Instance*, Particle&) const override;	// Spawn from another particle
 	void setEnabled(bool);				// start/stop spawning
@@ -167,11 +181,11 @@ class Emitter : public Object {
 	const std::vector<Event*>& events() const { return m_allEvents; }
 
 	void fireEvent(Instance*, const Event*, Particle&) const;
-	void fireEventT(Instance*, const Event*, Particle&, int threadIndex) const;
+	void fireEventT(Instance*, const Event*, Particle&) const;	// Queue event from worker thread
 	void allocateAffectorMasks();
 
 	private:
-	Particle& spawnParticle(Instance* instance, const vec3& pos, const Quaternion& orientation, const vec3& velocity, float key, float timeOffset) const;
+	Particle* spawnParticle(Instance* instance, const vec3& pos, const Quaternion& orientation, const vec3& velocity, float key, float timeOffset) const;
 
 	public:
 	bool   eventOnly=false;	// This emitter can only be triggered by internal events
@@ -229,24 +243,38 @@ class Instance {
 	virtual void initialise();
 	virtual void createMaterial(const RenderData*) {}
 
+	enum CullState { ACTIVE, HIDDEN, SLEEPING };	// Updated, simulated without geometry, not updated
+
 	void setEnabled(bool);
 	bool isEnabled() const { return m_enabled; }
+	CullState getCullState() const { return m_cullState; }
+	const BoundingBox& getBounds() const { return m_bounds; }	// World bounds of particle positions
+	BoundingBox getCullBounds() const;							// Particle bounds including emitter, expanded by padding
+	void setBoundsPadding(float p) { m_boundsPadding = p; }		// Allowance for particle size
+	void fastForward(float time);	// Advance time without simulating affectors
 	size_t getParticleCount() const { return m_count; }
 	System* getSystem() const { return m_system; }
 	float getTime() const { return m_time; }
 	void trigger();
 	void reset();
 	void shift(const vec3&);
+	void setRandomSeed(uint seed) { m_random = Random(seed); }
 
 	virtual const Matrix& getTransform() const = 0;
 	virtual vec3 getVelocity() const { return vec3(); }
 
 	protected:
 	void initialiseThreadData(int m_threads);
-	Particle& allocate(const Emitter*);
+	Particle* allocate(const Emitter*);	// Null if the pool or emitter limit is full
 	void freeParticle(Particle&);
 	void update(float time);
-	void updateT(int threadIndex, int threadCount, float time, const Matrix& view);
+	bool compact();					// Join particle lists packed by threaded update
+	void flushEvents(bool fire);	// Fire queued events and free particles waiting on die events
+	void updateRenderCounts();
+	void updateT(int threadIndex, int threadCount, float time);
+	void updateGeometryT(int threadIndex, int threadCount, const Matrix& view, float extrapolate);
+	void finishUpdate();			// Compact and resize render buffers to the survivors
+	void setCullState(CullState, float time);
 
 	virtual void updateGeometry() = 0;
 
@@ -261,12 +289,18 @@ class Instance {
 	size_t   m_head;			// Particle pool head
 	float    m_time;			// Current time in seconds
 	bool     m_enabled;			// Is system enabled
+	CullState m_cullState;		// Visibility state set by manager
+	float    m_sleepTime;		// Time skipped while sleeping
+	float    m_boundsPadding;	// Added to bounds for culling
+	BoundingBox m_bounds;		// Particle bounds from last update
+	Random   m_random;			// Generator used while spawning
 
 	struct EmitterInstance {
 		const Emitter* emitter;
 		float accumulator;
 		bool enabled;
 		std::vector<uint> particles;
+		std::vector<uint> alive;	// Surviving particles at the start of each thread's range after update
 	};
 	struct RenderInstance {
 		const RenderData* render;
@@ -282,10 +316,12 @@ class Instance {
 	std::vector<int>             m_active;		// List of active emitters
 	std::vector<Particle>        m_pool;		// Particle pool
 
+	// Events from worker threads. Sized before each update so appending never reallocates
 	struct TriggeredEvent { const Event* event; const Emitter* emitter; Particle* particle; };
-	struct DestroyMessage { const Emitter* emitter; Particle* particle; size_t index; };
-	std::vector<TriggeredEvent>* m_triggered = 0;
-	std::vector<DestroyMessage>* m_destroy = 0;
+	std::vector<TriggeredEvent> m_triggered;
+	std::atomic<int> m_triggeredCount;
+	bool m_compact = false;		// Particle lists need compacting after threaded update
+	BoundingBox* m_threadBounds = 0;
 	int m_threads = 0;
 };
 
@@ -297,6 +333,11 @@ class Manager {
 	void stopThreads();
 	int getThreads() const { return m_threads.size(); }
 	void update(float time, const Matrix& viewMatrix);
+	void update(float time, const base::Camera& camera);	// Update with culling of instances
+	void setFixedTimeStep(float step, int maxSteps=4);	// Simulate in fixed steps. 0 uses frame time
+	float getFixedTimeStep() const { return m_fixedStep; }
+	void setSleepDistance(float distance);	// Instances further away stop updating. 0 to disable
+	void setSleepOffscreen(bool sleep);		// Sleep off screen instances instead of only skipping geometry
 	void add(Instance*, bool enabled=true);
 	void remove(Instance*);
 	size_t getParticleCount() const;
@@ -306,12 +347,22 @@ class Manager {
 
 	protected:
 	void threadFunc(int index);
+	void updateInstances(float time);
+	void simulate(float time, bool geometry);
 	std::vector<base::Thread> m_threads;
 	base::Barrier m_barrier;
 	bool m_threadsRunning;
 	float m_timeStep;
+	bool  m_geometry;		// Build geometry this step
 	Matrix m_viewMatrix;
 
+	float m_fixedStep;		// Fixed simulation step, or 0
+	float m_accumulator;	// Unsimulated time
+	float m_extrapolate;	// Time rendered geometry is ahead of simulation
+	int   m_maxSteps;		// Step limit per frame to avoid spiralling
+	float m_sleepDistance;
+	bool  m_sleepOffscreen;
+
 	std::vector<Instance*> m_instances;
 };
 
@@ -13,12 +13,14 @@ namespace base {
 	class ShaderVars;
 	class Compositor;
 	class CompositorGraph;
+	class AssetCache;
 
 	/** Singleton class global resource manager */
 	class Resources {
 		static Resources* s_instance;
 		float m_progress = 1.f;
 		VirtualFileSystem* m_fileSystem;
+		AssetCache* m_cache = nullptr;
 		public:
 		static Resources* getInstance() { return s_instance; }
 		Resources();
@@ -43,6 +45,10 @@ namespace base {
 		void addArchive(const char* archive, const char* mount="");
 		const VirtualFileSystem& getFileSystem() const { return *m_fileSystem; }
 		File openFile(const char* name) const;
+
+		// Cache processed images, static meshes and shader binaries on disk. Null path disables the cache
+		void setCacheDirectory(const char* path);
+		AssetCache* getCache() const { return m_cache; }
 		
 		// Threaded or deferred loading. returns number of items finished this call
 		int update();
@@ -35,11 +35,13 @@ namespace script {
 	};
 
 	class FunctionCall;
+	class Program;
 
 	/// Script expression, eg "blah+5", or "a<b", or "6"
 	class Expression {
 		protected:
 		friend class Script;
+		friend class Program;
 		enum Operator { NIL, SET, SETADD, SETSUB, SETMUL, SETDIV, APPEND, OR, AND, EQ, NE, GT, GE, LT, LE, NOT, ADD, SUB, NEG, MUL, DIV, GET,GET2,CALL };
 		enum OperandType { NOTHING, NAME, COMPOUNDNAME, CONSTANT, EXPRESSION, FUNCTIONCALL };
 		struct Operand { OperandType type; union { uint var; uint* cvar; Variable* con; const Expression* expr; FunctionCall* call; }; };
@@ -51,7 +53,9 @@ namespace script {
 		static String    opString(const Operand&);
 		static void      opDelete(Operand&);
 		static int       compare(const Variable& a, const Variable& b);
-		static Variable  evaluateOp(Operator op, Variable& a, Variable& b, Context&&);
+		static Variable  binaryOp(Operator op, const Variable& a, const Variable& b);
+		static Variable  negate(const Variable& a);
+		static void      append(Variable& target, const Variable& value);
 		public:
 		virtual ~Expression();
 		virtual Variable evaluate(Context&& context) const;
@@ -64,6 +68,7 @@ namespace script {
 	class Conditional : public Expression {
 		protected:
 		friend class Script;
+		friend class Program;
 		Operand rhd;
 		Conditional();
 		public:
@@ -81,8 +86,10 @@ namespace script {
 		virtual String toString() const override;
 		protected:
 		friend class Script;
+		friend class Program;
 		Expression** lines;
 		int          length;
+		Program*     program;	// Compiled bytecode, if compiled
 		protected:
 		bool            scoped;
 		bool            localSet;	// set operations only use local scope
@@ -133,6 +140,7 @@ namespace script {
 		friend class Script;
 		friend class Variable;
 		friend class FunctionCall;
+		friend class Program;
 		int   argc;
 		uint* argn;
 		int   ref;
@@ -178,6 +186,11 @@ namespace script {
 		~Script();
 		bool        parse(const char* source);
 		bool		run(Variable& context);
+
+		/** Compile parsed script to bytecode. Functions defined in the script are also compiled.
+		 *  Compiled blocks produce the same results as the tree interpreter. */
+		bool        compile();
+		static void compile(Function* function);
 		public:
 		static Function*   parseFunction(const char* src);
 		static Function*   parseFunction(const char* src, int argc=0, const char* const argn[]=0);
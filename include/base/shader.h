@@ -4,6 +4,7 @@
 #include <string>
 
 namespace base {
+class AssetCache;
 
 enum ShaderType { VERTEX_SHADER, FRAGMENT_SHADER, GEOMETRY_SHADER, TESSCONTROL_SHADER, TESSELATION_SHADER };
 class ShaderPart {
@@ -56,6 +57,10 @@ class Shader {
 	// Quick shader creation
 	static Shader* create(const char* vertexShaderSrc, const char* fragmentShaderSrc, const char* defines=nullptr);
 
+	/** Cache linked program binaries. Skips compiling and linking if the sources are unchanged */
+	static void setBinaryCache(AssetCache* cache) { s_binaryCache = cache; }
+	static AssetCache* getBinaryCache() { return s_binaryCache; }
+
 	public:
 	Shader();
 	~Shader();
@@ -111,6 +116,11 @@ class Shader {
 
 	const std::vector<ShaderPart*> getParts() const { return m_shaders; }
 
+	private:
+	unsigned long long getBinaryKey() const;
+	bool loadBinary(unsigned long long key);
+	void saveBinary(unsigned long long key) const;
+
 	private:
 	std::vector<ShaderPart*> m_shaders;
 	char*    m_entry[5];
@@ -121,6 +131,7 @@ class Shader {
 	
 	static int           s_supported;
 	static const Shader* s_currentShader;
+	static AssetCache*   s_binaryCache;
 };
 }
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <base/math.h>
+#include <base/animation.h>
+#include <vector>
 
 namespace base {
 	class Skeleton;
@@ -37,9 +39,9 @@ namespace base {
 		const Quaternion& getOrientation() const;				// Get the relative orientation as a quaternion
 		const Matrix&     getTransformation() const;			// Get the local transformation of the bone
 		const Matrix&     getAbsoluteTransformation() const;	// *Deprecated - derived position and rotation
-		const Matrix&     getDerivedTranform() const { return m_combined; }
-		const vec3&       getDerivedScale() const { return m_combinedScale; } // Get derived scale
-		vec3              getDerivedPosition() const { return vec3(&m_combined[12]); }
+		const Matrix&     getDerivedTranform() const;			// Get the derived transformation
+		const vec3&       getDerivedScale() const;				// Get derived scale
+		vec3              getDerivedPosition() const;			// Get derived position
 
 		void setPosition(const vec3& pos);		// Set the relative position
 		void setScale(float scale);				// Set the relative scale
@@ -57,20 +59,11 @@ namespace base {
 		friend class Skeleton;
 		enum TransformState { TF_PARTS=1, TF_MATRIX=2, TF_ABSOLUTE=4, TF_FINAL=8 };
 
+		// Pose data lives in the skeleton arrays
 		Skeleton*   m_skeleton;	// Skeleton object this bone belongs to
 		int         m_index;	// Skeleton index
-		int         m_parent;	// Bone parent index
 		const char* m_name;		// Bone name
 		float       m_length;	// Rest length
-		Mode        m_mode;		// Update behavious mode
-		int         m_state;	// Which parts have been changed so need updating
-
-		Matrix      m_local;	// Local matrix (cached from pos/scale/rot)
-		Matrix      m_combined; // Derived matrix
-		vec3        m_position;	// Bone local position
-		vec3        m_scale;	// Bone local scale
-		vec3        m_combinedScale; // Derived scale vector
-		Quaternion  m_angle;	// Bone local orientation
 
 		Bone();					// Private constructor - create from Skeleton
 		~Bone();
@@ -88,6 +81,7 @@ namespace base {
 		~Skeleton();						// Destructor
 
 		Bone*       addBone(const Bone* parent, const char* name=0, const float* localMatrix=0, float length=1);	// Add a new bone to the skeleton
+		void        reserve(int bones);						// Allocate for this many bones so addBone does not move pose data
 		Bone*       getBone(int index);						// Get bone by index
 		const Bone* getBone(int index) const;				// Get bone by index
 		Bone*       getBone(const char *name) const;		//  Get bone by name
@@ -108,47 +102,115 @@ namespace base {
 		int  applyPose(const Animation*, float frame=0, int fromBone=-1, int mode=1, float weight=1, const unsigned char* keyMap=0);
 		bool applyBonePose(Bone* bone, const Animation* anim, int set, float frame, int blend=1, float weight=1);
 
+		void setLODMask(const ubyte* mask);		// Only bones with a non-zero mask value are animated. Not copied
+		class Pose;
+		bool isPoseCompatible(const Pose&) const;			// Same rest pose and bone modes, so the pose can be loaded
+		bool savePose(Pose&, bool matrices=false) const;	// Store pose. Final matrices are stored if requested, valid and there are no user bones
+		bool loadPose(const Pose&, bool matrices=false);	// Load pose from a compatible skeleton. USER and FIXED bones are kept.
 		const Matrix* getMatrixPtr() const;		// Null if update not yet called
 		Bone** begin() { return m_bones; }
 		Bone** end() { return m_bones + m_count; }
 
 
 		private:
-		Bone**           m_bones;	// Array of bones
-		int              m_count;	// Number of bones
-		uint16*          m_hints;	// Animation hints
-		ubyte*           m_flags;	// Flag array to save reallocation
-		Matrix*          m_matrices;	// Final transform matrices for all bones (bone.combined * rest.skin)
+		friend class Bone;
+		Bone**      m_bones;		// Bone objects. Pose data is stored in the arrays below
+		int         m_count;		// Number of bones
+		int         m_capacity;		// Bones the arrays have space for
+		bool        m_valid;		// Skin matrices have been calculated
+
+		// Pose data. Contiguous arrays indexed by bone, all in one allocation
+		Matrix*     m_local;		// Local matrix (cached from pos/scale/rot)
+		Matrix*     m_combined;		// Derived matrix
+		Matrix*     m_matrices;		// Final transform matrices for all bones (bone.combined * rest.skin)
+		Quaternion* m_angle;		// Bone local orientation
+		vec3*       m_position;		// Bone local position
+		vec3*       m_scale;		// Bone local scale
+		vec3*       m_combinedScale;// Derived scale
+		int*        m_parent;		// Parent index. Parents always have a smaller index
+		uint16*     m_hints;		// Animation hints
+		ubyte*      m_state;		// Which parts have been changed so need updating
+		ubyte*      m_mode;			// Bone update mode
+		ubyte*      m_flags;		// Flag array to save reallocation
+		char*       m_pose;			// Allocation holding all pose arrays
+		const ubyte* m_lodMask;		// Animated bones for current level of detail
+
+		void allocatePose(int capacity, const Skeleton& source);
+		void updateLocal(int index);
+		bool applyBoneTransform(int index, const AnimationClip::Transform&, int blend, float weight);
+
+		std::vector<AnimationClip::Transform> m_clipPose;	// Scratch buffer for baked clip samples
+
+		// Bone names - shared between copies
+		struct Names {
+			int   ref;
+			std::vector<char*> names;
+		};
+		Names* m_names;
+		void dropNames();
 
 		// Skeleton rest data - can be shared
 		struct RestPose {
 			int         ref;	// Reference count
 			int         size;	// Number of bones
 			Matrix*     local;	// Local bone matrixes for rest position
+			Quaternion* localRot;	// Rotation of local rest matrices
 			Quaternion* rot;	// Local rest orientation
 			vec3*       scale;	// Local rest scale
 			Matrix*     skin;	// Skin matrices - inverse modelspace rest matrixes
 		};
 		RestPose* m_rest;
-		void dropRestPose();
+		static void dropRestPose(RestPose*&);
+	};
+
+	/** Animated pose of a skeleton without bone objects or names, as used by AnimationCache.
+	 * Holds a reference to the rest pose so compatibility checks stay valid */
+	class Skeleton::Pose {
+		public:
+		Pose();
+		~Pose();
+		int    getBoneCount() const { return m_count; }
+		bool   hasMatrices() const { return m_hasMatrices; }	// Final matrices are stored
+		size_t getMemoryUsage() const;
+
+		private:
+		friend class Skeleton;
+		Pose(const Pose&) = delete;
+		Pose& operator=(const Pose&) = delete;
+		RestPose*   m_rest;
+		int         m_count;
+		bool        m_hasMatrices;
+		char*       m_data;			// Allocation holding all arrays
+		Matrix*     m_local;
+		Matrix*     m_combined;		// Only with matrices
+		Matrix*     m_matrices;		// Only with matrices
+		Quaternion* m_angle;
+		vec3*       m_position;
+		vec3*       m_scale;
+		vec3*       m_combinedScale;// Only with matrices
+		ubyte*      m_state;
+		ubyte*      m_mode;
 	};
 
 
 	// Inline functions
-	inline Bone::Mode  Bone::getMode() const    { return m_mode; }
-	inline void        Bone::setMode(Mode m)    { m_mode = m; }
+	inline Bone::Mode  Bone::getMode() const    { return (Mode)m_skeleton->m_mode[m_index]; }
+	inline void        Bone::setMode(Mode m)    { m_skeleton->m_mode[m_index] = m; }
 	inline int         Bone::getIndex() const   { return m_index; }
 	inline const char* Bone::getName() const    { return m_name; }
 	inline float       Bone::getLength() const  { return m_length; }
 	inline void        Bone::setLength(float l) { m_length = l; }
-	inline Bone*       Bone::getParent()        { return m_parent<0? 0: m_skeleton->getBone(m_parent); }
-
-	inline const Quaternion& Bone::getAngle() const                  { return m_angle; }
-	inline const Quaternion& Bone::getOrientation() const                  { return m_angle; }
-	inline const vec3&       Bone::getPosition() const               { return m_position; }
-	inline const vec3&       Bone::getScale() const                  { return m_scale; }
-	inline const Matrix&     Bone::getTransformation() const         { return m_local; }
-	inline const Matrix&     Bone::getAbsoluteTransformation() const { return m_combined; }
+	inline Bone*       Bone::getParent()        { int p = m_skeleton->m_parent[m_index]; return p<0? 0: m_skeleton->getBone(p); }
+
+	inline const Quaternion& Bone::getAngle() const                  { return m_skeleton->m_angle[m_index]; }
+	inline const Quaternion& Bone::getOrientation() const            { return m_skeleton->m_angle[m_index]; }
+	inline const vec3&       Bone::getPosition() const               { return m_skeleton->m_position[m_index]; }
+	inline const vec3&       Bone::getScale() const                  { return m_skeleton->m_scale[m_index]; }
+	inline const Matrix&     Bone::getTransformation() const         { return m_skeleton->m_local[m_index]; }
+	inline const Matrix&     Bone::getAbsoluteTransformation() const { return m_skeleton->m_combined[m_index]; }
+	inline const Matrix&     Bone::getDerivedTranform() const        { return m_skeleton->m_combined[m_index]; }
+	inline const vec3&       Bone::getDerivedScale() const           { return m_skeleton->m_combinedScale[m_index]; }
+	inline vec3              Bone::getDerivedPosition() const        { return vec3(&m_skeleton->m_combined[m_index][12]); }
 
 	// Skeleton Inlines
 	inline Bone*       Skeleton::getBone(int index)                        { return m_bones[index]; }
@@ -159,7 +221,8 @@ namespace base {
 	inline const Matrix& Skeleton::getSkinMatrix(int i) const { return m_rest->skin[i]; }
 	inline const Quaternion& Skeleton::getRestAngle(int i) const { return m_rest->rot[i]; }
 
-	inline const Matrix* Skeleton::getMatrixPtr() const { return m_matrices; }
+	inline const Matrix* Skeleton::getMatrixPtr() const { return m_valid? m_matrices: 0; }
+	inline void Skeleton::setLODMask(const ubyte* mask) { m_lodMask = mask; }
 
 }
 
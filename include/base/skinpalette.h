@@ -0,0 +1,41 @@
+#pragma once
+
+#include <base/texture.h>
+#include <base/matrix.h>
+#include <base/hardwarebuffer.h>
+#include <vector>
+
+namespace base {
+
+	/** Packs skin matrices of many skeletons into a single texture buffer so skinned
+	 * meshes can be drawn with one instanced call. Each matrix is stored as three
+	 * RGBA32F texels holding the rows of the 3x4 affine matrix.
+	 *
+	 * Vertex shaders include getShaderSource() and call getSkinMatrix(boneIndex).
+	 * Instanced draws store each instance's palette offset in the instance buffer with
+	 * addInstanceAttribute() and compile with SKIN_INSTANCED defined. Otherwise the
+	 * skinOffset uniform should be bound to the skin_offset auto variable.
+	 */
+	class SkinPalette {
+		public:
+		SkinPalette();
+		~SkinPalette();
+
+		void begin();		// Start a new frame. Clears local data
+		int  add(const Matrix* matrices, int count, const int* map=0);	// Append matrices. Returns base offset in matrices
+		void upload();		// Copy data to the GPU buffer. Call once after everything is added
+
+		const Texture* getTexture() const { return &m_texture; }
+		int  getSize() const { return m_data.size() / 12; }	// Number of matrices
+
+		static const char* getShaderSource();	// GLSL declaring skinPalette, skinOffset and getSkinMatrix()
+		static Attribute&  addInstanceAttribute(VertexAttributes&, unsigned offset);	// Per instance float skinOffset
+		static bool        hasInstanceAttribute(const VertexAttributes&);
+
+		private:
+		std::vector<float> m_data;
+		Texture  m_texture;
+		unsigned m_buffer;
+	};
+}
+
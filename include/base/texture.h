@@ -21,7 +21,7 @@ namespace base {
 			D16, D24, D32, D32F, D24S8 		// Depth formats
 		};
 		enum Filter { NEAREST, BILINEAR, TRILINEAR, ANISOTROPIC };
-		enum Type   { TEX1D, TEX2D, TEX3D, CUBE, ARRAY1D, ARRAY2D };
+		enum Type   { TEX1D, TEX2D, TEX3D, CUBE, ARRAY1D, ARRAY2D, BUFFER };
 		enum Wrapping { REPEAT, CLAMP, BORDER };
 		static Format getFormat(int channels, int bitsPerChannel, bool real=false);
 
@@ -40,6 +40,9 @@ namespace base {
 
 		bool setData(Type type, int width, int height, int depth, Format format, const void*const* data, int layers=1, bool generateMips=false);
 
+		/** Use a buffer object as texture data. Accessed in shaders with samplerBuffer and texelFetch */
+		bool setBuffer(unsigned buffer, Format format, int elements);
+
 		/** Update sub image */
 		int setPixels(int width, int height, Format format, const void* data, int mipLevel=0);
 		int setPixels(int width, int height, Format format, const void** data, int mipmaps);
@@ -24,6 +24,7 @@
 #endif
 
 #include <cstdio>
+#include <atomic>
 
 namespace base {
 	class Thread {
@@ -116,6 +117,19 @@ namespace base {
 			#endif
 		}
 
+		/** Number of hardware threads available */
+		static int cores() {
+			#ifdef PTHREAD
+			long n = sysconf(_SC_NPROCESSORS_ONLN);
+			return n>0? n: 1;
+			#endif
+			#ifdef WINTHREAD
+			SYSTEM_INFO info;
+			GetSystemInfo(&info);
+			return info.dwNumberOfProcessors;
+			#endif
+		}
+
 		/** Tell current thread to sleep (milliseconds) */
 		static void sleep(int time) {
 			#ifdef PTHREAD
@@ -162,6 +176,7 @@ namespace base {
 
 		bool _beginThread(ThreadData* data) {
 			data->thread = this;
+			m_running = true;	// Set here so join() can't return before the thread starts
 			#ifdef WINTHREAD
 			m_thread = (HANDLE)_beginthreadex(0, 0, _threadFunc, data, 0, &m_threadID);
 			if(m_priority) SetThreadPriority(m_thread, m_priority); //set thread priority
@@ -177,6 +192,7 @@ namespace base {
 			//thread creation failed
 			if(m_thread==0) {
 				printf("Failed to create thread\n");
+				m_running = false;
 				delete data;
 				return false;
 			}
@@ -197,16 +213,16 @@ namespace base {
 			ThreadData* d = static_cast<ThreadData*>(data);
 			d->thread->m_running = true;
 			d->run();
-			d->thread->m_running = false;
-			pthread_exit(0);
+			Thread* thread = d->thread;
 			delete d;
+			thread->m_running = false;
 			return 0;
 		}
 		#endif
 
 
 		private:
-		bool m_running;			//thread status
+		volatile bool m_running;//thread status
 		int m_priority;			//thread priority
 		
 		#ifdef WINTHREAD
@@ -227,6 +243,7 @@ namespace base {
 		void unlock() { LeaveCriticalSection(&m_lock); }
 		bool tryLock(){ return TryEnterCriticalSection(&m_lock); }
 		private:
+		friend class Condition;
 		CRITICAL_SECTION m_lock;
 	};
 	#else 
@@ -236,11 +253,36 @@ namespace base {
 		~Mutex()      { pthread_mutex_destroy(&m_lock); }
 		void lock()   { pthread_mutex_lock(&m_lock); }
 		void unlock() { pthread_mutex_unlock(&m_lock); }
-		bool tryLock(){ return pthread_mutex_lock(&m_lock)==0; }
+		bool tryLock(){ return pthread_mutex_trylock(&m_lock)==0; }
 		private:
+		friend class Condition;
 		pthread_mutex_t m_lock;
 	};
 	#endif
+
+	/** Condition variable. Wait must be called with the mutex locked */
+	#ifdef WINTHREAD
+	class Condition {
+		public:
+		Condition()            { InitializeConditionVariable(&m_condition); }
+		void wait(Mutex& m)    { SleepConditionVariableCS(&m_condition, &m.m_lock, INFINITE); }
+		void notify()          { WakeConditionVariable(&m_condition); }
+		void notifyAll()       { WakeAllConditionVariable(&m_condition); }
+		private:
+		CONDITION_VARIABLE m_condition;
+	};
+	#else
+	class Condition {
+		public:
+		Condition()            { pthread_cond_init(&m_condition, 0); }
+		~Condition()           { pthread_cond_destroy(&m_condition); }
+		void wait(Mutex& m)    { pthread_cond_wait(&m_condition, &m.m_lock); }
+		void notify()          { pthread_cond_signal(&m_condition); }
+		void notifyAll()       { pthread_cond_broadcast(&m_condition); }
+		private:
+		pthread_cond_t m_condition;
+	};
+	#endif
 	
 	/** Exception safe mutex aquistion class */
 	class MutexLock {
@@ -304,6 +346,115 @@ namespace base {
 	};
 	#endif
 
+
+	/** Persistent worker threads shared by parallelFor. Workers are created on first use and
+	 *  sleep on a condition variable between jobs. One job runs at a time */
+	class ThreadPool {
+		public:
+		typedef void(*JobFunc)(const void* data, int index);
+
+		static ThreadPool& instance() { static ThreadPool pool; return pool; }
+
+		~ThreadPool() {
+			m_mutex.lock();
+			m_quit = true;
+			m_wake.notifyAll();
+			m_mutex.unlock();
+			for(int i=0; i<m_count; ++i) m_workers[i].join();
+			delete [] m_workers;
+		}
+
+		/** Number of threads that can run a job, including the caller */
+		int size() { start(); return m_count + 1; }
+
+		/** Run func(data, index) for every index in [0,count). The calling thread takes part.
+		 *  Returns false without running anything if another job is in progress */
+		bool run(int count, JobFunc func, const void* data) {
+			bool idle = false;
+			if(!m_busy.compare_exchange_strong(idle, true)) return false;
+			start();
+			m_mutex.lock();
+			while(m_active > 0) m_done.wait(m_mutex);	// Late workers still leaving the last job
+			m_job = Job{ func, data, count };
+			m_next = 0;
+			++m_generation;
+			m_wake.notifyAll();
+			m_mutex.unlock();
+
+			execute(m_job);
+
+			m_mutex.lock();
+			while(m_active > 0) m_done.wait(m_mutex);
+			m_mutex.unlock();
+			m_busy = false;
+			return true;
+		}
+
+		private:
+		struct Job { JobFunc func; const void* data; int count; };
+
+		void start() {
+			if(m_workers) return;
+			m_count = Thread::cores() - 1;
+			m_workers = new Thread[m_count > 0? m_count: 1];
+			for(int i=0; i<m_count; ++i) m_workers[i].begin(this, &ThreadPool::workerFunc);
+		}
+
+		void execute(const Job& job) {
+			for(int i = m_next++; i < job.count; i = m_next++) job.func(job.data, i);
+		}
+
+		void workerFunc() {
+			unsigned seen = 0;
+			m_mutex.lock();
+			while(true) {
+				while(seen == m_generation && !m_quit) m_wake.wait(m_mutex);
+				if(m_quit) break;
+				seen = m_generation;
+				Job job = m_job;
+				++m_active;
+				m_mutex.unlock();
+				execute(job);
+				m_mutex.lock();
+				if(--m_active == 0) m_done.notifyAll();
+			}
+			m_mutex.unlock();
+		}
+
+		Mutex     m_mutex;
+		Condition m_wake;
+		Condition m_done;
+		Thread*   m_workers = 0;
+		int       m_count = 0;
+		Job       m_job = Job{ 0, 0, 0 };
+		unsigned  m_generation = 0;
+		int       m_active = 0;		// Workers holding a copy of the job
+		bool      m_quit = false;
+		std::atomic<int>  m_next { 0 };
+		std::atomic<bool> m_busy { false };	// A job is in progress
+	};
+
+
+	/** Run func(index) for every index in [0,count), split into contiguous ranges across threads.
+	 *  Ranges run on the shared ThreadPool with the calling thread taking part. Blocks until all ranges
+	 *  are complete. Nested or concurrent calls run on the calling thread.
+	 * @param count   Number of items
+	 * @param func    Functor taking (int index)
+	 * @param threads Maximum threads to use. 0 uses all cores */
+	template<class F>
+	void parallelFor(int count, const F& func, int threads=0) {
+		if(threads <= 0) threads = Thread::cores();
+		if(threads > count) threads = count;
+		if(threads > 1) {
+			struct Ranges { const F* func; int count, ranges; } job { &func, count, threads };
+			auto run = [](const void* data, int r) {
+				const Ranges& job = *static_cast<const Ranges*>(data);
+				for(int i=job.count*r/job.ranges; i<job.count*(r+1)/job.ranges; ++i) (*job.func)(i);
+			};
+			if(ThreadPool::instance().run(threads, run, &job)) return;
+		}
+		for(int i=0; i<count; ++i) func(i);
+	}
 };
 
 #endif
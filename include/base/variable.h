@@ -22,11 +22,17 @@ namespace script {
 		// LINK     : Data stored externally (Always FIXED)
 		// EXPLICIT : Object has fixed structure
 		enum Types { OBJECT=1, BOOL, INT, UINT, FLOAT, DOUBLE, VEC2, VEC3, VEC4, ARRAY, STRING, FUNCTION, NAME, FIXED=0x20, CONST=0x40, LINK=0x80, EXPLICIT=0x100 };
+		struct Shape;
 		struct Object {
-			std::vector<uint8> lookup;		// map of nameID -> item index
-			std::vector<uint> keys;			// list of sub variable names
+			Shape* shape = nullptr;			// Sub variable names and lookup index, shared between copies
 			std::vector<Variable> items;	// list of sub variables
 			uint ref;
+			~Object();
+			int  find(uint id) const;
+			Variable& add(uint id, const Variable&);
+			void erase(uint id);
+			void setShape(Shape*);
+			const uint* keys() const;
 		};
 		uint type;
 		union {
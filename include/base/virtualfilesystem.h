@@ -18,6 +18,7 @@ namespace base {
 			String getFullPath() const; // Full path from cwd, includes source. For error log
 			String getLocalPath() const; // path from mount point
 			bool inArchive() const; // Is tthis file part of a pack, fullPath is not a valid file.
+			bool getFileInfo(size_t& size, long long& modified) const; // Size and modification time on disk. Archived files get the archive info
 			File() {}
 			private:
 			File(VirtualFileSystem* fs, const String& name, int folder, int src) : name(name), m_fs(fs), m_source(src), m_folder(folder) {}
@@ -10,7 +10,10 @@ namespace base {
 	class Wavefront {
 		public:
 		static Model* load(const char* filename);
-		static Model* parse(const char* data);
+		/** Parse OBJ data. Large files are split into line chunks and parsed on multiple threads
+		 * @param data    Null terminated file contents
+		 * @param threads Maximum number of threads. 0 uses all cores */
+		static Model* parse(const char* data, int threads=0);
 		static bool   save(Model* model, const char* filename);
 		static bool   save(Mesh* model, const char* filename);
 
@@ -7,18 +7,22 @@
 #include <base/thread.h>
 #include <base/scene.h>
 #include <vector>
-#include <map>
+#include <atomic>
+#include <unordered_map>
 
 // Windows being infuriating again. ToDo: perhaps use an enum class.
 #undef ABSOLUTE
 #undef RELATIVE
 
+class RNG;
+
 namespace base {
 
 class Mesh;
 class Material;
 class DrawableMesh;
 class HardwareVertexBuffer;
+class FrameBuffer;
 class FoliageSystem;
 
 class FoliageMap {
@@ -27,6 +31,7 @@ class FoliageMap {
 	~FoliageMap();
 	void  setData(int w, int h, const unsigned char* data, int stride=1, bool copy=true);
 	float getValue(float x, float y) const; // Works on normalised 0-1 values
+	void  getValues(const vec2* points, size_t count, float* out) const;
 	protected:
 	int m_width;
 	int m_height;
@@ -72,6 +77,18 @@ class FoliageLayer : protected base::SceneNode {
 	void setClusterGap(const Rangef&);
 	void setClusterShape(int points, float scale);
 
+	void setBufferPoolSize(int size); // Maximum number of unused chunk buffers to keep for reuse
+
+	struct Stats {
+		int chunks;			// Chunks in range
+		int chunkHits;		// Chunks reused from free list
+		int bufferHits;		// Geometry buffers reused from pool
+		int bufferMisses;	// Geometry buffers created
+		int pooledBuffers;	// Unused buffers currently in pool
+	};
+	const Stats& getStats() const { return m_stats; }
+	void resetStats();
+
 
 	protected:
 	friend class FoliageSystem;
@@ -99,19 +116,76 @@ class FoliageLayer : protected base::SceneNode {
 	typedef Point Index;
 	typedef std::vector<Index> IndexList;
 	enum ChunkState { EMPTY, GENERATING, GENERATED, COMPLETE };
-	struct Geometry { base::Mesh* mesh = nullptr; base::HardwareVertexBuffer* instances = nullptr; size_t count = 0; };
-	struct Chunk { base::DrawableMesh* drawable = nullptr; Geometry geometry, swap; ChunkState state = EMPTY; bool active = false; };
-	std::map<Index, Chunk*> m_chunks;
+	struct LodData;
+	struct ItemIndex;
+	struct IndexHash { size_t operator()(const Index&) const; };
+	struct Geometry {
+		base::Mesh* mesh = nullptr;
+		base::HardwareVertexBuffer* instances = nullptr;
+		size_t count = 0;
+		size_t capacity = 0;	// Buffer capacity if pooled
+		ItemIndex* items = nullptr;	// Spatial index of generated items, if the layer tracks them
+	};
+	struct Chunk {
+		base::DrawableMesh* drawable = nullptr;
+		Geometry geometry, swap;
+		ChunkState state = EMPTY;
+		bool active = false;
+		bool cancelled = false;	// Left range. Deleted when no jobs reference it
+		int  jobs = 0;			// Queued or generating jobs for this chunk
+		LodData* lod = nullptr;	// Level of detail state for derived layers
+	};
+
+	/// Open addressed hash map of chunks in range
+	class ChunkMap {
+		public:
+		struct Slot { Index index; Chunk* chunk; };
+		struct iterator {
+			const Slot* slot; const Slot* end;
+			const Slot& operator*() const { return *slot; }
+			const Slot* operator->() const { return slot; }
+			iterator& operator++() { do ++slot; while(slot<end && !slot->chunk); return *this; }
+			bool operator!=(const iterator& o) const { return slot != o.slot; }
+		};
+		Chunk* find(const Index&) const;
+		void   insert(const Index&, Chunk*);
+		bool   erase(const Index&);
+		void   clear();
+		size_t size() const { return m_count; }
+		iterator begin() const;
+		iterator end() const;
+		private:
+		size_t slot(const Index&) const;
+		void   grow();
+		std::vector<Slot> m_slots;
+		size_t m_count = 0;
+	};
+	ChunkMap m_chunks;
+	std::vector<Chunk*> m_freeChunks;	// Recycled chunk objects
+	int m_cancelled = 0;		// Cancelled chunks waiting for jobs to finish
+
+	// Unused geometry kept for reuse. Buffer capacities are powers of two
+	mutable std::vector<Geometry> m_pool;
+	mutable base::Mutex m_poolMutex;	// Pool is used from generation threads
+	mutable Stats m_stats;
+	size_t m_poolSize = 16;
 
 	protected:
 	struct GenPoint { vec3 position, normal; };
 	typedef std::vector<GenPoint> PointList;
-	float getMapValue(const FoliageMap* map, const vec3& point) const;
+	int resolvePoints(const vec3* candidates, size_t count, const vec3& up, RNG& rng, PointList& out) const;
 	int generatePoints(const Index& index, int count, vec3* corners, const vec3& up, PointList& out) const;
 	int generatePoints(const Index& index, PointList& points, vec3& up) const;
 	virtual Geometry generateGeometry(const Point&) const = 0;
 	virtual void destroyGeometry(Geometry&) const {};
+	virtual void updateChunk(Chunk&, bool changed, const vec3& context) {}	// Called each update for completed chunks
+	virtual void releaseChunk(Chunk&) {}	// Called when a chunk is deleted
+	bool acquireGeometry(size_t count, Geometry& out) const;	// Get pooled geometry with capacity for count items. Sets capacity
+	void recycleGeometry(Geometry&) const;	// Return geometry to pool, or destroy it if pool is full
+	void clearPool();
 	void regenerateChunk(const Index&, Chunk&);
+	Chunk* createChunk();
+	void freeChunk(Chunk*);
 	bool deleteChunk(Chunk*);
 	void deleteMap(FoliageMap*&);
 	FoliageMap* referenceMap(FoliageMap*);
@@ -123,10 +197,23 @@ class FoliageInstanceLayer : public FoliageLayer {
 	public:
 	enum OrientaionMode { VERTICAL, NORMAL, ABSOLUTE, RELATIVE };
 	FoliageInstanceLayer(float chunkSize, float range);
+	~FoliageInstanceLayer();
 	void setMesh(base::Mesh*);
 	void setAlignment(OrientaionMode mode, const Rangef& range=0);
 
-	// Allow removing individual items - chopping down trees etc
+	/** Level of detail bands. Each band is drawn with its own instance list per chunk.
+	 * Band drawables set the custom shader variable to (start, end, fade, band) so materials
+	 * can cross-fade instances within fade/2 of the band edges, such as with dithered discard. */
+	void addLod(base::Mesh* mesh, float distance, base::Material* material=nullptr); // Use mesh beyond distance
+	void setImpostor(base::Material* material, float distance, const vec2& size);   // Camera facing quads beyond distance
+	void setLodFade(float range);
+	/// Render views of a mesh around the vertical axis into an atlas for impostor materials
+	static base::FrameBuffer* createImpostorAtlas(base::Mesh* mesh, base::Material* material, int views, int resolution);
+
+	/** Allow removing individual items - chopping down trees etc.
+	 * Item indices are the generation order within a cell, so they stay valid across regeneration.
+	 * getItems returns items within radius of point in layer space. Unloaded cells are regenerated
+	 * without building geometry when includeUnloaded is set. */
 	const std::vector<FoliageItemRef> getItems(const vec3& point, float radius, bool includeUnloaded) const;
 	void removeItems(const Point& cell, const std::vector<uint16>& indices);
 	void removeItem(const FoliageItemRef& item);
@@ -134,12 +221,29 @@ class FoliageInstanceLayer : public FoliageLayer {
 	protected:
 	virtual Geometry generateGeometry(const Index& page) const override;
 	virtual void destroyGeometry(Geometry&) const override;
+	virtual void updateChunk(Chunk&, bool changed, const vec3& context) override;
+	virtual void releaseChunk(Chunk&) override;
+	void buildBands(Chunk&, const vec3& context);
+	void removeInstances(Chunk&, const uint16* items, size_t count);
+	void applyRemoved(Chunk&);
+	void getRemoved(const Index&, std::vector<uint32>& out) const;
 	protected:
+	struct LodBand {
+		base::Mesh*     mesh;
+		base::Material* material;
+		float           distance;
+		float           custom[4];	// Shader data: start, end, fade, band
+	};
+	std::vector<LodBand> m_lods;	// Sorted by distance. Band 0 uses m_mesh
+	float       m_lodFade = 0;
+	int         m_lodVersion = 0;	// Changes when bands are modified
+	base::Mesh* m_impostorMesh = nullptr;
 	base::Mesh* m_mesh;
 	Rangef              m_alignRange; // RELATIVE: lerp range between normal and up vector, ABSOLUTE: lerp between sideways and up.
 	OrientaionMode      m_alignMode;
 
-	std::map<Index, std::vector<uint16>> m_removedItems; // vector should be sorted
+	std::unordered_map<Index, std::vector<uint32>, IndexHash> m_removedItems; // Bitset of removed items per cell
+	mutable base::Mutex m_removedMutex;	// Removed items are read by generation threads
 };
 
 // -------------------------------------------------------------------------------------- //
@@ -168,6 +272,7 @@ class FoliageSystem : public base::SceneNode {
 public:
 	friend class FoliageLayer;
 	friend class FoliageInstanceLayer;
+	friend class GrassLayer;
 	typedef FoliageLayer::Index Index;
 	typedef FoliageLayer::IndexList IndexList;
 
@@ -190,27 +295,44 @@ protected:
 	virtual void resolvePosition(const vec3& point, vec3& position, float& height) const = 0;
 	/// Resolve the normal and slope of a generated point
 	virtual void resolveNormal(const vec3& point, vec3& normal) const = 0;
-	/// Get a value from a texture map
-	virtual float getMapValue(const FoliageMap* map, const BoundingBox2D& bounds, const vec3& position) const;
+	/// Get a value from a texture map. Not virtual: override getMapValues to change how maps are sampled
+	float getMapValue(const FoliageMap* map, const BoundingBox2D& bounds, const vec3& position) const;
+	/// Batched versions of the above used for chunk generation. Default resolve functions call the per point versions.
+	virtual void resolvePositions(const vec3* points, size_t count, vec3* positions, float* heights) const;
+	virtual void resolveNormals(const vec3* points, size_t count, vec3* normals) const;
+	virtual void getMapValues(const FoliageMap* map, const BoundingBox2D& bounds, const vec3* positions, size_t count, float* out) const;
 	/// Random seed for chunk
 	virtual unsigned getSeed(const Index&, float size) const;
 
 private:
+	struct GenChunk;
 	void queueChunk(FoliageLayer*, const FoliageLayer::Index&, FoliageLayer::Chunk*);
 	bool cancelChunk(FoliageLayer::Chunk*);
+	void prioritise(const vec3& context);	// Sort queue by distance and drop cancelled chunks
+	void processCompleted();				// Hand finished geometry to chunks
+	void releaseJob(GenChunk*);
 
 protected:
 	std::vector<FoliageLayer*> m_layers;
 	
 	
 private:
-	base::Thread* m_threads;
-	base::Mutex   m_mutex;
+	base::Thread*   m_threads;
+	base::Mutex     m_mutex;		// Protects m_queue only
+	base::Condition m_condition;	// Signalled when jobs are queued
 	int     m_threadCount;
 	bool    m_running;
-	bool    m_sorted = false;
-	struct GenChunk { FoliageLayer* layer; FoliageLayer::Index index; FoliageLayer::Chunk* chunk; vec3 centre; };
-	std::vector<GenChunk> m_queue;
+	struct GenChunk {
+		FoliageLayer* layer;
+		FoliageLayer::Index index;
+		FoliageLayer::Chunk* chunk;
+		vec3 centre;
+		float priority;
+		FoliageLayer::Geometry geometry;
+		GenChunk* next;
+	};
+	std::vector<GenChunk*> m_queue;			// Sorted with nearest chunk at the back
+	std::atomic<GenChunk*> m_completed;		// Lock free list of finished jobs
 	void threadFunc(int index);
 };
 
@@ -12,6 +12,8 @@ class TerrainFoliage : public FoliageSystem {
 	TerrainFoliage(TerrainDrawable* zone, int threads);
 	void resolvePosition(const vec3& point, vec3& position, float& height) const override;
 	void resolveNormal(const vec3& point, vec3& normal) const override;
+	void resolvePositions(const vec3* points, size_t count, vec3* positions, float* heights) const override;
+	void resolveNormals(const vec3* points, size_t count, vec3* normals) const override;
 	int getActive(const vec3& p, float cs, float range, IndexList& out) const override;
 	private:
 	TerrainDrawable* m_terrain;
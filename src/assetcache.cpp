@@ -0,0 +1,157 @@
+#include <base/assetcache.h>
+#include <base/directory.h>
+#include <cstring>
+#include <cstdio>
+#include <atomic>
+
+#ifdef WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+using namespace base;
+
+struct AssetCache::Header {
+	char magic[4];
+	unsigned version;
+	unsigned long long sourceSize;
+	long long          sourceTime;
+	unsigned long long sourceHash;
+	unsigned long long dataSize;
+};
+
+AssetCache::AssetCache(const char* directory) : m_directory(directory) {
+	Directory::create(directory);
+}
+
+unsigned long long AssetCache::hash(const void* data, size_t size, unsigned long long seed) {
+	const unsigned char* c = (const unsigned char*)data;
+	const unsigned char* end = c + size;
+	unsigned long long h = seed;
+	while(c < end) {
+		h ^= *c++;
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+unsigned long long AssetCache::hashString(const char* string, unsigned long long seed) {
+	return string? hash(string, strlen(string), seed): seed;
+}
+
+void AssetCache::count(unsigned Stats::*stat) {
+	MutexLock lock(m_mutex);
+	++(m_stats.*stat);
+}
+
+String AssetCache::getEntryPath(const char* type, unsigned long long key) const {
+	return String::format("%s/%s-%016llx.cache", m_directory.str(), type, key);
+}
+
+File AssetCache::readEntry(const String& path, Header& header) const {
+	FILE* fp = fopen(path, "rb");
+	if(!fp) return File();
+	char* data = nullptr;
+	if(fread(&header, sizeof(Header), 1, fp) == 1 && memcmp(header.magic, "BAC1", 4) == 0) {
+		data = new char[header.dataSize + 1];
+		if(fread(data, 1, header.dataSize, fp) == header.dataSize) data[header.dataSize] = 0;
+		else delete [] data, data = nullptr;
+	}
+	fclose(fp);
+	if(!data) return File();
+	return File(path, data, header.dataSize);
+}
+
+bool AssetCache::writeEntry(const String& path, const Header& header, const void* data, size_t size) {
+	// Write to a temporary file first so an interrupted write can't leave a corrupt entry.
+	// Name is unique to this process and call, as other threads or processes may write the same key.
+	static std::atomic<unsigned> counter(0);
+	String temp = String::format("%s.%d-%u.tmp", path.str(), (int)getpid(), counter++);
+	FILE* fp = fopen(temp, "wb");
+	if(!fp) return false;
+	bool good = fwrite(&header, sizeof(Header), 1, fp) == 1;
+	good &= fwrite(data, 1, size, fp) == size;
+	fclose(fp);
+	remove(path);
+	if(!good || rename(temp, path) != 0) {
+		remove(temp);
+		return false;
+	}
+	count(&Stats::writes);
+	return true;
+}
+
+// ----------------------------------------------------------------------------- //
+
+File AssetCache::get(const char* type, const VirtualFileSystem::File& source, unsigned version) {
+	if(!source) return File();
+	String path = getEntryPath(type, hashString(source.getFullPath()));
+	Header header;
+	File data = readEntry(path, header);
+	size_t size;
+	long long modified;
+	if(!data || header.version != version || !source.getFileInfo(size, modified)) {
+		count(&Stats::misses);
+		return File();
+	}
+
+	// Cheap check first
+	if(header.sourceSize == size && header.sourceTime == modified) {
+		count(&Stats::hits);
+		return data;
+	}
+
+	// File has been touched. Contents may still be the same.
+	if(source.inArchive() || header.sourceSize == size) {
+		File src = source.read();
+		if(src && hash(src.data(), src.size()) == header.sourceHash) {
+			header.sourceSize = size;
+			header.sourceTime = modified;
+			writeEntry(path, header, data.data(), data.size());
+			count(&Stats::hits);
+			return data;
+		}
+	}
+
+	remove(path);
+	count(&Stats::stale);
+	return File();
+}
+
+bool AssetCache::put(const char* type, const VirtualFileSystem::File& source, unsigned version, const void* data, size_t size) {
+	Header header = { {'B','A','C','1'}, version, 0, 0, 0, size };
+	size_t sourceSize;
+	if(!source || !source.getFileInfo(sourceSize, header.sourceTime)) return false;
+	File src = source.read();
+	if(!src) return false;
+	header.sourceSize = sourceSize;
+	header.sourceHash = hash(src.data(), src.size());
+	return writeEntry(getEntryPath(type, hashString(source.getFullPath())), header, data, size);
+}
+
+File AssetCache::get(const char* type, unsigned long long key, unsigned version) {
+	Header header;
+	File data = readEntry(getEntryPath(type, key), header);
+	if(data && header.version == version && header.sourceHash == key) {
+		count(&Stats::hits);
+		return data;
+	}
+	count(&Stats::misses);
+	return File();
+}
+
+bool AssetCache::put(const char* type, unsigned long long key, unsigned version, const void* data, size_t size) {
+	Header header = { {'B','A','C','1'}, version, 0, 0, key, size };
+	return writeEntry(getEntryPath(type, key), header, data, size);
+}
+
+void AssetCache::clear() {
+	Directory dir(m_directory);
+	for(const Directory::File& f: dir) {
+		if(f.type == Directory::FILE && strstr(f.name, ".cache")) {
+			remove(String::cat(m_directory, "/", f.name));
+		}
+	}
+}
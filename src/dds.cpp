@@ -1,4 +1,5 @@
 #include <base/dds.h>
+#include <base/png.h>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
@@ -310,14 +311,14 @@ bool DDS::save(const Image& image, const char* filename) {
 	header.caps1 = DDS_TEXTURE;
 	if(image.getMode() == Image::CUBE) {
 		header.caps1 |= DDS_COMPLEX;
-		header.caps2 = DDS_VOLUME;
+		header.caps2 = DDS_CUBEMAP | DDS_CUBAMEP_ALL;
 	}
 	if(image.getMips() > 1) {
 		header.caps1 |= DDS_COMPLEX | DDS_MIPMAP;
 	}
 
 	// Open File
-	FILE* fp = fopen(filename, "rb");
+	FILE* fp = fopen(filename, "wb");
 	if(!fp) return false;
 
 	// Write header
@@ -343,6 +344,15 @@ bool DDS::save(const Image& image, const char* filename) {
 	return true;
 }
 
+bool DDS::convert(const char* source, const char* target, Image::Format format, Image::MipFilter filter, bool srgb, bool highQuality) {
+	Image image = PNG::load(source);
+	if(!image) return false;
+	if(!image.generateMips(filter, srgb)) return false;
+	if(Image::isCompressed(format)) image = image.compress(format, highQuality);
+	else if(format != image.getFormat()) image = image.convert(format);
+	return save(image, target);
+}
+
 /*
 
 void DDS::flip() {
@@ -29,6 +29,7 @@ NodeEditor::~NodeEditor() {
 
 void NodeEditor::onMouseMove(const Point& last, const Point& pos, int b) {
 	Widget::onMouseMove(last, pos, b);
+	invalidate();
 	if((b&m_mousePanButtonMask) && hasFocus()) {
 		m_boxStart = m_boxEnd = Point();
 		Point move = pos - last;
@@ -60,6 +61,7 @@ void NodeEditor::onMouseMove(const Point& last, const Point& pos, int b) {
 }
 void NodeEditor::onMouseButton(const Point& pos, int d, int u) {
 	Widget::onMouseButton(pos, d, u);
+	invalidate();
 	if(d==4 && m_overLink) unlink(const_cast<Link*>(m_overLink));
 	if(d==1) m_boxStart = m_boxEnd = pos;
 	if(u&1) {
@@ -145,6 +147,7 @@ void NodeEditor::drawCurve(const Point* control, unsigned colour, float width, i
 void NodeEditor::draw() const {
 	if(m_rect.width<=0 || m_rect.height<=0 || !isVisible()) return;
 	if(m_skin) m_root->getRenderer()->drawSkin(m_skin, m_rect, m_colour, getState(), 0);
+	if(m_dragLink) invalidate();	// Link follows the mouse
 	
 	getRoot()->getRenderer()->setTransform(m_derivedTransform);
 
@@ -264,6 +267,7 @@ bool NodeEditor::link(Node* nodeA, int out, Node* nodeB, int in) {
 	Link* link = new Link{ nodeA, nodeB, from->index, to->index, from->type }; 
 	nodeA->m_links.push_back(link);
 	nodeB->m_links.push_back(link);
+	invalidate();
 	return true;
 }
 
@@ -289,6 +293,7 @@ void NodeEditor::unlink(Link* link) {
 	};
 	erase(link->a->m_links, link);
 	erase(link->b->m_links, link);
+	invalidate();
 	if(eventUnlinked) eventUnlinked(*link);
 	delete link;
 }
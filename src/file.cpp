@@ -28,9 +28,10 @@ File& File::operator=(File&& f) noexcept {
 	free(m_name);
 	m_file = f.m_file;
 	m_data = f.m_data;
-	m_file = f.m_file;
+	m_name = f.m_name;
 	m_size = f.m_size;
-	f.m_file = 0;
+	m_mode = f.m_mode;
+	f.m_name = 0;
 	f.m_data = 0;
 	f.m_file = 0;
 	return *this;
@@ -1,9 +1,99 @@
 #include <base/gui/font.h>
 #include <base/opengl.h>
+#include <base/texture.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
 #include <cmath>
 
 using namespace gui;
 
+// Dynamic glyph atlas. Pages are stacked vertically in the font texture and split into shelves of one glyph height.
+// The texture is allocated for all pages up front so texture coordinates never change as pages are added.
+struct Font::GlyphAtlas {
+	struct Shelf { int y, height, x; };
+	struct Page {
+		std::vector<Shelf> shelves;
+		int      next;	// Top of unused space
+		unsigned used;	// Frame last used
+	};
+	base::Texture texture;
+	std::vector<Page> pages;
+	std::vector<unsigned char> alpha;	// Coverage of all pages
+	std::vector<unsigned char> glyph;	// Scratch buffer for rendering
+	std::vector<Rect> dirty;			// Regions waiting for upload
+	int width = 1024;
+	int pageHeight = 256;
+	int maxPages = 4;					// 4MB texture at the default size
+	unsigned frame = 1;
+	unsigned full = 0;					// Frame in which every page was in use
+	int glyphs = 0, evictions = 0, uploads = 0;
+
+	int  getPage(const Rect& r) const { return r.y / pageHeight; }
+	void touch(unsigned mask) { for(int i=0; mask; ++i, mask>>=1) if(mask&1) pages[i].used = frame; }
+	void addPage() {
+		markDirty(Rect(0, pages.size() * pageHeight, width, pageHeight));	// Texture starts undefined
+		pages.push_back({{}, (int)pages.size() * pageHeight, frame});
+		alpha.resize(width * pageHeight * pages.size(), 0);
+	}
+	// Least recently used page, or -1 if all pages are in use this frame
+	int getOldestPage() const {
+		int oldest = -1;
+		for(size_t i=0; i<pages.size(); ++i) {
+			if(pages[i].used != frame && (oldest < 0 || (int)(pages[oldest].used - pages[i].used) > 0)) oldest = i;
+		}
+		return oldest;
+	}
+	// Find space for a glyph, leaving a pixel gap for filtering. Adds pages up to the limit.
+	bool allocate(int w, int h, Rect& out) {
+		if(w + 1 > width || h + 1 > pageHeight) return false;
+		for(Page& page: pages) {
+			for(Shelf& shelf: page.shelves) {
+				if(shelf.height == h && shelf.x + w + 1 <= width) {
+					out.set(shelf.x, shelf.y, w, h);
+					shelf.x += w + 1;
+					page.used = frame;
+					return true;
+				}
+			}
+		}
+		for(size_t i=0; i<=pages.size(); ++i) {
+			if(i == pages.size()) {
+				if((int)pages.size() >= maxPages) return false;
+				addPage();
+			}
+			Page& page = pages[i];
+			if(page.next + h + 1 <= (int)(i+1) * pageHeight) {
+				page.shelves.push_back({page.next, h, w + 1});
+				out.set(0, page.next, w, h);
+				page.next += h + 1;
+				page.used = frame;
+				return true;
+			}
+		}
+		return false;
+	}
+	void markDirty(const Rect& r) {
+		if(!dirty.empty() && dirty.back().y == r.y && dirty.back().height == r.height && dirty.back().right() + 1 == r.x) {
+			dirty.back().width = r.right() - dirty.back().x;	// Glyphs on the same shelf are sent together
+		}
+		else dirty.push_back(r);
+	}
+	void upload(const Rect& r) {
+		std::vector<unsigned> rgba(r.width * r.height);
+		for(int y=0; y<r.height; ++y) {
+			const unsigned char* src = &alpha[r.x + (r.y + y) * width];
+			unsigned* dst = &rgba[y * r.width];
+			for(int x=0; x<r.width; ++x) dst[x] = 0xffffff | src[x] << 24;
+		}
+		texture.setPixels(r.x, r.y, r.width, r.height, base::Texture::RGBA8, rgba.data());
+		++uploads;
+	}
+};
+
+// Incremented when glyph texture coordinates of any font move
+static unsigned atlasVersion = 1;
+
 Font::Font() {}
 Font::Font(const char* source, int size) {
 	SystemFont src(source);
@@ -12,6 +102,14 @@ Font::Font(const char* source, int size) {
 }
 
 Font::~Font() {
+	for(Face& face: m_faces) delete face.source;
+	if(m_atlas) m_atlas->texture.destroy();
+	delete m_atlas;
+}
+
+Font::Face::Face(int size, int height) : size(size), height(height) {
+	glyphs.push_back(Rect(0,0,0,0));
+	memset(latin, 0, sizeof(latin));
 }
 
 int Font::getFontSize(int closest) const {
@@ -23,6 +121,7 @@ Point Font::getSize(const char* string, int size, int len) const {
 	Point result;
 	if(!string || !string[0]) return result;
 	if(const Face* face = selectFace(size)) {
+		if(const Layout* layout = getLayout(*face, string, len, size)) return layout->extent;
 		float scale = (float)size / (float)face->size;
 		result.y = face->height * scale;
 		int line = 0;
@@ -71,14 +170,262 @@ const Font::Face* Font::selectFace(int size) const {
 }
 
 const Rect& Font::getGlyph(const Face& face, unsigned code) const {
-	for(const GlyphRange& range: face.groups) {
-		if(code < range.start) break;
-		if(code < range.start + range.glyphs.size()) return range.glyphs[code - range.start];
+	unsigned index = 0;
+	if(code < 256) index = face.latin[code];
+	else {
+		auto it = face.other.find(code);
+		if(it != face.other.end()) index = it->second;
+	}
+	if(face.source) return renderGlyph(face, code, index);
+	return face.glyphs[index];
+}
+
+const Rect& Font::renderGlyph(const Face& face, unsigned code, unsigned index) const {
+	GlyphAtlas& atlas = *m_atlas;
+	if(index) {
+		const Rect& r = face.glyphs[index];
+		if(r.height > 0) atlas.pages[atlas.getPage(r)].used = atlas.frame;
+		if(r.height >= 0) return r;	// Evicted glyphs have negative height
+	}
+
+	// Dynamic faces are filled in as glyphs are used
+	Font& font = const_cast<Font&>(*this);
+	Face& f = const_cast<Face&>(face);
+	if(!index) index = addGlyph(f, code);
+	if(atlas.full == atlas.frame) {
+		f.glyphs[index].set(0,0,0,-1);
+		return f.glyphs[index];
+	}
+	Rect rect(0,0,0,0);
+	int width = 0;
+	atlas.glyph.clear();
+	if(f.source->render(code, width, atlas.glyph) && width > 0 && atlas.glyph.size() >= (size_t)(width * f.height)) {
+		if(!atlas.allocate(width, f.height, rect)) {
+			// Pages used this frame are kept, as their glyphs may already be in this frame's vertices
+			int page = atlas.getOldestPage();
+			if(page < 0) {
+				atlas.full = atlas.frame;
+				rect.set(0,0,0,-1);	// Try again next frame
+			}
+			else if(font.evictPage(page), !atlas.allocate(width, f.height, rect)) {
+				printf("Error: Glyph %u does not fit in font atlas\n", code);
+				rect.set(0,0,0,0);
+			}
+		}
+		if(rect.width) {
+			for(int y=0; y<rect.height; ++y) {
+				memcpy(&atlas.alpha[rect.x + (rect.y + y) * atlas.width], &atlas.glyph[y * width], width);
+			}
+			atlas.markDirty(rect);
+			++atlas.glyphs;
+		}
+	}
+	f.glyphs[index] = rect;
+	return f.glyphs[index];
+}
+
+void Font::evictPage(int index) {
+	GlyphAtlas::Page& page = m_atlas->pages[index];
+	int top = index * m_atlas->pageHeight;
+	int bottom = top + m_atlas->pageHeight;
+	page.shelves.clear();
+	page.next = top;
+	memset(&m_atlas->alpha[top * m_atlas->width], 0, m_atlas->pageHeight * m_atlas->width);
+	m_atlas->markDirty(Rect(0, top, m_atlas->width, m_atlas->pageHeight));
+	for(Face& face: m_faces) {
+		if(!face.source) continue;
+		for(size_t i=1; i<face.glyphs.size(); ++i) {
+			Rect& r = face.glyphs[i];
+			if(r.height > 0 && r.y >= top && r.y < bottom) r.height = -1;
+		}
+	}
+	++m_atlas->evictions;
+	++atlasVersion;
+	clearCache();
+}
+
+unsigned Font::addGlyph(Face& face, unsigned code) {
+	unsigned& index = code<256? face.latin[code]: face.other[code];
+	if(index == 0) {
+		index = face.glyphs.size();
+		face.glyphs.push_back(Rect(0,0,0,0));
+	}
+	return index;
+}
+
+// ====================================================================================== //
+
+// Strings longer than this are not cached. They are usually large text boxes that change often
+static const int maxCachedLength = 256;
+
+void Font::setCacheCapacity(int entries) {
+	m_capacity = entries>0? entries: 0;
+	if(m_capacity == 0) clearCache();
+	else if((int)m_layouts.size() > m_capacity) {
+		while((int)m_layouts.size() > m_capacity) evictLayouts();
+		rebuildLayoutTable();
+	}
+}
+
+void Font::clearCache() {
+	m_layouts.clear();
+	m_layoutTable.clear();
+	m_stats.entries = 0;
+}
+
+void Font::resetCacheStats() {
+	m_stats.lookups = m_stats.hits = 0;
+	m_stats.entries = m_layouts.size();
+}
+
+void Font::rebuildLayoutTable() const {
+	size_t size = 16;
+	while(size < m_layouts.size() * 2 || size < (size_t)m_capacity) size *= 2;
+	m_layoutTable.assign(size, -1);
+	const size_t mask = size - 1;
+	for(size_t e=0; e<m_layouts.size(); ++e) {
+		size_t i = m_layouts[e].hash & mask;
+		while(m_layoutTable[i] >= 0) i = (i+1) & mask;
+		m_layoutTable[i] = e;
 	}
-	static const Rect nope;
-	return nope;
 }
 
+void Font::evictLayouts() const {
+	// Drop the least recently used quarter
+	std::sort(m_layouts.begin(), m_layouts.end(), [](const Layout& a, const Layout& b) { return (int)(a.used - b.used) > 0; });
+	m_layouts.resize(m_layouts.size() - m_layouts.size() / 4 - 1);
+}
+
+const Font::Layout* Font::getLayout(const Face& face, const char* string, int len, float size) const {
+	if(m_capacity == 0) return nullptr;
+	// Find byte length and hash. Length limit is in characters.
+	const char* end = string;
+	if(len<0) len = 1<<24;
+	while(*end && len) {
+		--len;
+		readUTF8Character(end);
+		if(end - string > maxCachedLength) return nullptr;
+	}
+	int length = end - string;
+	unsigned hash = 2166136261u;
+	for(const char* c=string; c<end; ++c) hash = (hash ^ (unsigned char)*c) * 16777619u;
+	hash = (hash ^ (unsigned)(size * 64)) * 16777619u;
+	hash ^= hash >> 16;
+
+	++m_stats.lookups;
+	++m_counter;
+	if(!m_layoutTable.empty()) {
+		const size_t mask = m_layoutTable.size() - 1;
+		for(size_t i = hash & mask; m_layoutTable[i] >= 0; i = (i+1) & mask) {
+			Layout& l = m_layouts[ m_layoutTable[i] ];
+			if(l.hash == hash && l.length == length && l.size == size && (length == 0 || memcmp(l.text.data(), string, length) == 0)) {
+				l.used = m_counter;
+				++m_stats.hits;
+				if(m_atlas) m_atlas->touch(l.pages);
+				return &l;
+			}
+		}
+	}
+
+	// Create new layout. Rendering glyphs can evict atlas pages, which clears the cache.
+	Layout layout;
+	layout.hash = hash;
+	layout.length = length;
+	layout.size = size;
+	layout.used = m_counter;
+	layout.text.assign(string, end);
+	if(!buildLayout(layout, face, string, end, size)) return nullptr;	// Atlas full this frame
+	if((int)m_layouts.size() >= m_capacity) {
+		evictLayouts();
+		rebuildLayoutTable();
+	}
+	m_layouts.push_back(std::move(layout));
+	if(m_layoutTable.size() < m_layouts.size() * 2) rebuildLayoutTable();
+	else {
+		const size_t mask = m_layoutTable.size() - 1;
+		size_t i = hash & mask;
+		while(m_layoutTable[i] >= 0) i = (i+1) & mask;
+		m_layoutTable[i] = m_layouts.size() - 1;
+	}
+	m_stats.entries = m_layouts.size();
+	return &m_layouts.back();
+}
+
+bool Font::buildLayout(Layout& out, const Face& face, const char* string, const char* end, float size) const {
+	bool complete = true;
+	float scale = size / face.size;
+	int lineHeight = face.height * scale;
+	Point pen;
+	out.glyphs.clear();
+	out.lines.clear();
+	out.pages = 0;
+	out.extent.set(0, lineHeight);
+	while(string < end) {
+		unsigned code = readUTF8Character(string);
+		if(code == '\n') {
+			if(out.extent.x < pen.x) out.extent.x = pen.x;
+			pen.x = 0;
+			pen.y += face.height * scale;
+			out.extent.y += lineHeight;
+			out.lines.push_back({(unsigned)out.glyphs.size(), pen.y});
+		}
+		else {
+			const Rect& src = getGlyph(face, code);
+			if(src.width) {
+				Rect dst(pen.x, pen.y, src.width * scale, src.height * scale);
+				out.glyphs.push_back({dst, src});
+				if(face.source) out.pages |= 1u << m_atlas->getPage(src);
+				pen.x += dst.width;
+			}
+			else if(src.height < 0) complete = false;
+		}
+	}
+	if(out.extent.x < pen.x) out.extent.x = pen.x;
+	out.end = pen;
+	return complete;
+}
+
+
+// ====================================================================================== //
+
+void Font::setAtlasSize(int width, int pageHeight, int maxPages) {
+	if(isDynamic()) {
+		printf("Error: Font atlas size must be set before adding dynamic faces\n");
+		return;
+	}
+	if(!m_atlas) m_atlas = new GlyphAtlas();
+	m_atlas->width = width>16? width: 16;
+	m_atlas->pageHeight = pageHeight>16? pageHeight: 16;
+	m_atlas->maxPages = std::max(1, std::min(maxPages, 32));	// Layouts track pages in a bitmask
+}
+
+bool Font::isDynamic() const {
+	return m_atlas && !m_atlas->pages.empty();
+}
+
+void Font::uploadGlyphs() const {
+	if(!isDynamic()) return;
+	GlyphAtlas& atlas = *m_atlas;
+	for(const Rect& r: atlas.dirty) atlas.upload(r);
+	atlas.dirty.clear();
+	++atlas.frame;
+}
+
+Font::AtlasStats Font::getAtlasStats() const {
+	AtlasStats stats = { 0, 0, 0, 0, 0 };
+	if(m_atlas) {
+		stats.pages = m_atlas->pages.size();
+		stats.glyphs = m_atlas->glyphs;
+		stats.evictions = m_atlas->evictions;
+		stats.uploads = m_atlas->uploads;
+		stats.memory = m_atlas->width * m_atlas->pageHeight * m_atlas->maxPages * 4;
+	}
+	return stats;
+}
+
+unsigned Font::getAtlasVersion() {
+	return atlasVersion;
+}
 
 
 // ====================================================================================== //
@@ -95,8 +442,9 @@ void FontLoader::addRange(int start, int end) {
 }
 
 void FontLoader::createFace(int size, int height) {
-	m_font->m_faces.push_back({size, height});
+	m_font->m_faces.emplace_back(size, height);
 	m_face = &m_font->m_faces.back();
+	m_font->clearCache();
 }
 
 Point FontLoader::selectImageSize(int size, int count) const {
@@ -113,6 +461,10 @@ Point FontLoader::selectImageSize(int size, int count) const {
 }
 
 void FontLoader::addImage(int w, int h, const unsigned char* pixels) {
+	if(m_font->isDynamic()) {
+		printf("Error: Font with dynamic faces cannot add static glyph images\n");
+		return;
+	}
 	if(m_font->m_texture==0) {
 		glGenTextures(1, &m_font->m_texture);
 		glBindTexture(GL_TEXTURE_2D, m_font->m_texture);
@@ -136,12 +488,12 @@ void FontLoader::addImage(int w, int h, const unsigned char* pixels) {
 		m_font->m_textureSize = ns;
 		
 		// Shift glyphs
-		for(Font::GlyphRange& range: m_face->groups) {
-			for(Rect& r: range.glyphs) {
-				r.y += size.y;
-			}
+		for(size_t i=1; i<m_face->glyphs.size(); ++i) {
+			m_face->glyphs[i].y += size.y;
 		}
 	}
+	m_font->clearCache();
+	++atlasVersion;
 }
 
 int FontLoader::countGlyphs() const {
@@ -152,19 +504,38 @@ int FontLoader::countGlyphs() const {
 
 void FontLoader::allocateGlyphs() {
 	for(const Range& r: m_glyphs) {
-		m_face->groups.push_back({(unsigned)r.start});
-		m_face->groups.back().glyphs.resize(r.end - r.start + 1, Rect()); 
+		for(int code=r.start; code<=r.end; ++code) Font::addGlyph(*m_face, code);
 	}
 }
 
 bool FontLoader::setGlyph(unsigned code, const Rect& r) {
-	for(Font::GlyphRange& range: m_face->groups) {
-		if(code < range.start) break;
-		if(code < range.start + range.glyphs.size()) {
-			range.glyphs[code - range.start] = r;
-			return true;
-		}
+	unsigned index = 0;
+	if(code < 256) index = m_face->latin[code];
+	else {
+		auto it = m_face->other.find(code);
+		if(it != m_face->other.end()) index = it->second;
 	}
-	return false;
+	if(index == 0) return false;
+	m_face->glyphs[index] = r;
+	m_font->clearCache();
+	return true;
 }
 
+bool FontLoader::createDynamicFace(int size, int height, GlyphSource* source) {
+	if(m_font->m_texture && !m_font->isDynamic()) {
+		printf("Error: Font already has static faces, glyphs will not be rendered on demand\n");
+		return false;
+	}
+	if(!m_font->m_atlas) m_font->m_atlas = new Font::GlyphAtlas();
+	Font::GlyphAtlas& atlas = *m_font->m_atlas;
+	if(atlas.pages.empty()) {
+		const int height = atlas.pageHeight * atlas.maxPages;
+		atlas.addPage();
+		atlas.texture.setData(base::Texture::TEX2D, atlas.width, height, 1, base::Texture::RGBA8, nullptr, 1);
+		m_font->m_texture = atlas.texture.unit();
+		m_font->m_textureSize.set(atlas.width, height);
+	}
+	createFace(size, height);
+	m_face->source = source;
+	return true;
+}
@@ -13,8 +13,44 @@ gui::FreeTypeFont::FreeTypeFont(const char* file) {
 #include FT_FREETYPE_H
 #include FT_TRUETYPE_TABLES_H
 
+namespace gui {
+/** Renders glyphs from an open FreeType face. Owns the library and face */
+class FreeTypeGlyphSource : public GlyphSource {
+	public:
+	FreeTypeGlyphSource(FT_Library library, FT_Face face, int ascent, int height) : m_library(library), m_face(face), m_ascent(ascent), m_height(height) {}
+	~FreeTypeGlyphSource() {
+		FT_Done_Face(m_face);
+		FT_Done_FreeType(m_library);
+	}
+	bool render(unsigned code, int& width, std::vector<unsigned char>& alpha) override {
+		FT_UInt index = FT_Get_Char_Index(m_face, code);
+		if(FT_Load_Glyph(m_face, index, FT_LOAD_DEFAULT | FT_LOAD_RENDER)) return false;
+		const FT_Bitmap& bitmap = m_face->glyph->bitmap;
+		if(bitmap.buffer) width = bitmap.width;
+		else if(m_face->glyph->metrics.horiAdvance > 0) width = m_face->glyph->metrics.horiAdvance >> 6; // Space has no bitmap data
+		else width = 0;
+
+		// Copy out glyph pixels into a cell one line high
+		alpha.assign(width * m_height, 0);
+		if(bitmap.buffer) {
+			int top = m_ascent - m_face->glyph->bitmap_top;
+			for(int y=0; y<(int)bitmap.rows; ++y) {
+				if(y + top < 0 || y + top >= m_height) continue;
+				memcpy(&alpha[(y + top) * width], bitmap.buffer + y * bitmap.pitch, width);
+			}
+		}
+		return true;
+	}
+	private:
+	FT_Library m_library;
+	FT_Face    m_face;
+	int        m_ascent;
+	int        m_height;
+};
+}
+
 bool gui::FreeTypeFont::build(int size) {
-	if(m_glyphs.empty()) return false;
+	if(m_glyphs.empty() && !m_dynamic) return false;
 
 	FT_Library  library;
 	FT_Face     face;
@@ -24,81 +60,75 @@ bool gui::FreeTypeFont::build(int size) {
 	if(error) { printf("Error initilising freetype\n"); return false; }
 
 	error = FT_New_Face(library, m_file, 0, &face); // Note: 0 is the face index, a file can contain multiple faces
-	if(error) printf("Error: Failed to load font %s\n", m_file);
-	else {
-		// Set font size
-		if(face->face_flags & FT_FACE_FLAG_SCALABLE) {
-			FT_F26Dot6 ftSize = (FT_F26Dot6)(size*0.75) << 6;
-			FT_Set_Char_Size(face, ftSize, 0, 100, 100);
-		}
-		else printf("Error: Font %s not scalable\n", m_file);
-
-		int ascent = face->size->metrics.ascender >> 6;
-		int descent = face->size->metrics.descender >> 6;
-		if(TT_OS2* os2 = (TT_OS2*)FT_Get_Sfnt_Table(face, ft_sfnt_os2)) {
-			auto max = [](int& v, int n) { if(n>v) v=n; };
-			max(ascent,  os2->usWinAscent * face->size->metrics.y_ppem / face->units_per_EM);
-			max(descent, os2->usWinDescent * face->size->metrics.y_ppem / face->units_per_EM);
-			max(ascent,  os2->sTypoAscender * face->size->metrics.y_ppem / face->units_per_EM);
-			max(descent, -os2->sTypoDescender * face->size->metrics.y_ppem / face->units_per_EM);
-		}
+	if(error) {
+		printf("Error: Failed to load font %s\n", m_file);
+		FT_Done_FreeType(library);
+		return false;
+	}
+
+	// Set font size
+	if(face->face_flags & FT_FACE_FLAG_SCALABLE) {
+		FT_F26Dot6 ftSize = (FT_F26Dot6)(size*0.75) << 6;
+		FT_Set_Char_Size(face, ftSize, 0, 100, 100);
+	}
+	else printf("Error: Font %s not scalable\n", m_file);
+
+	int ascent = face->size->metrics.ascender >> 6;
+	int descent = face->size->metrics.descender >> 6;
+	if(TT_OS2* os2 = (TT_OS2*)FT_Get_Sfnt_Table(face, ft_sfnt_os2)) {
+		auto max = [](int& v, int n) { if(n>v) v=n; };
+		max(ascent,  os2->usWinAscent * face->size->metrics.y_ppem / face->units_per_EM);
+		max(descent, os2->usWinDescent * face->size->metrics.y_ppem / face->units_per_EM);
+		max(ascent,  os2->sTypoAscender * face->size->metrics.y_ppem / face->units_per_EM);
+		max(descent, -os2->sTypoDescender * face->size->metrics.y_ppem / face->units_per_EM);
+	}
+
+	// Glyphs rendered on demand
+	FreeTypeGlyphSource* source = new FreeTypeGlyphSource(library, face, ascent, ascent+descent);
+	if(m_dynamic && createDynamicFace(size, ascent+descent, source)) {
+		printf("Loaded font %s size %d, glyphs rendered on demand\n", m_file, size);
+		return true;
+	}
 
-		// Guess a reasonable texture size
-		Point imageSize = selectImageSize(size, countGlyphs());
-		int width = imageSize.x;
-		int height = imageSize.y;
-		int count = 0;
-
-		createFace(size, ascent+descent);
-		allocateGlyphs();
-
-		printf("Font metrics: %d : %dx%d %d %d\n", size, width, height, ascent, descent);
-		Rect rect(0,0,0,ascent+descent);
-		unsigned char* data = new unsigned char[width * height * 4];
-		unsigned char* end = data + width * height * 4;
-		for(unsigned char* p = data; p<end; p+=4) p[0]=p[1]=p[2]=0xff, p[3]=0;
-
-		for(const Range& range : m_glyphs) {
-			for(int glyph=range.start; glyph<=range.end; ++glyph) {
-				FT_UInt index = FT_Get_Char_Index(face, glyph);
-				if(FT_Load_Glyph(face, index, FT_LOAD_DEFAULT | FT_LOAD_RENDER)==0) {
-					if(face->glyph->bitmap.buffer) {
-						//float bearingX = face->glyph->metrics.horiBearingX / 64.f;
-
-						// Copy out glyph pixels
-						rect.width = face->glyph->bitmap.width;
-						int h = face->glyph->bitmap.rows;
-						int pitch = face->glyph->bitmap.pitch;
-						if(rect.right() > width) { rect.x = 0; rect.y += rect.height; }
-
-						int left = 0; //face->glyph->bitmap_left;
-						int top = ascent - face->glyph->bitmap_top;
-
-						//printf("%c : %f [%d,%d %dx%d %d]\n", (char)i, bearingX, left, top, w, h, pitch);
-
-						unsigned char* o = data + (rect.x + left + (rect.y+top)*width) * 4 + 3;
-						for(int y=0; y<h; ++y, o+=width*4) for(int x=0; x<rect.width; ++x) {
-							o[x*4] = face->glyph->bitmap.buffer[x + y*pitch];
-						}
-						++count;
-
-					}
-					else if(face->glyph->metrics.horiAdvance > 0) {
-						// Space has no bitmap data
-						rect.width = face->glyph->metrics.horiAdvance >> 6;
-					}
-					setGlyph(glyph, rect);
-					rect.x += rect.width;
+	// Guess a reasonable texture size
+	Point imageSize = selectImageSize(size, countGlyphs());
+	int width = imageSize.x;
+	int height = imageSize.y;
+	int count = 0;
+
+	createFace(size, ascent+descent);
+	allocateGlyphs();
+
+	printf("Font metrics: %d : %dx%d %d %d\n", size, width, height, ascent, descent);
+	Rect rect(0,0,0,ascent+descent);
+	unsigned char* data = new unsigned char[width * height * 4];
+	unsigned char* end = data + width * height * 4;
+	for(unsigned char* p = data; p<end; p+=4) p[0]=p[1]=p[2]=0xff, p[3]=0;
+
+	std::vector<unsigned char> alpha;
+	for(const Range& range : m_glyphs) {
+		for(int glyph=range.start; glyph<=range.end; ++glyph) {
+			int w = 0;
+			if(source->render(glyph, w, alpha)) {
+				rect.width = w;
+				if(rect.right() > width) { rect.x = 0; rect.y += rect.height; }
+				if(rect.bottom() > height) break;
+				unsigned char* o = data + (rect.x + rect.y*width) * 4 + 3;
+				for(int y=0; y<rect.height; ++y, o+=width*4) for(int x=0; x<w; ++x) {
+					o[x*4] = alpha[x + y*w];
 				}
-				else printf("No glyph for '%c'\n", (char)glyph);
+				if(w) ++count;
+				setGlyph(glyph, rect);
+				rect.x += rect.width;
 			}
+			else printf("No glyph for '%c'\n", (char)glyph);
 		}
-		addImage(width, height, data);
-		printf("Loaded font %s %dx%d %d glyphs\n", m_file, width, height, count);
-		delete [] data;
 	}
-	FT_Done_FreeType(library);
-	return error == 0;
+	addImage(width, height, data);
+	printf("Loaded font %s %dx%d %d glyphs\n", m_file, width, height, count);
+	delete [] data;
+	delete source;
+	return true;
 }
 
 #else
@@ -8,6 +8,7 @@
 #include <base/gui/font.h>
 #include <base/gui/animator.h>
 #include <base/assert.h>
+#include <algorithm>
 #include <cstdio>
 
 using namespace gui;
@@ -187,9 +188,12 @@ void Root::mouseEvent(const Point& p, int b, int w) {
 			}
 			else if(m_mouseFocus) {
 				m_mouseFocus->onMouseExit();
+				m_mouseFocus->invalidate(true);
 				m_mouseFocus = 0;
 			}
 		}
+		// Widget state and hover highlights can depend on the mouse position
+		if(moved && m_mouseFocus) m_mouseFocus->invalidate(b);
 	}
 
 	
@@ -206,6 +210,7 @@ void Root::mouseEvent(const Point& p, int b, int w) {
 	}
 
 	// Mouse event
+	if(m_mouseFocus && (mdown || mup)) m_mouseFocus->invalidate(true);
 	if(m_mouseFocus && m_mouseFocus->isEnabled() && m_mouseFocus->isParentEnabled() && (mdown || mup))  {
 		if(Widget* p =m_mouseFocus->getParent(true)) p->onChildMouseDown(m_mouseFocus, mdown);
 		m_mouseFocus->onMouseButton(m_mouseFocus->m_derivedTransform.untransform(p), mdown, mup);
@@ -215,7 +220,7 @@ void Root::mouseEvent(const Point& p, int b, int w) {
 	if(mup && !b && m_mouseFocus && !m_mouseFocus->m_rect.contains(p)) {
 		Widget* over = m_root->getWidget(p, false, true);
 		if(over) over->setMouseFocus();
-		else m_mouseFocus->onMouseExit(), m_mouseFocus=0;
+		else m_mouseFocus->onMouseExit(), m_mouseFocus->invalidate(true), m_mouseFocus=0;
 	}
 }
 
@@ -240,6 +245,8 @@ void Root::setFocusedWidget(Widget* w) {
 	if(w && w->getRoot() != this) return;
 	Widget* last = m_focus;
 	m_focus = w;
+	if(last) last->invalidate();
+	if(w) w->invalidate();
 	if(last) {
 		last->onLoseFocus();
 		if(last->eventLostFocus) last->eventLostFocus(last);
@@ -273,14 +280,24 @@ void Root::setFocusedWidget(Widget* w) {
 void Root::draw(const Point& viewport) const {
 	const Point& view = viewport.x? viewport: m_root->m_rect.size();
 	getRenderer()->begin(m_root->m_rect.size(), view);
-	m_root->draw();
+	getRenderer()->drawWidget(m_root);
+	// A glyph atlas page was cleared under cached geometry already drawn, so draw it again
+	if(getRenderer()->isCaching() && !getRenderer()->isFrameValid()) {
+		getRenderer()->restartFrame();
+		getRenderer()->drawWidget(m_root);
+	}
 	getRenderer()->end();
 }
 
 void Root::draw(const Matrix& transform, Widget* widget, bool depth) const {
 	if(!widget) widget = m_root;
 	getRenderer()->begin(widget->m_rect.bottomRight(), Point());
-	widget->draw();
+	getRenderer()->drawWidget(widget);
+	// A glyph atlas page was cleared under cached geometry already drawn, so draw it again
+	if(getRenderer()->isCaching() && !getRenderer()->isFrameValid()) {
+		getRenderer()->restartFrame();
+		getRenderer()->drawWidget(widget);
+	}
 	getRenderer()->end(transform, false, depth);
 }
 
@@ -443,6 +460,19 @@ Widget* Widget::clone(const char* newType) const {
 
 // ==================================================================================== //
 
+/// Uniform grid of child indices for hit testing. Each cell lists overlapping children in draw order
+struct Widget::HitTestGrid {
+	bool dirty = true;
+	Point origin;
+	int cellSize = 0;
+	int columns = 0;
+	int rows = 0;
+	std::vector<unsigned> start;	// Offset into items for each cell, plus end
+	std::vector<unsigned> items;	// Child indices
+	void build(const std::vector<Widget*>& children);
+	bool query(const Point& local, const unsigned*& begin, const unsigned*& end) const;
+};
+
 Widget::Widget()
 	: m_rect(0,0,32,32)
 	, m_skin(nullptr)
@@ -465,6 +495,10 @@ Widget::Widget()
 	m_overrideColour = 0;
 	m_layoutPaused = 0;
 	m_hasAnimatior = 0;
+	m_dirty = 1;
+	m_dirtyChildren = 0;
+	m_geometry = nullptr;
+	m_hitGrid = nullptr;
 	#ifdef WIDGET_LEAK_CHECK
 	s_widgetLeakList.insert(this);
 	#endif
@@ -475,11 +509,14 @@ Widget::Widget(int w, int h) : Widget() {
 }
 
 Widget::~Widget() {
+	if(m_parent) m_parent->invalidate(), m_parent->childrenChanged();
+	delete m_geometry;
 	pauseLayout();
 	if(m_relative) delete [] m_relative;
 	if(m_parent && m_parent->getRoot()) removeFromParent();
 	else if(m_root) setRoot(nullptr);
 	for(Widget* w: m_children) delete w;
+	delete m_hitGrid;	// After children, as deleting them marks it dirty
 	if(m_layout && --m_layout->ref<=0) delete m_layout;
 	#ifdef WIDGET_LEAK_CHECK
 	s_widgetLeakList.erase(this);
@@ -700,6 +737,14 @@ bool Widget::isRelative() const {
 
 void Widget::notifyChange() {
 	if(m_root) m_root->m_changed = true;
+	if(m_parent) m_parent->invalidate(), m_parent->childrenChanged();
+	invalidate();
+}
+
+void Widget::invalidate(bool children) const {
+	m_dirty = 1;
+	if(children) for(Widget* w: m_children) w->invalidate(true);
+	for(Widget* p = m_parent; p; p=p->m_parent) p->m_dirtyChildren = 1;
 }
 
 void Widget::setVisible(bool v) { 
@@ -713,10 +758,10 @@ void Widget::setVisible(bool v) {
 	}
 }
 
-void Widget::setEnabled(bool v) { m_enabled = v; }
+void Widget::setEnabled(bool v) { m_enabled = v; invalidate(true); }
 void Widget::setTangible(Tangible t) { m_tangible = (char)t; }
-void Widget::setSelected(bool v) { m_selected = v; }
-void Widget::setInheritState(bool v) { m_inheritState = v; }
+void Widget::setSelected(bool v) { m_selected = v; invalidate(true); }
+void Widget::setInheritState(bool v) { m_inheritState = v; invalidate(); }
 void Widget::setAsTemplate() { m_isTemplate = 1; }
 void Widget::setAutosize(bool v) {
 	m_autosize = v;
@@ -800,6 +845,8 @@ void Widget::raise() {
 			}
 		}
 		list.push_back(this);
+		m_parent->invalidate();
+		m_parent->childrenChanged();
 		if(!m_parent->isLayoutPaused()) m_parent->refreshLayout();
 	}
 }
@@ -817,8 +864,9 @@ bool Widget::hasFocus() const {
 }
 void Widget::setMouseFocus() {
 	if(m_root) {
-		if(m_root->m_mouseFocus) m_root->m_mouseFocus->onMouseExit();
+		if(m_root->m_mouseFocus) m_root->m_mouseFocus->onMouseExit(), m_root->m_mouseFocus->invalidate(true);
 		m_root->m_mouseFocus = this;
+		invalidate(true);
 		onMouseEnter();
 	}
 }
@@ -846,25 +894,116 @@ Widget* Widget::getWidget(const Point& p, int typeMask, bool tg, bool tm, bool c
 	Widget* client = tm? this: m_client;
 	Point clientOffset(0,0);
 	for(Widget* w = client; w!=this; w=w->m_parent) clientOffset += w->m_rect.position();
+
+	auto hit = [&](Widget* child) -> Widget* {
+		if(!child->isVisible() || (!tg && child->getTangible()==Tangible::NONE)) return nullptr;
+		Point local = p - clientOffset - child->m_rect.position();
+		if(!child->contains(local)) return nullptr;
+		if(tg || (child->m_tangible&2)) {
+			Widget* w = child->getWidget(local, typeMask, tg, tm, false);
+			if(w) return w;
+		}
+
+		// Filtering
+		if(child->isTemplate() && !tm) return nullptr;
+		if(!(child->m_tangible&1) && !tg) return nullptr;
+		if(typeMask!=Widget::staticType() && !child->isType(typeMask)) return nullptr;
+		return child;
+	};
+
+	// Only test children overlapping the grid cell
+	if(HitTestGrid* grid = client->m_hitGrid) {
+		if(grid->dirty) grid->build(client->m_children);
+		const unsigned *begin, *end;
+		if(!grid->query(p - clientOffset, begin, end)) return nullptr;
+		while(end > begin) {
+			if(Widget* w = hit(client->m_children[*--end])) return w;
+		}
+		return nullptr;
+	}
+
 	for(int i=client->m_children.size()-1; i>=0; --i) {
-		Widget* child = client->m_children[i];
-		if(child->isVisible() && (tg || child->getTangible()!=Tangible::NONE)) {
-			Point local = p - clientOffset - child->m_rect.position();
-			if(child->contains(local)) {
-				if(tg || (child->m_tangible&2)) {
-					Widget* w = child->getWidget(local, typeMask, tg, tm, false);
-					if(w) return w;
-				}
+		if(Widget* w = hit(client->m_children[i])) return w;
+	}
+	return nullptr;
+}
+
+// =================================================== //
+
+void Widget::useHitTestGrid(bool use) {
+	if(use && !m_client->m_hitGrid) m_client->m_hitGrid = new HitTestGrid();
+	else if(!use) {
+		delete m_client->m_hitGrid;
+		m_client->m_hitGrid = nullptr;
+	}
+}
 
-				// Filtering
-				if(child->isTemplate() && !tm) continue;
-				if(!(child->m_tangible&1) && !tg) continue;
-				if(typeMask!=Widget::staticType() && !child->isType(typeMask)) continue;
-				return child;
+void Widget::childrenChanged() {
+	if(m_hitGrid) m_hitGrid->dirty = true;
+}
+
+void Widget::HitTestGrid::build(const std::vector<Widget*>& children) {
+	dirty = false;
+	columns = rows = 0;
+	start.clear();
+	items.clear();
+
+	// Bounds are inclusive of the right and bottom edges, matching Widget::contains()
+	int count = 0;
+	long long total = 0;
+	Point low, high;
+	for(const Widget* w: children) {
+		const Rect& r = w->m_rect;
+		if(r.width<0 || r.height<0) continue;
+		if(count==0) low = r.position(), high = r.bottomRight();
+		low.x = std::min(low.x, r.x);
+		low.y = std::min(low.y, r.y);
+		high.x = std::max(high.x, r.right());
+		high.y = std::max(high.y, r.bottom());
+		total += std::max(r.width, r.height);
+		++count;
+	}
+	if(count==0) return;
+
+	// Cells about the size of an average child, with a limit on the cell count
+	origin = low;
+	cellSize = std::max(8, (int)(total / count));
+	auto cellCount = [&]() { return (long long)((high.x-low.x)/cellSize + 1) * ((high.y-low.y)/cellSize + 1); };
+	while(cellCount() > count * 4 + 64) cellSize *= 2;
+	columns = (high.x - low.x) / cellSize + 1;
+	rows = (high.y - low.y) / cellSize + 1;
+
+	// Two passes to keep each cell in child order
+	start.assign(columns * rows + 1, 0);
+	for(int pass=0; pass<2; ++pass) {
+		for(size_t i=0; i<children.size(); ++i) {
+			const Rect& r = children[i]->m_rect;
+			if(r.width<0 || r.height<0) continue;
+			int x0 = (r.x - origin.x) / cellSize, x1 = (r.right() - origin.x) / cellSize;
+			int y0 = (r.y - origin.y) / cellSize, y1 = (r.bottom() - origin.y) / cellSize;
+			for(int y=y0; y<=y1; ++y) for(int x=x0; x<=x1; ++x) {
+				if(pass==0) ++start[x + y * columns + 1];
+				else items[start[x + y * columns]++] = i;
 			}
 		}
+		if(pass==0) {
+			for(size_t c=1; c<start.size(); ++c) start[c] += start[c-1];
+			items.resize(start.back());
+		}
 	}
-	return nullptr;
+	// Second pass advanced each offset to the end of its cell
+	for(size_t c=start.size()-1; c>0; --c) start[c] = start[c-1];
+	start[0] = 0;
+}
+
+bool Widget::HitTestGrid::query(const Point& p, const unsigned*& begin, const unsigned*& end) const {
+	if(p.x < origin.x || p.y < origin.y) return false;
+	int x = (p.x - origin.x) / cellSize;
+	int y = (p.y - origin.y) / cellSize;
+	if(x >= columns || y >= rows) return false;
+	begin = items.data() + start[x + y * columns];
+	end = items.data() + start[x + y * columns + 1];
+	return begin < end;
 }
 
 Widget* Widget::findChildWidget(const char* name) const {
@@ -922,6 +1061,8 @@ void Widget::add(Widget* w, unsigned index) {
 		m_client->m_children.insert( m_client->m_children.begin()+index, w );
 	else m_client->m_children.push_back( w );
 	if(w->isTemplate()) ++m_client->m_skipTemplate;
+	m_client->invalidate();
+	m_client->childrenChanged();
 	// Setup
 	w->setRoot(m_root);
 	w->m_parent = m_client;
@@ -948,6 +1089,8 @@ bool Widget::remove(Widget* w) {
 			w->setRoot(0);
 			w->m_parent = 0;
 			if(w->isTemplate()) --m_skipTemplate;
+			m_client->invalidate();
+			m_client->childrenChanged();
 			onChildChanged(w);
 			notifyChange();
 			return true;
@@ -970,6 +1113,8 @@ int Widget::deleteChildWidgets() {
 		w->setRoot(0);
 		delete w;
 	}
+	m_client->invalidate();
+	m_client->childrenChanged();
 	if(deleted) {
 		refreshLayout();
 		notifyChange();
@@ -1100,6 +1245,7 @@ void Widget::setSkin(Skin* s) {
 		if(w->m_skin==m_skin) w->setSkin(s);
 	}
 	m_skin = s;
+	invalidate();
 }
 
 int Widget::getState() const {
@@ -1137,10 +1283,16 @@ void Widget::drawSkin() const {
 }
 void Widget::drawChildren() const {
 	if(!m_children.empty()) {
-		m_root->getRenderer()->push(m_rect);
-		m_root->getRenderer()->setTransform(m_derivedTransform);
-		for(unsigned i=0; i<m_children.size(); ++i) {
-			m_children[i]->draw();
+		Renderer* renderer = m_root->getRenderer();
+		renderer->push(m_rect);
+		renderer->setTransform(m_derivedTransform);
+		const Rect clip = renderer->getClipRect();
+		for(Widget* w: m_children) {
+			// Skip children outside the clip rect
+			if(!w->isVisible()) continue;
+			Rect bounds = m_derivedTransform.transform(w->m_rect);
+			if(bounds.width>0 && bounds.height>0 && !clip.intersects(bounds)) continue;
+			renderer->drawWidget(w);
 		}
 		if(m_parent) m_root->getRenderer()->setTransform(m_parent->m_derivedTransform);
 		m_root->getRenderer()->pop();
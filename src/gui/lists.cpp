@@ -243,6 +243,7 @@ Listbox::Listbox() : m_scrollbar(nullptr), m_multiSelect(false), m_itemHeight(20
 }
 Listbox::~Listbox() {
 	if(m_itemWidget && !m_itemWidget->getParent(true)) delete m_itemWidget;
+	for(Widget* w: m_cache) if(!w->getParent()) delete w;	// Unused pool widgets
 }
 void Listbox::initialise(const Root* root, const PropertyMap& p) {
 	// sub widgets
@@ -286,8 +287,9 @@ void Listbox::copyData(const Widget* from) {
 }
 
 void Listbox::setItemWidget(Widget* w) {
-	if(!m_itemWidget->getParent()) delete m_itemWidget;
+	if(m_itemWidget && !m_itemWidget->getParent()) delete m_itemWidget;
 	for(Widget* w: m_cache) delete w;
+	m_cache.clear();
 	m_itemWidget = w;
 	updateCache(true);
 }
@@ -407,64 +409,37 @@ void Listbox::cacheItem(ListItem& item, Widget* w) const {
 }
 
 void Listbox::updateCache(bool full) {
+	invalidate();
 	if(!m_itemWidget) return;
-	int columns = m_tileWidth? getClientRect().width / m_tileWidth : 1;
+	int columns = m_tileWidth? std::max(1, getClientRect().width / m_tileWidth) : 1;
 	int offset = m_scrollbar? m_scrollbar->getValue(): 0;
-	uint first = offset / m_itemHeight / columns;
+	uint first = std::min(offset / m_itemHeight * columns, (int)getItemCount());
 	uint last = std::min((offset + m_rect.height) / m_itemHeight * columns + columns, (int)getItemCount());
-	
-	uint requiredCount = last - first;
-	if(requiredCount != m_cacheSize || first != m_cacheFirst || full) {
-		// Resize item cache - Cache is a circular buffer, so need to add them in the right place
-		if(m_cache.size() < requiredCount) {
-			int count = requiredCount - m_cache.size();
-			m_cache.insert(m_cache.begin() + m_cacheOffset, count, nullptr);
-			for(int i=0; i<count; ++i) {
-				Widget* itemWidget = m_itemWidget->clone();
-				if((itemWidget->getAnchor() & 0xf)==3) itemWidget->setSize(getClientRect().width, itemWidget->getSize().y);
-				bindEvents(itemWidget);
-				m_cache[m_cacheOffset+i] = itemWidget;
-				add(itemWidget);
-			}
-			m_cacheOffset += count;
-		}
+	uint count = last - first;
 
-		if(full) m_cacheSize = 0;
-		if(requiredCount) {
-			// Before
-			int cacheIndex = m_cacheOffset - (m_cacheFirst - first);
-			if(cacheIndex < 0) cacheIndex += m_cache.size();
-			for(uint i=first; i<m_cacheFirst; ++i, ++cacheIndex) {
-				Widget* itemWidget = m_cache[cacheIndex % m_cache.size()];
-				if(!itemWidget->getParent()) add(itemWidget);
-				itemWidget->setPosition(0, i * m_itemHeight);
-				cacheItem(getItem(i), itemWidget);
-			}
-
-			// After
-			cacheIndex = (m_cacheOffset + m_cacheSize) % m_cache.size();
-			for(uint i=m_cacheFirst + m_cacheSize; i<last; ++i, ++cacheIndex) {
-				Widget* itemWidget = m_cache[cacheIndex % m_cache.size()];
-				if(!itemWidget->getParent()) add(itemWidget);
-				itemWidget->setPosition(0, i * m_itemHeight);
-				cacheItem(getItem(i), itemWidget);
-			}
-
-			m_cacheOffset = (m_cacheOffset + first + m_cache.size() - m_cacheFirst) % m_cache.size();
-			m_cacheFirst = first;
-			m_cacheSize = requiredCount;
-		}
-		else m_cacheOffset = m_cacheSize = m_cacheFirst = 0;
-		
-		// Remove surplus
-		for(size_t i=m_cacheSize; i<m_cache.size(); ++i) {
-			m_cache[(i + m_cacheOffset) % m_cache.size()]->removeFromParent();
-		}
+	// Grow item widget pool
+	while(m_cache.size() < count) {
+		Widget* itemWidget = m_itemWidget->clone();
+		if((itemWidget->getAnchor() & 0xf)==3) itemWidget->setSize(getClientRect().width, itemWidget->getSize().y);
+		bindEvents(itemWidget);
+		m_cache.push_back(itemWidget);
 	}
 
+	// Only items scrolled into view need caching
+	if(full) m_rows.reset();
+	m_rows.update(first, count, m_cache.size(), [this](uint index, uint slot) {
+		cacheItem(getItem(index), m_cache[slot]);
+	});
+
 	// Set positions and states
-	for(uint i=first, c=m_cacheOffset; i<last; ++i, ++c) {
-		Widget* itemWidget = m_cache[c%m_cache.size()];
+	for(uint slot=0; slot<m_cache.size(); ++slot) {
+		Widget* itemWidget = m_cache[slot];
+		int i = m_rows.getRow(slot);
+		if(i < 0) {
+			if(itemWidget->getParent()) itemWidget->removeFromParent();
+			continue;
+		}
+		if(!itemWidget->getParent()) add(itemWidget);
 		if(columns > 1) itemWidget->setPosition(i%columns * m_tileWidth, i/columns * m_itemHeight - offset);
 		else itemWidget->setPosition(0, i * m_itemHeight - offset);
 		itemWidget->setVisible(true);
@@ -133,6 +133,7 @@ Widget* Root::load(const XMLElement& xmlRoot, Widget* root, LoadFlags flags) {
 				else if(strstr(src, ".ttf")) {
 					if(FontLoader::getFreetypeLoader()) loader = FontLoader::getFreetypeLoader()(src);
 					else printf("Error: Freetype fonts not enabled.\n");
+					if(loader) loader->setDynamic(face.attribute("dynamic", 1));
 				}
 				else loader = new SystemFont(src);
 				if(!loader) return false;
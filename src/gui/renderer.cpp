@@ -6,6 +6,7 @@
 #include <base/png.h>
 #include <cstdio>
 #include <cstring>
+#include <algorithm>
 
 using namespace gui;
 
@@ -91,6 +92,7 @@ int Renderer::addImage(const char* name, int width, int height, int glUnit) {
 }
 bool Renderer::replaceImage(unsigned index, int w, int h, int channels, void* data) {
 	if(index >= m_images.size()) return false;
+	invalidateCache();
 	Image& image = m_images[index];
 	image.size.set(w,h);
 	if(image.atlased) {
@@ -112,6 +114,7 @@ bool Renderer::replaceImage(unsigned index, int w, int h, int channels, void* da
 }
 bool Renderer::replaceImage(unsigned index, int w, int h, int unit) {
 	if(index >= m_images.size()) return false;
+	invalidateCache();
 	removeFromAtlas(index);
 	Image& image = m_images[index];
 	image.texture = unit;
@@ -123,6 +126,7 @@ bool Renderer::replaceImage(unsigned index, int w, int h, int unit) {
 
 void Renderer::destroyImage(unsigned index) {
 	if(index==0 || index >= m_images.size()) return;
+	invalidateCache();
 	Image& img = m_images[index];
 	if(img.atlased) removeFromAtlas(index);
 	else {
@@ -240,18 +244,20 @@ Renderer::Renderer() : m_references(0) {
 	m_shader = createShader();
 	unsigned data = 0xffffffff;
 	addImage("blank", 1, 1, 4, &data); // index will be 0
+	resetStats();
 }
 
 Renderer::~Renderer() {
 	for(RenderBatch& b: m_renderData) {
-		glDeleteBuffers(2, &b.ix);
+		glDeleteBuffers(2, &b.vx);
 		glDeleteVertexArrays(1, &b.vao);
 	}
+	for(Batch* b: m_freeBatches) delete b;
 }
 
 Renderer::Batch* Renderer::getBatch(const Rect& sbox, int image, float line) {
 	Rect box = m_transform.transform(sbox);
-	if(image<0 || !m_scissor.back().intersects(box)) return 0;
+	if(image<0) return 0;
 
 	int texture;
 	if(image & 0x10000) texture = image & 0xffff; // Use opengl unit directly
@@ -260,6 +266,20 @@ Renderer::Batch* Renderer::getBatch(const Rect& sbox, int image, float line) {
 		texture = img.atlased? m_atlases[img.texture].texture: img.texture;
 	}
 
+	if(m_reuse) {
+		m_reuse = false;
+		replay(*m_lastRoot->m_geometry);
+	}
+	flushSlice();
+	if(!m_recording) m_unrecorded = true;
+	Batch* batch = findBatch(box, texture, line);
+	if(batch && m_recording) m_slice = Slice{ batch, batch->vertices.size(), batch->indices.size(), box, texture, line };
+	return batch;
+}
+
+Renderer::Batch* Renderer::findBatch(const Rect& box, int texture, float line) {
+	if(!m_scissor.back().intersects(box)) return 0;
+
 	// Get active batch
 	size_t activeIndex = 0;
 	for(activeIndex = 0; activeIndex<m_active.size(); ++activeIndex) {
@@ -310,7 +330,8 @@ Renderer::Batch* Renderer::getBatch(const Rect& sbox, int image, float line) {
 	// new batch
 	if(result) result->bounds.include(box);
 	else {
-		result = new Batch();
+		if(m_freeBatches.empty()) result = new Batch();
+		else result = m_freeBatches.back(), m_freeBatches.pop_back();
 		result->texture = texture;
 		result->line = line;
 		result->next = 0;
@@ -384,7 +405,29 @@ unsigned Renderer::createShader() {
 	return shader;
 }
 
+// Upload only the range that differs from the previous frame. Buffers grow with some slack
+template<class T>
+static size_t updateBuffer(unsigned target, std::vector<T>& uploaded, std::vector<T>& data, int& capacity) {
+	size_t size = data.size();
+	size_t first = 0, last = size;
+	if((int)size > capacity) {
+		capacity = size + size / 2;
+		glBufferData(target, capacity * sizeof(T), 0, GL_DYNAMIC_DRAW);
+	}
+	else {
+		size_t common = std::min(size, uploaded.size());
+		while(first < common && memcmp(&data[first], &uploaded[first], sizeof(T))==0) ++first;
+		if(size == uploaded.size()) {
+			while(last > first && memcmp(&data[last-1], &uploaded[last-1], sizeof(T))==0) --last;
+		}
+	}
+	if(last > first) glBufferSubData(target, first * sizeof(T), (last - first) * sizeof(T), &data[first]);
+	uploaded.swap(data);
+	return (last - first) * sizeof(T);
+}
+
 void Renderer::buildRenderBatches() {
+	flushSlice();
 	size_t index = 0;
 	Batch* previous = m_batches;
 	for(Batch* b = m_batches; b; b=b->next) {
@@ -408,9 +451,9 @@ void Renderer::buildRenderBatches() {
 			glBindBuffer(GL_ARRAY_BUFFER, r.vx);
 			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, r.ix);
 		}
-		glBufferData(GL_ARRAY_BUFFER, b->vertices.size() * sizeof(Vertex), &b->vertices[0], GL_STATIC_DRAW);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, b->indices.size()*2, &b->indices[0], GL_STATIC_DRAW);
 		r.size = b->indices.size();
+		m_stats.uploaded += updateBuffer(GL_ARRAY_BUFFER, r.vertices, b->vertices, r.vertexCapacity);
+		m_stats.uploaded += updateBuffer(GL_ELEMENT_ARRAY_BUFFER, r.indices, b->indices, r.indexCapacity);
 		r.texture = b->texture;
 		r.line = b->line;
 
@@ -419,20 +462,48 @@ void Renderer::buildRenderBatches() {
 		previous = b;
 	}
 	for(size_t i=index; i<m_renderData.size(); ++i) m_renderData[i].size = 0;
+	freeBatches();
+}
+
+void Renderer::freeBatches() {
 	m_active.clear();
 	m_head = 0;
 	while(m_batches) {
 		Batch* b = m_batches;
 		m_batches = b->next;
-		delete b;
+		b->coverage.clear();
+		b->vertices.clear();
+		b->indices.clear();
+		b->next = 0;
+		m_freeBatches.push_back(b);
 	}
 }
 
 void Renderer::begin(const Point& root, const Point& viewport) {
 	m_scissor.emplace_back(0, 0, root.x, root.y);
 	m_viewport = viewport;
+	// Glyphs may have moved in a font atlas since last frame
+	if(m_fontVersion != Font::getAtlasVersion()) {
+		m_fontVersion = Font::getAtlasVersion();
+		invalidateCache();
+	}
 }
 
+bool Renderer::isFrameValid() const {
+	return m_fontVersion == Font::getAtlasVersion();
+}
+
+void Renderer::restartFrame() {
+	// Discard everything drawn so far, keeping the root clip rect
+	flushSlice();
+	freeBatches();
+	m_scissor.resize(1);
+	m_recording = nullptr;
+	m_reuse = m_unrecorded = false;
+	m_topLevel = 0;
+	m_fontVersion = Font::getAtlasVersion();
+	invalidateCache();
+}
 
 void Renderer::end() {
 	Point size = m_scissor[0].size();
@@ -451,8 +522,20 @@ void Renderer::end(const Matrix& transform, bool scissor, bool depth) {
 	Point size = m_scissor[0].size();
 	m_scissor.clear();
 
+	// Send glyphs rendered this frame. Geometry recorded before an atlas change must be rebuilt next frame
+	for(const Font* font: m_fontUploads) font->uploadGlyphs();
+	m_fontUploads.clear();
+	if(m_fontVersion != Font::getAtlasVersion()) {
+		m_fontVersion = Font::getAtlasVersion();
+		invalidateCache();
+	}
+
 	// Create vertex buffers if changed
-	buildRenderBatches();
+	if(m_reuse) ++m_stats.reusedFrames;
+	else buildRenderBatches();
+	m_lastRoot = m_topLevel==1 && !m_unrecorded? m_frameRoot: nullptr;
+	m_reuse = m_unrecorded = false;
+	m_topLevel = 0;
 
 	if(m_renderData.empty() || m_renderData[0].size==0) return;
 
@@ -492,11 +575,134 @@ void Renderer::push(const Rect& rect) {
 	Rect r = m_transform.transform(rect);
 	r.intersect(m_scissor.back());
 	m_scissor.push_back(r);
+	if(m_recording) flushSlice(), m_recording->add(WidgetGeometry::PUSH).rect = r;
 }
 void Renderer::pushNew(const Rect& rect) {
 	m_scissor.push_back(m_transform.transform(rect));
+	if(m_recording) flushSlice(), m_recording->add(WidgetGeometry::PUSH).rect = m_scissor.back();
+}
+void Renderer::pop() {
+	m_scissor.pop_back();
+	if(m_recording) flushSlice(), m_recording->add(WidgetGeometry::POP);
+}
+void Renderer::setTransform(const Transform& t) {
+	m_transform = t;
+	if(m_recording) {
+		flushSlice();
+		m_recording->add(WidgetGeometry::TRANSFORM).value = m_recording->transforms.size();
+		m_recording->transforms.push_back(t);
+	}
+}
+
+// ==================================================== //
+
+void Renderer::setCaching(bool c) {
+	if(c && !m_caching) invalidateCache();
+	m_caching = c;
+	m_lastRoot = nullptr;
+}
+
+void Renderer::resetStats() {
+	m_stats.recorded = m_stats.replayed = m_stats.reusedFrames = 0;
+	m_stats.uploaded = 0;
+}
+
+void Renderer::flushSlice() {
+	if(!m_slice.batch) return;
+	if(m_recording) {
+		const Batch& b = *m_slice.batch;
+		WidgetGeometry& g = *m_recording;
+		WidgetGeometry::Command& c = g.add(WidgetGeometry::DRAW);
+		c.rect = m_slice.box;
+		c.value = m_slice.texture;
+		c.line = m_slice.line;
+		c.vertex = g.vertices.size();
+		c.vertexCount = b.vertices.size() - m_slice.vertex;
+		c.index = g.indices.size();
+		c.indexCount = b.indices.size() - m_slice.index;
+		g.vertices.insert(g.vertices.end(), b.vertices.begin() + m_slice.vertex, b.vertices.end());
+		for(size_t i=m_slice.index; i<b.indices.size(); ++i) g.indices.push_back(b.indices[i] - m_slice.vertex);
+	}
+	m_slice.batch = 0;
+}
+
+void Renderer::replay(const WidgetGeometry& g) {
+	++m_replaying;
+	for(const WidgetGeometry::Command& c: g.commands) {
+		switch(c.type) {
+		case WidgetGeometry::DRAW:
+			if(Batch* b = findBatch(c.rect, c.value, c.line)) {
+				const Vertex* v = &g.vertices[c.vertex];
+				// Line strips need a transparent segment to separate them
+				if(c.line && c.vertexCount && !b->vertices.empty()) {
+					b->vertices.push_back(b->vertices.back());
+					b->vertices.back().colour = 0;
+					b->vertices.emplace_back(v->x, v->y, 0, 0, 0);
+					b->indices.push_back(b->vertices.size()-2);
+					b->indices.push_back(b->vertices.size()-1);
+				}
+				unsigned short start = b->vertices.size();
+				b->vertices.insert(b->vertices.end(), v, v + c.vertexCount);
+				for(unsigned i=0; i<c.indexCount; ++i) b->indices.push_back(start + g.indices[c.index + i]);
+			}
+			break;
+		case WidgetGeometry::PUSH: m_scissor.push_back(c.rect); break;
+		case WidgetGeometry::POP: m_scissor.pop_back(); break;
+		case WidgetGeometry::TRANSFORM: m_transform = g.transforms[c.value]; break;
+		case WidgetGeometry::WIDGET: drawWidget(c.widget); break;
+		}
+	}
+	--m_replaying;
+}
+
+void Renderer::drawWidget(const Widget* w) {
+	if(!m_caching) {
+		w->draw();
+		return;
+	}
+	if(m_reuse) {
+		m_reuse = false;
+		replay(*m_lastRoot->m_geometry);
+	}
+	flushSlice();
+
+	WidgetGeometry* parent = m_recording;
+	bool topLevel = !parent && !m_replaying;
+	bool changed = w->m_dirtyChildren;
+	if(parent) parent->add(WidgetGeometry::WIDGET).widget = w;
+	w->m_dirtyChildren = 0;
+
+	WidgetGeometry* g = w->m_geometry;
+	bool valid = g && !w->m_dirty && g->renderer==this && g->version==m_cacheVersion && g->transform==m_transform && g->scissor==m_scissor.back();
+	if(topLevel) {
+		m_frameRoot = w;
+		// Nothing has changed since the last frame, so keep the existing buffers
+		if(++m_topLevel==1 && valid && !changed && w==m_lastRoot && !m_unrecorded && !m_batches) {
+			m_reuse = true;
+			return;
+		}
+	}
+
+	if(valid) {
+		m_recording = nullptr;
+		replay(*g);
+		++m_stats.replayed;
+	}
+	else {
+		if(!g) g = w->m_geometry = new WidgetGeometry();
+		g->clear();
+		g->renderer = this;
+		g->version = m_cacheVersion;
+		g->transform = m_transform;
+		g->scissor = m_scissor.back();
+		w->m_dirty = 0;
+		m_recording = g;
+		w->draw();
+		flushSlice();
+		++m_stats.recorded;
+	}
+	m_recording = parent;
 }
-void Renderer::pop() { m_scissor.pop_back(); }
 
 // ==================================================== //
 
@@ -619,6 +825,9 @@ Point Renderer::drawText(const Point& pos, const Font* font, int size, unsigned
 
 	Point p = pos;
 	font->buildVertexArray(text, len, size, p, clip, addVx, addIx);
+	if(font->isDynamic() && std::find(m_fontUploads.begin(), m_fontUploads.end(), font) == m_fontUploads.end()) {
+		m_fontUploads.push_back(font);
+	}
 	return p;
 }
 
@@ -637,6 +846,8 @@ void Renderer::drawLineStrip(int count, const Point* line, float width, const Po
 			b->vertices.emplace_back(p.x, p.y, 0, 0, 0);
 			b->indices.push_back(b->vertices.size()-2);
 			b->indices.push_back(b->vertices.size()-1);
+			// Separator depends on the previous strip, so is not part of recorded geometry
+			if(m_slice.batch == b) m_slice.vertex = b->vertices.size(), m_slice.index = b->indices.size();
 		}
 
 		b->vertices.reserve(b->vertices.size() + count);
@@ -18,6 +18,7 @@ void Table::initialise(const Root* r, const PropertyMap& p) {
 	if(m_dataPanel) {
 		m_dataPanel->as<Scrollpane>()->useFullSize(true);
 		m_dataPanel->setAutosize(false);
+		m_dataPanel->as<Scrollpane>()->eventChanged.bind(this, &Table::scrollChanged);
 		if(p.contains("showscrollbars")) showScrollbars(p.getValue("showscrollbars", 0));
 	}
 	else if(!m_header) {
@@ -51,6 +52,7 @@ void Table::setSize(int w, int h) {
 	Widget::setSize(w, h);
 	// Resize row cache
 	updateScrollSize();
+	updateCache(false);
 }
 
 Point Table::getPreferredSize(const Point&) const {
@@ -72,6 +74,8 @@ void Table::showScrollbars(bool always) {
 void Table::setRowHeight(int h) {
 	if(h!=m_rowHeight) {
 		m_rowHeight = h;
+		clearCache();
+		updateScrollSize();
 		cacheAll();
 	}
 }
@@ -87,6 +91,7 @@ void Table::onMouseButton(const Point&, int, int) {
 void Table::clearColumns() {
 	for(Column& c: m_columns) delete c.header;
 	m_columns.clear();
+	clearCache();
 }
 
 uint Table::getColumnCount() const {
@@ -128,9 +133,10 @@ uint Table::insertColumn(uint index, const char* name, const char* title, int wi
 		if(btn) btn->eventPressed.bind(this, &Table::columnPressed);
 	}
 
-	// TODO: Cache data in new column
-	
+	// Cell widgets are rebuilt for visible rows only
+	clearCache();
 	updateScrollSize();
+	cacheAll();
 	return index;
 }
 
@@ -140,8 +146,9 @@ void Table::removeColumn(uint index) {
 	delete m_columns[index].header;
 	for(uint i=index+1; i<m_columns.size(); ++i) m_columns[i].pos -= m_columns[index].width;
 	m_columns.erase(m_columns.begin() + index);
-	// TODO: remove cached widgets
+	clearCache();
 	updateScrollSize();
+	cacheAll();
 }
 
 void Table::setColumnWidth(uint index, int width) {
@@ -157,8 +164,9 @@ void Table::setColumnWidth(uint index, int width) {
 	}
 	// resize and move all item widgets
 	for(RowCache& row : m_cellCache) {
-		row[index]->setSize( width, m_rowHeight );
+		if(index < row.size() && row[index]) row[index]->setSize( width, m_rowHeight );
 		for(uint i=index+1; i<row.size(); ++i) {
+			if(!row[i]) continue;
 			Point pos = row[i]->getPosition();
 			row[i]->setPosition(pos.x + delta, pos.y);
 		}
@@ -178,7 +186,14 @@ void Table::setColumnIndex(uint index, uint newIndex) {
 	Column c = m_columns[index];
 	m_columns.erase(m_columns.begin()+index);
 	m_columns.insert(m_columns.begin()+newIndex, c);
-	// TODO: update item cache
+	int pos = 0;
+	for(Column& col: m_columns) {
+		col.pos = pos;
+		pos += col.width;
+		if(col.header) col.header->setPosition(col.pos, col.header->getPosition().y);
+	}
+	clearCache();
+	cacheAll();
 }
 
 int Table::getColumnWidth(uint index) const {
@@ -196,16 +211,16 @@ uint Table::insertRow(uint index) {
 }
 uint Table::addCustomRow(const Any& row) {
 	m_data.push_back(row);
-	cacheRow(m_data.size()-1);
 	updateScrollSize();
+	updateCache(false);
 	return m_data.size() - 1;
 }
 
 uint Table::insertCustomRow(uint index, const Any& data) {
 	if(index>=m_data.size()) return addCustomRow(data);
 	else m_data.insert(m_data.begin()+index, data);
-	cacheRow(index);
 	updateScrollSize();
+	updateCache(index < m_rows.getFirst() + m_rows.getCount());
 	return index;
 }
 
@@ -225,13 +240,9 @@ const Any& Table::getRowData(uint row) const {
 void Table::removeRow(uint index) {
 	if(index<m_data.size()) {
 		m_data.erase(m_data.begin()+index);
-		// Update cached widgets
-		if(index>=m_cacheOffset && index-m_cacheOffset<m_cellCache.size()) {
-			int from = index - m_cacheOffset;
-			for(uint i=from+1; i<m_cellCache.size(); ++i) std::swap(m_cellCache[i-1], m_cellCache[i]);
-			cachePositions(index);
-		}
+		// Rows below shift up, so any visible ones need caching again
 		updateScrollSize();
+		updateCache(index < m_rows.getFirst() + m_rows.getCount());
 	}
 }
 
@@ -239,6 +250,7 @@ void Table::clearRows() {
 	m_data.clear();
 	clearCache();
 	updateScrollSize();
+	updateCache(true);
 }
 
 uint Table::getRowCount() const { 
@@ -325,17 +337,41 @@ void Table::onAdded() {
 	cacheAll();
 }
 
+void Table::scrollChanged(Scrollpane*) {
+	updateCache(false);
+}
+
 void Table::clearCache() {
-	m_dataPanel->deleteChildWidgets();
+	if(m_dataPanel) m_dataPanel->deleteChildWidgets();
 	m_cellCache.clear();
+	m_rows.reset();
 }
 
 void Table::cacheAll() {
-	if(!getRoot()) return;
-	for(uint i=0; i<m_data.size(); ++i) {
-		for(uint j=0; j<m_columns.size(); ++j) {
-			cacheItem(i, j);
-		}
+	updateCache(true);
+}
+
+void Table::updateCache(bool full) {
+	if(!getRoot() || !m_dataPanel) return;
+	// Visible rows
+	int top = 0;
+	int height = m_dataPanel->getSize().y;
+	if(Scrollpane* scroll = cast<Scrollpane>(m_dataPanel)) {
+		top = std::max(0, scroll->getOffset().y);
+		height = scroll->getViewWidget()->getSize().y;
+	}
+	uint first = std::min(top / m_rowHeight, (int)m_data.size());
+	uint last = std::max(first, (uint)std::min((top + height) / m_rowHeight + 1, (int)m_data.size()));
+	if(m_cellCache.size() < last - first) m_cellCache.resize(last - first);
+
+	// Only rows scrolled into view are cached
+	if(full) m_rows.reset();
+	m_rows.update(first, last - first, m_cellCache.size(), [this](uint row, uint) { cacheRow(row); });
+
+	// Hide unused widgets
+	for(uint slot=0; slot<m_cellCache.size(); ++slot) {
+		bool used = m_rows.getRow(slot) >= 0;
+		for(Widget* w: m_cellCache[slot]) if(w && w->isVisible()!=used) w->setVisible(used);
 	}
 }
 
@@ -348,20 +384,19 @@ void Table::cacheRow(uint index) {
 
 void Table::cacheItem(uint row, uint column) {
 	if(!getRoot()) return;
-	if(row>=m_cellCache.size()) m_cellCache.resize(row+1);
-	RowCache& rowWidgets = m_cellCache[row];
+	int slot = m_rows.getSlot(row);
+	if(slot < 0) return;	// Not visible
+	RowCache& rowWidgets = m_cellCache[slot];
 	if(rowWidgets.size() < m_columns.size()) rowWidgets.resize(m_columns.size(), 0);
 	Widget*& w = rowWidgets[column];
+	const Column& col = m_columns[column];
 
 	// Create widget
 	if(!w) {
-		int ypos = row * m_rowHeight;
-		const Column& col = m_columns[column];
 		const Widget* templateWidget = col.widgets? getRoot()->getTemplate(col.widgets): 0;
 		if(templateWidget) {
 			w = templateWidget->clone();
 			w->setSize(col.width, m_rowHeight);
-			w->setPosition(col.pos, ypos);
 
 			if(Checkbox* c=cast<Checkbox>(w)) c->eventChanged.bind([this](Button* b){fireCustomEvent(b); });
 			else if(Button* b=cast<Button>(w)) b->eventPressed.bind([this](Button* b){fireCustomEvent(b); });
@@ -371,10 +406,11 @@ void Table::cacheItem(uint row, uint column) {
 		if(!w) {
 			w = new Label();
 			w->setSkin(m_skin);
-			w->setRect(col.pos, ypos, col.width, m_rowHeight);
+			w->setSize(col.width, m_rowHeight);
 		}
 		m_dataPanel->add(w);
 	}
+	w->setPosition(col.pos, row * m_rowHeight);
 
 	// Cache value
 	if(!eventCacheItem || !eventCacheItem(this, row, column, w)) {
@@ -389,24 +425,3 @@ void Table::cacheItem(uint row, uint column) {
 		}
 	}
 }
-
-void Table::cachePositions(uint fromRow, uint fromCol) {
-	uint bottom = m_cacheOffset + m_cellCache.size();
-	uint cols = m_columns.size();
-	if(fromCol >= cols || fromRow >= bottom) return;
-	if(fromRow < m_cacheOffset) fromRow=m_cacheOffset;
-	for(uint r=fromRow; r<bottom; ++r) {
-		RowCache& row = m_cellCache[r-m_cacheOffset];
-		for(uint c=fromCol; c<cols; ++c) {
-			if(row[c]) {
-				row[c]->setPosition(m_columns[c].pos, r*m_rowHeight);
-				if(r >= m_data.size()) {
-					row[c]->removeFromParent();
-					delete row[c];
-					row[c] = 0;
-				}
-			}
-		}
-	}
-}
-
@@ -77,26 +77,32 @@ void Textbox::setText(const char* t) {
 	updateLineData();
 	updateAutosize();
 	m_offset = m_skin->getState(0).textPos;
+	invalidate();
 }
 
 void Textbox::setMultiLine(bool m) {
 	m_multiline = m;
+	invalidate();
 }
 
 void Textbox::setReadOnly(bool r) {
 	m_readOnly = r;
+	invalidate();
 }
 
 void Textbox::setPassword(char c) {
 	m_password = c;
+	invalidate();
 }
 
 void Textbox::setSuffix(const char* s) {
 	m_suffix = s;
+	invalidate();
 }
 
 void Textbox::setHint(const char* s) {
 	m_hint = s;
+	invalidate();
 }
 
 void Textbox::setSubmitAction(SubmitOption s) {
@@ -147,6 +153,7 @@ void Textbox::insertText(const char* t) {
 	updateLineData();
 	updateAutosize();
 	select(start+s);
+	invalidate();
 }
 void Textbox::select(int s, int len, bool shift) {
 	if(s<0) s=0;
@@ -200,6 +207,7 @@ void Textbox::select(int s, int len, bool shift) {
 	}
 	m_selectLength = len;
 	updateOffset(false);
+	invalidate();
 }
 
 void Textbox::updateOffset(bool end) {
@@ -336,6 +344,7 @@ inline void Textbox::drawText(Point& p, const char* t, uint len, uint col) const
 }
 void Textbox::draw() const {
 	if(!isVisible()) return;
+	if(hasFocus()) invalidate();	// Cursor
 	m_root->getRenderer()->drawSkin(m_skin, m_rect, m_colour, getState());
 	// Selection - do we change text colour too?
 	m_root->getRenderer()->push(m_rect);
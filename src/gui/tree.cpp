@@ -3,11 +3,12 @@
 #include <base/gui/renderer.h>
 #include <base/gui/skin.h>
 #include <base/gui/font.h>
+#include <algorithm>
 
 using namespace gui;
 
 TreeNode::TreeNode(const char* text)
-	: m_treeView(0), m_parent(0), m_selected(false), m_expanded(false), m_depth(0), m_displayed(1), m_cached(0) {
+	: m_treeView(0), m_parent(0), m_selected(false), m_expanded(false), m_depth(0), m_displayed(1), m_childDisplayed(0), m_cached(0) {
 	if(text) m_data.push_back( Any(String(text)) );
 }
 
@@ -46,6 +47,8 @@ TreeNode* TreeNode::insert(uint index, TreeNode* node) {
 	node->setParentNode(this);
 	if(index > m_children.size()) index = m_children.size();
 	m_children.insert(m_children.begin() + index, node);
+	m_childDisplayed += node->m_displayed;
+	m_offsets.clear();
 	if(m_expanded) changeDisplayed(m_displayed + node->m_displayed);
 	return node;
 }
@@ -56,19 +59,21 @@ void TreeNode::setParentNode(TreeNode* parent) {
 	m_depth    = parent->m_depth + 1;
 	m_selected = false;
 	for(uint i=0; i<m_children.size(); ++i) m_children[i]->setParentNode(this);
-	if(m_treeView) m_treeView->m_needsUpdating = true;
+	if(m_treeView) m_treeView->m_needsUpdating = true, m_treeView->invalidate();
 }
 TreeNode* TreeNode::remove(uint index) {
 	if(index >= m_children.size()) return 0;
 	TreeNode* node = m_children[index];
 	if(m_expanded) changeDisplayed(m_displayed - node->m_displayed);
+	m_childDisplayed -= node->m_displayed;
+	m_offsets.clear();
 	if(m_treeView->m_selectedNode == node) m_treeView->m_selectedNode = 0;
 	if(m_cached) m_treeView->removeCache(this);
 	node->m_parent = 0;
 	node->m_treeView = 0;
 	m_children.erase( m_children.begin() + index );
 	if(m_children.empty() && (m_parent || !m_treeView->m_hideRootNode)) m_expanded = false;
-	if(m_treeView) m_treeView->m_needsUpdating = true;
+	if(m_treeView) m_treeView->m_needsUpdating = true, m_treeView->invalidate();
 	return node;
 }
 TreeNode* TreeNode::remove(TreeNode* node) {
@@ -89,23 +94,38 @@ void TreeNode::clear() {
 	if(m_children.empty()) return;
 	for(uint i=0; i<m_children.size(); ++i) delete m_children[i];
 	m_children.clear();
+	m_childDisplayed = 0;
+	m_offsets.clear();
 	if(m_parent || !m_treeView->m_hideRootNode)
 		m_expanded = false;
 	changeDisplayed(1);
 	if(m_treeView) {
 		m_treeView->m_needsUpdating = true;
 		m_treeView->m_selectedNode = 0;
+		m_treeView->invalidate();
 	}
 }
 
 // ------------- Display ---------------- //
 
 void TreeNode::changeDisplayed(int display) {
-	for(TreeNode* n = m_parent; n; n=n->m_parent) {
+	int delta = display - m_displayed;
+	m_displayed = display;
+	for(TreeNode* n = m_parent; n && delta; n=n->m_parent) {
+		n->m_childDisplayed += delta;
+		n->m_offsets.clear();
 		if(!n->isExpanded()) break;
-		n->m_displayed += display - m_displayed;
+		n->m_displayed += delta;
 	}
-	m_displayed = display;
+}
+
+const std::vector<int>& TreeNode::getChildOffsets() {
+	if(m_offsets.size() != m_children.size() + 1) {
+		m_offsets.resize(m_children.size() + 1);
+		m_offsets[0] = 0;
+		for(size_t i=0; i<m_children.size(); ++i) m_offsets[i+1] = m_offsets[i] + m_children[i]->m_displayed;
+	}
+	return m_offsets;
 }
 
 void TreeNode::select() {
@@ -114,6 +134,7 @@ void TreeNode::select() {
 		m_treeView->m_selectedNode = this;
 		if(m_cached) m_cached->setSelected(true);
 		m_selected = true;
+		m_treeView->invalidate();
 	}
 }
 
@@ -124,10 +145,9 @@ void TreeNode::expand(bool e) {
 	if(m_expanded == e) return;
 	m_expanded = e;
 	int display = isHiddenRootNode? 0: 1;
-	if(e) for(TreeNode* n: *this) display += n->m_displayed;
-	else for(TreeNode* n: *this) n->m_cached = 0;
+	if(e) display += m_childDisplayed;
 	changeDisplayed(display);
-	if(m_treeView) m_treeView->m_needsUpdating = true;
+	if(m_treeView) m_treeView->m_needsUpdating = true, m_treeView->invalidate();
 }
 void TreeNode::expandAll() {
 	expand(true);
@@ -143,6 +163,7 @@ bool TreeNode::isExpanded() const { return m_expanded; }
 bool TreeNode::isSelected() const { return m_selected; }
 void TreeNode::refresh() {
 	if(m_cached) m_treeView->cacheItem(this, m_cached);
+	else if(m_treeView) m_treeView->invalidate();
 }
 
 std::vector<TreeNode*>::const_iterator TreeNode::begin() const { return m_children.begin(); }
@@ -173,6 +194,7 @@ void TreeView::setRootNode(TreeNode* node) {
 }
 void TreeView::showRootNode(bool s) {
 	m_needsUpdating |= s==m_hideRootNode;
+	invalidate();
 	m_hideRootNode = !s;
 	if(m_hideRootNode) m_rootNode->expand(true);
 }
@@ -245,6 +267,7 @@ bool TreeView::onMouseWheel(int w) {
 	if(m_scrollbar) {
 		m_scrollbar->setValue( m_scrollbar->getValue() - w * m_scrollbar->getStep() );
 		m_needsUpdating = true;
+		invalidate();
 		Widget::onMouseWheel(w);
 	}
 	return m_scrollbar;
@@ -315,6 +338,7 @@ void TreeView::onMouseMove(const Point& a, const Point& p, int b) {
 void TreeView::setSize(int w, int h) {
 	Widget::setSize(w,h);
 	m_needsUpdating = true;
+	invalidate();
 }
 
 void TreeView::clearSelection() {
@@ -322,11 +346,13 @@ void TreeView::clearSelection() {
 		if(m_selectedNode->m_cached) m_selectedNode->m_cached->setSelected(false);
 		m_selectedNode->m_selected = false;
 		m_selectedNode = 0;
+		invalidate();
 	}
 }
 
 void TreeView::scrollChanged(Scrollbar* s, int v) {
 	m_needsUpdating = true;
+	invalidate();
 }
 
 void TreeView::scrollToItem(TreeNode* n) {
@@ -348,8 +374,7 @@ void TreeView::scrollToItem(TreeNode* n) {
 	p = n->m_parent;
 	while(p) {
 		++pos;
-		int ix = n->getIndex();
-		for(int i=0; i<ix; ++i) pos += p->at(i)->m_displayed;
+		pos += p->getChildOffsets()[n->getIndex()];
 		n = p; p = n->m_parent;
 	}
 	if(m_hideRootNode) --pos;
@@ -381,11 +406,13 @@ void TreeView::updateCache() const {
 	m_additionalLines.clear();
 	for(ItemWidget& w: m_itemWidgets) w.widget->setVisible(false);
 	if(m_hideRootNode) {
-		for(uint i=0, h=0; i<m_rootNode->size(); ++i)
-			h += buildCache(m_rootNode->at(i), h, offset, offset + height);
+		if(m_rootNode->size()) buildChildCache(m_rootNode, 0, offset, offset + height);
 	}
 	else buildCache(m_rootNode, 0, offset, offset + height);
 	m_cacheOffset = (offset / m_itemHeight) * m_itemHeight - offset;
+	// Lines to items below the view run from their parent to the end of the cache
+	int end = (offset / m_itemHeight + (int)m_drawCache.size()) * m_itemHeight;
+	for(Point& line: m_additionalLines) line.y = end - line.y - m_itemHeight/2;
 
 	// Cache widgets
 	if(!m_itemWidgets.empty()) {
@@ -438,7 +465,8 @@ void TreeView::updateCache() const {
 }
 
 int TreeView::buildCache(TreeNode* n, int y, int top, int bottom) const {
-	if(y + n->m_displayed * m_itemHeight < top) return n->m_displayed * m_itemHeight;
+	int height = n->m_displayed * m_itemHeight;
+	if(y + height < top) return height;
 	if(y > bottom) return 0;
 
 	// Add to cache
@@ -447,25 +475,33 @@ int TreeView::buildCache(TreeNode* n, int y, int top, int bottom) const {
 	}
 
 	// Recurse to children
-	int h = m_itemHeight;
-	if(n->isExpanded()) {
-		int line = 0;
-		int lineIndex = 0;
-		for(uint i=0; i<n->size(); ++i) {
-			line = h;
-			lineIndex = m_drawCache.size();
-			h += buildCache(n->at(i), y+h, top, bottom);
+	if(n->isExpanded() && n->size()) {
+		int line = m_itemHeight + n->getChildOffsets()[n->size()-1] * m_itemHeight;
+		uint lineIndex = buildChildCache(n, y + m_itemHeight, top, bottom);
+		if(lineIndex < m_drawCache.size()) {
+			m_drawCache[lineIndex].up = line - m_itemHeight/2;
 		}
-		if(line) {
-			if(lineIndex < (int)m_drawCache.size()) {
-				m_drawCache[lineIndex].up = line - m_itemHeight/2;
-			}
-			else {
-				m_additionalLines.push_back( Point((n->m_depth+1) * m_indent, line - m_itemHeight/2) );
-			}
+		else {
+			m_additionalLines.push_back( Point((n->m_depth+1) * m_indent, y) );	// Resolved in updateCache
 		}
 	}
-	return h;
+	return height;
+}
+
+int TreeView::buildChildCache(TreeNode* n, int y, int top, int bottom) const {
+	// Skip to the first visible child
+	const std::vector<int>& offsets = n->getChildOffsets();
+	auto it = std::partition_point(offsets.begin() + 1, offsets.end(), [&](int rows) { return y + rows * m_itemHeight < top; });
+	// Returns cache index of the last child, or cache size if it is below the view
+	int lineIndex = -1;
+	uint last = n->size() - 1;
+	for(uint i = it - offsets.begin() - 1; i<=last; ++i) {
+		int childY = y + offsets[i] * m_itemHeight;
+		if(childY > bottom) break;
+		if(i == last) lineIndex = m_drawCache.size();
+		buildCache(n->m_children[i], childY, top, bottom);
+	}
+	return lineIndex < 0? m_drawCache.size(): lineIndex;
 }
 
 inline void setFromData(Widget* w, const Any& value) {
@@ -506,6 +542,7 @@ void TreeView::cacheItem(TreeNode* node, Widget* w) const {
 }
 
 void TreeView::refresh() {
+	invalidate();
 	for(CacheItem& i: m_drawCache) {
 		if(i.node->m_cached) cacheItem(i.node, i.node->m_cached);
 	}
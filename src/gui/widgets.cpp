@@ -103,6 +103,7 @@ void Label::setWordWrap(bool w) {
 }
 void Label::updateWrap() {
 	m_lines.clear();
+	invalidate();
 	Font* font = m_font? m_font: m_skin? m_skin->getFont(): nullptr;
 	if(!m_caption || !font) return;
 	int size = m_fontSize? m_fontSize: m_skin? m_skin->getFontSize(): 16;
@@ -148,11 +149,13 @@ void Label::setFont(Font* font, int size) {
 }
 void Label::setFontSize(int s) {
 	m_fontSize = s;
+	invalidate();
 	if(m_wordWrap) updateWrap();
 	updateAutosize();
 }
 void Label::setFontAlign(int a) {
 	m_fontAlign = a;
+	invalidate();
 }
 const char* Label::getCaption() const {
 	return m_caption.str();
@@ -264,6 +267,7 @@ void Image::setImage(Root* root, const char* name) {
 }
 void Image::setImage(int image) {
 	m_image = image;
+	invalidate();
 	updateAutosize();
 }
 
@@ -5,7 +5,7 @@
 using namespace base;
 
 HardwareBuffer::HardwareBuffer(Usage u, bool keep) :
-	m_ref(0), m_buffer(~0u), m_target(0), m_usage(u), m_size(0), m_data(0), m_keepCopy(keep), m_ownsData(false) {
+	m_ref(0), m_buffer(~0u), m_target(0), m_usage(u), m_size(0), m_bufferSize(0), m_reserved(0), m_data(0), m_keepCopy(keep), m_ownsData(false) {
 }
 HardwareBuffer::~HardwareBuffer() {
 }
@@ -36,6 +36,8 @@ void HardwareBuffer::createBuffer() {
 }
 void HardwareBuffer::destroyBuffer() {
 	if(isBuffer()) glDeleteBuffers(1, &m_buffer);
+	m_buffer = ~0u;
+	m_bufferSize = 0;
 }
 
 void HardwareBuffer::writeBuffer() {
@@ -46,7 +48,16 @@ void HardwareBuffer::writeBuffer() {
 		GL_STREAM_DRAW, GL_STREAM_READ, GL_STREAM_COPY
 	};
 	glBindBuffer(m_target, m_buffer);
-	glBufferData(m_target, m_size, m_data, usage[m_usage]);
+	if(m_size && m_size <= m_bufferSize && m_usage < STREAM_DRAW) glBufferSubData(m_target, 0, m_size, m_data);
+	else if(m_reserved > m_size && m_usage < STREAM_DRAW) {
+		glBufferData(m_target, m_reserved, 0, usage[m_usage]);
+		if(m_size) glBufferSubData(m_target, 0, m_size, m_data);
+		m_bufferSize = m_reserved;
+	}
+	else {
+		glBufferData(m_target, m_size, m_data, usage[m_usage]);
+		m_bufferSize = m_size;
+	}
 	glBindBuffer(m_target, 0);
 	GL_CHECK_ERROR;
 }
@@ -212,6 +223,13 @@ Attribute& VertexAttributes::get(AttributeSemantic semantic, int index) {
 	}
 	return get(~0u);
 }
+
+const Attribute& VertexAttributes::get(AttributeSemantic semantic, int index) const {
+	for(const Attribute& a: m_attributes) {
+		if(a.semantic == semantic && --index<0) return a;
+	}
+	return get(~0u);
+}
 int VertexAttributes::hasAttrribute(AttributeSemantic s) const {
 	int count = 0;
 	for(const Attribute& a: m_attributes) if(a.semantic==s) ++count;
@@ -1,6 +1,8 @@
 #include <base/image.h>
 #include <cstring>
 #include <cmath>
+#include <vector>
+#include <base/thread.h>
 
 using namespace base;
 
@@ -83,6 +85,14 @@ Image::PixelType Image::getPixelType(Format f) {
 	}
 }
 
+size_t Image::getSurfaceSize(Format f, int w, int h, int d) {
+	switch(f) {
+	case BC1: case BC4: return ((w+3)/4) * ((h+3)/4) * 8 * d;
+	case BC2: case BC3: case BC5: return ((w+3)/4) * ((h+3)/4) * 16 * d;
+	default: return (size_t)w * h * d * getBytesPerPixel(f);
+	}
+}
+
 // ===================================================================== //
 
 
@@ -208,7 +218,10 @@ void convertArray(const S* src, const T* dest, int count) {
 using byte = Image::byte;
 
 Image Image::convert(Format to, const char* swizzle) const {
-	if(isCompressed(to)) return Image(); // Not implemented
+	if(isCompressed(to)) {
+		if(!swizzle || isCompressed()) return compress(to);
+		return convert(RGBA8, swizzle).compress(to);
+	}
 	int surfaces = getFaces();
 	byte** data = new byte*[surfaces * m_mips];
 	for(int n=0; n<surfaces; ++n) {
@@ -218,7 +231,7 @@ Image Image::convert(Format to, const char* swizzle) const {
 			if(h<=0) h=1;
 			if(d<=0) d=1;
 			
-			int k = n * i * surfaces;
+			int k = n + i * surfaces;
 			data[k] = convertSurface(m_data[k], w, h, d, to, swizzle);
 
 			w = w>>1;
@@ -264,6 +277,44 @@ int getPixelOffset(Image::Format format, char swizzle) {
 	return -1;
 }
 
+// ===================================================================== //
+//                          Block Compression                            //
+// ===================================================================== //
+
+// Blocks are decoded to and encoded from 4x4 RGBA pixels
+typedef byte ColourBlock[16][4];
+
+int blockSize(Image::Format f) {
+	return f==Image::BC1 || f==Image::BC4? 8: 16;
+}
+
+// Read a 4x4 block of pixels, clamping at image edges
+void readBlock(const byte* src, int w, int h, int channels, int bx, int by, ColourBlock& out) {
+	for(int j=0; j<4; ++j) for(int i=0; i<4; ++i) {
+		int x = bx*4 + i;
+		int y = by*4 + j;
+		if(x >= w) x = w-1;
+		if(y >= h) y = h-1;
+		const byte* p = src + (x + y * w) * channels;
+		byte* o = out[i + j*4];
+		switch(channels) {
+		case 1: o[0] = o[1] = o[2] = p[0]; o[3] = 255; break;
+		case 2: o[0] = p[0]; o[1] = p[1]; o[2] = 0; o[3] = 255; break;
+		case 3: o[0] = p[0]; o[1] = p[1]; o[2] = p[2]; o[3] = 255; break;
+		case 4: memcpy(o, p, 4); break;
+		}
+	}
+}
+
+// Write a 4x4 block of pixels, skipping anything outside the image
+void writeBlock(const ColourBlock& in, byte* dst, int w, int h, int channels, int bx, int by) {
+	for(int j=0; j<4; ++j) for(int i=0; i<4; ++i) {
+		int x = bx*4 + i;
+		int y = by*4 + j;
+		if(x < w && y < h) memcpy(dst + (x + y * w) * channels, in[i + j*4], channels);
+	}
+}
+
 int decodeR5G6B5(const byte* p) {
 	byte r = (p[1]>>3) * 255 / 31;
 	byte g = ((p[1]<<3 | p[0]>>5) & 0x3f) * 255 / 63;
@@ -271,7 +322,7 @@ int decodeR5G6B5(const byte* p) {
 	return r<<16 | g<<8 | b;
 }
 
-void createBC1Table(const byte* a, const byte* b, byte* table) {
+void createBC1Table(const byte* a, const byte* b, byte* table, bool allowThreeColour=false) {
 	int ca = decodeR5G6B5(a);
 	int cb = decodeR5G6B5(b);
 	table[0] = ca>>16;
@@ -282,6 +333,15 @@ void createBC1Table(const byte* a, const byte* b, byte* table) {
 	table[4] = (cb>>8) & 0xff;
 	table[5] = cb & 0xff;
 
+	// BC1 uses three colours and black if c0 <= c1
+	if(allowThreeColour && (a[0] | a[1]<<8) <= (b[0] | b[1]<<8)) {
+		table[6] = (table[0] + table[3]) / 2;
+		table[7] = (table[1] + table[4]) / 2;
+		table[8] = (table[2] + table[5]) / 2;
+		table[9] = table[10] = table[11] = 0;
+		return;
+	}
+
 	table[6] = (table[0] * 2 + table[3]) / 3;
 	table[7] = (table[1] * 2 + table[4]) / 3;
 	table[8] = (table[2] * 2 + table[5]) / 3;
@@ -312,25 +372,476 @@ void createBC4Table(byte a, byte b, byte* table) {
 	}
 }
 
+// Colour block { short c0, c1; byte row[4]; } - 2 bits per pixel
+void decodeColourBlock(const byte* block, ColourBlock& out, bool allowThreeColour) {
+	byte table[12];
+	createBC1Table(block, block+2, table, allowThreeColour);
+	unsigned bits = block[4] | block[5]<<8 | block[6]<<16 | (unsigned)block[7]<<24;
+	for(int k=0; k<16; ++k) memcpy(out[k], table + ((bits >> k*2) & 3) * 3, 3);
+}
+
+// Alpha block { byte a0, a1; byte indices[6]; } - 3 bits per pixel
+void decodeAlphaBlock(const byte* block, ColourBlock& out, int channel) {
+	byte table[8];
+	createBC4Table(block[0], block[1], table);
+	unsigned long long bits = 0;
+	for(int i=0; i<6; ++i) bits |= (unsigned long long)block[i+2] << i*8;
+	for(int k=0; k<16; ++k) out[k][channel] = table[(bits >> k*3) & 7];
+}
+
+// BC2 alpha block { byte alpha[8]; } - 4 bit absolute values
+void decodeExplicitAlphaBlock(const byte* block, ColourBlock& out) {
+	for(int k=0; k<16; ++k) out[k][3] = ((block[k/2] >> (k&1)*4) & 0xf) * 17;
+}
+
+void decodeBlock(const byte* block, Image::Format format, ColourBlock& out) {
+	for(int k=0; k<16; ++k) out[k][0] = out[k][1] = out[k][2] = 0, out[k][3] = 255;
+	switch(format) {
+	case Image::BC1: decodeColourBlock(block, out, true); break;
+	case Image::BC2: decodeExplicitAlphaBlock(block, out); decodeColourBlock(block+8, out, false); break;
+	case Image::BC3: decodeAlphaBlock(block, out, 3); decodeColourBlock(block+8, out, false); break;
+	case Image::BC4: decodeAlphaBlock(block, out, 0); break;
+	case Image::BC5: decodeAlphaBlock(block, out, 0); decodeAlphaBlock(block+8, out, 1); break;
+	default: break;
+	}
+}
+
+
+inline int encodeR5G6B5(const float* c) {
+	auto q = [](float v, int max) { int r = (int)(v * max / 255.f + 0.5f); return r<0? 0: r>max? max: r; };
+	return q(c[0], 31)<<11 | q(c[1], 63)<<5 | q(c[2], 31);
+}
+
+inline int colourError(const byte* a, const byte* b) {
+	int r = a[0]-b[0], g = a[1]-b[1], bl = a[2]-b[2];
+	return r*r + g*g + bl*bl;
+}
+
+// Select the best palette index for each pixel. Returns total squared error
+int fitColourIndices(const ColourBlock& in, int c0, int c1, int* indices) {
+	byte ends[4] = { (byte)(c0&0xff), (byte)(c0>>8), (byte)(c1&0xff), (byte)(c1>>8) };
+	byte table[12];
+	createBC1Table(ends, ends+2, table);
+	int total = 0;
+	for(int k=0; k<16; ++k) {
+		int best = colourError(in[k], table), index = 0;
+		for(int i=1; i<4; ++i) {
+			int e = colourError(in[k], table + i*3);
+			if(e < best) best = e, index = i;
+		}
+		indices[k] = index;
+		total += best;
+	}
+	return total;
+}
+
+// Least squares fit of endpoints for a fixed set of indices
+bool refineColourEndpoints(const ColourBlock& in, const int* indices, float* a, float* b) {
+	static const float weight[4] = { 1.f, 0.f, 2/3.f, 1/3.f };
+	float aa=0, ab=0, bb=0, ax[3]={0,0,0}, bx[3]={0,0,0};
+	for(int k=0; k<16; ++k) {
+		float alpha = weight[indices[k]];
+		float beta = 1.f - alpha;
+		aa += alpha * alpha;
+		ab += alpha * beta;
+		bb += beta * beta;
+		for(int c=0; c<3; ++c) {
+			ax[c] += alpha * in[k][c];
+			bx[c] += beta * in[k][c];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if(fabs(det) < 1e-6f) return false;
+	for(int c=0; c<3; ++c) {
+		a[c] = (ax[c] * bb - bx[c] * ab) / det;
+		b[c] = (bx[c] * aa - ax[c] * ab) / det;
+		a[c] = a[c]<0? 0: a[c]>255? 255: a[c];
+		b[c] = b[c]<0? 0: b[c]>255? 255: b[c];
+	}
+	return true;
+}
+
+// Encode colour block. Always uses four colour mode so it is valid for BC2 and BC3.
+void encodeColourBlock(const ColourBlock& in, byte* out, bool highQuality) {
+	float a[3], b[3];
+	if(!highQuality) {
+		// Bounding box, inset slightly to reduce error from quantisation
+		float lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+		for(int k=0; k<16; ++k) for(int c=0; c<3; ++c) {
+			if(in[k][c] < lo[c]) lo[c] = in[k][c];
+			if(in[k][c] > hi[c]) hi[c] = in[k][c];
+		}
+		for(int c=0; c<3; ++c) {
+			float inset = (hi[c] - lo[c]) / 16.f;
+			a[c] = hi[c] - inset;
+			b[c] = lo[c] + inset;
+		}
+	}
+	else {
+		// Principal axis of the colour distribution
+		float mean[3] = {0,0,0};
+		for(int k=0; k<16; ++k) for(int c=0; c<3; ++c) mean[c] += in[k][c] / 16.f;
+		float cov[6] = {0,0,0,0,0,0};
+		for(int k=0; k<16; ++k) {
+			float r = in[k][0]-mean[0], g = in[k][1]-mean[1], bl = in[k][2]-mean[2];
+			cov[0] += r*r; cov[1] += r*g; cov[2] += r*bl;
+			cov[3] += g*g; cov[4] += g*bl; cov[5] += bl*bl;
+		}
+		float axis[3] = { 1, 1, 1 };
+		for(int i=0; i<8; ++i) {
+			float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+			float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+			float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+			float m = fmax(fabs(x), fmax(fabs(y), fabs(z)));
+			if(m < 1e-6f) break;
+			axis[0] = x/m; axis[1] = y/m; axis[2] = z/m;
+		}
+		float lo = 1e9f, hi = -1e9f;
+		for(int k=0; k<16; ++k) {
+			float d = (in[k][0]-mean[0])*axis[0] + (in[k][1]-mean[1])*axis[1] + (in[k][2]-mean[2])*axis[2];
+			if(d < lo) lo = d;
+			if(d > hi) hi = d;
+		}
+		float len = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+		for(int c=0; c<3; ++c) {
+			a[c] = mean[c] + axis[c] * hi / len;
+			b[c] = mean[c] + axis[c] * lo / len;
+			a[c] = a[c]<0? 0: a[c]>255? 255: a[c];
+			b[c] = b[c]<0? 0: b[c]>255? 255: b[c];
+		}
+	}
+
+	int indices[16], best[16];
+	int c0 = encodeR5G6B5(a);
+	int c1 = encodeR5G6B5(b);
+	if(c0 < c1) { int t=c0; c0=c1; c1=t; }
+	int error = fitColourIndices(in, c0, c1, best);
+
+	// Iteratively refine endpoints to the chosen indices
+	for(int iteration=0; highQuality && iteration<2 && error>0; ++iteration) {
+		if(!refineColourEndpoints(in, best, a, b)) break;
+		int n0 = encodeR5G6B5(a);
+		int n1 = encodeR5G6B5(b);
+		if(n0 < n1) { int t=n0; n0=n1; n1=t; }
+		if(n0 == c0 && n1 == c1) break;
+		int e = fitColourIndices(in, n0, n1, indices);
+		if(e >= error) break;
+		error = e;
+		c0 = n0;
+		c1 = n1;
+		memcpy(best, indices, sizeof(best));
+	}
+
+	// Equal endpoints would switch to three colour mode
+	unsigned bits = 0;
+	if(c0 == c1) {
+		if(c1 > 0) --c1;
+		else ++c0;
+		fitColourIndices(in, c0, c1, best);
+	}
+	for(int k=0; k<16; ++k) bits |= best[k] << k*2;
+	out[0] = c0 & 0xff;
+	out[1] = c0 >> 8;
+	out[2] = c1 & 0xff;
+	out[3] = c1 >> 8;
+	out[4] = bits & 0xff;
+	out[5] = (bits >> 8) & 0xff;
+	out[6] = (bits >> 16) & 0xff;
+	out[7] = bits >> 24;
+}
+
+// Select the best palette index for each value. Returns total squared error
+int fitAlphaIndices(const ColourBlock& in, int channel, byte a0, byte a1, int* indices) {
+	byte table[8];
+	createBC4Table(a0, a1, table);
+	int total = 0;
+	for(int k=0; k<16; ++k) {
+		int best = 0x7fffffff;
+		for(int i=0; i<8; ++i) {
+			int d = in[k][channel] - table[i];
+			if(d*d < best) best = d*d, indices[k] = i;
+		}
+		total += best;
+	}
+	return total;
+}
+
+void encodeAlphaBlock(const ColourBlock& in, int channel, byte* out, bool highQuality) {
+	int lo = 255, hi = 0;
+	for(int k=0; k<16; ++k) {
+		if(in[k][channel] < lo) lo = in[k][channel];
+		if(in[k][channel] > hi) hi = in[k][channel];
+	}
+
+	int best[16], indices[16];
+	byte a0 = hi, a1 = lo;
+	int error = fitAlphaIndices(in, channel, a0, a1, best);
+	if(highQuality && error > 0) {
+		// Try shrinking the range in eight value mode
+		for(int i=0; i<=2; ++i) for(int j=0; j<=2; ++j) {
+			if(hi-i <= lo+j) continue;
+			int e = fitAlphaIndices(in, channel, hi-i, lo+j, indices);
+			if(e < error) error = e, a0 = hi-i, a1 = lo+j, memcpy(best, indices, sizeof(best));
+		}
+		// Six value mode has explicit 0 and 255 so the range only needs to cover the other values
+		int lo6 = 255, hi6 = 0;
+		for(int k=0; k<16; ++k) {
+			int v = in[k][channel];
+			if(v == 0 || v == 255) continue;
+			if(v < lo6) lo6 = v;
+			if(v > hi6) hi6 = v;
+		}
+		if(lo6 > hi6) lo6 = hi6 = 0;
+		int e = fitAlphaIndices(in, channel, lo6, hi6, indices);
+		if(e < error) error = e, a0 = lo6, a1 = hi6, memcpy(best, indices, sizeof(best));
+	}
+
+	unsigned long long bits = 0;
+	for(int k=0; k<16; ++k) bits |= (unsigned long long)best[k] << k*3;
+	out[0] = a0;
+	out[1] = a1;
+	for(int i=0; i<6; ++i) out[i+2] = (bits >> i*8) & 0xff;
+}
+
+void encodeExplicitAlphaBlock(const ColourBlock& in, byte* out) {
+	memset(out, 0, 8);
+	for(int k=0; k<16; ++k) out[k/2] |= ((in[k][3] * 15 + 127) / 255) << (k&1)*4;
+}
+
+void encodeBlock(const ColourBlock& in, Image::Format format, byte* out, bool highQuality) {
+	switch(format) {
+	case Image::BC1: encodeColourBlock(in, out, highQuality); break;
+	case Image::BC2: encodeExplicitAlphaBlock(in, out); encodeColourBlock(in, out+8, highQuality); break;
+	case Image::BC3: encodeAlphaBlock(in, 3, out, highQuality); encodeColourBlock(in, out+8, highQuality); break;
+	case Image::BC4: encodeAlphaBlock(in, 0, out, highQuality); break;
+	case Image::BC5: encodeAlphaBlock(in, 0, out, highQuality); encodeAlphaBlock(in, 1, out+8, highQuality); break;
+	default: break;
+	}
+}
 
-void decompressBC4Channel(const byte* data, int bx, int by, int stride, byte* out, int bpp) {
-	byte c[8];
-	int w = bx * 4;
-	int line = bx * stride;
-	unsigned long long b;
-	for(int x=0; x<bx; ++x) for(int y=0; y<by; ++y) {
-		const byte* block = data + x * stride + y*line;
-		createBC4Table(block[0], block[1], c);
-		memcpy(&b, block, 8);
-		for(int i=0; i<4; ++i) for(int j=0; j<4; ++j) {
-			int k = i + j*4;
-			int v = (b >> (48 - k*3)) & 7;
-			byte* px = out + (x*4+i + (y*4+j) * w) * bpp;
-			px[0] = c[v];
+Image Image::compress(Format to, bool highQuality, int threads) const {
+	if(!isCompressed(to) || getPixelType(m_format) != BYTE) return Image();
+	int surfaces = getFaces();
+	byte** data = new byte*[surfaces * m_mips];
+	for(int n=0; n<surfaces; ++n) {
+		int w = m_width, h = m_height, d = m_depth;
+		for(int i=0; i<m_mips; ++i) {
+			if(w<=0) w=1;
+			if(h<=0) h=1;
+			if(d<=0) d=1;
+			int k = n + i * surfaces;
+			data[k] = compressSurface(m_data[k], w, h, d, to, highQuality, threads);
+			w = w>>1;
+			h = h>>1;
+			if(m_mode == VOLUME) d = d>>1;
 		}
 	}
+	return Image(m_mode, to, m_width, m_height, m_depth, m_mips, data);
 }
 
+byte* Image::compressSurface(const byte* data, int w, int h, int d, Format to, bool highQuality, int threads) const {
+	const int bx = (w+3) / 4;
+	const int by = (h+3) / 4;
+	const int bs = blockSize(to);
+	const int channels = getChannels();
+	byte* out = new byte[bx * by * bs * d];
+	// Each row of blocks is independent
+	parallelFor(by * d, [&](int row) {
+		int slice = row / by;
+		int y = row % by;
+		const byte* src = data + slice * w * h * channels;
+		byte* dst = out + (slice * by + y) * bx * bs;
+		ColourBlock block;
+		for(int x=0; x<bx; ++x) {
+			readBlock(src, w, h, channels, x, y, block);
+			encodeBlock(block, to, dst + x * bs, highQuality);
+		}
+	}, threads);
+	return out;
+}
+
+// ===================================================================== //
+//                          Mipmap Generation                            //
+// ===================================================================== //
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define IMAGE_SSE
+#endif
+
+namespace {
+	struct FilterTap { int first, count, offset; };
+
+	// Kaiser windowed sinc. Same parameters as nvtt
+	float kaiserFilter(float x) {
+		const float width = 3.f, alpha = 4.f;
+		auto bessel0 = [](float x) {
+			float sum = 1, term = 1, k = 0;
+			do { ++k; term *= (x*x/4) / (k*k); sum += term; } while(term > sum * 1e-6f);
+			return sum;
+		};
+		if(fabs(x) >= width) return 0;
+		float sinc = x==0? 1: sin(3.14159265f * x) / (3.14159265f * x);
+		float t = x / width;
+		return sinc * bessel0(alpha * sqrt(1 - t*t)) / bessel0(alpha);
+	}
+
+	// Build normalised filter weights to downsample a line of src pixels to dst pixels
+	void createFilterTaps(int src, int dst, Image::MipFilter filter, std::vector<FilterTap>& taps, std::vector<float>& weights) {
+		const float scale = (float)src / dst;
+		const float radius = filter == Image::BOX? 0.5f: 3.f;
+		taps.resize(dst);
+		weights.clear();
+		for(int x=0; x<dst; ++x) {
+			float centre = (x + 0.5f) * scale;
+			int first = (int)floor(centre - radius * scale);
+			int last = (int)ceil(centre + radius * scale);
+			FilterTap& tap = taps[x];
+			tap.first = first;
+			tap.offset = weights.size();
+			float total = 0;
+			for(int i=first; i<=last; ++i) {
+				float t = (i + 0.5f - centre) / scale;
+				float w = filter == Image::BOX? (fabs(t) <= 0.5f? 1.f: 0.f): kaiserFilter(t);
+				weights.push_back(w);
+				total += w;
+			}
+			tap.count = weights.size() - tap.offset;
+			for(int i=0; i<tap.count; ++i) weights[tap.offset + i] /= total;
+		}
+	}
+
+	struct ColourSpace {
+		float toLinear[256];
+		byte fromLinear[4097];
+		ColourSpace() {
+			for(int i=0; i<256; ++i) {
+				float c = i / 255.f;
+				toLinear[i] = c <= 0.04045f? c / 12.92f: powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for(int i=0; i<=4096; ++i) {
+				float c = i / 4096.f;
+				c = c <= 0.0031308f? c * 12.92f: 1.055f * powf(c, 1/2.4f) - 0.055f;
+				fromLinear[i] = (byte)(c * 255 + 0.5f);
+			}
+		}
+	};
+	const ColourSpace& getColourSpace() {
+		static ColourSpace colourSpace;
+		return colourSpace;
+	}
+}
+
+// Downsample one surface. Pixels are filtered as four floats regardless of channel count.
+void downsampleSurface(const byte* src, int sw, int sh, byte* dst, int dw, int dh, int channels, Image::MipFilter filter, bool srgb, int threads) {
+	std::vector<FilterTap> tapsX, tapsY;
+	std::vector<float> weightsX, weightsY;
+	createFilterTaps(sw, dw, filter, tapsX, weightsX);
+	createFilterTaps(sh, dh, filter, tapsY, weightsY);
+
+	// Conversion tables
+	const ColourSpace& colourSpace = getColourSpace();
+	float decode[4][256];
+	byte encode[4][4097];
+	for(int c=0; c<4; ++c) {
+		bool linear = !srgb || c==3;
+		for(int i=0; i<256; ++i) decode[c][i] = linear? i / 255.f: colourSpace.toLinear[i];
+		for(int i=0; i<=4096; ++i) encode[c][i] = linear? (byte)(i * 255 / 4096.f + 0.5f): colourSpace.fromLinear[i];
+	}
+
+	if(threads <= 0) threads = Thread::cores();
+	if(threads > dh) threads = dh;
+	parallelFor(threads, [&](int thread) {
+		float* row = new float[sw * 4 + 4];
+		float* line = new float[sw * 4 + 4]; // decoded source line
+		for(int y = dh*thread/threads; y < dh*(thread+1)/threads; ++y) {
+			// Vertical pass
+			const FilterTap& ty = tapsY[y];
+			memset(row, 0, sw * 4 * sizeof(float));
+			for(int t=0; t<ty.count; ++t) {
+				int sy = ty.first + t;
+				sy = sy<0? 0: sy>=sh? sh-1: sy;
+				const byte* s = src + sy * sw * channels;
+				for(int x=0; x<sw; ++x, s+=channels) {
+					float* l = line + x * 4;
+					for(int c=0; c<channels; ++c) l[c] = decode[c][s[c]];
+					for(int c=channels; c<4; ++c) l[c] = 0;
+				}
+				float weight = weightsY[ty.offset + t];
+				#ifdef IMAGE_SSE
+				__m128 w = _mm_set1_ps(weight);
+				for(int x=0; x<sw*4; x+=4) _mm_storeu_ps(row+x, _mm_add_ps(_mm_loadu_ps(row+x), _mm_mul_ps(_mm_loadu_ps(line+x), w)));
+				#else
+				for(int x=0; x<sw*4; ++x) row[x] += line[x] * weight;
+				#endif
+			}
+
+			// Horizontal pass
+			byte* d = dst + y * dw * channels;
+			for(int x=0; x<dw; ++x, d+=channels) {
+				const FilterTap& tx = tapsX[x];
+				float out[4];
+				#ifdef IMAGE_SSE
+				__m128 sum = _mm_setzero_ps();
+				for(int t=0; t<tx.count; ++t) {
+					int sx = tx.first + t;
+					sx = sx<0? 0: sx>=sw? sw-1: sx;
+					sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(row + sx*4), _mm_set1_ps(weightsX[tx.offset + t])));
+				}
+				sum = _mm_min_ps(_mm_max_ps(sum, _mm_setzero_ps()), _mm_set1_ps(1.f));
+				_mm_storeu_ps(out, sum);
+				#else
+				out[0] = out[1] = out[2] = out[3] = 0;
+				for(int t=0; t<tx.count; ++t) {
+					int sx = tx.first + t;
+					sx = sx<0? 0: sx>=sw? sw-1: sx;
+					float weight = weightsX[tx.offset + t];
+					for(int c=0; c<4; ++c) out[c] += row[sx*4 + c] * weight;
+				}
+				for(int c=0; c<4; ++c) out[c] = out[c]<0? 0: out[c]>1? 1: out[c];
+				#endif
+				for(int c=0; c<channels; ++c) d[c] = encode[c][(int)(out[c] * 4096 + 0.5f)];
+			}
+		}
+		delete [] row;
+		delete [] line;
+	}, threads);
+}
+
+bool Image::generateMips(MipFilter filter, bool srgb, int threads) {
+	if(!m_data || getPixelType(m_format) != BYTE) return false;
+	if(m_mode != FLAT && m_mode != CUBE) return false;
+
+	int mips = 1;
+	for(int s = m_width>m_height? m_width: m_height; s>1; s>>=1) ++mips;
+
+	// Keep top level, discard existing mipmaps
+	int faces = getFaces();
+	const int channels = getChannels();
+	byte** data = new byte*[faces * mips];
+	for(int i=0; i<faces; ++i) data[i] = m_data[i];
+	for(int i=faces; i<faces*m_mips; ++i) delete [] m_data[i];
+	delete [] m_data;
+	m_data = data;
+	m_mips = mips;
+
+	for(int n=0; n<faces; ++n) {
+		int w = m_width, h = m_height;
+		for(int i=1; i<mips; ++i) {
+			int dw = w>1? w>>1: 1;
+			int dh = h>1? h>>1: 1;
+			byte* out = new byte[dw * dh * channels];
+			downsampleSurface(m_data[n + (i-1)*faces], w, h, out, dw, dh, channels, filter, srgb, threads);
+			m_data[n + i*faces] = out;
+			w = dw;
+			h = dh;
+		}
+	}
+	return true;
+}
+
+// ===================================================================== //
+
 byte* Image::convertSurface(const byte* data, int w, int h, int d, Format to, const char* swizzle) const {
 	if(isCompressed(to)) return nullptr;
 	Format format = m_format;
@@ -347,64 +858,31 @@ byte* Image::convertSurface(const byte* data, int w, int h, int d, Format to, co
 		case BC5: intermediateFormat = getChannels(to) < 3? RG8: RGB8; break; // Optionally decode blue channel
 		default: return nullptr;
 		}
-		byte* out = intermediateData = new byte[w*h*getBytesPerPixel(intermediateFormat)];
-		byte table[12];
-		const int bx = w / 4;
-		const int by = h / 4;
-		const int bs = format==BC1? 8: 16;
-		const int line = bx * bs;
-
-		// Colour blocks
-		if(format < BC3) {
-			int bpp = format == BC1? 3: 4;
-			const byte* cdata = intermediateFormat==BC1? data: data+8;
-			byte* cout = out + (intermediateFormat==BC1? 0: 1);
-			for(int x=0; x<bx; ++x) for(int y=0; y<by; ++y) {
-				const byte* block = cdata + x * bs + y*line;
-				// decode R5G6b5 colour
-				createBC1Table(block, block+2, table);
-				// Decode pixels
-				for(int i=0; i<4; ++i) for(int j=0; j<4; ++j) {
-					int p = (block[j+4]>>(i*2)) & 3;
-					byte* px = cout + (x*4+i + (y*4+j) * w) * bpp;
-					memcpy(px, table + p*3, 3);
-				}
+		const int bpp = getBytesPerPixel(intermediateFormat);
+		byte* out = intermediateData = new byte[w*h*d*bpp];
+		const int bx = (w+3) / 4;
+		const int by = (h+3) / 4;
+		const int bs = blockSize(format);
+		ColourBlock block;
+		for(int z=0; z<d; ++z) {
+			const byte* src = data + z * bx * by * bs;
+			byte* dst = out + z * w * h * bpp;
+			for(int y=0; y<by; ++y) for(int x=0; x<bx; ++x) {
+				decodeBlock(src + (x + y*bx) * bs, format, block);
+				writeBlock(block, dst, w, h, bpp, x, y);
 			}
 		}
-		// Single channel blocks
-		switch(format) {
-		case BC2: // BC2 alpha is never used, but may as well implement it
-			for(int x=0; x<bx; ++x) for(int y=0; y<by; ++y) {
-				const byte* block = data + x * bs + y*line;
-				for(int i=0; i<4; ++i) for(int j=0; j<4; ++j) {
-					int a = (block[j+4]>>(i*2)) & 3;
-					byte* px = out + (x*4+i + (y*4+j) * w) * 4; // bpp=4
-					px[0]  = a * 85;
-				}
-			}
-			break;
-		case BC3:	// BC3 Alpla
-			decompressBC4Channel(data, bx, by, 16, out, 4);
-			break;
-		case BC4:	// Single BC4 block
-			decompressBC4Channel(data, bx, by, 8, out, 1);
-			break;
-		case BC5:	// Dual BC4 blocks
-			if(intermediateFormat == RG8) {
-				decompressBC4Channel(data, bx, by, 16, out, 2);
-				decompressBC4Channel(data+8, bx, by, 16, out+1, 2);
-			}
-			else { // Probably a normal map - calculate blue channel from red,green
-				decompressBC4Channel(data, bx, by, 16, out, 3);
-				decompressBC4Channel(data+8, bx, by, 16, out+1, 3);
-				byte* end = out + w * h * 3;
-				for(byte* pixel = out; pixel<end; pixel += 3) {
-					pixel[2] = 255 * sqrt(1.f - (powf(pixel[0]/255.0, 2) + powf(pixel[1]/255.f, 2)));
-				}
+
+		// Probably a normal map - calculate blue channel from red,green
+		if(format == BC5 && intermediateFormat == RGB8) {
+			byte* end = out + w * h * d * 3;
+			for(byte* pixel = out; pixel<end; pixel += 3) {
+				float x = pixel[0]/127.5f - 1.f, y = pixel[1]/127.5f - 1.f;
+				float z = 1.f - x*x - y*y;
+				pixel[2] = 127.5f * (sqrt(z>0? z: 0) + 1.f);
 			}
-			break;
-		default: break;
 		}
+
 		// Are we done, or do we need to convert further ?
 		if(intermediateFormat == to && !hasSwizzle) return out;
 		format = intermediateFormat;
@@ -415,7 +893,7 @@ byte* Image::convertSurface(const byte* data, int w, int h, int d, Format to, co
 	// Channel changes
 	int istride = getBytesPerPixel(format);
 	int ostride = getBytesPerPixel(to);
-	int count = w*h;
+	int count = w*h*d;
 	byte* out = new byte[count * ostride];
 	const byte* i = data;
 	byte* o = out;
@@ -428,7 +906,7 @@ byte* Image::convertSurface(const byte* data, int w, int h, int d, Format to, co
 		offsets[c] = getPixelOffset(format, swizzle[c]);
 		if(offsets[c] < 0 || offsets[c] >= getChannels(format)) {
 			offsets[c] = 0;
-			if(!zeroed) memset(out, 0, count * istride);
+			if(!zeroed) memset(out, 0, count * ostride);
 			zeroed = true;
 		}
 	}
@@ -440,4 +918,3 @@ byte* Image::convertSurface(const byte* data, int w, int h, int d, Format to, co
 	delete [] intermediateData;
 	return out;
 }
-
@@ -2,11 +2,18 @@
 #include <base/skeleton.h>
 #include <base/thread.h>
 #include <cstring>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ANIMATION_SSE
+#endif
 
 using namespace base;
 
-Animation::Animation() : m_animations(0), m_name(""), m_length(0), m_fps(0), m_loop(true) {}
+Animation::Animation() : m_animations(0), m_name(""), m_length(0), m_fps(0), m_loop(true), m_clip(0) {}
 Animation::~Animation() {
+	delete m_clip;
 	for(uint i=0; i<m_animations.size(); ++i)
 		delete m_animations[i];
 }
@@ -18,6 +25,7 @@ int Animation::getBoneID(const char* name) const {
 	return -1;
 }
 int Animation::addKeySet(const char* name) {
+	dropClip();
 	m_animations.push_back( new KeySet() );
 	strcpy(m_animations.back()->name, name);
 	return m_animations.size()-1;
@@ -25,13 +33,15 @@ int Animation::addKeySet(const char* name) {
 
 // --------------------------------------------------------------------------------------------- //
 
+static base::Mutex s_mapMutex;	// Maps can be requested from animation worker threads
 const unsigned char* Animation::getMap(const Skeleton* s) const {
 	// Find it in list
+	MutexLock lock(s_mapMutex);
 	unsigned id = s->getMapID();
 	for(uint i=0; i<m_maps.size(); ++i) {
 		if(m_maps[i].skeletonID == id) return m_maps[i].map;
 	}
-	// Create it	TODO move this into Skeleton class to fix threading issues and potential memory leak.
+	// Create it	TODO move this into Skeleton class to fix potential memory leak.
 	SkeletonMap map;
 	map.size = s->getBoneCount();
 	map.map = new unsigned char[ map.size ];
@@ -39,8 +49,6 @@ const unsigned char* Animation::getMap(const Skeleton* s) const {
 	for(int i=0; i<map.size; ++i) {
 		map.map[i] = (unsigned char)getBoneID( s->getBone(i)->getName() );
 	}
-	static base::Mutex m;
-	MutexLock lock(m);
 	m_maps.push_back(map);
 	return map.map;
 }
@@ -66,6 +74,7 @@ void Animation::addKey( std::vector< Keyframe<N> >& keys, int frame, const float
 		}
 	}
 	// Set key
+	dropClip();
 	keys[index].frame = frame;
 	memcpy(keys[index].data, value, N*sizeof(float));
 	if(frame>m_length) m_length = frame;
@@ -90,6 +99,7 @@ template<int N>
 bool Animation::removeKey(std::vector< Keyframe<N> >& keys, int frame) {
 	for(unsigned int i=0; i<keys.size(); ++i) {
 		if(keys[i].frame == frame) {
+			dropClip();
 			keys.erase( keys.begin()+i );
 			return true;
 		}
@@ -130,7 +140,16 @@ inline int Animation::getValue( std::vector< Keyframe<N> >& keys, float frame, i
 		if(hint > count) hint = count; // validate hint
 		if((hint<count && keys[hint].frame<frame) || (hint>0 && keys[hint-1].frame>frame)) {
 			if(frame>=keys[count-1].frame) hint=count;
-			else for(int i=0; i<count; ++i) if(keys[i].frame>frame) { hint = i; break; }
+			else {
+				// Binary search for first key after frame
+				int lo = 0, hi = count - 1;
+				while(lo < hi) {
+					int mid = (lo + hi) >> 1;
+					if(keys[mid].frame > frame) hi = mid;
+					else lo = mid + 1;
+				}
+				hint = lo;
+			}
 		}
 		// Interpolate
 		if(hint==0) memcpy(value, keys[0].data, N*sizeof(float));
@@ -165,7 +184,17 @@ int Animation::getScale(int bone, float frame, int hint, vec3& s) const {
 
 // --------------------------------------------------------------------------------------------- //
 
+void Animation::bake(float step) {
+	dropClip();
+	m_clip = new AnimationClip(this, step);
+}
+
+void Animation::dropClip() {
+	delete m_clip;
+	m_clip = 0;
+}
 
+// --------------------------------------------------------------------------------------------- //
 
 Animation* Animation::subAnimation(int start, int end) const {
 	Animation* a = new Animation;
@@ -220,3 +249,216 @@ Animation* Animation::subAnimation(int start, int end) const {
 }
 
 
+
+
+
+// ===================================================================== //
+//                          Baked Animation Clip                         //
+// ===================================================================== //
+
+namespace {
+	const float QuatRange = 0.70710678f;	// Smallest three components are within +-1/sqrt(2)
+
+	// Quantise quaternion to 48 bits. Index of the dropped component uses the top bit of the first two values
+	void encodeRotation(const Quaternion& q, uint16* out) {
+		float v[4] = { q.w, q.x, q.y, q.z };
+		float len = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2] + v[3]*v[3]);
+		int largest = 0;
+		for(int i=1; i<4; ++i) if(fabs(v[i]) > fabs(v[largest])) largest = i;
+		float scale = (v[largest] < 0? -1.f: 1.f) / len;
+		uint16 c[3];
+		for(int i=0, k=0; i<4; ++i) {
+			if(i == largest) continue;
+			float n = (v[i] * scale / QuatRange + 1) * 0.5f;
+			c[k++] = (uint16)(fmin(fmax(n, 0.f), 1.f) * 32767 + 0.5f);
+		}
+		out[0] = c[0] | (largest & 1) << 15;
+		out[1] = c[1] | (largest >> 1) << 15;
+		out[2] = c[2];
+	}
+
+	inline void decodeRotation(const uint16* in, float* out) {
+		const float scale = 2 * QuatRange / 32767;
+		int largest = (in[0] >> 15) | (in[1] >> 15) << 1;
+		float a = (in[0] & 0x7fff) * scale - QuatRange;
+		float b = (in[1] & 0x7fff) * scale - QuatRange;
+		float c = (in[2] & 0x7fff) * scale - QuatRange;
+		float d = sqrt(fmax(0.f, 1 - a*a - b*b - c*c));
+		switch(largest) {
+		case 0: out[0]=d; out[1]=a; out[2]=b; out[3]=c; break;
+		case 1: out[0]=a; out[1]=d; out[2]=b; out[3]=c; break;
+		case 2: out[0]=a; out[1]=b; out[2]=d; out[3]=c; break;
+		case 3: out[0]=a; out[1]=b; out[2]=c; out[3]=d; break;
+		}
+	}
+
+	// Normalised lerp along the shortest path
+	inline void nlerp(float* out, const float* qa, const float* qb, float t) {
+		#ifdef ANIMATION_SSE
+		__m128 a = _mm_loadu_ps(qa);
+		__m128 b = _mm_loadu_ps(qb);
+		__m128 d = _mm_mul_ps(a, b);
+		d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2,3,0,1)));
+		d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1,0,3,2)));
+		b = _mm_xor_ps(b, _mm_and_ps(d, _mm_set1_ps(-0.f)));
+		__m128 r = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), _mm_set1_ps(t)));
+		__m128 l = _mm_mul_ps(r, r);
+		l = _mm_add_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2,3,0,1)));
+		l = _mm_add_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1,0,3,2)));
+		_mm_storeu_ps(out, _mm_div_ps(r, _mm_sqrt_ps(l)));
+		#else
+		float dot = qa[0]*qb[0] + qa[1]*qb[1] + qa[2]*qb[2] + qa[3]*qb[3];
+		float tb = dot < 0? -t: t, ta = 1 - t;
+		float r[4];
+		for(int i=0; i<4; ++i) r[i] = qa[i] * ta + qb[i] * tb;
+		float len = 1.f / sqrt(r[0]*r[0] + r[1]*r[1] + r[2]*r[2] + r[3]*r[3]);
+		for(int i=0; i<4; ++i) out[i] = r[i] * len;
+		#endif
+	}
+
+	// Quantise a track to 16 bits over its range. Returns false if the track is constant
+	bool getRange(const vec3* values, int count, int stride, vec3& min, vec3& range) {
+		vec3 max = min = values[0];
+		for(int i=1; i<count; ++i) {
+			const vec3& v = values[i * stride];
+			for(int k=0; k<3; ++k) {
+				if(v[k] < min[k]) min[k] = v[k];
+				if(v[k] > max[k]) max[k] = v[k];
+			}
+		}
+		range = max - min;
+		if(range.x < 1e-5f && range.y < 1e-5f && range.z < 1e-5f) {
+			range.set(0,0,0);
+			return false;
+		}
+		range /= 65535.f;
+		return true;
+	}
+	void encodeVector(const vec3& v, const vec3& min, const vec3& range, uint16* out) {
+		for(int k=0; k<3; ++k) out[k] = range[k] > 0? (uint16)fmin((v[k] - min[k]) / range[k] + 0.5f, 65535.f): 0;
+	}
+	inline void decodeVector(const uint16* a, const uint16* b, float t, const vec3& min, const vec3& range, vec3& out) {
+		out.x = min.x + range.x * (a[0] + (b[0] - a[0]) * t);
+		out.y = min.y + range.y * (a[1] + (b[1] - a[1]) * t);
+		out.z = min.z + range.z * (a[2] + (b[2] - a[2]) * t);
+	}
+}
+
+AnimationClip::AnimationClip(const Animation* src, float step) : m_stride(0), m_samples(0), m_step(step>0? step: 1) {
+	m_length = src->getLength();
+	m_fps = src->getSpeed();
+	m_loop = src->isLoop();
+	m_samples = (int)ceil(m_length / m_step) + 1;
+
+	// Resample source animation
+	const int count = src->getSize();
+	std::vector<Quaternion> rot(m_samples * count);
+	std::vector<vec3> pos(m_samples * count), scl(m_samples * count);
+	for(int i=0; i<count; ++i) {
+		int hint[3] = { 0, 0, 0 };
+		for(int s=0; s<m_samples; ++s) {
+			float frame = fmin(s * m_step, m_length);
+			int k = s * count + i;
+			hint[0] = src->getRotation(i, frame, hint[0], rot[k]);
+			hint[1] = src->getPosition(i, frame, hint[1], pos[k]);
+			hint[2] = src->getScale(i, frame, hint[2], scl[k]);
+		}
+	}
+
+	// Determine which channels are animated and lay out sample block
+	m_tracks.resize(count);
+	for(int i=0; i<count; ++i) {
+		Track& track = m_tracks[i];
+		strcpy(track.name, src->getName(i));
+		const Quaternion& q0 = rot[i];
+		track.constRotation = q0;
+		track.rotation = -1;
+		for(int s=1; s<m_samples; ++s) {
+			const Quaternion& q = rot[s * count + i];
+			if(fabs(q0.w*q.w + q0.x*q.x + q0.y*q.y + q0.z*q.z) < 1 - 1e-6f) {
+				track.rotation = m_stride;
+				m_stride += 3;
+				break;
+			}
+		}
+		track.position = getRange(&pos[i], m_samples, count, track.positionMin, track.positionRange)? m_stride: -1;
+		if(track.position >= 0) m_stride += 3;
+		track.scale = getRange(&scl[i], m_samples, count, track.scaleMin, track.scaleRange)? m_stride: -1;
+		if(track.scale >= 0) m_stride += 3;
+	}
+
+	// Encode animated channels
+	m_data.resize(m_stride * m_samples);
+	for(int s=0; s<m_samples; ++s) {
+		uint16* block = &m_data[s * m_stride];
+		for(int i=0; i<count; ++i) {
+			const Track& track = m_tracks[i];
+			int k = s * count + i;
+			if(track.rotation >= 0) encodeRotation(rot[k], block + track.rotation);
+			if(track.position >= 0) encodeVector(pos[k], track.positionMin, track.positionRange, block + track.position);
+			if(track.scale >= 0) encodeVector(scl[k], track.scaleMin, track.scaleRange, block + track.scale);
+		}
+	}
+}
+
+AnimationClip::~AnimationClip() {
+}
+
+int AnimationClip::getBoneID(const char* name) const {
+	for(uint i=0; i<m_tracks.size(); ++i) {
+		if(strcmp(m_tracks[i].name, name)==0) return i;
+	}
+	return -1;
+}
+
+size_t AnimationClip::getMemoryUsage() const {
+	return sizeof(AnimationClip) + m_tracks.size() * sizeof(Track) + m_data.size() * sizeof(uint16);
+}
+
+inline void AnimationClip::getBlocks(float frame, const uint16*& a, const uint16*& b, float& t) const {
+	// Looping clips wrap like AnimationState does, others clamp
+	if(m_loop && m_length > 0) frame -= floor(frame / m_length) * m_length;
+	int index = (int)(frame / m_step);
+	if(frame <= 0) index = 0, t = 0;
+	else if(index >= m_samples - 1) index = m_samples - 1, t = 0;
+	else {
+		// Last sample is at the end of the animation, which may be less than a step after the previous one
+		float start = index * m_step;
+		float end = fmin(start + m_step, m_length);
+		t = (frame - start) / (end - start);
+	}
+	a = m_data.data() + index * m_stride;
+	b = t > 0? a + m_stride: a;
+}
+
+inline void AnimationClip::sampleTrack(const Track& track, const uint16* a, const uint16* b, float t, Transform& out) const {
+	if(track.rotation < 0) out.rotation = track.constRotation;
+	else {
+		float qa[4], qb[4];
+		decodeRotation(a + track.rotation, qa);
+		decodeRotation(b + track.rotation, qb);
+		nlerp(out.rotation, qa, qb, t);
+	}
+	if(track.position < 0) out.position = track.positionMin;
+	else decodeVector(a + track.position, b + track.position, t, track.positionMin, track.positionRange, out.position);
+	if(track.scale < 0) out.scale = track.scaleMin;
+	else decodeVector(a + track.scale, b + track.scale, t, track.scaleMin, track.scaleRange, out.scale);
+}
+
+void AnimationClip::sampleAll(float frame, Transform* out) const {
+	const uint16* a;
+	const uint16* b;
+	float t;
+	getBlocks(frame, a, b, t);
+	for(size_t i=0; i<m_tracks.size(); ++i) {
+		sampleTrack(m_tracks[i], a, b, t, out[i]);
+	}
+}
+
+void AnimationClip::sample(int set, float frame, Transform& out) const {
+	const uint16* a;
+	const uint16* b;
+	float t;
+	getBlocks(frame, a, b, t);
+	sampleTrack(m_tracks[set], a, b, t, out);
+}
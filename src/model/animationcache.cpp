@@ -0,0 +1,151 @@
+#include <base/animationcache.h>
+#include <base/skeleton.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace base;
+
+AnimationCache::AnimationCache(float step, int capacity)
+	: m_frameStep(step>0? step: 1), m_time(0), m_capacity(capacity), m_phases(8), m_frame(0)
+{
+	resetStats();
+}
+
+AnimationCache::~AnimationCache() {
+	clear();
+}
+
+void AnimationCache::setFrameStep(float step) {
+	MutexLock lock(m_mutex);
+	if(step <= 0 || step == m_frameStep) return;
+	clearEntries();	// Existing keys are invalid
+	m_frameStep = step;
+}
+
+void AnimationCache::setCapacity(int entries) {
+	MutexLock lock(m_mutex);
+	m_capacity = entries>1? entries: 1;
+	while((int)m_entries.size() > m_capacity) evict();
+	rebuild();
+}
+
+void AnimationCache::setCrowdPhases(int phases) {
+	MutexLock lock(m_mutex);
+	m_phases = phases>0? phases: 1;
+}
+
+void AnimationCache::update(float time) {
+	MutexLock lock(m_mutex);
+	m_time += time;
+	++m_frame;
+	updateSize();
+}
+
+void AnimationCache::clear() {
+	MutexLock lock(m_mutex);
+	clearEntries();
+}
+
+void AnimationCache::clearEntries() {
+	for(Entry& e: m_entries) delete e.pose;
+	m_entries.clear();
+	m_table.clear();
+	updateSize();
+}
+
+void AnimationCache::updateSize() {
+	m_stats.entries = m_entries.size();
+	m_stats.memory = 0;
+	for(const Entry& e: m_entries) m_stats.memory += e.pose->getMemoryUsage();
+}
+
+void AnimationCache::resetStats() {
+	MutexLock lock(m_mutex);
+	m_stats.lookups = m_stats.hits = m_stats.matrixHits = 0;
+	updateSize();
+}
+
+AnimationCache::Key AnimationCache::makeKey(const Animation* anim, const unsigned char* keyMap, float frame, int variant) const {
+	return Key{ anim, keyMap, (int)floor(frame / m_frameStep + 0.5f), variant };
+}
+
+size_t AnimationCache::hash(const Key& key) const {
+	size_t h = (size_t)key.animation >> 4;
+	h = h * 31 + ((size_t)key.keyMap >> 4);
+	h = h * 31 + key.frame;
+	h = h * 31 + key.variant;
+	return h ^ (h >> 16);
+}
+
+AnimationCache::Entry* AnimationCache::find(const Key& key) {
+	if(m_table.empty()) return nullptr;
+	const size_t mask = m_table.size() - 1;
+	for(size_t i = hash(key) & mask; m_table[i] >= 0; i = (i+1) & mask) {
+		Entry& e = m_entries[ m_table[i] ];
+		if(e.key == key) return &e;
+	}
+	return nullptr;
+}
+
+void AnimationCache::rebuild() {
+	size_t size = 16;
+	while(size < m_entries.size() * 2 || size < (size_t)m_capacity) size *= 2;
+	m_table.assign(size, -1);
+	const size_t mask = size - 1;
+	for(size_t e=0; e<m_entries.size(); ++e) {
+		size_t i = hash(m_entries[e].key) & mask;
+		while(m_table[i] >= 0) i = (i+1) & mask;
+		m_table[i] = e;
+	}
+}
+
+void AnimationCache::evict() {
+	// Drop the least recently used quarter
+	std::sort(m_entries.begin(), m_entries.end(), [](const Entry& a, const Entry& b) { return a.used > b.used; });
+	size_t keep = m_entries.size() - m_entries.size() / 4 - 1;
+	for(size_t i=keep; i<m_entries.size(); ++i) delete m_entries[i].pose;
+	m_entries.resize(keep);
+}
+
+int AnimationCache::fetch(const Key& key, Skeleton* skeleton, bool matrices) {
+	MutexLock lock(m_mutex);
+	++m_stats.lookups;
+	Entry* e = find(key);
+	if(!e || !skeleton->isPoseCompatible(*e->pose)) return 0;
+	e->used = m_frame;
+	++m_stats.hits;
+	if(skeleton->loadPose(*e->pose, matrices)) {
+		++m_stats.matrixHits;
+		return 2;
+	}
+	return 1;
+}
+
+void AnimationCache::store(const Key& key, const Skeleton* skeleton, bool matrices) {
+	MutexLock lock(m_mutex);
+	Entry* e = find(key);
+	if(e && skeleton->isPoseCompatible(*e->pose)) {
+		if(matrices && !e->pose->hasMatrices()) skeleton->savePose(*e->pose, true);
+		e->used = m_frame;
+		return;
+	}
+	else if(!e) {
+		if((int)m_entries.size() >= m_capacity) {
+			evict();
+			rebuild();
+		}
+		m_entries.push_back(Entry{ key, new Skeleton::Pose(), m_frame });
+		if(m_table.size() < m_entries.size() * 2) rebuild();
+		else {
+			const size_t mask = m_table.size() - 1;
+			size_t i = hash(key) & mask;
+			while(m_table[i] >= 0) i = (i+1) & mask;
+			m_table[i] = m_entries.size() - 1;
+		}
+		e = &m_entries.back();
+	}
+	// New entry, or a different skeleton with the same animation map replacing the entry
+	e->used = m_frame;
+	skeleton->savePose(*e->pose, matrices);
+}
+
@@ -3,6 +3,7 @@
 #include <base/animation.h>
 #include <base/animationstate.h>
 #include <base/animationcontroller.h>
+#include <base/animationcache.h>
 #include <algorithm>
 #include <assert.h>
 #include <cstdio>
@@ -27,11 +28,14 @@ const char* AnimationKey::lookup(uint key) {
 
 // ============================================================================================= //
 
-AnimationBank::AnimationBank(const char* rootBone, const vec3& forward) : m_forward(forward) {
+AnimationBank::AnimationBank(const char* rootBone, const vec3& forward) : m_lodScreenSize(false), m_forward(forward) {
 	m_rootBone = rootBone? strdup(rootBone): 0;
 }
 AnimationBank::~AnimationBank() {
 	free((char*)m_rootBone);
+	for(LODLevel& lod: m_lods) {
+		for(const char* bone: lod.truncate) free((char*)bone);
+	}
 	for(AnimationInfo* a: m_animations) {
 		while(a) {
 			AnimationInfo* next = a->next;
@@ -201,13 +205,42 @@ const AnimationBank::AnimationInfo* AnimationBank::getAnimation(float speed, int
 }
 
 
+void AnimationBank::addLOD(float threshold, int interval, std::initializer_list<const char*> truncate) {
+	LODLevel lod;
+	lod.threshold = threshold;
+	lod.interval = interval>1? interval: 1;
+	for(const char* bone: truncate) lod.truncate.push_back(strdup(bone));
+	m_lods.push_back(lod);
+	setLODScreenSize(m_lodScreenSize);
+}
+
+void AnimationBank::setLODScreenSize(bool screenSize) {
+	m_lodScreenSize = screenSize;
+	// Levels ordered from most to least detail
+	if(screenSize) std::sort(m_lods.begin(), m_lods.end(), [](const LODLevel& a, const LODLevel& b) { return a.threshold > b.threshold; });
+	else std::sort(m_lods.begin(), m_lods.end(), [](const LODLevel& a, const LODLevel& b) { return a.threshold < b.threshold; });
+}
+
+int AnimationBank::getLODLevel(float value) const {
+	int level = -1;
+	for(size_t i=0; i<m_lods.size(); ++i) {
+		if(m_lodScreenSize? value <= m_lods[i].threshold: value >= m_lods[i].threshold) level = i;
+		else break;
+	}
+	return level;
+}
+
+
 // ============================================================================================= //
 
+static int s_lodStagger = 0;	// Spreads reduced rate updates across frames
 
 AnimationController::AnimationController()
 	: m_state(0), m_bank(0), m_rootMotion(true), m_group(0),  m_moveSpeed(0)
 	, m_idleTrack(-1), m_actionTrack(-1), m_overrideStart(2), m_lastAction(-1)
 	, m_fadeTime(0.3), m_rootBone(0)
+	, m_lodValue(0), m_lod(-1), m_lodFrame(0), m_lodPhase(s_lodStagger++), m_lodValid(false), m_evaluated(0)
+	, m_cache(0), m_crowd(false)
 {
 }
 
@@ -230,6 +263,10 @@ void AnimationController::initialise(Model* model, AnimationBank* bank, bool roo
 
 void AnimationController::setAnimationBank(AnimationBank* bank) {
 	m_bank = bank;
+	m_lod = -1;
+	m_lodValid = false;
+	m_lodMasks.clear();
+	if(getSkeleton()) getSkeleton()->setLODMask(nullptr);
 	if(bank && getSkeleton()) {
 		m_rootBone = getSkeleton()->getBoneIndex( bank->getRootBone() );
 		if(m_rootBone<0) m_rootBone = 0;
@@ -551,6 +588,7 @@ bool AnimationController::currentActionAffectsBone(unsigned index) const {
 void AnimationController::update(float time, bool finalise) {
 	const float fade = time / m_fadeTime;
 	m_state->update(time, false);	// Advance animations
+	if(m_crowd && m_cache) snapCrowdPhase();
 
 
 	// Animation end handler
@@ -615,19 +653,55 @@ void AnimationController::update(float time, bool finalise) {
 	}
 
 
+	// Level of detail
+	int lod = m_bank? m_bank->getLODLevel(m_lodValue): -1;
+	int interval = lod<0? 1: m_bank->getLOD(lod).interval;
+	if(lod != m_lod) {
+		m_lod = lod;
+		m_lodValid = false;
+		getSkeleton()->setLODMask(lod<0? nullptr: getLODMask(lod));
+	}
+	const int phase = (++m_lodFrame + m_lodPhase) % interval;
+	const bool evaluate = interval==1 || phase==0 || !m_lodValid;
+
 	// Calculate movement deltas
-	if(m_rootMotion) {
-		updateRootOffset(true);
-		Bone* root = m_state->getSkeleton()->getBone(m_rootBone);
-		getSkeleton()->resetPose();
-		m_state->apply(false);
-		root->setPosition( vec3() );
-		root->setAngle( Quaternion() );
-		if(finalise) getSkeleton()->update();
+	if(m_rootMotion) updateRootOffset(true);
+
+	// Sample animations. Single animations can be shared through the pose cache
+	m_evaluated = 0;
+	int cacheTrack = -1;
+	int cached = 0;
+	AnimationCache::Key key;
+	if(evaluate) {
+		if(m_cache) cacheTrack = getCacheTrack();
+		if(cacheTrack >= 0) {
+			int variant = (lod + 1) | (int)m_state->getBlend(cacheTrack)<<8 | (m_rootMotion? m_rootBone+1: 0)<<10;
+			key = m_cache->makeKey(m_state->getAnimation(cacheTrack), m_state->getKeyMap(cacheTrack), m_state->getFrame(cacheTrack), variant);
+			cached = m_cache->fetch(key, getSkeleton(), finalise && interval==1);
+		}
+		if(!cached) {
+			getSkeleton()->resetPose();
+			if(cacheTrack >= 0) getSkeleton()->applyPose(key.animation, m_cache->getFrame(key), -1, (int)m_state->getBlend(cacheTrack), 1, key.keyMap);
+			else m_state->apply(false);
+			if(m_rootMotion) {
+				Bone* root = getSkeleton()->getBone(m_rootBone);
+				root->setPosition( vec3() );
+				root->setAngle( Quaternion() );
+			}
+			int bones = lod<0? getSkeleton()->getBoneCount(): m_lodBones[lod];
+			for(int i=m_state->getNextTrack(); i>=0; i=m_state->getNextTrack(i)) {
+				if(m_state->getWeight(i)!=0 || m_state->getBlend(i)==AnimationBlend::Set) m_evaluated += bones;
+			}
+			// Final matrices are added to the cache after update
+			if(cacheTrack >= 0 && !(finalise && interval==1)) m_cache->store(key, getSkeleton());
+		}
+		if(interval > 1) storeLODPose();
 	}
-	else {
-		getSkeleton()->resetPose();
-		m_state->apply(finalise);
+	// Reduced rate updates interpolate between the last two evaluated poses
+	if(interval > 1) applyLODPose((float)phase / interval);
+	if(finalise && cached < 2) {
+		getSkeleton()->update();
+		if(cacheTrack >= 0 && interval==1) m_cache->store(key, getSkeleton(), true);
 	}
 
 
@@ -719,3 +793,112 @@ void AnimationController::updateRootOffset(bool output) {
 	if(output) m_rotation = m_rootRest * m_rotation * m_rootSkin; // Object space rotation correction
 }
 
+
+
+// -------------------------------- //
+
+void AnimationController::setLODValue(float value) {
+	m_lodValue = value;
+}
+
+const unsigned char* AnimationController::getLODMask(int level) {
+	Skeleton* skeleton = getSkeleton();
+	if(m_lodMasks.size() != (size_t)m_bank->getLODCount()) {
+		m_lodMasks.assign(m_bank->getLODCount(), std::vector<unsigned char>());
+		m_lodBones.assign(m_bank->getLODCount(), 0);
+	}
+	std::vector<unsigned char>& mask = m_lodMasks[level];
+	if(mask.empty()) {
+		// Bones are animated unless an ancestor is truncated
+		const int count = skeleton->getBoneCount();
+		std::vector<unsigned char> truncated(count, 0);
+		for(const char* name: m_bank->getLOD(level).truncate) {
+			int bone = skeleton->getBoneIndex(name);
+			if(bone >= 0) truncated[bone] = 1;
+		}
+		mask.resize(count);
+		m_lodBones[level] = 0;
+		for(int i=0; i<count; ++i) {
+			Bone* parent = skeleton->getBone(i)->getParent();
+			mask[i] = !parent || (mask[parent->getIndex()] && !truncated[parent->getIndex()]);
+			m_lodBones[level] += mask[i];
+		}
+	}
+	return mask.data();
+}
+
+void AnimationController::storeLODPose() {
+	Skeleton* skeleton = getSkeleton();
+	m_lodPose[0].swap(m_lodPose[1]);
+	m_lodPose[1].resize(skeleton->getBoneCount());
+	for(int i=0; i<skeleton->getBoneCount(); ++i) {
+		const Bone* bone = skeleton->getBone(i);
+		LODPose& pose = m_lodPose[1][i];
+		pose.rotation = bone->getAngle();
+		pose.position = bone->getPosition();
+		pose.scale = bone->getScale();
+	}
+	if(!m_lodValid || m_lodPose[0].size() != m_lodPose[1].size()) m_lodPose[0] = m_lodPose[1];
+	m_lodValid = true;
+}
+
+void AnimationController::applyLODPose(float t) {
+	Skeleton* skeleton = getSkeleton();
+	const unsigned char* mask = m_lod<0? nullptr: m_lodMasks[m_lod].data();
+	for(int i=0; i<skeleton->getBoneCount(); ++i) {
+		Bone* bone = skeleton->getBone(i);
+		if(mask && !mask[i]) continue;	// Not animated at this level
+		if(bone->getMode()==Bone::USER || bone->getMode()==Bone::FIXED) continue;
+		const LODPose& a = m_lodPose[0][i];
+		const LODPose& b = m_lodPose[1][i];
+		// Normalised lerp along shortest path
+		const Quaternion& qa = a.rotation;
+		const Quaternion& qb = b.rotation;
+		float tb = qa.dot(qb) < 0? -t: t;
+		Quaternion q(qa.w + (qb.w*tb - qa.w*t), qa.x + (qb.x*tb - qa.x*t), qa.y + (qb.y*tb - qa.y*t), qa.z + (qb.z*tb - qa.z*t));
+		q.normalise();
+		bone->setAngle(q);
+		bone->setPosition(a.position + (b.position - a.position) * t);
+		bone->setScale(a.scale + (b.scale - a.scale) * t);
+	}
+}
+
+
+// -------------------------------- //
+
+void AnimationController::setPoseCache(AnimationCache* cache, bool crowd) {
+	m_cache = cache;
+	m_crowd = crowd;
+}
+
+int AnimationController::getCacheTrack() const {
+	// Only a single full weight animation on the whole skeleton is cached
+	int track = -1;
+	for(int i=m_state->getNextTrack(); i>=0; i=m_state->getNextTrack(i)) {
+		if(m_state->getWeight(i)==0 && m_state->getBlend(i)!=AnimationBlend::Set) continue;
+		if(track >= 0) return -1;
+		track = i;
+	}
+	if(track < 0 || m_state->getWeight(track) != 1 || m_state->getBone(track) >= 0) return -1;
+	return track;
+}
+
+void AnimationController::snapCrowdPhase() {
+	// Looping animations keep a fixed offset from the shared clock, rounded to a shared phase.
+	// Instances with the same phase then sample identical frames.
+	const double time = m_cache->getTime();
+	for(int i=m_state->getNextTrack(); i>=0; i=m_state->getNextTrack(i)) {
+		const Animation* anim = m_state->getAnimation(i);
+		const float length = anim->getLength();
+		const double rate = anim->getSpeed() * m_state->getSpeed(i);
+		if(!m_state->getLoop(i) || length <= 0 || rate == 0) continue;
+		const float step = length / m_cache->getCrowdPhases();
+		float clock = fmod(time * rate, (double)length);
+		float offset = m_state->getFrame(i) - clock;
+		offset = floor(offset / step + 0.5f) * step;
+		float frame = clock + offset;
+		frame -= floor(frame / length) * length;
+		m_state->setFrame(frame, i);
+	}
+}
+
@@ -104,6 +104,9 @@ float AnimationState::getFrameNormalised(int track) const {
 float AnimationState::getWeight(int track) const {
 	return m_animations[track].weight;
 }
+int AnimationState::getBone(int track) const {
+	return m_animations[track].bone;
+}
 
 AnimationBlend AnimationState::getBlend(int track) const {
 	return m_animations[track].blend;
@@ -0,0 +1,63 @@
+#include <base/animationsystem.h>
+#include <base/animationcontroller.h>
+#include <base/animationstate.h>
+#include <base/animationcache.h>
+#include <base/skeleton.h>
+#include <base/thread.h>
+#include <algorithm>
+
+using namespace base;
+
+AnimationSystem::AnimationSystem(int threads) : m_threads(threads), m_cache(0) {
+	m_stats.skeletons = m_stats.bones = m_stats.evaluated = 0;
+}
+
+void AnimationSystem::add(AnimationController* controller) {
+	if(!controller || !controller->getSkeleton()) return;
+	m_jobs.push_back(Job{controller->getSkeleton(), controller, nullptr});
+}
+
+void AnimationSystem::add(AnimationState* state) {
+	if(!state || !state->getSkeleton()) return;
+	m_jobs.push_back(Job{state->getSkeleton(), nullptr, state});
+}
+
+void AnimationSystem::clear() {
+	m_jobs.clear();
+}
+
+int AnimationSystem::run(const Job& job, float time) const {
+	if(job.controller) {
+		job.controller->update(time, true);
+		return job.controller->getEvaluatedBones();
+	}
+	job.state->update(time, true);
+	return job.skeleton->getBoneCount();
+}
+
+void AnimationSystem::update(float time) {
+	m_stats.skeletons = m_stats.bones = m_stats.evaluated = 0;
+	if(m_cache) m_cache->update(time);
+	if(m_jobs.empty()) return;
+
+	// Group jobs by skeleton as they can't be updated concurrently
+	std::stable_sort(m_jobs.begin(), m_jobs.end(), [](const Job& a, const Job& b) { return a.skeleton < b.skeleton; });
+	m_groups.clear();
+	for(size_t i=0; i<m_jobs.size(); ++i) {
+		if(i==0 || m_jobs[i].skeleton != m_jobs[i-1].skeleton) {
+			m_groups.push_back(i);
+			m_stats.bones += m_jobs[i].skeleton->getBoneCount();
+		}
+	}
+	m_groups.push_back(m_jobs.size());
+	m_stats.skeletons = m_groups.size() - 1;
+
+	m_evaluated.assign(m_stats.skeletons, 0);
+	parallelFor(m_stats.skeletons, [this, time](int group) {
+		for(int i=m_groups[group]; i<m_groups[group+1]; ++i) m_evaluated[group] += run(m_jobs[i], time);
+	}, m_threads);
+	for(int n: m_evaluated) m_stats.evaluated += n;
+
+	m_jobs.clear();
+}
+
@@ -254,9 +254,18 @@ Mesh* BMLoader::loadMesh(const XMLElement& e) {
 }
 // ----------------------------------------------------------------------------------------------------------- //
 
+static int countBones(const XMLElement& e) {
+	int count = 0;
+	for(XML::iterator i=e.begin(); i!=e.end(); ++i) {
+		if(*i == "bone") count += 1 + countBones(*i);
+	}
+	return count;
+}
+
 Skeleton* BMLoader::loadSkeleton(const XMLElement& e) {
 	// Create skeleton
 	Skeleton* skeleton = new Skeleton();
+	skeleton->reserve(countBones(e));
 
 	// Parse bones
 	for(XML::iterator i=e.begin(); i!=e.end(); ++i) {
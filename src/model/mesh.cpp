@@ -119,6 +119,9 @@ const char* Mesh::getSkinName(int i) const {
 size_t Mesh::getSkinCount() const {
 	return m_skinCount;
 }
+int Mesh::getMorphCount() const {
+	return m_morphCount;
+}
 size_t Mesh::getWeightsPerVertex() const {
 	return m_weightsPerVertex;
 }
@@ -1,8 +1,15 @@
 #include <base/model.h>
 #include <base/hardwarebuffer.h>
 #include <base/assert.h>
+#include <base/thread.h>
 #include <cstring>
 #include <cstdio>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define MODEL_SSE
+#endif
 
 using namespace base;
 
@@ -217,42 +224,146 @@ inline size_t getOffset(const base::HardwareVertexBuffer* buf, base::AttributeSe
 	return a? a.offset: ~0u;
 }
 
-void Model::skinMesh(Mesh* in, const Skeleton* s, int* map, Mesh* out) {
-	int wpv = in->getWeightsPerVertex();
-	const char* skinData = in->getSkinBuffer()->getData<char>();
-	size_t wOffset = getOffset(in->getSkinBuffer(), VA_SKINWEIGHT);
-	size_t iOffset = getOffset(in->getSkinBuffer(), VA_SKININDEX);
-	size_t stride = in->getSkinBuffer()->getStride();
+namespace {
+	// Affine transform stored as three rows. The fourth element of each row is the translation
+	struct SkinMatrix { float row[3][4]; };
+
+	struct SkinJob {
+		const char* source;		// Source vertex data
+		const char* skin;		// Skin weights and indices
+		char*       dest;		// Output vertex data
+		size_t      stride, skinStride;
+		size_t      vertex, normal, tangent;	// Attribute offsets
+		size_t      weights, indices;			// Skin attribute offsets
+		int         weightsPerVertex;
+		const SkinMatrix* palette;
+	};
+
+	const size_t SkinBatchSize = 4096;	// Minimum vertices per thread
 
-	// Setup skin matrices
-	Matrix* m = new Matrix[in->getSkinCount()];
-	for(uint i=0; i<in->getSkinCount(); ++i) {
-		m[i] =  s->getBone( map[i] )->getAbsoluteTransformation() * s->getSkinMatrix( map[i] );
+	#ifdef MODEL_SSE
+	inline __m128 load3(const char* p) {
+		const float* f = reinterpret_cast<const float*>(p);
+		return _mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<const __m64*>(f)), _mm_load_ss(f+2));
+	}
+	inline void store3(char* p, __m128 v) {
+		float* f = reinterpret_cast<float*>(p);
+		_mm_storel_pi(reinterpret_cast<__m64*>(f), v);
+		_mm_store_ss(f+2, _mm_movehl_ps(v, v));
+	}
+	// m holds columns
+	inline __m128 transform(const __m128* m, const float* v) {
+		__m128 r = _mm_mul_ps(m[0], _mm_set1_ps(v[0]));
+		r = _mm_add_ps(r, _mm_mul_ps(m[1], _mm_set1_ps(v[1])));
+		return _mm_add_ps(r, _mm_mul_ps(m[2], _mm_set1_ps(v[2])));
+	}
+	inline __m128 normalise(__m128 v) {
+		__m128 l = _mm_mul_ps(v, v);
+		l = _mm_add_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2,3,0,1)));
+		l = _mm_add_ps(l, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1,0,3,2)));
+		return _mm_cvtss_f32(l) > 0? _mm_div_ps(v, _mm_sqrt_ps(l)): v;
 	}
 
-	// Get vertex offsets from semantics
-	size_t vOffset = getOffset(in->getVertexBuffer(), VA_VERTEX);
-	//size_t nOffset = getOffset(in->getVertexBuffer(), VA_NORMAL);
-	//size_t tOffset = getOffset(in->getVertexBuffer(), VA_TANGENT);
-	size_t vStride = in->getVertexBuffer()->getStride();
-	char* source = in->getVertexBuffer()->getData<char>();
-	char* dest  = out->getVertexBuffer()->getData<char>();
-
-	// Positions
-	for(size_t i=0; i<in->getVertexCount(); ++i) {
-		vec3* vertexIn  = (vec3*) (source + vOffset + i*vStride);
-		vec3* vertexOut = (vec3*) (dest + vOffset + i*vStride);
-
-		float* weights = (float*) (skinData + i * stride + wOffset);
-		IndexType* indices = (IndexType*) (skinData + i*stride + iOffset);
-		
-		vertexOut->set(0,0,0);
-		for(int j=0; j<wpv && weights[j]>0; ++j) {
-			*vertexOut += m[ indices[j] ] * *vertexIn * weights[j];
+	void skinVertices(const SkinJob& shared, size_t begin, size_t end) {
+		const SkinJob job = shared; // Local copy as output writes may alias it
+		for(size_t i=begin; i<end; ++i) {
+			const float* weights = reinterpret_cast<const float*>(job.skin + i*job.skinStride + job.weights);
+			const IndexType* indices = reinterpret_cast<const IndexType*>(job.skin + i*job.skinStride + job.indices);
+			// Blend matrix rows, then transpose to columns once for all attributes
+			__m128 m[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+			for(int j=0; j<job.weightsPerVertex && weights[j]>0; ++j) {
+				const SkinMatrix& s = job.palette[ indices[j] ];
+				__m128 w = _mm_set1_ps(weights[j]);
+				m[0] = _mm_add_ps(m[0], _mm_mul_ps(_mm_loadu_ps(s.row[0]), w));
+				m[1] = _mm_add_ps(m[1], _mm_mul_ps(_mm_loadu_ps(s.row[1]), w));
+				m[2] = _mm_add_ps(m[2], _mm_mul_ps(_mm_loadu_ps(s.row[2]), w));
+			}
+			// Transpose against a zero fourth row, so the columns have w cleared
+			__m128 zero = _mm_setzero_ps();
+			__m128 lo = _mm_unpacklo_ps(m[0], m[1]);
+			__m128 hi = _mm_unpackhi_ps(m[0], m[1]);
+			__m128 lo2 = _mm_unpacklo_ps(m[2], zero);
+			__m128 hi2 = _mm_unpackhi_ps(m[2], zero);
+			m[0] = _mm_movelh_ps(lo, lo2);
+			m[1] = _mm_movehl_ps(lo2, lo);
+			m[2] = _mm_movelh_ps(hi, hi2);
+			m[3] = _mm_movehl_ps(hi2, hi);
+			const char* src = job.source + i*job.stride;
+			char* dst = job.dest + i*job.stride;
+			store3(dst + job.vertex, _mm_add_ps(transform(m, reinterpret_cast<const float*>(src + job.vertex)), m[3]));
+			if(job.normal != ~0u) store3(dst + job.normal, normalise(transform(m, reinterpret_cast<const float*>(src + job.normal))));
+			if(job.tangent != ~0u) store3(dst + job.tangent, normalise(transform(m, reinterpret_cast<const float*>(src + job.tangent))));
+		}
+	}
+	#else
+	// m holds rows
+	inline void transform(const float (*m)[4], const char* in, char* out, float w, bool normalise) {
+		const float* v = reinterpret_cast<const float*>(in);
+		float result[3];
+		for(int k=0; k<3; ++k) result[k] = m[k][0]*v[0] + m[k][1]*v[1] + m[k][2]*v[2] + m[k][3]*w;
+		if(normalise) {
+			float l = result[0]*result[0] + result[1]*result[1] + result[2]*result[2];
+			if(l > 0) for(int k=0; k<3; ++k) result[k] /= sqrt(l);
 		}
+		memcpy(out, result, sizeof(result));
 	}
 
-	delete [] m;
+	void skinVertices(const SkinJob& shared, size_t begin, size_t end) {
+		const SkinJob job = shared; // Local copy as output writes may alias it
+		for(size_t i=begin; i<end; ++i) {
+			const float* weights = reinterpret_cast<const float*>(job.skin + i*job.skinStride + job.weights);
+			const IndexType* indices = reinterpret_cast<const IndexType*>(job.skin + i*job.skinStride + job.indices);
+			float m[3][4] = {};
+			for(int j=0; j<job.weightsPerVertex && weights[j]>0; ++j) {
+				const SkinMatrix& s = job.palette[ indices[j] ];
+				for(int k=0; k<12; ++k) m[k/4][k%4] += s.row[k/4][k%4] * weights[j];
+			}
+			const char* src = job.source + i*job.stride;
+			char* dst = job.dest + i*job.stride;
+			transform(m, src + job.vertex, dst + job.vertex, 1, false);
+			if(job.normal != ~0u) transform(m, src + job.normal, dst + job.normal, 0, true);
+			if(job.tangent != ~0u) transform(m, src + job.tangent, dst + job.tangent, 0, true);
+		}
+	}
+	#endif
+}
+
+void Model::skinMesh(Mesh* in, const Skeleton* s, int* map, Mesh* out, int threads) {
+	// Setup skin matrices. Small palettes use the stack
+	const uint skinCount = in->getSkinCount();
+	SkinMatrix local[128];
+	SkinMatrix* palette = skinCount > 128? new SkinMatrix[skinCount]: local;
+	const Matrix* matrices = s->getMatrixPtr();
+	for(uint i=0; i<skinCount; ++i) {
+		Matrix m = matrices? matrices[ map[i] ]: s->getBone( map[i] )->getAbsoluteTransformation() * s->getSkinMatrix( map[i] );
+		for(int r=0; r<3; ++r) for(int c=0; c<4; ++c) palette[i].row[r][c] = m[c*4+r];
+	}
+
+	// Get vertex offsets from semantics
+	SkinJob job;
+	job.source = in->getVertexBuffer()->getData<char>();
+	job.dest = out->getVertexBuffer()->getData<char>();
+	job.skin = in->getSkinBuffer()->getData<char>();
+	job.stride = in->getVertexBuffer()->getStride();
+	job.skinStride = in->getSkinBuffer()->getStride();
+	job.vertex = getOffset(in->getVertexBuffer(), VA_VERTEX);
+	job.normal = getOffset(in->getVertexBuffer(), VA_NORMAL);
+	job.tangent = getOffset(in->getVertexBuffer(), VA_TANGENT);
+	job.weights = getOffset(in->getSkinBuffer(), VA_SKINWEIGHT);
+	job.indices = getOffset(in->getSkinBuffer(), VA_SKININDEX);
+	job.weightsPerVertex = in->getWeightsPerVertex();
+	job.palette = palette;
+
+	// Split large meshes between threads
+	const size_t count = in->getVertexCount();
+	if(threads <= 0) threads = Thread::cores();
+	int batches = count / SkinBatchSize + 1;
+	if(batches > threads) batches = threads;
+	parallelFor(batches, [&job, count, batches](int b) {
+		skinVertices(job, count * b / batches, count * (b+1) / batches);
+	}, batches);
+
+	if(palette != local) delete [] palette;
 }
 
 void Model::resetTargetMesh(Mesh* mesh, const Mesh* source) {
@@ -274,14 +385,25 @@ void Model::applyMorph(Mesh* mesh, const Mesh* source, int index, float amount)
 	char* data = mesh->getVertexBuffer()->getData<char>();
 	
 	const Mesh::Morph& morph = source->m_morphs[index];
+	#ifdef MODEL_SSE
+	const __m128 t = _mm_set1_ps(amount);
+	#endif
 	for(int i=0; i<morph.size; ++i) {
 		char* dst = data + morph.indices[i] * stride;
+		// Absolute morphs for now
+		#ifdef MODEL_SSE
+		__m128 v = load3(dst + vertexOffset);
+		__m128 n = load3(dst + normalOffset);
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_sub_ps(load3((const char*)&morph.vertices[i]), v), t));
+		n = _mm_add_ps(n, _mm_mul_ps(_mm_sub_ps(load3((const char*)&morph.normals[i]), n), t));
+		store3(dst + vertexOffset, v);
+		store3(dst + normalOffset, n);
+		#else
 		vec3& vx = *reinterpret_cast<vec3*>(dst + vertexOffset);
 		vec3& nx = *reinterpret_cast<vec3*>(dst + normalOffset); 
-
-		// Absolute morphs for now
 		vx = lerp(vx, morph.vertices[i], amount);
 		nx = lerp(nx, morph.normals[i], amount);
+		#endif
 	}
 }
 
@@ -1,92 +1,68 @@
 #include <base/skeleton.h>
 #include <base/animation.h>
+#include <base/assert.h>
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SKELETON_SSE
+#endif
+
 using namespace base;
 
-Bone::Bone() : 
-	m_skeleton(0), m_index(0), m_parent(0),
-	m_name(""), m_length(1), m_mode(DEFAULT), m_state(0), m_scale(1,1,1) {
+Bone::Bone() : m_skeleton(0), m_index(0), m_name(""), m_length(1) {
 }
 Bone::~Bone() {
-	if(m_name[0]) free((char*)m_name);
 }
 
 void Bone::setPosition(const vec3& p) {
-	m_position = p;
-	m_state = TF_PARTS;
+	m_skeleton->m_position[m_index] = p;
+	m_skeleton->m_state[m_index] = TF_PARTS;
 }
 void Bone::setScale(float s) {
-	m_scale.x = m_scale.y = m_scale.z = s;
-	m_state = TF_PARTS;
+	m_skeleton->m_scale[m_index].set(s, s, s);
+	m_skeleton->m_state[m_index] = TF_PARTS;
 }
 void Bone::setScale(const vec3& s) {
-	m_scale = s;
-	m_state = TF_PARTS;
+	m_skeleton->m_scale[m_index] = s;
+	m_skeleton->m_state[m_index] = TF_PARTS;
 }
 void Bone::setEuler(const vec3& pyr) {
-	m_angle.fromEuler(pyr.y, pyr.x, pyr.z);
-	m_state = TF_PARTS;
+	m_skeleton->m_angle[m_index].fromEuler(pyr.y, pyr.x, pyr.z);
+	m_skeleton->m_state[m_index] = TF_PARTS;
 }
 void Bone::setAngle(const Quaternion& q) {
-	m_angle = q;
-	m_state = TF_PARTS;
+	m_skeleton->m_angle[m_index] = q;
+	m_skeleton->m_state[m_index] = TF_PARTS;
 }
 
 void Bone::setTransformation(const Matrix& m) {
-	m_local = m;
-	m_state = TF_MATRIX;
+	m_skeleton->m_local[m_index] = m;
+	m_skeleton->m_state[m_index] = TF_MATRIX;
 }
 void Bone::setAbsoluteTransformation(const Matrix& m, const vec3& scale) {
-	m_combinedScale = scale;
-	m_combined = m;
-	m_state = TF_ABSOLUTE;
+	m_skeleton->m_combinedScale[m_index] = scale;
+	m_skeleton->m_combined[m_index] = m;
+	m_skeleton->m_state[m_index] = TF_ABSOLUTE;
 }
 
 void Bone::move(const vec3& m) {
-	m_position += m;
-	m_state = TF_PARTS;
+	m_skeleton->m_position[m_index] += m;
+	m_skeleton->m_state[m_index] = TF_PARTS;
 }
 void Bone::rotate(const Quaternion& q) {
-	m_angle *= q;
-	m_state = TF_PARTS;
+	m_skeleton->m_angle[m_index] *= q;
+	m_skeleton->m_state[m_index] = TF_PARTS;
 }
 
 const EulerAngles Bone::getEuler() const {
-	return m_angle.getEuler();
+	return getAngle().getEuler();
 }
 
 void Bone::updateLocal() {
-	// Note: when absoluteMatrix is being set, local values mean nothing.
-	switch(m_state&7) {
-	case TF_PARTS: // parts to matrix
-		{
-		const Matrix& rest = m_skeleton->getRestPose(m_index);
-		Quaternion rot( rest );
-		rot *= m_angle;
-		rot.toMatrix(m_local);
-		// Translation relative to rest pose of this bone
-		m_local.setTranslation(rest * m_position);
-		}
-		m_state = TF_PARTS | TF_MATRIX;
-		break;
-	case 2: // Matrix to parts
-		m_angle.fromMatrix(m_local);
-		memcpy(m_position, &m_local[12], sizeof(vec3));
-		m_scale.x = vec3(&m_local[0]).length();
-		m_scale.y = vec3(&m_local[4]).length();
-		m_scale.z = vec3(&m_local[8]).length();
-		{
-		const Matrix& rest = m_skeleton->getRestPose(m_index);
-		m_position.x -= rest[12];
-		m_position.y -= rest[13];
-		m_position.z -= rest[14];
-		}
-		m_state = TF_PARTS | TF_MATRIX;
-		break;
-	}
+	m_skeleton->updateLocal(m_index);
 }
 
 
@@ -95,66 +71,117 @@ void Bone::updateLocal() {
 // ================================================================================================ //
 
 
+namespace {
+	template<class T> void carveArray(char*& data, int count, T*& array, const T* source, int used) {
+		T* a = reinterpret_cast<T*>(data);
+		data += count * sizeof(T);
+		if(used) memcpy(a, source, used * sizeof(T));
+		array = a;
+	}
+	template<class T> void carveArray(char*& data, int count, T*& array, int used) {
+		carveArray(data, count, array, (const T*)array, used);
+	}
+	size_t getPoseSize(int count) {
+		return count * (3*sizeof(Matrix) + sizeof(Quaternion) + 3*sizeof(vec3) + sizeof(int) + 3*sizeof(uint16) + 3*sizeof(ubyte));
+	}
+	size_t getStoredPoseSize(int count, bool matrices) {
+		return count * (sizeof(Matrix) + sizeof(Quaternion) + 2*sizeof(vec3) + 2*sizeof(ubyte) + (matrices? 2*sizeof(Matrix) + sizeof(vec3): 0));
+	}
+}
 
+void Skeleton::allocatePose(int capacity, const Skeleton& s) {
+	// Largest types first to keep alignment
+	char* old = m_pose;
+	char* data = m_pose = new char[ getPoseSize(capacity) ];
+	carveArray(data, capacity, m_local, s.m_local, s.m_count);
+	carveArray(data, capacity, m_combined, s.m_combined, s.m_count);
+	carveArray(data, capacity, m_matrices, s.m_matrices, s.m_count);
+	carveArray(data, capacity, m_angle, s.m_angle, s.m_count);
+	carveArray(data, capacity, m_position, s.m_position, s.m_count);
+	carveArray(data, capacity, m_scale, s.m_scale, s.m_count);
+	carveArray(data, capacity, m_combinedScale, s.m_combinedScale, s.m_count);
+	carveArray(data, capacity, m_parent, s.m_parent, s.m_count);
+	carveArray(data, capacity * 3, m_hints, s.m_hints, s.m_count * 3);
+	carveArray(data, capacity, m_state, s.m_state, s.m_count);
+	carveArray(data, capacity, m_mode, s.m_mode, s.m_count);
+	carveArray(data, capacity, m_flags, s.m_flags, s.m_count);
+	delete [] old;
+	m_capacity = capacity;
+}
 
+void Skeleton::reserve(int count) {
+	if(count <= m_capacity) return;
+	allocatePose(count, *this);
+	Bone** tmp = m_bones;
+	m_bones = new Bone*[ count ];
+	if(m_count) memcpy(m_bones, tmp, m_count*sizeof(Bone*));
+	delete [] tmp;
+}
 
-Skeleton::Skeleton(): m_bones(0), m_count(0), m_hints(0), m_flags(0), m_matrices(0), m_rest(0) {
+Skeleton::Skeleton(): m_bones(0), m_count(0), m_capacity(0), m_valid(false), m_pose(0), m_lodMask(0), m_names(0), m_rest(0) {
 }
-Skeleton::Skeleton(const Skeleton& s) : m_count(s.m_count), m_matrices(0) {
+Skeleton::Skeleton(const Skeleton& s) : m_count(0), m_capacity(0), m_valid(s.m_valid), m_pose(0), m_lodMask(0) {
+	allocatePose(s.m_count, s);
+	m_count = s.m_count;
+	memset(m_hints, 0, 3 * m_count * sizeof(uint16));
 	m_bones = new Bone*[ m_count ];
-	m_hints = new uint16[ 3 * m_count ];
-	m_flags = new ubyte[ m_count ];
-	m_matrices = new Matrix[ m_count ];
 	for(int i=0; i<m_count; ++i) {
 		m_bones[i] = new Bone(*s.m_bones[i]);
 		m_bones[i]->m_skeleton = this;
-		if(m_bones[i]->m_name[0]) m_bones[i]->m_name = strdup( m_bones[i]->m_name );
 	}
-	memset(m_hints, 0, 3 * m_count * sizeof(uint16));
-	if(s.m_matrices) memcpy(m_matrices, s.m_matrices, m_count*sizeof(Matrix));
+	m_names = s.m_names;
+	if(m_names) ++m_names->ref;
 	m_rest = s.m_rest;
-	++m_rest->ref;
+	if(m_rest) ++m_rest->ref;
 }
 Skeleton::~Skeleton() {
 	// Destroy bones
-	if(m_count) {
-		for(int i=0; i<m_count; ++i) delete m_bones[i];
-		delete [] m_bones;
-		delete [] m_hints;
-		delete [] m_flags;
-		delete [] m_matrices;
-	}
+	for(int i=0; i<m_count; ++i) delete m_bones[i];
+	delete [] m_bones;
+	delete [] m_pose;
+	dropNames();
 	// Destroy rest pose data
-	dropRestPose();
+	dropRestPose(m_rest);
+}
+
+void Skeleton::dropNames() {
+	if(m_names && --m_names->ref==0) {
+		for(char* name: m_names->names) free(name);
+		delete m_names;
+	}
+	m_names = 0;
 }
 
 void Skeleton::setRestPose() {
-	dropRestPose();
+	dropRestPose(m_rest);
 	m_rest = new RestPose();
 	m_rest->ref = 1;
 	m_rest->size = m_count;
 	m_rest->local = new Matrix[m_count];
 	m_rest->skin = new Matrix[m_count];
 	m_rest->rot = new Quaternion[m_count];
+	m_rest->localRot = new Quaternion[m_count];
 	m_rest->scale = new vec3[m_count];
 	// Copy pose matrices
+	memcpy(m_rest->scale, m_scale, m_count * sizeof(vec3));
+	memcpy(m_rest->rot, m_angle, m_count * sizeof(Quaternion));
+	memcpy(m_rest->local, m_local, m_count * sizeof(Matrix));
 	for(int i=0; i<m_count; ++i) {
-		m_rest->scale[i] = m_bones[i]->getScale();
-		m_rest->rot[i] = m_bones[i]->getAngle();
-		memcpy(m_rest->local[i], m_bones[i]->getTransformation(), sizeof(Matrix));
-		Matrix::inverseAffine(m_rest->skin[i], m_bones[i]->getAbsoluteTransformation());
+		Matrix::inverseAffine(m_rest->skin[i], m_combined[i]);
+		m_rest->localRot[i].fromMatrix(m_local[i]);
 	}
 }
 
-void Skeleton::dropRestPose() {
-	if(m_rest && --m_rest->ref==0) {
-		delete [] m_rest->local;
-		delete [] m_rest->skin;
-		delete [] m_rest->rot;
-		delete [] m_rest->scale;
-		delete m_rest;
-		m_rest = 0;
+void Skeleton::dropRestPose(RestPose*& rest) {
+	if(rest && --rest->ref==0) {
+		delete [] rest->local;
+		delete [] rest->skin;
+		delete [] rest->rot;
+		delete [] rest->localRot;
+		delete [] rest->scale;
+		delete rest;
 	}
+	rest = 0;
 }
 
 unsigned Skeleton::getMapID() const {
@@ -169,32 +196,50 @@ Bone* Skeleton::addBone(const Bone* p, const char* name, const float* local, flo
 		printf("Warning: Parent '%s' for bone '%s' is invalid\n", p->getName(), name);
 		p = 0;
 	}
-	// Resize array
-	Bone** tmp = m_bones;
-	m_bones = new Bone*[ m_count+1 ];
-	// Delete old data
-	if(m_count) { 
-		memcpy(m_bones, tmp, m_count*sizeof(Bone*));
-		delete [] tmp;
-		delete [] m_hints;
-		delete [] m_flags;
-	}
-	// Resize hint arrays
-	m_flags = new ubyte[ m_count+1 ];
-	m_hints = new uint16[ (m_count+1) * 3 ];
+	// Grow arrays. Pose data moves, so references from bone getters are invalidated
+	if(m_count == m_capacity) reserve(m_capacity? m_capacity * 2: 16);
 	memset(m_hints, 0, (m_count+1) * 3 * sizeof(uint16));
+
 	// Initialise bone data
-	Bone* bone = m_bones[m_count] = new Bone();
+	const int index = m_count;
+	Bone* bone = m_bones[index] = new Bone();
 	bone->m_skeleton = this;
-	bone->m_index = m_count;
-	bone->m_parent = p? p->getIndex(): -1;
+	bone->m_index = index;
 	bone->m_length = length;
-	if(name && name[0]) bone->m_name = strdup(name);
+	if(name && name[0]) {
+		if(!m_names) {
+			m_names = new Names();
+			m_names->ref = 1;
+		}
+		else if(m_names->ref > 1) {
+			// Names are shared with a copy - take our own
+			Names* names = new Names();
+			names->ref = 1;
+			for(int i=0; i<m_count; ++i) {
+				if(!m_bones[i]->m_name[0]) continue;
+				names->names.push_back( strdup(m_bones[i]->m_name) );
+				m_bones[i]->m_name = names->names.back();
+			}
+			--m_names->ref;
+			m_names = names;
+		}
+		m_names->names.push_back( strdup(name) );
+		bone->m_name = m_names->names.back();
+	}
+	m_parent[index] = p? p->getIndex(): -1;
+	m_mode[index] = Bone::DEFAULT;
+	m_state[index] = 0;
+	m_flags[index] = 0;
+	m_angle[index] = Quaternion();
+	m_position[index].set(0,0,0);
+	m_scale[index].set(1,1,1);
+	m_combinedScale[index].set(1,1,1);
+	m_matrices[index] = Matrix();
 	// Initial Transforms
-	if(local) memcpy(bone->m_local, local, sizeof(Matrix));
-	bone->m_combined = p? p->m_combined * bone->m_local: bone->m_local;
+	m_local[index] = local? Matrix(local): Matrix();
+	m_combined[index] = p? m_combined[p->m_index] * m_local[index]: m_local[index];
 	// rest pose is probably invalid
-	dropRestPose();
+	dropRestPose(m_rest);
 	++m_count;
 	return bone;
 }
@@ -213,7 +258,39 @@ Bone* Skeleton::getBone(const char* name) const {
 }
 
 void Skeleton::setMode(Bone::Mode m) {
-	for(int i=0; i<m_count; ++i) m_bones[i]->setMode(m);
+	memset(m_mode, m, m_count);
+}
+
+void Skeleton::updateLocal(int i) {
+	// Note: when absoluteMatrix is being set, local values mean nothing.
+	switch(m_state[i]&7) {
+	case Bone::TF_PARTS: // parts to matrix
+		{
+		const Matrix& rest = getRestPose(i);
+		Quaternion rot = m_rest->localRot[i];
+		rot *= m_angle[i];
+		rot.toMatrix(m_local[i]);
+		// Translation relative to rest pose of this bone
+		m_local[i].setTranslation(rest * m_position[i]);
+		}
+		m_state[i] = Bone::TF_PARTS | Bone::TF_MATRIX;
+		break;
+	case Bone::TF_MATRIX: // Matrix to parts
+		{
+		const Matrix& local = m_local[i];
+		m_angle[i].fromMatrix(local);
+		memcpy(m_position[i], &local[12], sizeof(vec3));
+		m_scale[i].x = vec3(&local[0]).length();
+		m_scale[i].y = vec3(&local[4]).length();
+		m_scale[i].z = vec3(&local[8]).length();
+		const Matrix& rest = getRestPose(i);
+		m_position[i].x -= rest[12];
+		m_position[i].y -= rest[13];
+		m_position[i].z -= rest[14];
+		}
+		m_state[i] = Bone::TF_PARTS | Bone::TF_MATRIX;
+		break;
+	}
 }
 
 
@@ -222,15 +299,94 @@ void Skeleton::setMode(Bone::Mode m) {
 void Skeleton::resetPose() {
 	for(int i=0; i<m_count; ++i) resetPose(i);
 }
-void Skeleton::resetPose(int boneIndex) {
-	Bone* bone = m_bones[boneIndex];
-	if(bone->getMode() != Bone::FIXED && bone->getMode() != Bone::USER) {
-		bone->m_local = m_rest->local[boneIndex];
-		bone->m_scale = m_rest->scale[boneIndex];
-		bone->m_angle = m_rest->rot[boneIndex];
-		bone->m_position.set(0,0,0);
-		bone->m_state = 3;
+void Skeleton::resetPose(int i) {
+	if(m_mode[i] != Bone::FIXED && m_mode[i] != Bone::USER) {
+		m_local[i] = m_rest->local[i];
+		m_scale[i] = m_rest->scale[i];
+		m_angle[i] = m_rest->rot[i];
+		m_position[i].set(0,0,0);
+		m_state[i] = 3;
+	}
+}
+
+Skeleton::Pose::Pose() : m_rest(0), m_count(0), m_hasMatrices(false), m_data(0) {
+}
+
+Skeleton::Pose::~Pose() {
+	delete [] m_data;
+	dropRestPose(m_rest);
+}
+
+size_t Skeleton::Pose::getMemoryUsage() const {
+	return sizeof(Pose) + getStoredPoseSize(m_count, m_hasMatrices);
+}
+
+bool Skeleton::isPoseCompatible(const Pose& p) const {
+	return m_rest && m_rest==p.m_rest && m_count==p.m_count && memcmp(m_mode, p.m_mode, m_count)==0;
+}
+
+bool Skeleton::savePose(Pose& pose, bool matrices) const {
+	// User bones may differ, so their final matrices can't be shared
+	matrices &= m_valid;
+	for(int i=0; i<m_count && matrices; ++i) {
+		if(m_mode[i]==Bone::USER || m_mode[i]==Bone::FIXED) matrices = false;
+	}
+	if(pose.m_count != m_count || pose.m_hasMatrices != matrices) {
+		// Only allocate derived matrix arrays if they are stored
+		delete [] pose.m_data;
+		char* data = pose.m_data = new char[ getStoredPoseSize(m_count, matrices) ];
+		carveArray(data, m_count, pose.m_local, 0);
+		if(matrices) {
+			carveArray(data, m_count, pose.m_combined, 0);
+			carveArray(data, m_count, pose.m_matrices, 0);
+		}
+		carveArray(data, m_count, pose.m_angle, 0);
+		carveArray(data, m_count, pose.m_position, 0);
+		carveArray(data, m_count, pose.m_scale, 0);
+		if(matrices) carveArray(data, m_count, pose.m_combinedScale, 0);
+		carveArray(data, m_count, pose.m_state, 0);
+		carveArray(data, m_count, pose.m_mode, 0);
+		pose.m_count = m_count;
+		pose.m_hasMatrices = matrices;
+	}
+	if(pose.m_rest != m_rest) {
+		dropRestPose(pose.m_rest);
+		pose.m_rest = m_rest;
+		if(m_rest) ++m_rest->ref;
+	}
+	memcpy(pose.m_local, m_local, m_count * sizeof(Matrix));
+	memcpy(pose.m_angle, m_angle, m_count * sizeof(Quaternion));
+	memcpy(pose.m_position, m_position, m_count * sizeof(vec3));
+	memcpy(pose.m_scale, m_scale, m_count * sizeof(vec3));
+	memcpy(pose.m_state, m_state, m_count);
+	memcpy(pose.m_mode, m_mode, m_count);
+	if(matrices) {
+		memcpy(pose.m_combined, m_combined, m_count * sizeof(Matrix));
+		memcpy(pose.m_matrices, m_matrices, m_count * sizeof(Matrix));
+		memcpy(pose.m_combinedScale, m_combinedScale, m_count * sizeof(vec3));
 	}
+	return matrices;
+}
+
+bool Skeleton::loadPose(const Pose& p, bool matrices) {
+	assert(isPoseCompatible(p));
+	// Modes match, so the pose only has matrices if there are no user bones
+	matrices &= p.m_hasMatrices;
+	for(int i=0; i<m_count; ++i) {
+		if(m_mode[i]==Bone::USER || m_mode[i]==Bone::FIXED) continue;
+		m_angle[i] = p.m_angle[i];
+		m_position[i] = p.m_position[i];
+		m_scale[i] = p.m_scale[i];
+		m_local[i] = p.m_local[i];
+		m_state[i] = matrices? p.m_state[i]: p.m_state[i] & ~Bone::TF_FINAL;
+	}
+	if(matrices) {
+		memcpy(m_combined, p.m_combined, m_count * sizeof(Matrix));
+		memcpy(m_combinedScale, p.m_combinedScale, m_count * sizeof(vec3));
+		memcpy(m_matrices, p.m_matrices, m_count * sizeof(Matrix));
+		m_valid = true;
+	}
+	return matrices;
 }
 
 int Skeleton::applyPose(const Animation* anim, float frame, int root, int blend, float weight, const unsigned char* map) {
@@ -240,101 +396,157 @@ int Skeleton::applyPose(const Animation* anim, float frame, int root, int blend,
 	int modified = 0;
 	int start = root<0? 0: root;
 	if(!map) map = anim->getMap(this);
+	// Baked clips decode every track at once
+	const AnimationClip* clip = anim->getClip();
+	if(clip) {
+		m_clipPose.resize(clip->getSize());
+		clip->sampleAll(frame, &m_clipPose[0]);
+	}
 	// Loop through remaining bones
 	for(int i=start; i<m_count; ++i) {
 		// Determine what to do based on parent flag and bone mode
-		Bone* bone = m_bones[i];
 		m_flags[i] = i==root || root<0? 1: 0;
-		if(bone->getParent()) m_flags[i] |= m_flags[ bone->getParent()->getIndex() ];
+		if(m_parent[i] >= 0) m_flags[i] |= m_flags[ m_parent[i] ];
 
 		bool set = false;
-		switch( m_bones[i]->getMode() ) {
+		switch( m_mode[i] ) {
 		case Bone::DEFAULT:  set = m_flags[i] == 1; break;	// stops at truncate flag
 		case Bone::ANIMATED: set = m_flags[i] > 0;  break;	// overrides truncate flag
 		case Bone::TRUNCATE: if(i==root) set=true; else m_flags[i]=2; break;	// truncate animation unless starting from here
 		case Bone::USER:     break;	// user overridden
 		case Bone::FIXED:    break;	// user overridden
 		}
+		if(m_lodMask && !m_lodMask[i]) set = false;
 		// Set bone values from animation
-		if(set && map[i]!=0xff && applyBonePose(m_bones[i], anim, map[i], frame, blend, weight)) ++modified;
+		if(!set || map[i]==0xff) continue;
+		if(clip? applyBoneTransform(i, m_clipPose[map[i]], blend, weight): applyBonePose(m_bones[i], anim, map[i], frame, blend, weight)) ++modified;
 	}
 	return modified;
 }
 bool Skeleton::applyBonePose(Bone* b, const Animation* anim, int keyset, float frame, int blend, float weight) {
+	const int index = b->m_index;
+	if(m_mode[index]!=Bone::DEFAULT && m_mode[index]!=Bone::ANIMATED) return false;
+	// Get values from animation
+	AnimationClip::Transform t;
+	if(const AnimationClip* clip = anim->getClip()) clip->sample(keyset, frame, t);
+	else {
+		anim->getRotation(keyset, frame, m_hints[index*3],   t.rotation);
+		anim->getPosition(keyset, frame, m_hints[index*3+1], t.position);
+		anim->getScale   (keyset, frame, m_hints[index*3+2], t.scale);
+	}
+	return applyBoneTransform(index, t, blend, weight);
+}
+bool Skeleton::applyBoneTransform(int index, const AnimationClip::Transform& t, int blend, float weight) {
 	static SlerpFunc slerp;
 	static LerpFunc lerp;
-	if(b->m_mode==Bone::DEFAULT || b->m_mode==Bone::ANIMATED) {
-		vec3 pos, scl;
-		Quaternion rot;
-		// Get values from animation
-		int index = b->getIndex();
-		anim->getRotation(keyset, frame, m_hints[index*3],   rot);
-		anim->getPosition(keyset, frame, m_hints[index*3+1], pos);
-		anim->getScale   (keyset, frame, m_hints[index*3+2], scl);
-		// Blending
-		if(weight != 1) {
-			if(blend==1) {	// MIX - interpolate between current and new values
-				if(b->m_state==2) b->updateLocal();
-				slerp(rot, b->m_angle, rot, weight);
-				lerp(pos, b->m_position, pos, weight);
-				lerp(scl, b->m_scale, scl, weight);
-			} else {	// SET - scale new values
-				slerp(rot, m_rest->rot[index], rot, weight);
-				lerp(scl, m_rest->scale[index], scl, weight);
-				pos *= weight;
-			}
-		}
-		if(blend==2) {	// ADD - add new values
-			if(b->m_state==2) b->updateLocal();
-			rot = b->m_angle * rot;
-			pos += b->m_position;
-			scl *= b->m_scale;
+	if(m_mode[index]!=Bone::DEFAULT && m_mode[index]!=Bone::ANIMATED) return false;
+	Quaternion rot = t.rotation;
+	vec3 pos = t.position;
+	vec3 scl = t.scale;
+	// Blending
+	if(weight != 1) {
+		if(blend==1) {	// MIX - interpolate between current and new values
+			if(m_state[index]==2) updateLocal(index);
+			slerp(rot, m_angle[index], rot, weight);
+			lerp(pos, m_position[index], pos, weight);
+			lerp(scl, m_scale[index], scl, weight);
+		} else {	// SET - scale new values
+			slerp(rot, m_rest->rot[index], rot, weight);
+			lerp(scl, m_rest->scale[index], scl, weight);
+			pos *= weight;
 		}
-		// Set new values
-		memcpy(&b->m_angle,    &rot, sizeof(Quaternion));
-		memcpy(&b->m_position, &pos, sizeof(vec3));
-		memcpy(&b->m_scale,    &scl, sizeof(vec3));
-		b->m_state = 1;
-		return true;
-	} else return false;
+	}
+	if(blend==2) {	// ADD - add new values
+		if(m_state[index]==2) updateLocal(index);
+		rot = m_angle[index] * rot;
+		pos += m_position[index];
+		scl *= m_scale[index];
+	}
+	// Set new values
+	m_angle[index] = rot;
+	m_position[index] = pos;
+	m_scale[index] = scl;
+	m_state[index] = Bone::TF_PARTS;
+	return true;
 }
 
 
+// ============================ Hierarchy update ============================= //
+
+namespace {
+	#ifdef SKELETON_SSE
+	// out = [c0 c1 c2 c3] * b
+	inline void multiplyColumns(float* out, __m128 c0, __m128 c1, __m128 c2, __m128 c3, const float* b) {
+		for(int j=0; j<16; j+=4) {
+			__m128 r = _mm_mul_ps(c0, _mm_set1_ps(b[j]));
+			r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(b[j+1])));
+			r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(b[j+2])));
+			r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(b[j+3])));
+			_mm_storeu_ps(out + j, r);
+		}
+	}
+	#endif
+
+	// out = parent * local, with local translation scaled by parent scale
+	inline void combineMatrix(Matrix& out, const Matrix& parent, const Matrix& local, const vec3& scale) {
+		float b[16];
+		memcpy(b, local, sizeof(b));
+		b[12] *= scale.x;
+		b[13] *= scale.y;
+		b[14] *= scale.z;
+		#ifdef SKELETON_SSE
+		multiplyColumns(out, _mm_loadu_ps(parent), _mm_loadu_ps(parent+4), _mm_loadu_ps(parent+8), _mm_loadu_ps(parent+12), b);
+		#else
+		out = parent * Matrix(b);
+		#endif
+	}
+
+	// out = combined * scale * skin
+	inline void skinMatrix(Matrix& out, const Matrix& combined, const vec3& scale, const Matrix& skin) {
+		#ifdef SKELETON_SSE
+		__m128 c0 = _mm_mul_ps(_mm_loadu_ps(combined),   _mm_set1_ps(scale.x));
+		__m128 c1 = _mm_mul_ps(_mm_loadu_ps(combined+4), _mm_set1_ps(scale.y));
+		__m128 c2 = _mm_mul_ps(_mm_loadu_ps(combined+8), _mm_set1_ps(scale.z));
+		multiplyColumns(out, c0, c1, c2, _mm_loadu_ps(combined+12), skin);
+		#else
+		Matrix m = combined;
+		m.scale(scale);
+		out = m * skin;
+		#endif
+	}
+}
+
 bool Skeleton::update() {
 	// Build combined matrices - may be able to skip some
+	// Flags mark bones that changed so children are updated
 	bool changed = false;
-	memset(m_flags, 0, m_count);
-	if(!m_matrices) m_matrices = new Matrix[ m_count ];
+	m_valid = true;
 	for(int i=0; i<m_count; ++i) {
-		Bone* bone = m_bones[i];
-		if(bone->getMode() != Bone::FIXED) { // Use local transformation
-			if(bone->m_state<Bone::TF_FINAL || (bone->m_parent>=0 && m_flags[bone->m_parent])) {
+		const int parent = m_parent[i];
+		m_flags[i] = 0;
+		if(m_mode[i] != Bone::FIXED) { // Use local transformation
+			if(m_state[i]<Bone::TF_FINAL || (parent>=0 && m_flags[parent])) {
 				m_flags[i] = 1;
-				if(bone->m_state == Bone::TF_PARTS) bone->updateLocal();
-				Bone* parent = bone->getParent();
-				vec3 parentScale = parent? parent->m_combinedScale: vec3(1,1,1);
-				Matrix local = bone->m_local;
-				local[12] *= parentScale.x;
-				local[13] *= parentScale.y;
-				local[14] *= parentScale.z;
-				bone->m_combinedScale = parentScale * bone->m_scale;
-				bone->m_combined = parent? parent->m_combined * local: local;
-
-				m_matrices[i] = bone->m_combined;
-				m_matrices[i].scale(bone->m_combinedScale);
-				m_matrices[i] *= m_rest->skin[i];
-
+				if(m_state[i] == Bone::TF_PARTS) updateLocal(i);
+				if(parent >= 0) {
+					const vec3& parentScale = m_combinedScale[parent];
+					combineMatrix(m_combined[i], m_combined[parent], m_local[i], parentScale);
+					m_combinedScale[i] = parentScale * m_scale[i];
+				}
+				else {
+					m_combined[i] = m_local[i];
+					m_combinedScale[i] = m_scale[i];
+				}
+				skinMatrix(m_matrices[i], m_combined[i], m_combinedScale[i], m_rest->skin[i]);
 				changed = true;
 			}
 		}
-		else if(bone->m_state==Bone::TF_ABSOLUTE) {	  // Absolute transformation manually set
+		else if(m_state[i]==Bone::TF_ABSOLUTE) {	  // Absolute transformation manually set
 			changed = true;
 			m_flags[i] = 1;
-			m_matrices[i] = bone->m_combined;
-			m_matrices[i].scale(bone->m_combinedScale);
-			m_matrices[i] *= m_rest->skin[i];
+			skinMatrix(m_matrices[i], m_combined[i], m_combinedScale[i], m_rest->skin[i]);
 		}
-		bone->m_state |= Bone::TF_FINAL;
+		m_state[i] |= Bone::TF_FINAL;
 	}
 	return changed;
 }
@@ -2,9 +2,12 @@
 #include <base/hardwarebuffer.h>
 #include <base/model.h>
 #include <base/parse.h>
+#include <base/thread.h>
+#include <base/string.h>
+#include <algorithm>
+#include <cstring>
 #include <cstdio>
 #include <vector>
-#include <map>
 
 using namespace base;
 
@@ -28,181 +31,266 @@ Model* Wavefront::load(const char* file) {
 	return 0;
 }
 
-Model* Wavefront::parse(const char* str) {
-	std::vector<vec3> vx;
-	std::vector<vec3> vn;
-	std::vector<vec2> vt;
-	std::vector<Point3> f;
+namespace {
+	// Negative face indices are relative to the vertices read so far. Within a chunk that count is
+	// unknown, so they are stored offset by RelativeIndex and resolved when chunks are merged.
+	const int RelativeIndex = 1<<30;
 
-	const char* s = str;
-	int r=0, i=0;
-	vec3 tmp;
-	Point3 ix;
-	Point3 size;
-	char material[32], group[32];
-	material[0] = group[0] = 0;
+	struct ObjEvent {
+		size_t face;	// Number of face indices read before this event
+		bool   group;	// Group or material change
+		String name;
+	};
 
-	Model* model = new Model;
+	struct ObjChunk {
+		std::vector<vec3> vx;
+		std::vector<vec3> vn;
+		std::vector<vec2> vt;
+		std::vector<Point3> f;
+		std::vector<ObjEvent> events;
+		bool failed = false;
+	};
+
+	inline const char* skipBlank(const char* s) {
+		while(*s==' ' || *s=='\t' || *s=='\r') ++s;
+		return s;
+	}
+
+	inline String readName(const char* s, const char* eol) {
+		s = skipBlank(s);
+		const char* e = s;
+		while(e<eol && *e!=' ' && *e!='\t' && *e!='\r') ++e;
+		return String(s, e-s);
+	}
+}
 
-	while(*s) {
+static void parseChunk(const char* s, const char* end, ObjChunk& out) {
+	vec3 tmp;
+	Point3 ix;
+	while(s < end) {
 		s += parseSpace(s);
+		if(s >= end) break;
+		const char* eol = (const char*)memchr(s, '\n', end - s);
+		if(!eol) eol = end;
+		const char* p = s;
+
 		switch(*s) {
 		case '#':	// Comment
-			s += parseDelimiter(s);
 			break;
 
 		case 'v':	// Vertex data
 			switch(s[1]) {
 			case ' ': case '\t':	// Position
-				r = 1;
-				for(i=0; i<3; ++i) {
-					r += parseSpace(s+r);
-					r += parseFloat(s+r, tmp[i]);
-				}
-				if(r) vx.push_back(tmp);
-				else return 0;
+				p = s + 1;
+				for(int i=0; i<3; ++i) p = skipBlank(p), p += parseFloat(p, tmp[i]);
+				out.vx.push_back(tmp);
 				break;
 			case 'n':				// Normal
-				r = 2;
-				for(i=0; i<3; ++i) {
-					r += parseSpace(s+r);
-					r += parseFloat(s+r, tmp[i]);
-				}
-				if(r) vn.push_back(tmp);
-				else return 0;
+				p = s + 2;
+				for(int i=0; i<3; ++i) p = skipBlank(p), p += parseFloat(p, tmp[i]);
+				out.vn.push_back(tmp);
 				break;
 			case 't':				// Texture Coordinates
-				r = 2;
-				for(i=0; i<2; ++i) {
-					r += parseSpace(s+r);
-					r += parseFloat(s+r, tmp[i]);
-				}
-				if(r) vt.push_back(tmp.xy());
-				else return 0;
+				p = s + 2;
+				for(int i=0; i<2; ++i) p = skipBlank(p), p += parseFloat(p, tmp[i]);
+				out.vt.push_back(tmp.xy());
 				break;
 			default:
 				printf("OBJ error: %.10s...\n", s);
-				return 0;
+				out.failed = true;
+				return;
 			}
-			s += r;
 			break;
 		
-		case 'f': // Read face: 'vertex/uv/normal' or 'vertex' or 'vertex/uv' or 'vertex//normal'
-			++s;
-			i = f.size();
-			size = Point3(vx.size()+1, vt.size()+1, vn.size()+1);
-			for(int j=0; true; ++j) {
-				s += parseSpace(s);
+		case 'f': { // Read face: 'vertex/uv/normal' or 'vertex' or 'vertex/uv' or 'vertex//normal'
+			p = s + 1;
+			size_t first = out.f.size();
+			Point3 size(out.vx.size()+1, out.vt.size()+1, out.vn.size()+1);
+			for(int j=0; p<eol; ++j) {
+				p = skipBlank(p);
 				for(int k=0; k<3; ++k) {
-					r = parseInt(s, ix[k]);
+					int r = parseInt(p, ix[k]);
 					if(r == 0) ix[k] = 0;
-					else s += r;
-					if(ix[k] < 0) ix[k] += size[k]; // negative values are relative
-					if(*s != '/') break;
-					++s;
+					else p += r;
+					if(ix[k] < 0) ix[k] += size[k] - RelativeIndex;
+					if(*p != '/') break;
+					++p;
 				}
 				if(ix[0] == 0) break;
 				// Add to face list and triangulate if nessesary
 				if(j > 2) {
-					f.push_back(f[i]);
-					f.push_back(f[f.size()-2]);
+					out.f.push_back(out.f[first]);
+					out.f.push_back(out.f[out.f.size()-2]);
 				}
-				f.push_back(ix);
+				out.f.push_back(ix);
 			}
 			break;
+		}
 		
 		case 'g':	// Groups
-			++s;
-			s += parseSpace(s);
-			r = parseDelimiter(s, '\n', group, 32);
-
-			// start a new mesh
-			if(!f.empty()) {
-				model->addMesh(group, buildMesh(f.size(), f.data(), vx.data(), vt.data(), vn.data()), material);
-				f.clear();
-			}
-			for(char* c=group; *c; ++c) if(*c==' ' || *c=='\t') { *c=0; break; }
-			s += r;
+			out.events.push_back(ObjEvent{out.f.size(), true, readName(s+1, eol)});
 			break;
+
 		case 'u': // usemtl
-			r = parseKeyword(s, "usemtl");
-			if(r>0) {
-				r += parseSpace(s+r);
-				r += parseDelimiter(s+r, '\n', material, 32);
-				for(char* c=material; *c; ++c) if(*c==' ' || *c=='\t') { *c=0; break; }
-				s += r;
-				// Start a new mesh
-				if(!f.empty()) {
-					model->addMesh(group, buildMesh(f.size(), f.data(), vx.data(), vt.data(), vn.data()), material);
-					f.clear();
-				}
+			if(parseKeyword(s, "usemtl") == 6) {
+				out.events.push_back(ObjEvent{out.f.size(), false, readName(s+6, eol)});
 				break;
 			}
 		default:
-			if(strncmp(s, "s ", 2)==0) s += parseDelimiter(s);
-			else if(parseKeyword(s, "mtllib")) s += parseDelimiter(s);
-			else {
-				r = parseDelimiter(s);
-				printf("Wavefront error: invalid line '%.*s'\n", r, s);
-				s += r;
+			if(strncmp(s, "s ", 2)==0) break;
+			else if(parseKeyword(s, "mtllib")) break;
+			else printf("Wavefront error: invalid line '%.*s'\n", (int)(eol-s), s);
+		}
+		s = eol + 1;
+	}
+}
+
+Model* Wavefront::parse(const char* str, int threads) {
+	// Split into chunks on line boundaries. Small files are parsed in one chunk.
+	size_t length = strlen(str);
+	if(threads <= 0) threads = Thread::cores();
+	int chunkCount = length < (1u<<20)? 1: threads * 4;
+	std::vector<const char*> bounds(chunkCount + 1, str + length);
+	bounds[0] = str;
+	for(int i=1; i<chunkCount; ++i) {
+		const char* s = std::max(str + length * i / chunkCount, bounds[i-1]);
+		const char* e = (const char*)memchr(s, '\n', str + length - s);
+		bounds[i] = e? e + 1: str + length;
+	}
+
+	std::vector<ObjChunk> chunks(chunkCount);
+	parallelFor(chunkCount, [&](int i) { parseChunk(bounds[i], bounds[i+1], chunks[i]); }, threads);
+
+	// Merge vertex data
+	std::vector<vec3> vx;
+	std::vector<vec3> vn;
+	std::vector<vec2> vt;
+	std::vector<Point3> offsets(chunkCount);
+	Point3 total;
+	for(int i=0; i<chunkCount; ++i) {
+		if(chunks[i].failed) return 0;
+		offsets[i] = total;
+		total += Point3(chunks[i].vx.size(), chunks[i].vt.size(), chunks[i].vn.size());
+	}
+	vx.reserve(total.x);
+	vt.reserve(total.y);
+	vn.reserve(total.z);
+	for(const ObjChunk& c: chunks) {
+		vx.insert(vx.end(), c.vx.begin(), c.vx.end());
+		vt.insert(vt.end(), c.vt.begin(), c.vt.end());
+		vn.insert(vn.end(), c.vn.begin(), c.vn.end());
+	}
+
+	// Merge faces, splitting meshes on groups and materials
+	Model* model = new Model;
+	std::vector<Point3> f;
+	String material, group;
+	auto addMesh = [&]() {
+		if(f.empty()) return;
+		model->addMesh(group, buildMesh(f.size(), f.data(), vx.data(), vt.empty()? 0: vt.data(), vn.empty()? 0: vn.data()), material);
+		f.clear();
+	};
+	for(int i=0; i<chunkCount; ++i) {
+		ObjChunk& c = chunks[i];
+		size_t face = 0;
+		for(size_t e=0; e<=c.events.size(); ++e) {
+			size_t next = e<c.events.size()? c.events[e].face: c.f.size();
+			for(; face<next; ++face) {
+				Point3 ix = c.f[face];
+				for(int k=0; k<3; ++k) if(ix[k] < 0) ix[k] += RelativeIndex + offsets[i][k];
+				f.push_back(ix);
 			}
+			if(e == c.events.size()) break;
+			addMesh();
+			if(c.events[e].group) group = c.events[e].name;
+			else material = c.events[e].name;
 		}
 	}
 
 	// Add final mesh
-	if(!f.empty()) model->addMesh(group, buildMesh(f.size(), f.data(), vx.data(), vt.data(), vn.data()), material);
+	addMesh();
 
 	// Something failed
 	if(model->getMeshCount()==0) { delete model; return 0; }
 	return model;
 }
 
+namespace {
+	/** Open addressing map from vertex/texcoord/normal index triples to vertex indices */
+	class VertexIndexMap {
+		public:
+		VertexIndexMap(size_t maxSize) {
+			size_t capacity = 16;
+			while(capacity < maxSize * 2) capacity <<= 1;
+			m_mask = capacity - 1;
+			m_slots.assign(capacity, -1);
+			m_keys.reserve(maxSize);
+		}
+		uint32 insert(const Point3& key) {
+			size_t slot = hash(key) & m_mask;
+			while(m_slots[slot] >= 0) {
+				if(m_keys[m_slots[slot]] == key) return m_slots[slot];
+				slot = (slot + 1) & m_mask;
+			}
+			m_slots[slot] = m_keys.size();
+			m_keys.push_back(key);
+			return m_slots[slot];
+		}
+		size_t size() const { return m_keys.size(); }
+		const Point3& operator[](size_t i) const { return m_keys[i]; }
+		private:
+		static size_t hash(const Point3& p) {
+			uint32 h = (uint32)p.x * 0x9e3779b1u;
+			h = (h ^ (h >> 15) ^ (uint32)p.y) * 0x85ebca77u;
+			h = (h ^ (h >> 13) ^ (uint32)p.z) * 0xc2b2ae3du;
+			return h ^ (h >> 16);
+		}
+		std::vector<int> m_slots;
+		std::vector<Point3> m_keys;	// Unique keys in vertex order
+		size_t m_mask;
+	};
+}
+
 template<class T>
-inline void setIndexBufferData(int size, const Point3* f, std::map<Point3, int>& map, HardwareIndexBuffer* indexBuffer) {
+inline void setIndexBufferData(int size, const uint32* indices, HardwareIndexBuffer* indexBuffer) {
 	T* ix = new T[size];
-	std::map<Point3, int>::iterator it;
-	for(int i=0; i<size; ++i) {
-		it = map.find(f[i]);
-		if(it == map.end()) {
-			ix[i] = map.size();
-			map[f[i]] = ix[i];
-		}
-		else ix[i] = it->second;
-	}
+	for(int i=0; i<size; ++i) ix[i] = indices[i];
 	indexBuffer->setData(ix, size, true);
 }
 
 Mesh* Wavefront::buildMesh(int size, Point3* f, vec3* vx, vec2* tx, vec3* nx) {
-	std::map<Point3, int> map;
+	VertexIndexMap map(size);
+	std::vector<uint32> indices(size);
+	for(int i=0; i<size; ++i) indices[i] = map.insert(f[i]);
 
 	HardwareVertexBuffer* vertexBuffer = new HardwareVertexBuffer();
 	HardwareIndexBuffer* indexBuffer = new HardwareIndexBuffer();
 	
-	// Index array
-	if(size < 256) {
+	// Index array - smallest type that can address every vertex
+	if(map.size() <= 256) {
 		indexBuffer->setIndexSize(IndexSize::I8);
-		setIndexBufferData<uint8>(size, f, map, indexBuffer);
+		setIndexBufferData<uint8>(size, indices.data(), indexBuffer);
 	}
-	else if(size < 65536) {
+	else if(map.size() <= 65536) {
 		indexBuffer->setIndexSize(IndexSize::I16);
-		setIndexBufferData<uint16>(size, f, map, indexBuffer);
+		setIndexBufferData<uint16>(size, indices.data(), indexBuffer);
 	}
 	else {
 		indexBuffer->setIndexSize(IndexSize::I32);
-		setIndexBufferData<uint32>(size, f, map, indexBuffer);
+		setIndexBufferData<uint32>(size, indices.data(), indexBuffer);
 	}
 
 	// Vertex array
-	std::map<Point3, int>::iterator it;
 	vertexBuffer->attributes.add(VA_VERTEX, VA_FLOAT3);
 	if(nx) vertexBuffer->attributes.add(VA_NORMAL, VA_FLOAT3);
 	if(tx) vertexBuffer->attributes.add(VA_TEXCOORD, VA_FLOAT2);
 	int stride = vertexBuffer->attributes.calculateStride() / 4;
 	int on = 3, ot = (nx?6:3);
 	float* v = new float[ stride * map.size() ];
-	for(const auto& i: map) {
-		const Point3& face = i.first;
-		int k = i.second * stride;
+	memset(v, 0, stride * map.size() * sizeof(float));
+	for(size_t i=0; i<map.size(); ++i) {
+		const Point3& face = map[i];
+		int k = i * stride;
 		memcpy(v + k, vx + face.x - 1, 3*sizeof(float));
 		if(nx && face.z) memcpy(v+k+on, nx+face.z-1, 3*sizeof(float));
 		if(tx && face.y) memcpy(v+k+ot, tx+face.y-1, 2*sizeof(float));
@@ -246,7 +334,7 @@ static void writeMesh(FILE* fp, Mesh* mesh, int offset=0) {
 	for(uint i=0; i<size; ++i) {
 		if(i%3==0) fprintf(fp, "\nf ");
 		else fputc(' ', fp);
-		uint16 ix = mesh->getIndexBuffer()->getIndex(i) + offset;
+		uint ix = mesh->getIndexBuffer()->getIndex(i) + offset;
 		fprintf(fp, "%d", ix);
 		if(hasTexCoords) fprintf(fp,"/%d", ix);
 		else if(hasNormals) fprintf(fp, "/");
@@ -71,6 +71,7 @@ PFNGLBINDBUFFERPROC     glBindBuffer    = 0;
 PFNGLDELETEBUFFERSPROC  glDeleteBuffers = 0;
 PFNGLGENBUFFERSPROC     glGenBuffers    = 0;
 PFNGLBUFFERDATAPROC     glBufferData    = 0;
+PFNGLBUFFERSUBDATAPROC  glBufferSubData = 0;
 
 PFNGLCREATESHADERPROC   glCreateShader  = 0;
 PFNGLSHADERSOURCEPROC   glShaderSource  = 0;
@@ -92,6 +93,9 @@ PFNGLGETUNIFORMLOCATIONPROC   glGetUniformLocation   = 0;
 PFNGLGETATTRIBLOCATIONPROC    glGetAttribLocation    = 0;
 PFNGLBINDFRAGDATALOCATIONPROC glBindFragDataLocation = 0;
 PFNGLBINDATTRIBLOCATIONPROC   glBindAttribLocation   = 0;
+PFNGLGETPROGRAMBINARYPROC     glGetProgramBinary     = 0;
+PFNGLPROGRAMBINARYPROC        glProgramBinary        = 0;
+PFNGLPROGRAMPARAMETERIPROC    glProgramParameteri    = 0;
 
 PFNGLUNIFORM1IVPROC         glUniform1iv = 0;
 PFNGLUNIFORM2IVPROC         glUniform2iv = 0;
@@ -132,6 +136,7 @@ PFNGLBINDVERTEXARRAYPROC       glBindVertexArray       = 0;
 PFNGLDELETEVERTEXARRAYSPROC    glDeleteVertexArrays    = 0;
 PFNGLDRAWELEMENTSINSTANCEDPROC glDrawElementsInstanced = 0;
 PFNGLDRAWARRAYSINSTANCEDPROC   glDrawArraysInstanced   = 0;
+PFNGLTEXBUFFERPROC             glTexBuffer             = 0;
 
 PFNGLBINDRENDERBUFFERPROC        glBindRenderbuffer        = 0;
 PFNGLDELETERENDERBUFFERSPROC     glDeleteRenderbuffers     = 0;
@@ -154,6 +159,7 @@ int initialiseOpenGLExtensions() {
 	glDeleteBuffers = (PFNGLDELETEBUFFERSPROC) wglGetProcAddress("glDeleteBuffers");
 	glGenBuffers    = (PFNGLGENBUFFERSPROC)    wglGetProcAddress("glGenBuffers");
 	glBufferData    = (PFNGLBUFFERDATAPROC)    wglGetProcAddress("glBufferData");
+	glBufferSubData = (PFNGLBUFFERSUBDATAPROC) wglGetProcAddress("glBufferSubData");
 
 	glActiveTexture        = (PFNGLACTIVETEXTUREARBPROC)wglGetProcAddress("glActiveTextureARB");
 	glTexImage3D           = (PFNGLTEXIMAGE3DPROC)wglGetProcAddress("glTexImage3D");
@@ -189,6 +195,9 @@ int initialiseOpenGLExtensions() {
 	glGetAttribLocation  = (PFNGLGETATTRIBLOCATIONPROC)  wglGetProcAddress("glGetAttribLocation");
 	glBindAttribLocation = (PFNGLBINDATTRIBLOCATIONPROC) wglGetProcAddress("glBindAttribLocation");
 	glBindFragDataLocation = (PFNGLBINDFRAGDATALOCATIONPROC) wglGetProcAddress("glBindFragDataLocation");
+	glGetProgramBinary   = (PFNGLGETPROGRAMBINARYPROC)   wglGetProcAddress("glGetProgramBinary");
+	glProgramBinary      = (PFNGLPROGRAMBINARYPROC)      wglGetProcAddress("glProgramBinary");
+	glProgramParameteri  = (PFNGLPROGRAMPARAMETERIPROC)  wglGetProcAddress("glProgramParameteri");
 	
 	glUniform1iv = (PFNGLUNIFORM1IVPROC) wglGetProcAddress("glUniform1iv");
 	glUniform2iv = (PFNGLUNIFORM2IVPROC) wglGetProcAddress("glUniform2iv");
@@ -216,6 +225,7 @@ int initialiseOpenGLExtensions() {
 	glDeleteVertexArrays    = (PFNGLDELETEVERTEXARRAYSPROC)    wglGetProcAddress("glDeleteVertexArrays");
 	glDrawElementsInstanced = (PFNGLDRAWELEMENTSINSTANCEDPROC) wglGetProcAddress("glDrawElementsInstanced");
 	glDrawArraysInstanced   = (PFNGLDRAWARRAYSINSTANCEDPROC)   wglGetProcAddress("glDrawArraysInstanced");
+	glTexBuffer             = (PFNGLTEXBUFFERPROC)             wglGetProcAddress("glTexBuffer");
 
 
 	glBindRenderbuffer        = (PFNGLBINDRENDERBUFFERPROC)        wglGetProcAddress("glBindRenderbuffer");
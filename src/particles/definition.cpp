@@ -359,6 +359,8 @@ void particle::registerInternalStructures() {
 	CreateRenderDataDefinition(SpriteRendererQuads, RenderData);
 	CreateRenderDataDefinition(SpriteRenderer, RenderData);
 	CreateRenderDataDefinition(QuadRenderer, RenderData);
+	CreateRenderDataDefinition(PointRenderer, RenderData);
+	CreateRenderDataDefinition(SpriteRendererInstanced, RenderData);
 
 	{
 	auto def = CreateRenderDataDefinition(InstanceRenderer,RenderData);
@@ -1,4 +1,8 @@
 #include <base/particles.h>
+#include <base/camera.h>
+#include <algorithm>
+#include <cstring>
+#include <atomic>
 
 #ifndef EMSCRIPTEN
 #define assert(x) if(!(x)) asm("int $3\nnop");
@@ -26,6 +30,22 @@ inline void eraseFast(std::vector<T>& list, T& item) {
 	}
 }
 
+namespace {
+	thread_local Random threadRandom((uint)(size_t)&threadRandom);
+	thread_local Random* currentRandom = 0;
+
+	// Binds an instance generator to the calling thread while it spawns particles
+	struct RandomScope {
+		Random* previous;
+		RandomScope(Random& r) : previous(currentRandom) { currentRandom = &r; }
+		~RandomScope() { currentRandom = previous; }
+	};
+}
+
+float Object::random() {
+	return currentRandom? currentRandom->getFloat(): threadRandom.getFloat();
+}
+
 
 // ================================================================================= //
 
@@ -131,26 +151,68 @@ void Emitter::update(Instance* instance, float time) const {
 
 void Emitter::updateT(int thread, int count, Instance* instance, float time) const {
 	assert((uint)getDataIndex() < instance->m_emitters.size());
-	std::vector<uint>& data = instance->m_emitters[getDataIndex()].particles;
-	for(size_t i=thread; i<data.size(); i+=count) {
-		Particle& particle = instance->m_pool[ data[i] ];
+	Instance::EmitterInstance& data = instance->m_emitters[getDataIndex()];
+	BoundingBox& bounds = instance->m_threadBounds[thread];
+	const std::vector<Event*>& dieEvents = m_events[(int)Event::Type::DIE];
+	// Each thread takes a contiguous range and packs survivors at its start. Instance::compact joins the ranges.
+	uint* indices = data.particles.data();
+	size_t begin = data.particles.size() * thread / count;
+	size_t end = data.particles.size() * (thread + 1) / count;
+	size_t out = begin;
+	for(size_t i=begin; i<end; ++i) {
+		Particle& particle = instance->m_pool[ indices[i] ];
+		if(particle.dieTime < instance->m_time) {
+			// Slots with die events are freed after the events fire
+			if(dieEvents.empty()) particle.spawnTime = particle.dieTime = 0;
+			else for(const Event* event: dieEvents) fireEventT(instance, event, particle);
+			continue;
+		}
 		for(const Affector* a: m_affectors) {
 			if(particle.affectorMask & a->getDataIndex())
 				a->update(*instance, particle, time);
 		}
 		particle.position += particle.velocity * time;
-		if(particle.dieTime < instance->m_time) instance->m_destroy[thread].push_back( Instance::DestroyMessage{this, &particle, i} );
+		bounds.include(particle.position);
 
 		for(const Event* event: m_events[(int)Event::Type::TIME]) {
 			float t = instance->m_time - particle.spawnTime;
 			if(!event->once) t -= floor(t/event->time)*event->time;
-			if(t < event->time && t+time >= event->time) fireEventT(instance, event, particle, thread);
+			if(t < event->time && t+time >= event->time) fireEventT(instance, event, particle);
+		}
+		indices[out++] = indices[i];
+	}
+	data.alive[thread] = out - begin;
+}
+
+void Emitter::fastForward(Instance* instance, float time) const {
+	Instance::EmitterInstance& data = instance->m_emitters[getDataIndex()];
+	data.accumulator = 0;
+	float currentRate = rate.getValue(instance->m_time);
+	if(currentRate<=0) return;
+	// Only particles spawned within one lifetime of the current time survive
+	vec2 lifeRange = life.getRange();
+	float window = life.getType()==Value::GRAPH? time: fmin(time, fmax(lifeRange.x, lifeRange.y));
+	int num = window * currentRate;
+	vec3 pos = vec3(&instance->getTransform()[12]);
+	Quaternion rot(instance->getTransform());
+	for(int i=0; i<num; ++i) {
+		float timeOffset = -i/currentRate;
+		for(int j=0; j<spawnCount; ++j) {
+			Particle* n = spawnParticle(instance, pos, rot, instance->getVelocity(), instance->m_time, timeOffset);
+			if(!n) return; // limit reached
+			if(n->dieTime < instance->m_time) {
+				instance->freeParticle(*n);
+				data.particles.pop_back();
+			}
+			else n->position -= n->velocity * timeOffset;
 		}
 	}
 }
 
-Particle& Emitter::spawnParticle(Instance* instance, const vec3& pos, const Quaternion& orientation, const vec3& velocity, float key, float timeOffset) const {
-	Particle& n = instance->allocate(this);
+Particle* Emitter::spawnParticle(Instance* instance, const vec3& pos, const Quaternion& orientation, const vec3& velocity, float key, float timeOffset) const {
+	Particle* p = instance->allocate(this);
+	if(!p) return 0;
+	Particle& n = *p;
 	n.position = pos;
 	n.orientation = orientation;
 	n.velocity = velocity * inheritVelocity;
@@ -162,7 +224,7 @@ Particle& Emitter::spawnParticle(Instance* instance, const vec3& pos, const Quat
 	n.affectorMask = m_initialAffectorMask;
 	spawnParticle(n, instance->getTransform(), key);
 	for(Event* event: m_events[(int)Event::Type::SPAWN]) fireEvent(instance, event, n);
-	return n;
+	return p;
 }
 
 void Emitter::addAffector(Affector* e) {
@@ -228,8 +290,9 @@ void Emitter::fireEvent(Instance* instance, const Event* e, Particle& p) const {
 	}
 }
 
-void Emitter::fireEventT(Instance* instance, const Event* e, Particle& p, int thread) const {
-	instance->m_triggered[thread].push_back(Instance::TriggeredEvent{e, this, &p});
+void Emitter::fireEventT(Instance* instance, const Event* e, Particle& p) const {
+	int index = instance->m_triggeredCount++;
+	if(index < (int)instance->m_triggered.size()) instance->m_triggered[index] = Instance::TriggeredEvent{e, this, &p};
 }
 
 void Emitter::trigger(Instance* instance, Particle& p) const {
@@ -267,25 +330,37 @@ void RenderData::setCount(Instance* instance, size_t count, int threads) const {
 		data.capacity = particleSize * (count + 16);
 		data.data = new char[data.capacity];
 	}
-	for(int i=0; i<threads; ++i) data.head[i] = data.data + particleSize * i;
+	for(int i=0; i<threads; ++i) data.head[i] = data.data;
 	data.count = count;
 }
 
-void RenderData::updateT(int threadIndex, int threadCount, Instance* instance, int emitter, const Matrix& view) const {
+void RenderData::updateT(int threadIndex, int threadCount, Instance* instance, int emitter, const Matrix& view, float extrapolate) const {
 	const std::vector<uint>& indices = instance->m_emitters[emitter].particles;
 	Instance::RenderInstance& data = instance->m_renderers[getDataIndex()];
-	if(indices.size() > data.count) {
+	const size_t particleSize = m_attributes.getStride() * m_verticesPerParticle;
+	// Every thread advances the head past the whole emitter, but only writes its own range
+	char*& head = reinterpret_cast<char*&>(data.head[threadIndex]);
+	if(head + indices.size() * particleSize > data.data + data.count * particleSize) {
 		printf("Particle buffer error\n");
 		return;
 	}
-	size_t step = m_attributes.getStride() * m_verticesPerParticle * threadCount;
-	char* ptr = (char*)data.head[threadIndex];
-	for(size_t i=threadIndex; i<indices.size(); i+=threadCount) {
-		assert((size_t)ptr - (size_t)data.data < data.capacity);
-		setParticleVertices(ptr, instance->m_pool[indices[i]], view);
-		ptr += step;
+	size_t begin = indices.size() * threadIndex / threadCount;
+	size_t end = indices.size() * (threadIndex + 1) / threadCount;
+	if(end > begin) setVertices(head + begin * particleSize, instance->m_pool.data(), indices.data() + begin, end - begin, view, extrapolate);
+	head += indices.size() * particleSize;
+}
+
+void RenderData::setVertices(char* out, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const {
+	const size_t particleSize = m_attributes.getStride() * m_verticesPerParticle;
+	for(size_t i=0; i<count; ++i, out+=particleSize) {
+		if(extrapolate > 0) {
+			// Fixed time step: move particles to the render time
+			Particle p = pool[indices[i]];
+			p.position += p.velocity * extrapolate;
+			setParticleVertices(out, p, view);
+		}
+		else setParticleVertices(out, pool[indices[i]], view);
 	}
-	data.head[threadIndex] = ptr;
 }
 
 
@@ -342,8 +417,12 @@ void System::removeRenderer(RenderData* r) {
 Instance::Instance(System* sys)
 	: m_manager(0), m_system(sys)
 	, m_count(0), m_head(0), m_time(0), m_enabled(false)
-	, m_triggered(0), m_destroy(0)
+	, m_cullState(ACTIVE), m_sleepTime(0), m_boundsPadding(1)
+	, m_triggeredCount(0)
 {
+	static std::atomic<uint> seeds(0);
+	m_random = Random(++seeds * 0x9e3779b9u);
+	m_bounds.setInvalid();
 }
 
 Instance::~Instance() {
@@ -352,8 +431,7 @@ Instance::~Instance() {
 		delete [] r.data;
 		delete [] r.head;
 	}
-	delete [] m_triggered;
-	delete [] m_destroy;
+	delete [] m_threadBounds;
 }
 
 void Instance::initialise() {
@@ -369,6 +447,7 @@ void Instance::initialise() {
 	for(Emitter* e: m_system->emitters()) {
 		assert(e->m_index >= 0);
 		m_emitters.push_back(EmitterInstance{e, 0.f, e->startEnabled});
+		m_emitters.back().alive.resize(m_threads);
 		if(e->startEnabled && !e->eventOnly) m_active.push_back(e->m_index);
 	}
 	for(RenderInstance& r: m_renderers) delete [] r.head;
@@ -377,14 +456,13 @@ void Instance::initialise() {
 		m_renderers.push_back(RenderInstance{r, 0, 0, 0, 0});
 		if(m_threads) m_renderers.back().head = new void*[m_threads];
 	}
-	for(int i=0; i<m_threads; ++i) {
-		m_triggered[i].clear();
-		m_destroy[i].clear();
-	}
+	m_triggeredCount = 0;
+	m_compact = false;
 }
 
 void Instance::trigger() {
 	if(!m_enabled) return;
+	RandomScope scope(m_random);
 	Particle n;
 	n.position = vec3(&getTransform()[12]);
 	n.orientation.fromMatrix(getTransform());
@@ -397,10 +475,10 @@ void Instance::trigger() {
 
 void Instance::reset() {
 	m_time = 0;
-	for(int i=0; i<m_threads; ++i) {
-		m_triggered[i].clear();
-		m_destroy[i].clear();
-	}
+	m_sleepTime = 0;
+	m_bounds.setInvalid();
+	compact();
+	flushEvents(false);
 	for(EmitterInstance& e: m_emitters) {
 		e.enabled = e.emitter->startEnabled;
 		for(uint i: e.particles) freeParticle(m_pool[i]);
@@ -421,13 +499,23 @@ void Instance::shift(const vec3& delta) {
 }
 
 void Instance::update(float time) {
+	compact();
+
 	// Need to reset head pointers if paused
 	if(time==0) {
-		for(RenderInstance& r: m_renderers) r.render->setCount(this, r.count, m_threads);
+		updateRenderCounts();
 		return;
 	}
 
 	m_time += time;
+	RandomScope scope(m_random);
+
+	// Collect bounds from threaded update
+	m_bounds.setInvalid();
+	for(int i=0; i<m_threads; ++i) {
+		m_bounds.include(m_threadBounds[i]);
+		m_threadBounds[i].setInvalid();
+	}
 
 	// Update spawns
 	if(m_enabled) {
@@ -436,27 +524,21 @@ void Instance::update(float time) {
 		}
 	}
 
-	// Fire threaded events
-	for(int i=0; i<m_threads; ++i) {
-		for(const TriggeredEvent& e: m_triggered[i]) {
-			e.emitter->fireEvent(this, e.event, *e.particle);
-		}
-		m_triggered[i].clear();
-
-		for(const DestroyMessage& d: m_destroy[i]) {
-			EmitterInstance& e = m_emitters[d.emitter->m_index];
-			if(d.index < e.particles.size()) {
-				for(const Event* event: e.emitter->m_events[(int)Event::Type::DIE]) e.emitter->fireEvent(this, event, *d.particle);
-				freeParticle(m_pool[e.particles[d.index]]);
-				e.particles[d.index] = e.particles.back();
-				e.particles.pop_back();
-			}
-		}
-		m_destroy[i].clear();
+	flushEvents(true);
+
+	// Reserve space for every event the threaded update could fire
+	size_t events = 0;
+	for(EmitterInstance& e: m_emitters) {
+		const size_t perParticle = e.emitter->m_events[(int)Event::Type::TIME].size() + e.emitter->m_events[(int)Event::Type::DIE].size();
+		events += e.particles.size() * perParticle;
 	}
+	if(events > m_triggered.size()) m_triggered.resize(events + events / 2);
+	m_compact = true;
 
+	updateRenderCounts();
+}
 
-	// Update renderer particle counts
+void Instance::updateRenderCounts() {
 	for(RenderInstance& r: m_renderers) r.count = 0;
 	for(EmitterInstance& e: m_emitters) {
 		if(e.emitter->getRenderer()) m_renderers[e.emitter->getRenderer()->m_index].count += e.particles.size();
@@ -464,26 +546,118 @@ void Instance::update(float time) {
 	for(RenderInstance& r: m_renderers) r.render->setCount(this, r.count, m_threads);
 }
 
-void Instance::updateT(int thread, int count, float time, const Matrix& view) {
+bool Instance::compact() {
+	if(!m_compact) return false;
+	m_compact = false;
+	// Prefix sum of per thread survivor counts gives each range's output position
+	for(EmitterInstance& e: m_emitters) {
+		const size_t size = e.particles.size();
+		size_t out = e.alive[0];
+		for(int t=1; t<m_threads; ++t) {
+			size_t begin = size * t / m_threads;
+			if(out != begin && e.alive[t]) memmove(&e.particles[out], &e.particles[begin], e.alive[t] * sizeof(uint));
+			out += e.alive[t];
+		}
+		m_count -= size - out;
+		e.particles.resize(out);
+	}
+	return true;
+}
+
+void Instance::flushEvents(bool fire) {
+	const int count = std::min<int>(m_triggeredCount, m_triggered.size());
+	if(fire) {
+		for(int i=0; i<count; ++i) {
+			const TriggeredEvent& e = m_triggered[i];
+			e.emitter->fireEvent(this, e.event, *e.particle);
+		}
+	}
+	// Particles removed by compact() that waited for their die events
+	for(int i=0; i<count; ++i) {
+		if(m_triggered[i].event->getType() == Event::Type::DIE) m_triggered[i].particle->spawnTime = m_triggered[i].particle->dieTime = 0;
+	}
+	m_triggeredCount = 0;
+}
+
+void Instance::updateT(int thread, int count, float time) {
 	if(time>0) for(Emitter* e: m_system->emitters()) e->updateT(thread, count, this, time);
-	// Update geometry
+}
+
+void Instance::updateGeometryT(int thread, int count, const Matrix& view, float extrapolate) {
 	for(Emitter* e: m_system->emitters()) {
-		if(e->getRenderer()) e->getRenderer()->updateT(thread, count, this, e->getDataIndex(), view);
+		if(e->getRenderer()) e->getRenderer()->updateT(thread, count, this, e->getDataIndex(), view, extrapolate);
+	}
+}
+
+void Instance::finishUpdate() {
+	// Geometry must only see survivors, so join the thread ranges before it is built
+	if(compact()) updateRenderCounts();
+}
+
+BoundingBox Instance::getCullBounds() const {
+	BoundingBox box = BoundingBox(vec3(&getTransform()[12]));
+	if(m_count) box.include(m_bounds);
+	box.expand(m_boundsPadding);
+	return box;
+}
+
+void Instance::fastForward(float time) {
+	if(time <= 0) return;
+	RandomScope scope(m_random);
+	compact();
+	flushEvents(true);
+	m_time += time;
+	// Existing particles move ballistically, affectors are skipped
+	m_bounds.setInvalid();
+	for(EmitterInstance& e: m_emitters) {
+		for(size_t i=0; i<e.particles.size();) {
+			Particle& p = m_pool[e.particles[i]];
+			if(p.dieTime < m_time) {
+				freeParticle(p);
+				e.particles[i] = e.particles.back();
+				e.particles.pop_back();
+			}
+			else {
+				p.position += p.velocity * time;
+				m_bounds.include(p.position);
+				++i;
+			}
+		}
+	}
+	if(m_enabled) {
+		for(EmitterInstance& e: m_emitters) {
+			if(e.enabled && !e.emitter->eventOnly) e.emitter->fastForward(this, time);
+		}
 	}
 }
 
-Particle& Instance::allocate(const Emitter* emitter) {
-	static Particle bad;
-	if(m_count == m_pool.size()) return bad;
+void Instance::setCullState(CullState state, float time) {
+	if(state == SLEEPING) {
+		if(m_cullState != SLEEPING) {
+			// Hide geometry
+			for(RenderInstance& r: m_renderers) r.count = 0;
+			updateGeometry();
+		}
+		m_sleepTime += time;
+	}
+	else if(m_cullState == SLEEPING) {
+		fastForward(m_sleepTime);
+		m_sleepTime = 0;
+	}
+	m_cullState = state;
+}
+
+Particle* Instance::allocate(const Emitter* emitter) {
+	if(m_count == m_pool.size()) return 0;
 	EmitterInstance& data = m_emitters[emitter->m_index];
 
-	if((int)data.particles.size() >= emitter->limit) return m_pool[0];
+	if((int)data.particles.size() >= emitter->limit) return 0;
 	
 	++m_head%=m_pool.size();
 	if(m_pool[m_head].spawnTime == 0) {
 		data.particles.push_back(m_head);
 		++m_count;
-		return m_pool[m_head];
+		return &m_pool[m_head];
 	}
 
 	/* // this allocater is slow
@@ -503,7 +677,7 @@ Particle& Instance::allocate(const Emitter* emitter) {
 		}
 	}
 	*/
-	return bad; // should never get here
+	return 0; // Slot still in use
 }
 
 void Instance::freeParticle(Particle& p) {
@@ -513,14 +687,15 @@ void Instance::freeParticle(Particle& p) {
 
 void Instance::initialiseThreadData(int threads) {
 	if(threads == m_threads) return;
-	delete [] m_triggered;
-	delete [] m_destroy;
-	m_triggered = new std::vector<TriggeredEvent>[threads];
-	m_destroy = new std::vector<DestroyMessage>[threads];
+	compact();
+	delete [] m_threadBounds;
+	m_threadBounds = new BoundingBox[threads];
+	for(int i=0; i<threads; ++i) m_threadBounds[i].setInvalid();
 	for(RenderInstance& r: m_renderers) {
 		delete [] r.head;
 		r.head = new void*[threads];
 	}
+	for(EmitterInstance& e: m_emitters) e.alive.resize(threads);
 	m_threads = threads;
 }
 
@@ -532,7 +707,9 @@ void Instance::setEnabled(bool e) {
 
 // ================================================================ //
 
-Manager::Manager() : m_threadsRunning(false), m_timeStep(0) {
+Manager::Manager() : m_threadsRunning(false), m_timeStep(0), m_geometry(true)
+	, m_fixedStep(0), m_accumulator(0), m_extrapolate(0), m_maxSteps(4)
+	, m_sleepDistance(0), m_sleepOffscreen(false) {
 }
 
 Manager::~Manager() {
@@ -550,41 +727,111 @@ void Manager::startThreads(int count) {
 void Manager::stopThreads() {
 	if(m_threadsRunning) {
 		m_threadsRunning = false;
+		m_barrier.sync(); // Release waiting threads
 		for(base::Thread& t: m_threads) t.join();
+		m_threads.clear();
+		for(Instance* i: m_instances) i->initialiseThreadData(1);
 	}
 }
 
+void Manager::setFixedTimeStep(float step, int maxSteps) {
+	m_fixedStep = step>0? step: 0;
+	m_maxSteps = maxSteps>1? maxSteps: 1;
+	m_accumulator = 0;
+	m_extrapolate = 0;
+}
+
+void Manager::setSleepDistance(float distance) {
+	m_sleepDistance = distance;
+}
+
+void Manager::setSleepOffscreen(bool sleep) {
+	m_sleepOffscreen = sleep;
+}
+
 void Manager::threadFunc(int index) {
-	while(m_threadsRunning) {
+	const int count = m_threads.size();
+	while(true) {
 		m_barrier.sync();
+		if(!m_threadsRunning) break;
+		// Spawn and destroy particles, split by instance
+		for(size_t i=index; i<m_instances.size(); i+=count) {
+			if(m_instances[i]->m_cullState != Instance::SLEEPING) m_instances[i]->update(m_timeStep);
+		}
+		m_barrier.sync();
+		// Move particles, split by particle
 		for(Instance* inst: m_instances) {
-			inst->updateT(index, m_threads.size(), m_timeStep, m_viewMatrix);
+			if(inst->m_cullState != Instance::SLEEPING) inst->updateT(index, count, m_timeStep);
+		}
+		m_barrier.sync();
+		// Join surviving particle ranges, split by instance
+		for(size_t i=index; i<m_instances.size(); i+=count) {
+			if(m_instances[i]->m_cullState != Instance::SLEEPING) m_instances[i]->finishUpdate();
+		}
+		m_barrier.sync();
+		// Build geometry, split by particle
+		if(m_geometry) for(Instance* inst: m_instances) {
+			if(inst->m_cullState == Instance::ACTIVE) inst->updateGeometryT(index, count, m_viewMatrix, m_extrapolate);
 		}
 		m_barrier.sync();
 	}
 }
 
-void Manager::update(float time, const Matrix& viewMatrix) {
-	// Main thread updates (spawn/destroy particles)
-	for(Instance* inst: m_instances) {
-		inst->update(time);
-	}
-
-	// Trigger threaded updates (move)
+void Manager::simulate(float time, bool geometry) {
 	if(m_threadsRunning) {
-		m_barrier.sync();
-		m_viewMatrix = viewMatrix;
 		m_timeStep = time;
-		m_barrier.sync();
+		m_geometry = geometry;
+		for(int i=0; i<5; ++i) m_barrier.sync();
 	}
 	else { // Main thread update mode
 		for(Instance* inst: m_instances) {
-			inst->updateT(0, 1, time, viewMatrix);
+			if(inst->m_cullState == Instance::SLEEPING) continue;
+			inst->update(time);
+			inst->updateT(0, 1, time);
+			inst->finishUpdate();
+			if(geometry && inst->m_cullState==Instance::ACTIVE) inst->updateGeometryT(0, 1, m_viewMatrix, m_extrapolate);
 		}
 	}
+}
+
+void Manager::updateInstances(float time) {
+	if(m_fixedStep > 0) {
+		m_accumulator += time;
+		int steps = m_accumulator / m_fixedStep;
+		if(steps > m_maxSteps) {
+			steps = m_maxSteps;
+			m_accumulator = steps * m_fixedStep; // Drop time we can't keep up with
+		}
+		m_accumulator -= steps * m_fixedStep;
+		m_extrapolate = m_accumulator;
+		if(steps == 0) simulate(0, true); // Geometry only
+		for(int i=0; i<steps; ++i) simulate(m_fixedStep, i==steps-1);
+	}
+	else simulate(time, true);
 
 	// Update main thread drawables
-	for(Instance* inst : m_instances) inst->updateGeometry();
+	for(Instance* inst : m_instances) {
+		if(inst->m_cullState == Instance::ACTIVE) inst->updateGeometry();
+	}
+}
+
+void Manager::update(float time, const Matrix& viewMatrix) {
+	for(Instance* inst: m_instances) inst->setCullState(Instance::ACTIVE, time);
+	m_viewMatrix = viewMatrix;
+	updateInstances(time);
+}
+
+void Manager::update(float time, const base::Camera& camera) {
+	const vec3& eye = camera.getPosition();
+	for(Instance* inst: m_instances) {
+		BoundingBox bounds = inst->getCullBounds();
+		Instance::CullState state = Instance::ACTIVE;
+		if(m_sleepDistance > 0 && bounds.clamp(eye).distance2(eye) > m_sleepDistance * m_sleepDistance) state = Instance::SLEEPING;
+		else if(!camera.onScreen(bounds)) state = m_sleepOffscreen? Instance::SLEEPING: Instance::HIDDEN;
+		inst->setCullState(state, time);
+	}
+	m_viewMatrix = camera.getModelview();
+	updateInstances(time);
 }
 
 void Manager::add(Instance* instance, bool enabled) {
@@ -1,5 +1,10 @@
 #include "renderers.h"
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define PARTICLE_SSE
+#endif
+
 using namespace particle;
 
 struct ParticleVertex {
@@ -8,6 +13,167 @@ struct ParticleVertex {
 	uint colour;
 };
 
+namespace {
+	// Billboard corners: (-x-y), (+x-y), (+x+y), (-x+y)
+	const int quadCorners[4] = { 0, 1, 2, 3 };
+	const int triangleCorners[6] = { 0, 1, 3, 3, 1, 2 };
+	const vec2 cornerUV[4] = { vec2(0,0), vec2(1,0), vec2(1,1), vec2(0,1) };
+
+	// Fast sin approximation for x in [-pi,pi]. Max error about 0.001
+	inline float fastSin(float x) {
+		float y = 4/PI * x - 4/(PI*PI) * x * fabs(x);
+		return 0.225f * (y * fabs(y) - y) + y;
+	}
+	inline float wrapAngle(float x) {
+		return x - floor(x / TWOPI + 0.5f) * TWOPI;
+	}
+
+	#ifdef PARTICLE_SSE
+	inline __m128 absolute(__m128 x) { return _mm_andnot_ps(_mm_set1_ps(-0.f), x); }
+	inline __m128 fastSin(__m128 x) {
+		__m128 y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(4/PI), x), _mm_mul_ps(_mm_set1_ps(-4/(PI*PI)), _mm_mul_ps(x, absolute(x))));
+		return _mm_add_ps(_mm_mul_ps(_mm_set1_ps(0.225f), _mm_sub_ps(_mm_mul_ps(y, absolute(y)), y)), y);
+	}
+	inline __m128 wrapAngle(__m128 x) {
+		// Adding 1.5*2^23 rounds to the nearest integer
+		const __m128 magic = _mm_set1_ps(12582912.f);
+		__m128 k = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(1/TWOPI)), magic), magic);
+		return _mm_sub_ps(x, _mm_mul_ps(k, _mm_set1_ps(TWOPI)));
+	}
+	/// Sin and cos of four sprite angles. Angle 0 means unrotated, giving s=1, c=0
+	inline void spriteSinCos(__m128 angle, __m128& s, __m128& c) {
+		__m128 a = wrapAngle(angle);
+		__m128 b = _mm_add_ps(a, _mm_set1_ps(HALFPI));
+		b = _mm_sub_ps(b, _mm_and_ps(_mm_cmpgt_ps(b, _mm_set1_ps(PI)), _mm_set1_ps(TWOPI)));
+		__m128 zero = _mm_cmpeq_ps(angle, _mm_setzero_ps());
+		s = _mm_or_ps(_mm_and_ps(zero, _mm_set1_ps(1.f)), _mm_andnot_ps(zero, fastSin(a)));
+		c = _mm_andnot_ps(zero, fastSin(b));
+	}
+
+	/// Write billboard vertices from centre and half axes
+	inline void writeBillboard(ParticleVertex* vx, __m128 pos, __m128 x, __m128 y, uint colour, const int* order, int count) {
+		__m128 corner[4];
+		__m128 a = _mm_sub_ps(pos, y);
+		__m128 b = _mm_add_ps(pos, y);
+		corner[0] = _mm_sub_ps(a, x);
+		corner[1] = _mm_add_ps(a, x);
+		corner[2] = _mm_add_ps(b, x);
+		corner[3] = _mm_sub_ps(b, x);
+		for(int i=0; i<count; ++i) {
+			_mm_storeu_ps(&vx[i].position.x, corner[order[i]]);	// w overwritten by texcoord
+			vx[i].texcoord = cornerUV[order[i]];
+			vx[i].colour = colour;
+		}
+	}
+
+	inline __m128 loadPosition(const Particle& p, __m128 extrapolate) {
+		// Unaligned loads read one float past each vec3, which is still inside Particle
+		return _mm_add_ps(_mm_loadu_ps(&p.position.x), _mm_mul_ps(_mm_loadu_ps(&p.velocity.x), extrapolate));
+	}
+
+	void writeSprites(char* out, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate, const int* order, int vertices) {
+		ParticleVertex* vx = reinterpret_cast<ParticleVertex*>(out);
+		const __m128 right = _mm_setr_ps(view[0], view[1], view[2], 0);
+		const __m128 up = _mm_setr_ps(view[4], view[5], view[6], 0);
+		const __m128 ext = _mm_set1_ps(extrapolate);
+		alignas(16) float angle[4], sn[4], cs[4];
+		for(size_t i=0; i<count; i+=4) {
+			const int n = count - i < 4? count - i: 4;
+			for(int k=0; k<4; ++k) angle[k] = k<n? pool[indices[i+k]].orientation.x: 0;
+			__m128 s, c;
+			spriteSinCos(_mm_load_ps(angle), s, c);
+			_mm_store_ps(sn, s);
+			_mm_store_ps(cs, c);
+			for(int k=0; k<n; ++k, vx+=vertices) {
+				const Particle& p = pool[indices[i+k]];
+				__m128 vs = _mm_set1_ps(sn[k]);
+				__m128 vc = _mm_set1_ps(cs[k]);
+				__m128 x = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(right, vs), _mm_mul_ps(up, vc)), _mm_set1_ps(p.scale.x));
+				__m128 y = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(up, vs), _mm_mul_ps(right, vc)), _mm_set1_ps(p.scale.y));
+				writeBillboard(vx, loadPosition(p, ext), x, y, p.colour, order, vertices);
+			}
+		}
+	}
+
+	void writeQuads(char* out, const Particle* pool, const uint* indices, size_t count, float extrapolate) {
+		ParticleVertex* vx = reinterpret_cast<ParticleVertex*>(out);
+		const __m128 ext = _mm_set1_ps(extrapolate);
+		for(size_t i=0; i<count; ++i, vx+=6) {
+			const Particle& p = pool[indices[i]];
+			vec3 ax = p.orientation.xAxis();
+			vec3 ay = p.orientation.yAxis();
+			__m128 x = _mm_mul_ps(_mm_setr_ps(ax.x, ax.y, ax.z, 0), _mm_set1_ps(p.scale.x));
+			__m128 y = _mm_mul_ps(_mm_setr_ps(ay.x, ay.y, ay.z, 0), _mm_set1_ps(p.scale.y));
+			writeBillboard(vx, loadPosition(p, ext), x, y, p.colour, triangleCorners, 6);
+		}
+	}
+
+	#else
+	inline void writeBillboard(ParticleVertex* vx, const vec3& pos, const vec3& x, const vec3& y, uint colour, const int* order, int count) {
+		vec3 corner[4] = { pos - x - y, pos + x - y, pos + x + y, pos - x + y };
+		for(int i=0; i<count; ++i) {
+			vx[i].position = corner[order[i]];
+			vx[i].texcoord = cornerUV[order[i]];
+			vx[i].colour = colour;
+		}
+	}
+
+	void writeSprites(char* out, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate, const int* order, int vertices) {
+		ParticleVertex* vx = reinterpret_cast<ParticleVertex*>(out);
+		const vec3 right(&view[0]), up(&view[4]);
+		for(size_t i=0; i<count; ++i, vx+=vertices) {
+			const Particle& p = pool[indices[i]];
+			float s = 1, c = 0;
+			if(p.orientation.x) {
+				float a = wrapAngle(p.orientation.x);
+				s = fastSin(a);
+				c = fastSin(wrapAngle(a + HALFPI));
+			}
+			vec3 x = (right*s + up*c) * p.scale.x;
+			vec3 y = (up*s - right*c) * p.scale.y;
+			writeBillboard(vx, p.position + p.velocity * extrapolate, x, y, p.colour, order, vertices);
+		}
+	}
+
+	void writeQuads(char* out, const Particle* pool, const uint* indices, size_t count, float extrapolate) {
+		ParticleVertex* vx = reinterpret_cast<ParticleVertex*>(out);
+		for(size_t i=0; i<count; ++i, vx+=6) {
+			const Particle& p = pool[indices[i]];
+			vec3 x = p.orientation.xAxis() * p.scale.x;
+			vec3 y = p.orientation.yAxis() * p.scale.y;
+			writeBillboard(vx, p.position + p.velocity * extrapolate, x, y, p.colour, triangleCorners, 6);
+		}
+	}
+	#endif
+}
+
+// ======================================================================================== //
+
+struct PointVertex {
+	vec3 position;
+	uint colour;
+};
+
+PointRenderer::PointRenderer() : RenderData(POINTS) {
+	m_attributes.add(base::VA_VERTEX, base::VA_FLOAT3);
+	m_attributes.add(base::VA_COLOUR, base::VA_ARGB);
+}
+void PointRenderer::setParticleVertices(void* out, const Particle& p, const Matrix& view) const {
+	PointVertex* vx = reinterpret_cast<PointVertex*>(out);
+	vx->position = p.position;
+	vx->colour = p.colour;
+}
+void PointRenderer::setVertices(char* out, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const {
+	PointVertex* vx = reinterpret_cast<PointVertex*>(out);
+	for(size_t i=0; i<count; ++i) {
+		const Particle& p = pool[indices[i]];
+		vx[i].position = p.position + p.velocity * extrapolate;
+		vx[i].colour = p.colour;
+	}
+}
+
+// ======================================================================================== //
+
 SpriteRendererQuads::SpriteRendererQuads() : RenderData(QUADS) {
 	m_attributes.add(base::VA_VERTEX, base::VA_FLOAT3);
 	m_attributes.add(base::VA_TEXCOORD, base::VA_FLOAT2);
@@ -46,6 +212,9 @@ void SpriteRendererQuads::setParticleVertices(void* out, const Particle& p, cons
 	vx[3].texcoord.set(0, 1);
 	vx[3].colour = p.colour;
 }
+void SpriteRendererQuads::setVertices(char* out, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const {
+	writeSprites(out, pool, indices, count, view, extrapolate, quadCorners, 4);
+}
 
 // ======================================================================================== //
 
@@ -95,6 +264,9 @@ void SpriteRenderer::setParticleVertices(void* out, const Particle& p, const Mat
 	vx[5].texcoord.set(1, 1);
 	vx[5].colour = p.colour;
 }
+void SpriteRenderer::setVertices(char* out, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const {
+	writeSprites(out, pool, indices, count, view, extrapolate, triangleCorners, 6);
+}
 
 // ======================================================================================== //
 
@@ -132,6 +304,38 @@ void QuadRenderer::setParticleVertices(void* out, const Particle& p, const Matri
 	vx[5].texcoord.set(1, 1);
 	vx[5].colour = p.colour;
 }
+void QuadRenderer::setVertices(char* out, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const {
+	writeQuads(out, pool, indices, count, extrapolate);
+}
+
+// ======================================================================================== //
+
+struct SpriteInstance {
+	vec3 position;
+	vec3 size;		// x scale, y scale, rotation
+	uint colour;
+};
+
+SpriteRendererInstanced::SpriteRendererInstanced() : RenderData(INSTANCE) {
+	m_attributes.add(base::VA_CUSTOM, base::VA_FLOAT3, "loc",  1);	// Location
+	m_attributes.add(base::VA_CUSTOM, base::VA_FLOAT3, "size", 1);	// Scale and rotation
+	m_attributes.add(base::VA_CUSTOM, base::VA_ARGB,   "col",  1);	// Colour
+}
+void SpriteRendererInstanced::setParticleVertices(void* out, const Particle& p, const Matrix& view) const {
+	SpriteInstance* inst = reinterpret_cast<SpriteInstance*>(out);
+	inst->position = p.position;
+	inst->size.set(p.scale.x, p.scale.y, p.orientation.x);
+	inst->colour = p.colour;
+}
+void SpriteRendererInstanced::setVertices(char* out, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const {
+	SpriteInstance* inst = reinterpret_cast<SpriteInstance*>(out);
+	for(size_t i=0; i<count; ++i) {
+		const Particle& p = pool[indices[i]];
+		inst[i].position = p.position + p.velocity * extrapolate;
+		inst[i].size.set(p.scale.x, p.scale.y, p.orientation.x);
+		inst[i].colour = p.colour;
+	}
+}
 
 // ======================================================================================== //
 
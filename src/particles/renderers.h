@@ -4,24 +4,48 @@
 namespace particle {
 
 class PointRenderer : public RenderData {
+	public:
+	PointRenderer();
+	void setParticleVertices(void* output, const Particle& p, const Matrix& view) const override;
+	void setVertices(char* output, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const override;
 };
 
 class SpriteRendererQuads : public RenderData {
 	public:
 	SpriteRendererQuads();
 	void setParticleVertices(void* output, const Particle& p, const Matrix& view) const override;
+	void setVertices(char* output, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const override;
 };
 
 class SpriteRenderer : public RenderData {
 	public:
 	SpriteRenderer();
 	void setParticleVertices(void* output, const Particle& p, const Matrix& view) const override;
+	void setVertices(char* output, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const override;
 };
 
 class QuadRenderer : public RenderData {
 	public:
 	QuadRenderer();
 	void setParticleVertices(void* output, const Particle& p, const Matrix& view) const override;
+	void setVertices(char* output, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const override;
+};
+
+/** Sprites expanded on the GPU. Each particle is one instance of a quad, with only
+ * position, size, rotation and colour uploaded. Vertex shader for the particlesprite material:
+ *   in vec3 vertex; in vec2 texCoord; in vec3 loc; in vec3 size; in vec4 col;
+ *   vec3 right = vec3(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0]);
+ *   vec3 up    = vec3(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1]);
+ *   vec2 sc = size.z==0.0? vec2(1,0): vec2(sin(size.z), cos(size.z));
+ *   vec3 x = (right*sc.x + up*sc.y) * size.x;
+ *   vec3 y = (up*sc.x - right*sc.y) * size.y;
+ *   gl_Position = viewProjection * vec4(loc + x*vertex.x + y*vertex.z, 1);
+ */
+class SpriteRendererInstanced : public RenderData {
+	public:
+	SpriteRendererInstanced();
+	void setParticleVertices(void* output, const Particle& p, const Matrix& view) const override;
+	void setVertices(char* output, const Particle* pool, const uint* indices, size_t count, const Matrix& view, float extrapolate) const override;
 };
 
 
@@ -19,6 +19,7 @@
 #include <base/xml.h>
 #include <base/thread.h>
 #include <base/opengl.h>
+#include <base/assetcache.h>
 #include <cstdio>
 #include <list>
 
@@ -94,12 +95,173 @@ template<class T> class DefaultNullLoader : public ResourceLoader<T> {
 };
 
 
+// ----------------------------------------------------------------------------------- //
+
+// Binary data for the asset cache. Bump the versions when the layout changes.
+static const unsigned ImageCacheVersion = 1;
+static const unsigned ModelCacheVersion = 1;
+
+class CacheWriter {
+	public:
+	template<class T> void write(const T& value) { write(&value, sizeof(T)); }
+	void write(const void* data, size_t size) { m_data.insert(m_data.end(), (const char*)data, (const char*)data + size); }
+	void writeString(const char* s) { uint len = s? strlen(s): 0; write(len); write(s, len); }
+	const char* data() const { return &m_data[0]; }
+	size_t size() const { return m_data.size(); }
+	private:
+	std::vector<char> m_data;
+};
+
+class CacheReader {
+	public:
+	CacheReader(const File& file) : m_data(file.data()), m_end(file.data() + file.size()) {}
+	template<class T> T read() { T value = T(); read(&value, sizeof(T)); return value; }
+	bool read(void* out, size_t size) {
+		if(m_data + size > m_end) { m_data = m_end; m_valid = false; return false; }
+		memcpy(out, m_data, size);
+		m_data += size;
+		return true;
+	}
+	String readString() {
+		uint len = read<uint>();
+		if(!m_valid || m_data + len > m_end) { m_valid = false; return String(); }
+		String s(m_data, len);
+		m_data += len;
+		return s;
+	}
+	operator bool() const { return m_valid && m_data; }
+	private:
+	const char* m_data;
+	const char* m_end;
+	bool m_valid = true;
+};
+
+static void writeCachedImage(CacheWriter& out, const Image& image) {
+	int mode = image.getMode(), format = image.getFormat();
+	int w = image.getWidth(), h = image.getHeight(), d = image.getDepth(), mips = image.getMips();
+	out.write(mode);
+	out.write(format);
+	out.write(w);
+	out.write(h);
+	out.write(d);
+	out.write(mips);
+	for(int face=0; face<image.getFaces(); ++face) {
+		for(int mip=0; mip<mips; ++mip) {
+			int mw = w>>mip, mh = h>>mip, md = mode==Image::VOLUME? d>>mip: d;
+			out.write(image.getData(face, mip), Image::getSurfaceSize(image.getFormat(), mw>0?mw:1, mh>0?mh:1, md>0?md:1));
+		}
+	}
+}
+
+static Image readCachedImage(const File& file) {
+	if(!file) return Image();
+	CacheReader in(file);
+	Image::Mode mode = (Image::Mode)in.read<int>();
+	Image::Format format = (Image::Format)in.read<int>();
+	int w = in.read<int>(), h = in.read<int>(), d = in.read<int>(), mips = in.read<int>();
+	if(!in || mips <= 0 || format == Image::INVALID) return Image();
+	int faces = mode==Image::CUBE? 6: 1;
+	Image::byte** data = new Image::byte*[faces * mips];
+	memset(data, 0, faces * mips * sizeof(Image::byte*));
+	for(int face=0; face<faces; ++face) {
+		for(int mip=0; mip<mips; ++mip) {
+			int mw = w>>mip, mh = h>>mip, md = mode==Image::VOLUME? d>>mip: d;
+			size_t size = Image::getSurfaceSize(format, mw>0?mw:1, mh>0?mh:1, md>0?md:1);
+			Image::byte* surface = data[face + mip*faces] = new Image::byte[size];
+			in.read(surface, size);
+		}
+	}
+	Image image(mode, format, w, h, d, mips, data);
+	return in? std::move(image): Image();
+}
+
+// Only static meshes are cached. Models with skeletons, morphs or custom data still load from source.
+static bool isCacheable(const Model* model) {
+	if(model->getSkeleton() || model->getAnimationCount() || model->getLayout() || !model->getExtensions().empty()) return false;
+	for(const Model::MeshInfo& m : model->meshes()) {
+		if(!m.mesh->getVertexBuffer() || m.mesh->getSkinBuffer() || m.mesh->getMorphCount()) return false;
+		for(const Attribute& a : m.mesh->getVertexBuffer()->attributes) if(a.name) return false;
+	}
+	return true;
+}
+
+static void writeCachedModel(CacheWriter& out, const Model* model) {
+	out.write((uint)model->getMeshCount());
+	for(const Model::MeshInfo& m : model->meshes()) {
+		HardwareVertexBuffer* vertices = m.mesh->getVertexBuffer();
+		HardwareIndexBuffer* indices = m.mesh->getIndexBuffer();
+		out.writeString(m.name);
+		out.writeString(m.materialName);
+		out.write(m.mesh->getPolygonMode());
+		out.write(vertices->attributes.size());
+		for(const Attribute& a : vertices->attributes) {
+			out.write(a.semantic);
+			out.write(a.type);
+			out.write((uint)a.offset);
+			out.write(a.divisor);
+		}
+		out.write((uint)vertices->getStride());
+		out.write((uint)vertices->getVertexCount());
+		out.write(vertices->getData<char>(), vertices->getSize<char>());
+		out.write(indices? 1: 0);
+		if(indices) {
+			out.write(indices->getIndexSize());
+			out.write((uint)indices->getSize<char>());
+			out.write(indices->getData<char>(), indices->getSize<char>());
+		}
+	}
+}
+
+static Model* readCachedModel(const File& file) {
+	if(!file) return nullptr;
+	CacheReader in(file);
+	Model* model = new Model();
+	uint meshCount = in.read<uint>();
+	for(uint i=0; i<meshCount && in; ++i) {
+		String name = in.readString();
+		String material = in.readString();
+		PolygonMode polygonMode = in.read<PolygonMode>();
+		HardwareVertexBuffer* vertices = new HardwareVertexBuffer();
+		uint attributes = in.read<uint>();
+		for(uint j=0; j<attributes && in; ++j) {
+			AttributeSemantic semantic = in.read<AttributeSemantic>();
+			AttributeType type = in.read<AttributeType>();
+			uint offset = in.read<uint>();
+			uint divisor = in.read<uint>();
+			vertices->attributes.add(semantic, type, offset, nullptr, divisor);
+		}
+		uint stride = in.read<uint>();
+		uint count = in.read<uint>();
+		char* vertexData = new char[stride * count];
+		in.read(vertexData, stride * count);
+		vertices->setData(vertexData, count, stride, true);
+
+		Mesh* mesh = new Mesh();
+		mesh->setPolygonMode(polygonMode);
+		mesh->setVertexBuffer(vertices);
+		if(in.read<int>()) {
+			HardwareIndexBuffer* indices = new HardwareIndexBuffer(in.read<IndexSize>());
+			uint size = in.read<uint>();
+			char* indexData = new char[size];
+			in.read(indexData, size);
+			indices->setData(indexData, size, true);
+			mesh->setIndexBuffer(indices);
+		}
+		model->addMesh(name, mesh, material);
+	}
+	if(!in) {
+		delete model;
+		return nullptr;
+	}
+	return model;
+}
+
 // ----------------------------------------------------------------------------------- //
 
 
 class TextureLoader : public ResourceLoader<Texture> {
 	public:
-	TextureLoader(VirtualFileSystem* fs) : m_fileSystem(fs) {}
+	TextureLoader(Resources* res, VirtualFileSystem* fs) : m_resources(res), m_fileSystem(fs) {}
 	Texture* create(const char*, Manager*) override;
 	bool reload(const char* name, Texture* object, Manager*) override;
 	void destroy(Texture*) override;
@@ -108,13 +270,37 @@ class TextureLoader : public ResourceLoader<Texture> {
 	void updateT() override;
 	static Texture* createTexture(const Image&, Texture* replace=nullptr);
 	protected:
+	Image loadImage(const VirtualFileSystem::File&) const;
 	struct LoadMessage { Texture* target; VirtualFileSystem::File file; Image image; };
 	std::list<LoadMessage> m_requests;
 	std::list<LoadMessage> m_completed;
 	Texture* m_currentlyLoading = nullptr;
+	Resources* m_resources = nullptr;
 	VirtualFileSystem* m_fileSystem = nullptr;
 };
 
+Image TextureLoader::loadImage(const VirtualFileSystem::File& file) const {
+	// Decoded png data is cached. dds files are already raw.
+	AssetCache* cache = m_resources->getCache();
+	bool png = file.name.endsWith(".png");
+	if(png && cache) {
+		Image image = readCachedImage(cache->get("image", file, ImageCacheVersion));
+		if(image) return image;
+	}
+
+	File data = file.read();
+	Image image;
+	if(png) image = PNG::parse(data, data.size());
+	else if(file.name.endsWith(".dds")) image = DDS::parse(data, data.size());
+
+	if(png && cache && image) {
+		CacheWriter out;
+		writeCachedImage(out, image);
+		cache->put("image", file, ImageCacheVersion, out.data(), out.size());
+	}
+	return image;
+}
+
 Texture* TextureLoader::createTexture(const Image& image, Texture* tex) {
 	assert(image);
 	static constexpr const Texture::Format formats[] = { Texture::NONE, Texture::R8, Texture::RG8, Texture::RGB8, Texture::RGBA8, Texture::BC1, Texture::BC2, Texture::BC3, Texture::BC4, Texture::BC5, Texture::R16, Texture::R16F, Texture::R32F };
@@ -172,15 +358,7 @@ Texture* TextureLoader::create(const char* name, Manager* manager) {
 		else printf("Resource Error: Invalid image file '%s'\n", name);
 	}
 	else {
-		Image image;
-		if(ext == ".png") {
-			File data = file.read();
-			image = PNG::parse(data, data.size());
-		}
-		else if(ext == ".dds") {
-			File data = file.read();
-			image = DDS::parse(data, data.size());
-		}
+		Image image = loadImage(file);
 		if(image) return createTexture(image);
 		else printf("Resource Error: Invalid image file '%s'\n", name);
 	}
@@ -214,14 +392,7 @@ void TextureLoader::updateT() {
 	}
 
 	printf("Loading %s\n", msg.file.name.str());
-	if(msg.file.name.endsWith(".png")) {
-		File data = msg.file.read();
-		msg.image = PNG::parse(data, data.size());
-	}
-	else if(msg.file.name.endsWith(".dds")) {
-		File data = msg.file.read();
-		msg.image = DDS::parse(data, data.size());
-	}
+	msg.image = loadImage(msg.file);
 
 	MutexLock lock(resourceMutex);
 	m_completed.push_back(std::move(msg));
@@ -485,33 +656,46 @@ class ModelLoader : public ResourceLoader<Model> {
 };
 Model* ModelLoader::create(const char* name, Manager* manager) {
 	// Resolve filename
-	File file = resources->getFileSystem().getFile(name).read();
-	if(!file) {
-		printf("ModelLoader: File not found %s\n", name);
-		return 0;
-	}
-
-	Model* model = nullptr;
-	StringView n(name);
-	if(n.endsWith(".obj")) {
-		model = Wavefront::parse(file);
-	}
-	else { // .bm
-		XML xml = XML::parse(file);
-		XMLResourceLoader loader(resources);
+	const VirtualFileSystem::File& source = resources->getFileSystem().getFile(name);
+	AssetCache* cache = resources->getCache();
+	Model* model = cache? readCachedModel(cache->get("model", source, ModelCacheVersion)): nullptr;
+
+	if(!model) {
+		File file = source.read();
+		if(!file) {
+			printf("ModelLoader: File not found %s\n", name);
+			return 0;
+		}
 
-		// Materials defined here need to be loaded into the material manager somehow.
-		for(const XMLElement& e: xml.getRoot()) {
-			if(e=="material") {
-				char matName[128];
-				snprintf(matName, 128, "%s:%s", name, e.attribute("name"));
-				Material* m = loader.loadMaterial(e, matName);
-				resources->materials.add(matName, m); // ToDo: Custom loader here too, or additional file data
+		bool hasMaterials = false;
+		StringView n(name);
+		if(n.endsWith(".obj")) {
+			model = Wavefront::parse(file);
+		}
+		else { // .bm
+			XML xml = XML::parse(file);
+			XMLResourceLoader loader(resources);
+
+			// Materials defined here need to be loaded into the material manager somehow.
+			for(const XMLElement& e: xml.getRoot()) {
+				if(e=="material") {
+					char matName[128];
+					snprintf(matName, 128, "%s:%s", name, e.attribute("name"));
+					Material* m = loader.loadMaterial(e, matName);
+					resources->materials.add(matName, m); // ToDo: Custom loader here too, or additional file data
+					hasMaterials = true;
+				}
 			}
+			
+			// Load model
+			model = BMLoader::loadModel(xml.getRoot());
+		}
+
+		if(model && cache && !hasMaterials && isCacheable(model)) {
+			CacheWriter out;
+			writeCachedModel(out, model);
+			cache->put("model", source, ModelCacheVersion, out.data(), out.size());
 		}
-		
-		// Load model
-		model = BMLoader::loadModel(xml.getRoot());
 	}
 
 	if(model) printf("Loaded %s\n", name);
@@ -1237,7 +1421,7 @@ Resources::Resources() {
 	m_fileSystem = new VirtualFileSystem();
 	Shader::getSupportedVersion();
 	// Setup default loaders
-	textures.setDefaultLoader( new TextureLoader(m_fileSystem) );
+	textures.setDefaultLoader( new TextureLoader(this, m_fileSystem) );
 	shaders.setDefaultLoader( new ShaderLoader(shaderParts, m_fileSystem) );
 	shaderParts.setDefaultLoader( new ShaderPartLoader(shaders, m_fileSystem) );
 	materials.setDefaultLoader( new MaterialLoader(this) );
@@ -1249,9 +1433,17 @@ Resources::Resources() {
 Resources::~Resources() {
 	if(s_instance==this) s_instance = nullptr;
 	resourceThread.join();
+	setCacheDirectory(nullptr);
 	delete m_fileSystem;
 }
 
+void Resources::setCacheDirectory(const char* path) {
+	if(m_cache && Shader::getBinaryCache() == m_cache) Shader::setBinaryCache(nullptr);
+	delete m_cache;
+	m_cache = path? new AssetCache(path): nullptr;
+	if(m_cache) Shader::setBinaryCache(m_cache);
+}
+
 void Resources::addFolder(const char* path, bool recursive, const char* mount) {
 	m_fileSystem->addPath(path, recursive, mount);
 }
@@ -12,7 +12,7 @@ extern int glhInvertMatrixf2(const float* in, float* out);
 using namespace base;
 
 AutoVariableSource::AutoVariableSource() 
-	: m_derivedMask(0), m_skinSize(0), m_skinCapacity(0), m_skinMatrixVector(0), m_skinMatrices(0) 
+	: m_derivedMask(0), m_skinSize(0), m_skinCapacity(0), m_skinMatrixVector(0), m_skinMatrices(0), m_skinOffset(0)
 	, m_near(0), m_far(0), m_time(0), m_frameTime(1.f/60)
 {
 	setCustom(0);
@@ -31,7 +31,7 @@ const char* AutoVariableSource::getKeyString(int key) {
 		"inverse_modelview_matrix", "inverse_viewprojection_matrix", "inverse_modelviewprojection_matrix",
 		"viewport_size", "far_clip", "near_clip",
 		"camera_position", "camera_direction",
-		"skin_matrices", "custom" };
+		"skin_matrices", "skin_offset", "custom" };
 	if(key>AUTO_CUSTOM) return 0; // max
 	return autos[key];
 }
@@ -68,6 +68,7 @@ int AutoVariableSource::getData(int key, int& e, int& a, const float*& data) {
 	
 	// skin data
 	case AUTO_SKIN_MATRICES: e=16; a=m_skinSize; data=m_skinMatrices[0]; return VT_MATRIX;
+	case AUTO_SKIN_OFFSET:   return_float(m_skinOffset);
 
 	// Custom data
 	case AUTO_CUSTOM: e=4; a=1; data=m_custom; return VT_FLOAT;
@@ -153,6 +154,10 @@ void AutoVariableSource::setSkinMatrices(int c, const Matrix* m, int* map) {
 	}
 }
 
+void AutoVariableSource::setSkinOffset(int offset) {
+	m_skinOffset = offset;
+}
+
 void AutoVariableSource::setCustom(const float* v) {
 	static float empty[4] = {0,0,0,0};
 	m_custom = v? v: empty;
@@ -7,6 +7,7 @@
 #include <base/hardwarebuffer.h>
 #include <base/mesh.h>
 #include <base/model.h>
+#include <base/skinpalette.h>
 #include <base/assert.h>
 #include <cstdio>
 
@@ -92,7 +93,7 @@ void Drawable::bind() {
 
 
 DrawableMesh::DrawableMesh(Mesh* m, const Skeleton* s, Material* mat, int queue)
-	: m_mesh(m), m_skeleton(0), m_skinMap(0), m_instances(1), m_instanceBuffer(0) 
+	: m_mesh(m), m_skeleton(0), m_skinMap(0), m_skinOffset(-1), m_instances(1), m_instanceBuffer(0) 
 {
 	setRenderQueue(queue);
 	setMaterial(mat);
@@ -143,6 +144,15 @@ void DrawableMesh::setupSkinData( const Skeleton* s ) {
 	}
 }
 
+int DrawableMesh::writeSkinPalette(SkinPalette& palette) {
+	if(!m_skeleton || !m_skeleton->getMatrixPtr()) return m_skinOffset = -1;
+	return m_skinOffset = palette.add(m_skeleton->getMatrixPtr(), m_mesh->getSkinCount(), m_skinMap);
+}
+
+void DrawableMesh::setSkinOffset(int offset) {
+	m_skinOffset = offset;
+}
+
 void DrawableMesh::setInstanceCount(unsigned count) {
 	m_instances = count;
 }
@@ -184,7 +194,16 @@ void DrawableMesh::draw( RenderState& state) {
 }
 
 void DrawableMesh::updateSkeletonSource(RenderState& r) const {
-	if(m_skeleton && m_skeleton->getMatrixPtr() && r.getVariableSource()) {
+	if(m_instanceBuffer && m_mesh->getSkinCount() && r.getVariableSource() && SkinPalette::hasInstanceAttribute(m_instanceBuffer->attributes)) {
+		// Each instance reads its palette offset from the instance buffer
+		r.getVariableSource()->setSkinOffset(0);
+		r.getVariableSource()->setSkinMatrices(0, 0);
+	}
+	else if(m_skinOffset >= 0 && r.getVariableSource()) {
+		r.getVariableSource()->setSkinOffset(m_skinOffset);
+		r.getVariableSource()->setSkinMatrices(0, 0);
+	}
+	else if(m_skeleton && m_skeleton->getMatrixPtr() && r.getVariableSource()) {
 		int size = m_mesh->getSkinCount();
 		const Matrix* matrices = m_skeleton->getMatrixPtr();
 		r.getVariableSource()->setSkinMatrices( size, matrices, m_skinMap );
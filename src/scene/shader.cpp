@@ -1,6 +1,7 @@
 //#define GL_GLEXT_PROTOTYPES
 #include <base/opengl.h>
 #include <base/shader.h>
+#include <base/assetcache.h>
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
@@ -265,6 +266,7 @@ bool ShaderPart::preprocess(const char* code, ShaderType type, int& version, cha
 int Shader::s_supported=-1;
 const Shader Shader::Null;
 const Shader* Shader::s_currentShader;
+AssetCache* Shader::s_binaryCache = nullptr;
 
 int Shader::getSupportedVersion() {
 	if(s_supported<0) {
@@ -361,8 +363,18 @@ bool Shader::compile() {
 	bool good = true;
 	m_linked = 0;
 	m_changed = false;
+
+	#ifndef EMSCRIPTEN
+	unsigned long long binaryKey = 0;
+	if(s_binaryCache) {
+		binaryKey = getBinaryKey();
+		if(loadBinary(binaryKey)) return true;
+	}
+	#endif
+
+	// Parts may be unchanged but not compiled if the program was loaded from a binary
 	for(ShaderPart* part : m_shaders) {
-		if(part->m_changed) good &= part->compile();
+		if(part->m_changed || !part->m_compiled) good &= part->compile();
 	}
 	if(!good) return false;
 
@@ -380,14 +392,67 @@ bool Shader::compile() {
 		if(!alreadyAttached) glAttachShader(m_object, part->m_object);
 		GL_CHECK_ERROR;
 	}
+	#ifndef EMSCRIPTEN
+	if(s_binaryCache) glProgramParameteri(m_object, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	#endif
 	glLinkProgram(m_object);
 	GL_CHECK_ERROR;
 
 	glGetProgramiv(m_object, GL_LINK_STATUS, &m_linked);
 	GL_CHECK_ERROR;
+
+	#ifndef EMSCRIPTEN
+	if(m_linked && s_binaryCache) saveBinary(binaryKey);
+	#endif
 	return m_linked;
 }
 
+unsigned long long Shader::getBinaryKey() const {
+	// Binaries are only valid for the driver that created them
+	unsigned long long key = AssetCache::hashString((const char*)glGetString(GL_RENDERER));
+	key = AssetCache::hashString((const char*)glGetString(GL_VERSION), key);
+	for(const ShaderPart* part : m_shaders) {
+		key = AssetCache::hash(&part->m_type, sizeof(part->m_type), key);
+		key = AssetCache::hashString(part->m_source, key);
+		for(const char* def : part->m_defines) key = AssetCache::hashString(def, key);
+	}
+	for(const char* entry : m_entry) key = AssetCache::hashString(entry, key);
+	return key;
+}
+
+bool Shader::loadBinary(unsigned long long key) {
+	#ifndef EMSCRIPTEN
+	File data = s_binaryCache->get("program", key, 1);
+	if(data.size() <= sizeof(GLenum)) return false;
+	if(!m_object) m_object = glCreateProgram();
+	if(!m_object) return false;
+
+	GLenum format;
+	memcpy(&format, data.data(), sizeof(GLenum));
+	glProgramBinary(m_object, format, data.data() + sizeof(GLenum), data.size() - sizeof(GLenum));
+	glGetProgramiv(m_object, GL_LINK_STATUS, &m_linked);
+	while(glGetError()); // Driver may reject the binary format
+	if(!m_linked) return false;
+	for(ShaderPart* part : m_shaders) part->m_changed = false;
+	return true;
+	#else
+	return false;
+	#endif
+}
+
+void Shader::saveBinary(unsigned long long key) const {
+	#ifndef EMSCRIPTEN
+	GLint length = 0;
+	glGetProgramiv(m_object, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(length <= 0) return;
+	std::vector<char> data(length + sizeof(GLenum));
+	GLenum format = 0;
+	glGetProgramBinary(m_object, length, &length, &format, &data[sizeof(GLenum)]);
+	memcpy(&data[0], &format, sizeof(GLenum));
+	if(length > 0) s_binaryCache->put("program", key, 1, &data[0], length + sizeof(GLenum));
+	#endif
+}
+
 void Shader::bind() const {
 	if(!m_linked) {
 		glUseProgram(0);
@@ -0,0 +1,74 @@
+#include <base/skinpalette.h>
+#include <base/opengl.h>
+#include <cstdio>
+#include <cstring>
+
+using namespace base;
+
+static const char* skinOffsetName = "skinOffset";
+
+const char* SkinPalette::getShaderSource() {
+	return
+	"uniform samplerBuffer skinPalette;\n"
+	"#ifdef SKIN_INSTANCED\n"
+	"in float skinOffset;\n"
+	"#else\n"
+	"uniform float skinOffset;\n"
+	"#endif\n"
+	"mat4 getSkinMatrix(int bone) {\n"
+	"	int k = (int(skinOffset) + bone) * 3;\n"
+	"	return transpose(mat4(texelFetch(skinPalette,k), texelFetch(skinPalette,k+1), texelFetch(skinPalette,k+2), vec4(0,0,0,1)));\n"
+	"}\n";
+}
+
+Attribute& SkinPalette::addInstanceAttribute(VertexAttributes& attributes, unsigned offset) {
+	return attributes.add(VA_CUSTOM, VA_FLOAT1, offset, skinOffsetName, 1);
+}
+
+bool SkinPalette::hasInstanceAttribute(const VertexAttributes& attributes) {
+	for(const Attribute& a: attributes) {
+		if(a.semantic == VA_CUSTOM && a.divisor && a.name && strcmp(a.name, skinOffsetName)==0) return true;
+	}
+	return false;
+}
+
+SkinPalette::SkinPalette() : m_buffer(0) {
+}
+
+SkinPalette::~SkinPalette() {
+	m_texture.destroy();
+	if(m_buffer) glDeleteBuffers(1, &m_buffer);
+}
+
+void SkinPalette::begin() {
+	m_data.clear();
+}
+
+int SkinPalette::add(const Matrix* matrices, int count, const int* map) {
+	int base = m_data.size() / 12;
+	m_data.resize(m_data.size() + count * 12);
+	float* out = &m_data[base * 12];
+	for(int i=0; i<count; ++i, out+=12) {
+		const float* m = matrices[ map? map[i]: i ];
+		for(int r=0; r<3; ++r) {
+			out[r*4+0] = m[r];
+			out[r*4+1] = m[r+4];
+			out[r*4+2] = m[r+8];
+			out[r*4+3] = m[r+12];
+		}
+	}
+	return base;
+}
+
+void SkinPalette::upload() {
+	if(m_data.empty()) return;
+	if(!m_buffer) glGenBuffers(1, &m_buffer);
+	// Respecifying the whole store each frame lets the driver orphan the previous data
+	// instead of stalling on draws still using it. The texture stays attached to the buffer.
+	glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, m_data.size() * sizeof(float), &m_data[0], GL_STREAM_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	if(m_texture.width() != getSize() * 3) m_texture.setBuffer(m_buffer, Texture::RGBA32F, getSize() * 3);
+	GL_CHECK_ERROR;
+}
+
@@ -38,7 +38,7 @@ Texture::Texture(uint glUnit, Type type) : m_unit(glUnit), m_type(type), m_forma
 
 /** Get bind target */
 inline unsigned Texture::getTarget() const {
-	static unsigned targets[] = { GL_TEXTURE_1D, GL_TEXTURE_2D, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_1D_ARRAY, GL_TEXTURE_2D_ARRAY };
+	static unsigned targets[] = { GL_TEXTURE_1D, GL_TEXTURE_2D, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_1D_ARRAY, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BUFFER };
 	return targets[m_type];
 }
 
@@ -305,6 +305,28 @@ bool Texture::setData(Type type, int width, int height, int depth, Format format
 	return true;
 }
 
+bool Texture::setBuffer(unsigned buffer, Format format, int elements) {
+	unsigned fmt = getInternalFormat(format);
+	if(fmt == 0 || isCompressedFormat(format) || isDepthFormat(format)) {
+		printf("Error: Invalid buffer texture format %d\n", (int)format);
+		return false;
+	}
+	if(m_unit && m_type != BUFFER) { // Can't change target type once initialised
+		glDeleteTextures(1, &m_unit);
+		m_unit = 0;
+	}
+	m_type   = BUFFER;
+	m_format = format;
+	m_width  = elements;
+	m_height = m_depth = 1;
+	if(m_unit == 0) glGenTextures(1, &m_unit);
+	glBindTexture(GL_TEXTURE_BUFFER, m_unit);
+	glTexBuffer(GL_TEXTURE_BUFFER, fmt, buffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	GL_CHECK_ERROR;
+	return true;
+}
+
 // ToDo: setPixels() functions
 
 int Texture::setPixels(int width, int height, Format format, const void* src, int mip) {
@@ -2,6 +2,8 @@
 #include <assert.h>
 #include <cstring>
 #include <cstdio>
+#include <vector>
+#include <new>
 
 #define NAME_LIMIT 64
 
@@ -13,7 +15,7 @@ Context::Context(const Variable& top) : front(0), signal(NONE), writeFlags(0), w
 	scope = new Variable[16];
 	scope[0] = top;
 }
-Context::Context() : front(0) {
+Context::Context() : front(0), signal(NONE), writeFlags(0), writeMask(1) {
 	scope = new Variable[16];
 }
 Context::~Context() {
@@ -118,6 +120,7 @@ class FunctionCall {
 	String toString() const;
 	Variable call(Function* func, Context&& context) const;
 	private:
+	friend class Program;
 	int          argc;
 	Expression** argv;
 };
@@ -217,40 +220,10 @@ int Expression::compare(const Variable& a, const Variable& b) {
 	}
 }
 
-inline Variable Expression::evaluateOp(Operator op, Variable& a, Variable& b, Context&& context) {
-	Expression tmp;
-	tmp.lhs.type = tmp.rhs.type = CONSTANT;
-	tmp.lhs.con = &a;
-	tmp.rhs.con = &b;
-	tmp.op = op;
-	Variable r = tmp.evaluate(fwd(context));
-	tmp.lhs.type = tmp.rhs.type = NOTHING;
-	return r;
-}
-
-Variable Expression::evaluate(Context&& context) const {
-	if(op==NIL) return opValue(lhs, fwd(context)); // Trivial case - single value
-	if(op==NOT) { Variable r; r=!(bool)opValue(rhs, fwd(context)); return r; } // simple invert
-	if(op==NEG) {
-		Variable r = opValue(rhs, fwd(context));
-		switch(r.type) {
-		case Variable::BOOL:
-		case Variable::INT:
-		case Variable::UINT: r = -(int)r; break;
-		case Variable::FLOAT: r = -(float)r; break;
-		case Variable::DOUBLE: r = -(double)r; break;
-		default: return Variable(); // Error
-		}
-		return r;
-	}
-
-	// The rest require both operands
-	Variable a = opValue(lhs, fwd(context));
-	Variable b = opValue(rhs, fwd(context));
+Variable Expression::binaryOp(Operator op, const Variable& a, const Variable& b) {
 	Variable r;
 	int rt = (a.type&0xf) > (b.type&0xf)? (a.type&0xf): (b.type&0xf);
 	switch(op) {
-	case NIL: case NOT: case NEG: break;
 	case EQ: r = a.isNull()==b.isNull() && compare(a, b)==0; break;
 	case NE: r = !(a.isNull()==b.isNull() && compare(a, b)==0); break;
 	case GT: r = compare(a, b)==1; break;
@@ -274,8 +247,8 @@ Variable Expression::evaluate(Context&& context) const {
 		case Variable::ARRAY:
 			if(a.isArray() && b.isArray()) {
 				r.makeArray();
-				for(Variable& v: a) r.set(r.size(), v);
-				for(Variable& v: b) r.set(r.size(), v);
+				for(const Variable& v: a) r.set(r.size(), v);
+				for(const Variable& v: b) r.set(r.size(), v);
 			}
 			break;
 		default: break;
@@ -305,11 +278,11 @@ Variable Expression::evaluate(Context&& context) const {
 		case Variable::ARRAY:
 			if(a.isArray() && b.isNumber()) {
 				r.makeArray();
-				for(int n=b; n>0; --n) for(Variable& v: a) r.set(r.size(), v);
+				for(int n=b; n>0; --n) for(const Variable& v: a) r.set(r.size(), v);
 			}
 			else if(a.isNumber() && b.isArray()) {
 				r.makeArray();
-				for(int n=a; n>0; --n) for(Variable& v: b) r.set(r.size(), v);
+				for(int n=a; n>0; --n) for(const Variable& v: b) r.set(r.size(), v);
 			}
 			break;
 		default: break;
@@ -327,50 +300,82 @@ Variable Expression::evaluate(Context&& context) const {
 		default: break;
 		}
 		break;
+
+	case GET: // rhs is subtext of lhs - string, or integer if array : lhs[rhs]
+		if(a.isArray() && b.isNumber()) r = a.get_const((int)b);
+		else if(b.isName()) r = a.get_const(b.operator VariableName());
+		else r = a.find_const( b.toString() );
+		break;
+	default: break;
+	}
+	return r;
+}
+
+Variable Expression::negate(const Variable& a) {
+	Variable r;
+	switch(a.type & 0xf) {
+	case Variable::BOOL:
+	case Variable::INT:
+	case Variable::UINT: r = -(int)a; break;
+	case Variable::FLOAT: r = -(float)a; break;
+	case Variable::DOUBLE: r = -(double)a; break;
+	default: break; // Error
+	}
+	return r;
+}
+
+void Expression::append(Variable& ref, const Variable& b) {
+	if(ref.isArray()) {
+		ref.set(ref.size(), b);
+	}
+	else if(ref.isNull()) {
+		Variable r;
+		r.makeArray();
+		r.set(0u, b);
+		ref = r;
+	}
+	else if(!ref.isObject()) {
+		Variable r;
+		r.makeArray();
+		r.set(0u, ref);
+		r.set(1u, b);
+		ref = r;
+	}
+	else {
+		assert(false); // Can't append to objects
+	}
+}
+
+Variable Expression::evaluate(Context&& context) const {
+	if(op==NIL) return opValue(lhs, fwd(context)); // Trivial case - single value
+	if(op==NOT) { Variable r; r=!(bool)opValue(rhs, fwd(context)); return r; } // simple invert
+	if(op==NEG) return negate(opValue(rhs, fwd(context)));
+
+	// The rest require both operands
+	Variable a = opValue(lhs, fwd(context));
+	Variable b = opValue(rhs, fwd(context));
+	Variable r;
+	switch(op) {
 	case SET:
 		r = opVariableRef(lhs, fwd(context)) = std::move(b);
 		break;
 	case SETADD:
-		r = opVariableRef(lhs, fwd(context)) = std::move(evaluateOp(ADD, a, b, fwd(context)));
+		r = opVariableRef(lhs, fwd(context)) = binaryOp(ADD, a, b);
 		break;
 	case SETSUB:
-		r = opVariableRef(lhs, fwd(context)) = std::move(evaluateOp(SUB, a, b, fwd(context)));
+		r = opVariableRef(lhs, fwd(context)) = binaryOp(SUB, a, b);
 		break;
 	case SETMUL:
-		r = opVariableRef(lhs, fwd(context)) = std::move(evaluateOp(MUL, a, b, fwd(context)));
+		r = opVariableRef(lhs, fwd(context)) = binaryOp(MUL, a, b);
 		break;
 	case SETDIV:
-		r = opVariableRef(lhs, fwd(context)) = std::move(evaluateOp(DIV, a, b, fwd(context)));
+		r = opVariableRef(lhs, fwd(context)) = binaryOp(DIV, a, b);
 		break;
 	case APPEND:
-		{
-		Variable& ref = opVariableRef(lhs, fwd(context));
-		if(ref.isArray()) {
-			ref.set(ref.size(), b);
-		}
-		else if(ref.isNull()) {
-			r.makeArray();
-			r.set(0u, b);
-			ref = r;
-		}
-		else if(!ref.isObject()) {
-			r.makeArray();
-			r.set(0u, ref);
-			r.set(1u, b);
-			ref = r;
-		}
-		else {
-			assert(false); // Can't append to objects
-		}
+		append(opVariableRef(lhs, fwd(context)), b);
 		r = std::move(b);
-		}
 		break;
 
-	case GET: // rhs is subtext of lhs - string, or integer if array : lhs[rhs]
-		if(a.isArray() && b.isNumber()) r = a.get_const((int)b);
-		else if(b.isName()) r = a.get_const(b.operator VariableName());
-		else r = a.find_const( b.toString() );
-		break;
 	case GET2: // rhs must be var or cvar: lhs.rhs
 		assert(!a.isArray());
 		if(rhs.type==NAME) a = a.get_const(rhs.var);
@@ -387,6 +392,8 @@ Variable Expression::evaluate(Context&& context) const {
 		if(rhs.type == FUNCTIONCALL) r = rhs.call->call(a, fwd(context));
 		else { assert(false); }
 		break;
+	default:
+		return binaryOp(op, a, b);
 	}
 	return r;
 }
@@ -436,16 +443,432 @@ Variable Conditional::evaluate(Context&& context) const {
 
 
 // ================================================================================================== //
+/// Bytecode for a block. Each line of the block is flattened into instructions on a register file.
+/// Operands read constants and context variables in place, so only results are copied.
+/// Anything that is not worth compiling falls back to the tree interpreter through EVAL.
+namespace script {
+class Program {
+	public:
+	~Program();
+	static void compile(Block* block);
+	Variable run(Context&& context) const;
 
-Block::Block() : lines(0), length(0), scoped(true), localSet(false), signal(Context::NONE) {}
+	private:
+	typedef Expression::Operand  Node;
+	typedef Expression::Operator Operator;
+	enum OpCode : uint8 {
+		MOVE,		// dst = a
+		BINARY,		// dst = a <op> b
+		NOT,		// dst = !a
+		NEG,		// dst = -a
+		SUBITEM,	// dst = a.node
+		SET,		// dst = node = b
+		SETOP,		// dst = node = a <op> b
+		APPEND,		// node[] = b, dst = b
+		EVAL,		// dst = expression->evaluate()
+		JUMP,		// goto target
+		JUMPIFNOT,	// if(!a) goto target
+		FUNCTION,	// dst = a, report error if not a function
+		ARGJUMP,	// if(argument index >= function(a) argc) goto target
+		CALL,		// dst = a(registers[b .. b+count])
+		CHECK,		// return if context has a signal
+	};
+	enum ArgType : uint8 { NONE, REGISTER, CONSTANT, NAME, COMPOUNDNAME };
+	struct Arg { ArgType type; uint index; };
+	struct Instruction {
+		OpCode code;
+		uint8  op;			// Expression operator for BINARY and SETOP
+		uint16 dst;			// Destination register
+		Arg    a, b;
+		uint   data;		// Node, expression, jump target or argument count
+	};
+	static const uint16 NoRegister = 0xffff;
+
+	Program() {}
+	size_t emit(OpCode code, uint dst, Arg a=Arg{NONE,0}, Arg b=Arg{NONE,0}, uint data=0, uint8 op=0);
+	uint allocate();
+	uint addNode(const Node&);
+	uint addExpression(const Expression*);
+	Arg  compileValue(const Node&);
+	void compileInto(const Node&, uint dst);
+	void compileInto(const Expression*, uint dst);
+	void compileCall(const Expression*, uint dst);
+	bool fold(const Expression*, Arg& out);
+	static bool isPure(const Node&);
+	static bool isFoldable(const Node&);
+	const Variable& value(const Arg&, Context&, const Variable* registers) const;
+
+	std::vector<Instruction>       m_code;
+	std::vector<const Variable*>   m_constants;
+	std::vector<Variable*>         m_folded;		// Owned constants from folded expressions
+	std::vector<const uint*>       m_names;
+	std::vector<const Node*>       m_nodes;
+	std::vector<const Expression*> m_expressions;
+	uint m_registers = 0;	// Register file size
+	uint m_used = 0;		// Registers in use while compiling
+	int  m_result = -1;		// Register holding the block result
+	bool m_signals = false;	// Current line may raise a context signal
+};
+}
+
+Program::~Program() {
+	for(Variable* v: m_folded) delete v;
+}
+
+size_t Program::emit(OpCode code, uint dst, Arg a, Arg b, uint data, uint8 op) {
+	m_code.push_back(Instruction{code, op, (uint16)dst, a, b, data});
+	return m_code.size() - 1;
+}
+
+uint Program::allocate() {
+	assert(m_used < NoRegister);
+	if(++m_used > m_registers) m_registers = m_used;
+	return m_used - 1;
+}
+
+uint Program::addNode(const Node& node) {
+	m_nodes.push_back(&node);
+	return m_nodes.size() - 1;
+}
+
+uint Program::addExpression(const Expression* e) {
+	m_expressions.push_back(e);
+	return m_expressions.size() - 1;
+}
+
+// Expression has no side effects, so operands may be read in any order
+bool Program::isPure(const Node& node) {
+	switch(node.type) {
+	case Expression::FUNCTIONCALL: return false;
+	case Expression::EXPRESSION: {
+		const Expression* e = node.expr;
+		if(dynamic_cast<const Block*>(e)) return false;
+		if(const Conditional* c = dynamic_cast<const Conditional*>(e)) return isPure(c->lhs) && isPure(c->rhs) && isPure(c->rhd);
+		if(e->op==Expression::CALL || (e->op>=Expression::SET && e->op<=Expression::APPEND)) return false;
+		return isPure(e->lhs) && isPure(e->rhs);
+	}
+	default: return true;
+	}
+}
+
+// Expression only depends on constants
+bool Program::isFoldable(const Node& node) {
+	switch(node.type) {
+	case Expression::NOTHING:
+	case Expression::CONSTANT: return true;
+	case Expression::EXPRESSION: {
+		const Expression* e = node.expr;
+		if(dynamic_cast<const Block*>(e)) return false;
+		if(const Conditional* c = dynamic_cast<const Conditional*>(e)) return isFoldable(c->lhs) && isFoldable(c->rhs) && isFoldable(c->rhd);
+		if(!e->isConst() || e->op==Expression::CALL || e->op==Expression::GET2) return false;
+		return isFoldable(e->lhs) && isFoldable(e->rhs);
+	}
+	default: return false;
+	}
+}
+
+bool Program::fold(const Expression* e, Arg& out) {
+	Node node;
+	node.type = Expression::EXPRESSION;
+	node.expr = e;
+	if(!isFoldable(node)) return false;
+	Variable scope;
+	scope.makeObject();
+	Context context(scope);
+	Variable* value = new Variable(e->evaluate(context));
+	// Objects created by an expression must be unique per evaluation
+	if(value->isObject() || value->isArray() || value->isVector()) {
+		delete value;
+		return false;
+	}
+	m_folded.push_back(value);
+	m_constants.push_back(value);
+	out = Arg{CONSTANT, (uint)m_constants.size()-1};
+	return true;
+}
+
+Program::Arg Program::compileValue(const Node& node) {
+	switch(node.type) {
+	case Expression::NAME:
+		return Arg{NAME, node.var};
+	case Expression::COMPOUNDNAME:
+		m_names.push_back(node.cvar);
+		return Arg{COMPOUNDNAME, (uint)m_names.size()-1};
+	case Expression::CONSTANT:
+		if(node.con->isFunction()) Script::compile(*node.con);
+		m_constants.push_back(node.con);
+		return Arg{CONSTANT, (uint)m_constants.size()-1};
+	case Expression::EXPRESSION: {
+		Arg folded;
+		if(fold(node.expr, folded)) return folded;
+		uint r = allocate();
+		compileInto(node.expr, r);
+		return Arg{REGISTER, r};
+	}
+	default:
+		return Arg{NONE, 0};
+	}
+}
+
+void Program::compileInto(const Node& node, uint dst) {
+	if(node.type == Expression::EXPRESSION) compileInto(node.expr, dst);
+	else {
+		Arg value = compileValue(node);
+		if(dst != NoRegister) emit(MOVE, dst, value);
+	}
+}
+
+void Program::compileInto(const Expression* e, uint dst) {
+	uint mark = m_used;
+	Arg a, b;
+
+	// Sub-blocks keep their own scope handling
+	if(const Block* block = dynamic_cast<const Block*>(e)) {
+		if(!dynamic_cast<const ArrayBlock*>(block)) compile(const_cast<Block*>(block));
+		else for(int i=0; i<block->length; ++i) {
+			if(const Block* sub = dynamic_cast<const Block*>(block->lines[i])) compile(const_cast<Block*>(sub));
+		}
+		emit(EVAL, dst, a, b, addExpression(e));
+		m_signals = true;
+		return;
+	}
+
+	if(fold(e, a)) {
+		if(dst != NoRegister) emit(MOVE, dst, a);
+		return;
+	}
+
+	if(const Conditional* c = dynamic_cast<const Conditional*>(e)) {
+		a = compileValue(c->lhs);
+		size_t jumpFalse = emit(JUMPIFNOT, NoRegister, a);
+		m_used = mark;
+		compileInto(c->rhs, dst);
+		size_t jumpEnd = emit(JUMP, NoRegister);
+		m_code[jumpFalse].data = m_code.size();
+		compileInto(c->rhd, dst);
+		m_code[jumpEnd].data = m_code.size();
+		return;
+	}
+
+	switch(e->op) {
+	case Expression::NIL:
+		compileInto(e->lhs, dst);
+		break;
+
+	case Expression::NOT:
+	case Expression::NEG:
+		a = compileValue(e->rhs);
+		if(dst == NoRegister) dst = allocate();
+		emit(e->op==Expression::NOT? NOT: NEG, dst, a);
+		break;
+
+	case Expression::SET:
+	case Expression::APPEND:
+		// Left side is evaluated first, as subscripts may have side effects
+		if(e->lhs.type == Expression::EXPRESSION) compileInto(e->lhs.expr, NoRegister);
+		b = compileValue(e->rhs);
+		emit(e->op==Expression::SET? SET: APPEND, dst, a, b, addNode(e->lhs));
+		break;
+
+	case Expression::SETADD:
+	case Expression::SETSUB:
+	case Expression::SETMUL:
+	case Expression::SETDIV: {
+		static const Operator setOp[] = { Expression::ADD, Expression::SUB, Expression::MUL, Expression::DIV };
+		a = compileValue(e->lhs);
+		if(!isPure(e->rhs) && (a.type==NAME || a.type==COMPOUNDNAME)) {
+			uint r = allocate();
+			emit(MOVE, r, a);
+			a = Arg{REGISTER, r};
+		}
+		b = compileValue(e->rhs);
+		emit(SETOP, dst, a, b, addNode(e->lhs), setOp[e->op - Expression::SETADD]);
+		break;
+	}
+
+	case Expression::GET2:
+		a = compileValue(e->lhs);
+		if(dst == NoRegister) dst = allocate();
+		emit(SUBITEM, dst, a, b, addNode(e->rhs));
+		break;
+
+	case Expression::CALL:
+		compileCall(e, dst);
+		break;
+
+	default:
+		// Take a copy of variables the right side could change
+		a = compileValue(e->lhs);
+		if(!isPure(e->rhs) && (a.type==NAME || a.type==COMPOUNDNAME)) {
+			uint r = allocate();
+			emit(MOVE, r, a);
+			a = Arg{REGISTER, r};
+		}
+		b = compileValue(e->rhs);
+		if(dst == NoRegister) dst = allocate();
+		emit(BINARY, dst, a, b, 0, e->op);
+		break;
+	}
+	m_used = mark;
+}
+
+void Program::compileCall(const Expression* e, uint dst) {
+	uint function = allocate();
+	emit(FUNCTION, function, compileValue(e->lhs), Arg{NONE,0}, addExpression(e));
+
+	// Arguments are only evaluated up to the number of parameters the function takes
+	const FunctionCall* call = e->rhs.call;
+	uint base = m_used;
+	for(int i=0; i<call->argc; ++i) allocate();
+	std::vector<size_t> jumps;
+	for(int i=0; i<call->argc; ++i) {
+		jumps.push_back(emit(ARGJUMP, NoRegister, Arg{REGISTER, function}, Arg{NONE, 0}, 0, i));
+		compileInto(call->argv[i], base + i);
+	}
+	for(size_t j: jumps) m_code[j].data = m_code.size();
+	emit(CALL, dst, Arg{REGISTER, function}, Arg{REGISTER, base}, call->argc);
+	m_signals = true;
+}
+
+void Program::compile(Block* block) {
+	if(block->program) return;
+	Program* p = new Program();
+	block->program = p;
+	if(block->signal) p->m_result = p->allocate();
+	for(int i=0; i<block->length; ++i) {
+		bool last = i == block->length - 1;
+		p->m_signals = false;
+		p->compileInto(block->lines[i], last && p->m_result>=0? p->m_result: NoRegister);
+		if(p->m_signals && !last) p->emit(CHECK, NoRegister);
+	}
+}
+
+inline const Variable& Program::value(const Arg& arg, Context& context, const Variable* registers) const {
+	static const Variable nothing;
+	switch(arg.type) {
+	case REGISTER:     return registers[arg.index];
+	case CONSTANT:     return *m_constants[arg.index];
+	case NAME:         return context.get(arg.index);
+	case COMPOUNDNAME: return context.get(const_cast<uint*>(m_names[arg.index]));
+	default:           return nothing;
+	}
+}
+
+// Replace a register value without going through assignment type conversion
+inline void store(Variable& reg, Variable&& value) {
+	reg.~Variable();
+	new(&reg) Variable(std::move(value));
+}
+
+Variable Program::run(Context&& context) const {
+	Variable local[16];
+	std::vector<Variable> heap;
+	if(m_registers > 16) heap.resize(m_registers);
+	Variable* r = m_registers > 16? &heap[0]: local;
+	#define VALUE(x) value(x, context, r)
+
+	for(size_t pc=0; pc<m_code.size(); ++pc) {
+		const Instruction& i = m_code[pc];
+		switch(i.code) {
+		case MOVE:
+			r[i.dst] = VALUE(i.a);
+			break;
+		case BINARY:
+			store(r[i.dst], Expression::binaryOp((Operator)i.op, VALUE(i.a), VALUE(i.b)));
+			break;
+		case NOT:
+			store(r[i.dst], Variable(!(bool)VALUE(i.a)));
+			break;
+		case NEG:
+			store(r[i.dst], Expression::negate(VALUE(i.a)));
+			break;
+		case SUBITEM: {
+			const Variable* v = &VALUE(i.a);
+			const Node& node = *m_nodes[i.data];
+			if(node.type == Expression::NAME) v = &v->get_const(node.var);
+			else for(const uint* id=node.cvar; *id!=~0u; ++id) v = &v->get_const(*id);
+			r[i.dst] = *v;
+			break;
+		}
+		case SET:
+		case APPEND: {
+			// Context variables may move when the target is created
+			Variable copy;
+			const Variable* b = &VALUE(i.b);
+			if(i.b.type==NAME || i.b.type==COMPOUNDNAME) copy = *b, b = &copy;
+			Variable& target = Expression::opVariableRef(*m_nodes[i.data], fwd(context));
+			if(i.code == SET) {
+				target = *b;
+				if(i.dst != NoRegister) r[i.dst] = target;
+			}
+			else {
+				Expression::append(target, *b);
+				if(i.dst != NoRegister) r[i.dst] = *b;
+			}
+			break;
+		}
+		case SETOP: {
+			Variable result = Expression::binaryOp((Operator)i.op, VALUE(i.a), VALUE(i.b));
+			Variable& target = Expression::opVariableRef(*m_nodes[i.data], fwd(context));
+			target = result;
+			if(i.dst != NoRegister) r[i.dst] = target;
+			break;
+		}
+		case EVAL:
+			if(i.dst != NoRegister) store(r[i.dst], m_expressions[i.data]->evaluate(fwd(context)));
+			else m_expressions[i.data]->evaluate(fwd(context));
+			break;
+		case JUMP:
+			pc = i.data - 1;
+			break;
+		case JUMPIFNOT:
+			if(!(bool)VALUE(i.a)) pc = i.data - 1;
+			break;
+		case FUNCTION:
+			r[i.dst] = VALUE(i.a);
+			if(!r[i.dst].isFunction()) printf("Error: %s is not a function\n", Expression::opString(m_expressions[i.data]->lhs).str());
+			break;
+		case ARGJUMP: {
+			Function* func = VALUE(i.a);
+			if(!func || i.op >= func->argc) pc = i.data - 1;
+			break;
+		}
+		case CALL: {
+			Function* func = VALUE(i.a);
+			Variable result;
+			if(!func) result = nullVar;
+			else {
+				Variable params;
+				for(uint k=0; k<i.data && (int)k<func->argc; ++k) params.set(func->argn[k], r[i.b.index + k]);
+				context.push(params);
+				store(result, func->evaluate(fwd(context)));
+				context.pop();
+			}
+			if(i.dst != NoRegister) store(r[i.dst], std::move(result));
+			break;
+		}
+		case CHECK:
+			if(context.getSignal()) return Variable();
+			break;
+		}
+	}
+	#undef VALUE
+	return m_result>=0? Variable(std::move(r[m_result])): Variable();
+}
+
+// ================================================================================================== //
+
+Block::Block() : lines(0), length(0), program(0), scoped(true), localSet(false), signal(Context::NONE) {}
 Block::~Block() {
 	for(int i=0; i<length; ++i) delete lines[i];
 	delete [] lines;
+	delete program;
 }
 Variable Block::evaluate(Context&& context) const {
 	Variable local, result;
 	if(scoped) local.makeObject(), context.push(local, localSet);
-	for(int i=0; i<length; ++i) {
+	if(program) result = program->run(fwd(context));
+	else for(int i=0; i<length; ++i) {
 		result = lines[i]->evaluate(fwd(context));
 		if(context.getSignal()) break;
 	}
@@ -1189,5 +1612,13 @@ bool Script::run(Variable& v) {
 	m_block->evaluate(fwd(context));
 	return true;
 }
+bool Script::compile() {
+	if(!m_block) return false;
+	Program::compile(m_block);
+	return true;
+}
+void Script::compile(Function* func) {
+	if(func) Program::compile(func);
+}
 Script::~Script() { delete m_block; }
 
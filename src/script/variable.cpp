@@ -14,6 +14,103 @@ bool Variable::isValid() const { return this != &nullVar; }
 struct FixNullVar { FixNullVar() { nullVar.lock(); } } FixNullVarHack;
 
 
+// ------------------------------------------------ //
+
+/// Object key layout. Small objects scan the key list, larger ones use an open addressing index.
+/// Shapes are reference counted so deep copies share them until a key is added or removed.
+struct Variable::Shape {
+	static const size_t SmallObject = 8;
+	std::vector<uint> keys;		// Sub variable names, parallel to Object::items
+	std::vector<uint> slots;	// Hash index of item index + 1. Empty for small objects
+	uint ref = 1;
+
+	static uint hash(uint id) { id *= 0x9e3779b1u; return id ^ (id >> 16); }
+	int find(uint id) const {
+		if(slots.empty()) {
+			for(size_t i=0; i<keys.size(); ++i) if(keys[i]==id) return i;
+			return -1;
+		}
+		size_t mask = slots.size() - 1;
+		for(size_t slot = hash(id) & mask; slots[slot]; slot = (slot + 1) & mask) {
+			if(keys[slots[slot]-1] == id) return slots[slot] - 1;
+		}
+		return -1;
+	}
+	void insert(uint index) {
+		size_t mask = slots.size() - 1;
+		size_t slot = hash(keys[index]) & mask;
+		while(slots[slot]) slot = (slot + 1) & mask;
+		slots[slot] = index + 1;
+	}
+	void rebuild() {
+		slots.clear();
+		if(keys.size() <= SmallObject) return;
+		size_t size = 16;
+		while(size < keys.size() * 2) size <<= 1;
+		slots.assign(size, 0);
+		for(size_t i=0; i<keys.size(); ++i) insert(i);
+	}
+	void add(uint id) {
+		keys.push_back(id);
+		if(keys.size() <= SmallObject) return;
+		if(slots.size() < keys.size() * 2) rebuild();
+		else insert(keys.size() - 1);
+	}
+	// Shared layouts for vector types, never deleted
+	static Shape* vector(int size) {
+		static Shape shapes[3];
+		Shape* s = &shapes[size-2];
+		if(s->keys.empty()) {
+			for(int i=0; i<size; ++i) s->keys.push_back(i);
+			s->ref = 1;
+		}
+		++s->ref;
+		return s;
+	}
+};
+
+Variable::Object::~Object() {
+	setShape(nullptr);
+}
+void Variable::Object::setShape(Shape* s) {
+	if(shape && --shape->ref==0) delete shape;
+	shape = s;
+}
+const uint* Variable::Object::keys() const {
+	return shape? shape->keys.data(): nullptr;
+}
+int Variable::Object::find(uint id) const {
+	return shape? shape->find(id): -1;
+}
+Variable& Variable::Object::add(uint id, const Variable& var) {
+	// Copy on write
+	if(!shape) shape = new Shape();
+	else if(shape->ref > 1) {
+		Shape* copy = new Shape(*shape);
+		copy->ref = 1;
+		setShape(copy);
+	}
+	shape->add(id);
+	items.push_back(var);
+	return items.back();
+}
+void Variable::Object::erase(uint id) {
+	int index = find(id);
+	if(index < 0) return;
+	if(shape->ref > 1) {
+		Shape* copy = new Shape(*shape);
+		copy->ref = 1;
+		setShape(copy);
+	}
+	if(index < (int)items.size() - 1) {
+		items[index] = std::move(items.back());
+		shape->keys[index] = shape->keys.back();
+	}
+	items.pop_back();
+	shape->keys.pop_back();
+	if(!shape->slots.empty()) shape->rebuild();
+}
+
 // ------------------------------------------------ //
 static base::HashMap<uint> nameLookup = {{"x",0}, {"y",1}, {"z",2}, {"w",3}};
 static std::vector<const char*> reverseLookup = { "x", "y", "z", "w" };
@@ -226,9 +323,13 @@ const Variable& Variable::operator=(const Variable& v) {
 Variable Variable::copy(uint depth) const {
 	if(depth==0) return *this;
 	if(isObject()) {
+		// Key layout is shared until either object adds or removes a key
 		Variable out;
 		out.makeObject();
-		for(auto i: *this) out.set(i.id, i.value.copy(depth-1));
+		if(obj->shape) ++obj->shape->ref;
+		out.obj->setShape(obj->shape);
+		out.obj->items.reserve(obj->items.size());
+		for(const Variable& v: obj->items) out.obj->items.push_back(v.copy(depth-1));
 		return out;
 	}
 	if(isArray()) {
@@ -307,10 +408,9 @@ bool Variable::setType(uint t) {
 	s = 0;
 	if(isObject() || isVector() || isArray()) { obj = new Object; obj->ref=1; }
 	if(isVector()) {
-		_set( 0u, nullVar );
-		_set( 1u, nullVar );
-		if(t>=VEC3) _set( 2u, nullVar);
-		if(t==VEC4) _set( 3u, nullVar);
+		int size = (t&0xf) - VEC2 + 2;
+		obj->shape = Shape::vector(size);
+		obj->items.resize(size);
 	}
 	return true;
 }
@@ -524,19 +624,10 @@ bool Variable::isRef() const { return type&LINK; }
 // ------------------------------------------------------------- //
 
 inline int Variable::_contains(uint id) const {
-	return id<obj->lookup.size() &&  obj->lookup[id]!=0xff;
+	return obj->find(id) >= 0;
 }
 inline void Variable::_erase(uint id) {
-	if(!_contains(id)) return;
-	uint index = obj->lookup[id];
-	obj->lookup[id] = 0xff;
-	if(index < obj->keys.size() - 1) {
-		obj->lookup[ obj->keys.back() ] = index;
-		obj->items[index] = std::move(obj->items.back());
-		obj->keys[index] = obj->keys.back();
-	}
-	obj->items.pop_back();
-	obj->keys.pop_back();
+	obj->erase(id);
 }
 inline void Variable::_eraseArray(uint index, bool keepOrder) {
 	if(isArray() && index<obj->items.size()) {
@@ -548,21 +639,13 @@ inline void Variable::_eraseArray(uint index, bool keepOrder) {
 	}
 }
 inline Variable& Variable::_set(uint id, const Variable& var) {
-	assert(obj->keys.size()<0xfe); // Limit number of child variables as lookup uses uint8
-	// resize lookup array
-	if(id >= obj->lookup.size())
-		obj->lookup.resize(id+1, 0xff);
 	// Update existing item
-	int index = obj->lookup[id];
-	if(index!=0xff) {
+	int index = obj->find(id);
+	if(index >= 0) {
 		obj->items[index] = var;
 		return obj->items[index];
 	}
-	// Add item
-	obj->lookup[id] = obj->items.size();
-	obj->keys.push_back(id);
-	obj->items.push_back(var);
-	return obj->items.back();
+	return obj->add(id, var);
 }
 
 // --------------------- //
@@ -602,17 +685,21 @@ Variable& Variable::get_const(const VariableName& name) const { return get(name)
 //Variable& Variable::get(const Variable& v) { return isArray() && v.isNumber()? get((int)v): get((const char*)v); }
 
 Variable& Variable::get(uint id) const {
-	if(!contains(id)) return nullVar;
-	if(isArray()) return obj->items[id];
-	return obj->items[ obj->lookup[id] ];
+	if(isArray()) return id<obj->items.size()? obj->items[id]: nullVar;
+	if(!isObject() && !isVector()) return nullVar;
+	int index = obj->find(id);
+	return index<0? nullVar: obj->items[index];
 }
 Variable& Variable::get(uint id) {
 	if(isArray()) {
 		if(id>=obj->items.size()) obj->items.resize(id+1);
 		return obj->items[id];
 	}
-	else if(contains(id)) return obj->items[ obj->lookup[id] ];
-	else if(setType(OBJECT)) return _set(id, nullVar);
+	if(isObject() || isVector()) {
+		int index = obj->find(id);
+		if(index >= 0) return obj->items[index];
+	}
+	if(setType(OBJECT)) return obj->add(id, nullVar);
 	else return nullVar;
 }
 
@@ -692,8 +779,7 @@ bool Variable::makeObject() {
 bool Variable::makeArray(int initialSize) {
 	// Convert object into an array - order may vary
 	if(isObject() && !obj->items.empty() && !(type&(FIXED|CONST))) {
-		obj->lookup.clear();
-		obj->keys.clear();
+		obj->setShape(nullptr);
 		type = ARRAY;
 	}
 	if(!setType(ARRAY)) return false;
@@ -790,24 +876,24 @@ String Variable::toString(int depth, bool quotes, int multiLine, int indent) con
 
 
 Variable::const_iterator Variable::begin() const {
-	if(isObject() || isVector() || isArray()) return {obj->keys.data(), obj->items.data(), isArray()};
+	if(isObject() || isVector() || isArray()) return {const_cast<uint*>(obj->keys()), obj->items.data(), isArray()};
 	else return {nullptr,0,false};
 }
 Variable::const_iterator Variable::end() const {
 	if(isObject() || isVector() || isArray()) {
 		size_t s = obj->items.size();
-		return {obj->keys.data() + s, obj->items.data() + s, isArray()};
+		return {isArray()? nullptr: const_cast<uint*>(obj->keys()) + s, obj->items.data() + s, isArray()};
 	}
 	else return {nullptr,0,false};
 }
 Variable::iterator Variable::begin() {
-	if(isObject() || isVector() || isArray()) return {obj->keys.data(), obj->items.data(), isArray()};
+	if(isObject() || isVector() || isArray()) return {const_cast<uint*>(obj->keys()), obj->items.data(), isArray()};
 	else return {nullptr,0,false};
 }
 Variable::iterator Variable::end() {
 	if(isObject() || isVector() || isArray()) {
 		size_t s = obj->items.size();
-		return {obj->keys.data() + s, obj->items.data() + s, isArray()};
+		return {isArray()? nullptr: const_cast<uint*>(obj->keys()) + s, obj->items.data() + s, isArray()};
 	}
 	else return {nullptr,0,false};
 }
@@ -2,6 +2,7 @@
 #include <base/directory.h>
 #include <base/archive.h>
 #include <base/assert.h>
+#include <sys/stat.h>
 
 using namespace base;
 
@@ -27,6 +28,19 @@ bool VirtualFileSystem::File::inArchive() const {
 	return m_fs->m_sources[m_source].archive;
 }
 
+bool VirtualFileSystem::File::getFileInfo(size_t& size, long long& modified) const {
+	if(m_source<0 || !name) return false;
+	Source& src = m_fs->m_sources[m_source];
+	struct stat st;
+	if(src.archive) {
+		if(stat(src.path, &st) != 0) return false;
+	}
+	else if(stat(String::cat(src.path, "/", name), &st) != 0) return false;
+	size = st.st_size;
+	modified = st.st_mtime;
+	return true;
+}
+
 String VirtualFileSystem::File::getLocalPath() const {
 	if(m_source<0 || !name) return nullptr;
 	if(!m_fs->m_folders[m_folder].name) return name;
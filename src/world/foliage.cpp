@@ -2,10 +2,19 @@
 #include <base/drawablemesh.h>
 #include <base/mesh.h>
 #include <base/hardwarebuffer.h>
+#include <base/framebuffer.h>
+#include <base/primitives.h>
+#include <base/renderer.h>
+#include <base/camera.h>
 #include <base/random.h>
 #include <cstdio>
 #include <algorithm>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FOLIAGE_SSE
+#endif
+
 using base::Mesh;
 using base::DrawableMesh;
 using base::Material;
@@ -39,27 +48,72 @@ void FoliageMap::setData(int w, int h, const unsigned char* data, int stride, bo
 float FoliageMap::getValue(float x, float y) const {
 	x *= m_width - 1;
 	y *= m_height - 1;
-	x = x<0? 0: x>=m_width? m_width-1.0001: x;
-	y = y<0? 0: y>=m_height? m_height-1.0001: y;
+	x = x<0? 0: x>m_width-1.0001f? m_width-1.0001f: x;
+	y = y<0? 0: y>m_height-1.0001f? m_height-1.0001f: y;
 	// Values
 	int ix = floor(x);
 	int iy = floor(y);
 	const unsigned char* k = m_data + (ix + iy * m_width) * m_stride;
-	float a = k[0] * (ix-x+1) + k[m_width*m_stride] * (x-ix);
-	float b = k[m_stride] * (ix-x+1) + k[m_width*m_stride+m_stride] * (x-ix);
+	float a = k[0] * (ix-x+1) + k[m_stride] * (x-ix);
+	float b = k[m_width*m_stride] * (ix-x+1) + k[m_width*m_stride+m_stride] * (x-ix);
 	return (a * (iy-y+1) + b * (y-iy)) / 255.f;
 }
 
+void FoliageMap::getValues(const vec2* points, size_t count, float* out) const {
+	size_t i = 0;
+	#ifdef FOLIAGE_SSE
+	const __m128 scaleX = _mm_set1_ps(m_width - 1);
+	const __m128 scaleY = _mm_set1_ps(m_height - 1);
+	const __m128 maxX = _mm_set1_ps(m_width - 1.0001f);
+	const __m128 maxY = _mm_set1_ps(m_height - 1.0001f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 norm = _mm_set1_ps(1 / 255.f);
+	const int row = m_width * m_stride;
+	alignas(16) int cx[4], cy[4];
+	alignas(16) float k[4][4];
+	for(; i+4 <= count; i+=4) {
+		__m128 a = _mm_loadu_ps(&points[i].x);
+		__m128 b = _mm_loadu_ps(&points[i+2].x);
+		__m128 x = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0));
+		__m128 y = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1));
+		x = _mm_min_ps(_mm_max_ps(_mm_mul_ps(x, scaleX), zero), maxX);
+		y = _mm_min_ps(_mm_max_ps(_mm_mul_ps(y, scaleY), zero), maxY);
+		__m128i ix = _mm_cvttps_epi32(x); // Positive so truncation is floor
+		__m128i iy = _mm_cvttps_epi32(y);
+		__m128 fx = _mm_sub_ps(x, _mm_cvtepi32_ps(ix));
+		__m128 fy = _mm_sub_ps(y, _mm_cvtepi32_ps(iy));
+		_mm_store_si128((__m128i*)cx, ix);
+		_mm_store_si128((__m128i*)cy, iy);
+		for(int j=0; j<4; ++j) {
+			const unsigned char* p = m_data + (cx[j] + cy[j] * m_width) * m_stride;
+			k[0][j] = p[0];
+			k[1][j] = p[m_stride];
+			k[2][j] = p[row];
+			k[3][j] = p[row + m_stride];
+		}
+		__m128 k0 = _mm_load_ps(k[0]), k1 = _mm_load_ps(k[1]), k2 = _mm_load_ps(k[2]), k3 = _mm_load_ps(k[3]);
+		__m128 top = _mm_add_ps(k0, _mm_mul_ps(_mm_sub_ps(k1, k0), fx));
+		__m128 bottom = _mm_add_ps(k2, _mm_mul_ps(_mm_sub_ps(k3, k2), fx));
+		__m128 r = _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+		_mm_storeu_ps(out + i, _mm_mul_ps(r, norm));
+	}
+	#endif
+	for(; i<count; ++i) out[i] = getValue(points[i].x, points[i].y);
+}
+
 // ===================================================================================================== //
 
 FoliageLayer::FoliageLayer(float cs, float r) : m_parent(0), m_material(0), m_chunkSize(cs), m_range(r), m_density(1), m_scaleRange(1), m_densityMap(0) {
 	m_heightRange.set(-1e8f, 1e8f);
 	m_slopeRange.set(-1e8f, 1e8f);
+	resetStats();
 }
 FoliageLayer::~FoliageLayer() {
 	if(m_parent && m_parent != getParent()) m_parent->removeLayer(this);
 	deleteMap(m_densityMap);
 	clear();
+	clearPool();
+	for(Chunk* chunk: m_freeChunks) delete chunk;
 }
 
 void FoliageLayer::setName(const char* name) { SceneNode::setName(name); }
@@ -84,7 +138,7 @@ void FoliageLayer::setClusterShape(int points, float scale) {
 void FoliageLayer::setMaterial(Material* m) {
 	m_material = m;
 	for(auto& c: m_chunks) {
-		if(c.second->drawable) c.second->drawable->setMaterial(m);
+		if(c.chunk->drawable) c.chunk->drawable->setMaterial(m);
 	}
 }
 void FoliageLayer::setMapBounds(const BoundingBox2D& b) { m_mapBounds = b; }
@@ -95,14 +149,20 @@ void FoliageLayer::setDensityMap(FoliageMap* map) {
 }
 
 void FoliageLayer::clear() {
-	for(auto& i:m_chunks) deleteChunk(i.second);
+	for(auto& i:m_chunks) deleteChunk(i.chunk);
 	m_chunks.clear();
+	// Wait for any chunks still being generated
+	while(m_cancelled > 0) {
+		m_parent->prioritise(vec3());
+		m_parent->processCompleted();
+		if(m_cancelled > 0) Thread::sleep(1);
+	}
 }
 
 void FoliageLayer::regenerate() {
 	for(auto& i:m_chunks) {
-		if(i.second->state != EMPTY) {
-			m_parent->queueChunk(this, i.first, i.second);
+		if(i.chunk->state != EMPTY) {
+			m_parent->queueChunk(this, i.index, i.chunk);
 		}
 	}
 }
@@ -111,9 +171,9 @@ void FoliageLayer::regenerate(const vec3& centre, float radius) {
 	IndexList out;
 	m_parent->getActive(centre, m_chunkSize, radius, out);
 	for(const Index& index: out) {
-		auto i = m_chunks.find(index);
-		if(i != m_chunks.end() && i->second->state != EMPTY) {
-			m_parent->queueChunk(this, i->first, i->second);
+		Chunk* chunk = m_chunks.find(index);
+		if(chunk && chunk->state != EMPTY) {
+			m_parent->queueChunk(this, index, chunk);
 		}
 	}
 }
@@ -123,6 +183,22 @@ FoliageMap* FoliageLayer::referenceMap(FoliageMap* map) {
 	return map;
 }
 
+void FoliageLayer::setBufferPoolSize(int size) {
+	m_poolSize = size>0? size: 0;
+	MutexLock lock(m_poolMutex);
+	while(m_pool.size() > m_poolSize) {
+		destroyGeometry(m_pool.back());
+		m_pool.pop_back();
+	}
+	m_stats.pooledBuffers = m_pool.size();
+}
+
+void FoliageLayer::resetStats() {
+	m_stats.chunks = m_chunks.size();
+	m_stats.chunkHits = m_stats.bufferHits = m_stats.bufferMisses = 0;
+	m_stats.pooledBuffers = m_pool.size();
+}
+
 void FoliageLayer::deleteMap(FoliageMap*& map) {
 	if(map && --map->m_ref<=0) delete map;
 	map = 0;
@@ -130,70 +206,89 @@ void FoliageLayer::deleteMap(FoliageMap*& map) {
 
 // ----------------------------------------------------------------------------------------------------- //
 
-inline float FoliageLayer::getMapValue(const FoliageMap* map, const vec3& point) const {
-	return m_parent->getMapValue(map, m_mapBounds, point);
+// Write indices of values within [min,max] to out. Returns number selected
+static size_t selectRange(const float* values, size_t count, float min, float max, uint16* out) {
+	size_t n = 0, i = 0;
+	#ifdef FOLIAGE_SSE
+	const __m128 lo = _mm_set1_ps(min);
+	const __m128 hi = _mm_set1_ps(max);
+	for(; i+4 <= count; i+=4) {
+		__m128 v = _mm_loadu_ps(values + i);
+		int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(v, lo), _mm_cmple_ps(v, hi)));
+		out[n] = i;   n += mask & 1;
+		out[n] = i+1; n += (mask>>1) & 1;
+		out[n] = i+2; n += (mask>>2) & 1;
+		out[n] = i+3; n += (mask>>3) & 1;
+	}
+	#endif
+	for(; i<count; ++i) {
+		out[n] = i;
+		n += values[i]>=min && values[i]<=max;
+	}
+	return n;
 }
 
-int FoliageLayer::generatePoints(const Index& index, int count, vec3* corners, const vec3& up, PointList& out) const {
-	bool testHeight = m_heightRange.isValid();
-	bool testSlope = m_slopeRange.isValid();
-
+int FoliageLayer::resolvePoints(const vec3* candidates, size_t count, const vec3& up, RNG& rng, PointList& out) const {
+	// Candidates are processed in batches: Resolve positions, reject by height, resolve normals
+	// of the survivors, reject by slope, then sample the density map for what remains.
+	static constexpr size_t batchSize = 256;
+	vec3 query[batchSize], position[batchSize], normal[batchSize];
+	float value[batchSize];
+	uint16 keep[batchSize];
+	const bool testHeight = m_heightRange.isValid();
+	const bool testSlope = m_slopeRange.isValid();
 	const vec3 offset(&getDerivedTransform()[12]); // Threading issue if we move the node when generating
-	RNG rng( m_parent->getSeed(index, m_chunkSize) );
-	vec3 t0, t1, pos;
-	GenPoint point;
-	float height;
 	size_t start = out.size();
-	out.reserve(start + count);
-	for(int i=0; i<count; ++i) {
-		float rx = rng.randf();
-		float ry = rng.randf();
-		t0 = lerp(corners[0], corners[1], rx);
-		t1 = lerp(corners[2], corners[3], rx);
-		pos = lerp(t0, t1, ry);
-		pos += offset;
+	for(size_t first=0; first<count; first+=batchSize) {
+		size_t n = std::min(batchSize, count - first);
+		for(size_t i=0; i<n; ++i) query[i] = candidates[first + i] + offset;
+
+		m_parent->resolvePositions(query, n, position, value);
+		if(testHeight) {
+			n = selectRange(value, n, m_heightRange.min, m_heightRange.max, keep);
+			for(size_t i=0; i<n; ++i) query[i] = query[keep[i]], position[i] = position[keep[i]];
+		}
+		if(n == 0) continue;
 
-		m_parent->resolvePosition(pos, point.position, height);
-		if(testHeight && !m_heightRange.contains(height)) continue;
-		m_parent->resolveNormal(pos, point.normal);
-		if(testSlope && !m_slopeRange.contains(1 - point.normal.dot(up))) continue;
-		point.position -= offset;
+		m_parent->resolveNormals(query, n, normal);
+		if(testSlope) {
+			for(size_t i=0; i<n; ++i) value[i] = 1 - normal[i].dot(up);
+			n = selectRange(value, n, m_slopeRange.min, m_slopeRange.max, keep);
+			for(size_t i=0; i<n; ++i) position[i] = position[keep[i]], normal[i] = normal[keep[i]];
+		}
+		for(size_t i=0; i<n; ++i) position[i] -= offset;
 
-		if(m_densityMap) {
-			float d = getMapValue(m_densityMap, point.position);
-			if(rng.randf() > d) continue;
+		if(m_densityMap && n) {
+			m_parent->getMapValues(m_densityMap, m_mapBounds, position, n, value);
+			for(size_t i=0; i<n; ++i) value[i] -= rng.randf();
+			n = selectRange(value, n, 0, 2, keep);
+			for(size_t i=0; i<n; ++i) position[i] = position[keep[i]], normal[i] = normal[keep[i]];
 		}
 
-		out.push_back(point);
+		for(size_t i=0; i<n; ++i) out.push_back(GenPoint{position[i], normal[i]});
 	}
 	return out.size() - start;
 }
 
+int FoliageLayer::generatePoints(const Index& index, int count, vec3* corners, const vec3& up, PointList& out) const {
+	RNG rng( m_parent->getSeed(index, m_chunkSize) );
+	std::vector<vec3> candidates(count);
+	vec3 t0, t1;
+	for(vec3& pos: candidates) {
+		float rx = rng.randf();
+		float ry = rng.randf();
+		t0 = lerp(corners[0], corners[1], rx);
+		t1 = lerp(corners[2], corners[3], rx);
+		pos = lerp(t0, t1, ry);
+	}
+	out.reserve(out.size() + count);
+	return resolvePoints(candidates.data(), count, up, rng, out);
+}
+
 int FoliageLayer::generatePoints(const Index& index, PointList& points, vec3& up) const {
 	vec3 corners[4];
 	RNG rng(m_parent->getSeed(index, m_chunkSize));
 
-	GenPoint point;
-	bool testHeight = m_heightRange.isValid();
-	bool testSlope = m_slopeRange.isValid();
-	auto addPointIfValid = [this, testHeight, testSlope, &point, &points, &up, &rng](const vec3& pos) {
-		float height;
-		const vec3& offset = *reinterpret_cast<const vec3*>(&getDerivedTransform()[12]);
-		m_parent->resolvePosition(pos+offset, point.position, height);
-		if(testHeight && !m_heightRange.contains(height)) return false;
-		m_parent->resolveNormal(pos, point.normal);
-		if(testSlope && !m_slopeRange.contains(1 - point.normal.dot(up))) return false;
-		point.position -= offset;
-		if(m_densityMap) {
-			float d = getMapValue(m_densityMap, point.position);
-			if(rng.randf() > d) return false;
-		}
-		points.push_back(point);
-		return true;
-	};
-
-
-	size_t start = points.size();
 	if(m_clusterDensity > 0) {
 		float clusterAmount = m_clusterDensity * m_chunkSize * m_chunkSize;
 		if(rng.randf() < clusterAmount-floor(clusterAmount)) ++clusterAmount;
@@ -209,6 +304,7 @@ int FoliageLayer::generatePoints(const Index& index, PointList& points, vec3& up
 		const vec3 dz = (corners[2] - corners[0]).normalise();
 		int shapePoints = m_clusterShapeMult<1 && m_clusterShapeOctaves>0? m_clusterShapeOctaves: 0;
 		float* shape = shapePoints? new float[shapePoints+1]: nullptr;
+		std::vector<vec3> candidates;
 		for(const GenPoint& centre: clusters) {
 			for(int i=1; i<=shapePoints; ++i) shape[i] = rng.randf();
 			if(shapePoints) shape[0] = shape[shapePoints];
@@ -216,7 +312,7 @@ int FoliageLayer::generatePoints(const Index& index, PointList& points, vec3& up
 			float max = rng.randf(m_clusterRadius);
 			float area = PI*max*max - PI*min*min;
 			int amount = m_density * area;
-			if(amount <= 0) return 0;
+			if(amount <= 0) continue;
 			float variance = max - min;
 			vec3 pos;
 			while(--amount>=0) {
@@ -229,12 +325,11 @@ int FoliageLayer::generatePoints(const Index& index, PointList& points, vec3& up
 					distance *= flerp(a, b, t-floor(t)) * m_clusterShapeMult;
 				}
 				pos.set(distance * cos(angle), 0, distance * sin(angle));
-				pos = centre.position + dx * pos.x + dz * pos.z;
-				addPointIfValid(pos);
+				candidates.push_back(centre.position + dx * pos.x + dz * pos.z);
 			}
 		}
 		delete [] shape;
-		return points.size() - start;
+		return resolvePoints(candidates.data(), candidates.size(), up, rng, points);
 	}
 	else { // Uniform
 		float amount = m_density * m_chunkSize * m_chunkSize;
@@ -248,31 +343,249 @@ int FoliageLayer::generatePoints(const Index& index, PointList& points, vec3& up
 
 // ----------------------------------------------------------------------------------------------------- //
 
+size_t FoliageLayer::IndexHash::operator()(const Index& index) const {
+	size_t h = (size_t)(index.x * 73856093u ^ index.y * 19349663u);
+	return h ^ (h >> 13);
+}
+
+size_t FoliageLayer::ChunkMap::slot(const Index& index) const {
+	return IndexHash()(index) & (m_slots.size() - 1);
+}
+
+FoliageLayer::Chunk* FoliageLayer::ChunkMap::find(const Index& index) const {
+	if(m_slots.empty()) return nullptr;
+	const size_t mask = m_slots.size() - 1;
+	for(size_t i = slot(index); m_slots[i].chunk; i = (i+1) & mask) {
+		if(m_slots[i].index == index) return m_slots[i].chunk;
+	}
+	return nullptr;
+}
+
+void FoliageLayer::ChunkMap::insert(const Index& index, Chunk* chunk) {
+	if((m_count + 1) * 2 > m_slots.size()) grow();
+	const size_t mask = m_slots.size() - 1;
+	size_t i = slot(index);
+	while(m_slots[i].chunk && m_slots[i].index != index) i = (i+1) & mask;
+	if(!m_slots[i].chunk) ++m_count;
+	m_slots[i] = Slot{ index, chunk };
+}
+
+bool FoliageLayer::ChunkMap::erase(const Index& index) {
+	if(m_slots.empty()) return false;
+	const size_t mask = m_slots.size() - 1;
+	size_t i = slot(index);
+	while(m_slots[i].index != index || !m_slots[i].chunk) {
+		if(!m_slots[i].chunk) return false;
+		i = (i+1) & mask;
+	}
+	// Shift following entries back so lookups need no tombstones
+	for(size_t j = (i+1) & mask; m_slots[j].chunk; j = (j+1) & mask) {
+		size_t k = slot(m_slots[j].index);
+		if((j > i && (k <= i || k > j)) || (j < i && k <= i && k > j)) {
+			m_slots[i] = m_slots[j];
+			i = j;
+		}
+	}
+	m_slots[i].chunk = nullptr;
+	--m_count;
+	return true;
+}
+
+void FoliageLayer::ChunkMap::clear() {
+	for(Slot& s: m_slots) s.chunk = nullptr;
+	m_count = 0;
+}
+
+void FoliageLayer::ChunkMap::grow() {
+	std::vector<Slot> old;
+	old.swap(m_slots);
+	m_slots.resize(old.empty()? 64: old.size() * 2, Slot{ Index(), nullptr });
+	m_count = 0;
+	for(const Slot& s: old) if(s.chunk) insert(s.index, s.chunk);
+}
+
+FoliageLayer::ChunkMap::iterator FoliageLayer::ChunkMap::begin() const {
+	iterator i { m_slots.data(), m_slots.data() + m_slots.size() };
+	if(i.slot < i.end && !i.slot->chunk) ++i;
+	return i;
+}
+
+FoliageLayer::ChunkMap::iterator FoliageLayer::ChunkMap::end() const {
+	const Slot* e = m_slots.data() + m_slots.size();
+	return iterator { e, e };
+}
+
+// ----------------------------------------------------------------------------------------------------- //
+
+/// Grid of the items generated for a chunk, sorted by grid cell for radius queries
+struct FoliageLayer::ItemIndex {
+	enum : uint16 { NONE = 0xffff };
+	struct Item {
+		vec3   position;
+		float  scale;
+		uint16 id;			// Generation order
+		uint16 instance;	// Index in instance buffer, or NONE if removed
+	};
+	Index cell;
+	int   axis[2];		// Grid axes: the two largest extents of the items
+	float origin[2];
+	float scale[2];		// Grid cells per unit
+	int   size;			// Grid is size*size cells
+	std::vector<uint32> start;		// First item of each grid cell
+	std::vector<Item>   items;
+	std::vector<uint16> slots;		// Item by id
+	std::vector<uint16> instances;	// Item by instance
+
+	ItemIndex(const Index& index, const std::vector<Item>& list, size_t instanceCount) : cell(index) {
+		BoundingBox box(list[0].position, list[0].position);
+		for(const Item& item: list) box.include(item.position);
+		const vec3 extent = box.size();
+		int order[3] = { 0, 1, 2 };
+		std::sort(order, order+3, [&extent](int a, int b) { return extent[a] > extent[b]; });
+		size = std::min(64, std::max(1, (int)ceil(sqrt(list.size() / 4.f))));
+		for(int i=0; i<2; ++i) {
+			axis[i] = order[i];
+			origin[i] = box.min[order[i]];
+			scale[i] = size / fmax(extent[order[i]], 1e-3f);
+		}
+		start.assign(size*size + 1, 0);
+		for(const Item& item: list) ++start[getCell(item.position) + 1];
+		for(size_t i=1; i<start.size(); ++i) start[i] += start[i-1];
+		std::vector<uint32> next(start.begin(), start.end() - 1);
+		items.resize(list.size());
+		slots.resize(list.size());
+		instances.assign(instanceCount, NONE);
+		for(const Item& item: list) {
+			uint32 slot = next[getCell(item.position)]++;
+			items[slot] = item;
+			slots[item.id] = slot;
+			if(item.instance != NONE) instances[item.instance] = slot;
+		}
+	}
+
+	int getCoord(const vec3& p, int i) const {
+		return std::min(size-1, std::max(0, (int)floor((p[axis[i]] - origin[i]) * scale[i])));
+	}
+	int getCell(const vec3& p) const { return getCoord(p, 0) + getCoord(p, 1) * size; }
+
+	template<class F> void query(const vec3& p, float radius, F&& func) const {
+		int lo[2], hi[2];
+		for(int i=0; i<2; ++i) {
+			lo[i] = (int)floor((p[axis[i]] - radius - origin[i]) * scale[i]);
+			hi[i] = (int)floor((p[axis[i]] + radius - origin[i]) * scale[i]);
+			if(hi[i] < 0 || lo[i] >= size) return;
+			lo[i] = std::max(lo[i], 0);
+			hi[i] = std::min(hi[i], size-1);
+		}
+		const float r2 = radius * radius;
+		for(int y=lo[1]; y<=hi[1]; ++y) {
+			for(int c=lo[0]+y*size, e=hi[0]+y*size; c<=e; ++c) {
+				for(uint32 i=start[c]; i<start[c+1]; ++i) {
+					if(items[i].instance != NONE && items[i].position.distance2(p) <= r2) func(items[i]);
+				}
+			}
+		}
+	}
+};
+
+static bool isRemoved(const std::vector<uint32>& bits, uint index) {
+	return index/32 < bits.size() && (bits[index/32] >> (index&31) & 1);
+}
+
+// ----------------------------------------------------------------------------------------------------- //
+
+FoliageLayer::Chunk* FoliageLayer::createChunk() {
+	if(m_freeChunks.empty()) return new Chunk();
+	Chunk* chunk = m_freeChunks.back();
+	m_freeChunks.pop_back();
+	++m_stats.chunkHits;
+	return chunk;
+}
+
+void FoliageLayer::freeChunk(Chunk* chunk) {
+	*chunk = Chunk();
+	m_freeChunks.push_back(chunk);
+}
+
+bool FoliageLayer::acquireGeometry(size_t count, Geometry& out) const {
+	size_t capacity = 64;
+	while(capacity < count) capacity *= 2;
+	MutexLock lock(m_poolMutex);
+	for(size_t i=0; i<m_pool.size(); ++i) {
+		if(m_pool[i].capacity == capacity) {
+			out = m_pool[i];
+			m_pool[i] = m_pool.back();
+			m_pool.pop_back();
+			++m_stats.bufferHits;
+			m_stats.pooledBuffers = m_pool.size();
+			return true;
+		}
+	}
+	out.capacity = capacity;
+	++m_stats.bufferMisses;
+	return false;
+}
+
+void FoliageLayer::recycleGeometry(Geometry& geometry) const {
+	delete geometry.items;
+	geometry.items = nullptr;
+	if(geometry.capacity) {
+		MutexLock lock(m_poolMutex);
+		if(m_pool.size() < m_poolSize) {
+			m_pool.push_back(geometry);
+			m_stats.pooledBuffers = m_pool.size();
+			geometry = Geometry();
+			return;
+		}
+	}
+	destroyGeometry(geometry);
+}
+
+void FoliageLayer::clearPool() {
+	MutexLock lock(m_poolMutex);
+	for(Geometry& g: m_pool) destroyGeometry(g);
+	m_pool.clear();
+	m_stats.pooledBuffers = 0;
+}
+
+// Upload buffer data, reusing the hardware buffer if it already exists
+static void uploadBuffer(HardwareBuffer* buffer) {
+	if(buffer->isBuffer()) buffer->writeBuffer();
+	else buffer->createBuffer();
+}
+
+// ----------------------------------------------------------------------------------------------------- //
+
 void FoliageLayer::update(const vec3& context) {
 	IndexList active;
-	for(auto& ci: m_chunks) ci.second->active = false;
+	for(auto& ci: m_chunks) ci.chunk->active = false;
 	vec3 localContext = getDerivedTransform().untransform(context);
 	m_parent->getActive(localContext, m_chunkSize, m_range, active);
 	// Activate any new chunks
 	for(Index& index: active) {
-		auto c = m_chunks.find(index);
-		if(c == m_chunks.end()) {
-			Chunk* chunk = new Chunk();
-			c = m_chunks.insert( std::make_pair(index, chunk) ).first;
-			m_parent->queueChunk(this, index, chunk);
+		Chunk* c = m_chunks.find(index);
+		if(!c) {
+			c = createChunk();
+			m_chunks.insert(index, c);
+			m_parent->queueChunk(this, index, c);
 		}
-		Chunk& chunk = *c->second;
+		Chunk& chunk = *c;
 		chunk.active = true;
 		// Completed
 		if(chunk.state == GENERATED) {
-			if(!m_parent->m_mutex.tryLock()) continue;
 			Geometry g = chunk.swap;
 			chunk.swap = {};
-			m_parent->m_mutex.unlock();
 
 			if(g.mesh) {
-				g.mesh->getVertexBuffer()->createBuffer();
-				g.mesh->getIndexBuffer()->createBuffer();
+				// Instanced geometry shares its mesh. Otherwise the mesh belongs to the chunk and may be recycled.
+				if(g.instances) {
+					g.mesh->getVertexBuffer()->createBuffer();
+					g.mesh->getIndexBuffer()->createBuffer();
+				}
+				else {
+					uploadBuffer(g.mesh->getVertexBuffer());
+					uploadBuffer(g.mesh->getIndexBuffer());
+				}
 				if(chunk.drawable) chunk.drawable->setMesh(g.mesh);
 				else {
 					chunk.drawable = new DrawableMesh(g.mesh, m_material);
@@ -280,7 +593,7 @@ void FoliageLayer::update(const vec3& context) {
 				}
 
 				if(g.instances) {
-					g.instances->createBuffer();
+					uploadBuffer(g.instances);
 					chunk.drawable->setInstanceBuffer(g.instances);
 					chunk.drawable->setInstanceCount(g.count);
 				}
@@ -290,30 +603,38 @@ void FoliageLayer::update(const vec3& context) {
 				delete chunk.drawable;
 				chunk.drawable = nullptr;
 			}
-			destroyGeometry(chunk.geometry);
+			recycleGeometry(chunk.geometry);
 			chunk.geometry = g;
 			chunk.state = COMPLETE;
+			updateChunk(chunk, true, localContext);
 		}
+		else if(chunk.state == COMPLETE) updateChunk(chunk, false, localContext);
 	}
 	// delete inactive chunks
-	for(auto i=m_chunks.begin(); i!=m_chunks.end();) {
-		if(!i->second->active) {
-			if(i->second->drawable) detach(i->second->drawable);
-			deleteChunk(i->second);
-			i = m_chunks.erase(i);
+	if(m_chunks.size() > active.size()) {
+		IndexList inactive;
+		for(auto& i: m_chunks) if(!i.chunk->active) inactive.push_back(i.index);
+		for(const Index& index: inactive) {
+			Chunk* chunk = m_chunks.find(index);
+			if(chunk->drawable) detach(chunk->drawable);
+			deleteChunk(chunk);
+			m_chunks.erase(index);
 		}
-		else ++i;
 	}
+	m_stats.chunks = m_chunks.size();
 }
 
 bool FoliageLayer::deleteChunk(Chunk* chunk) {
+	releaseChunk(*chunk);
+	delete chunk->drawable;
+	chunk->drawable = nullptr;
+	recycleGeometry(chunk->geometry);
 	if(m_parent->cancelChunk(chunk)) {
-		delete chunk->drawable;
-		destroyGeometry(chunk->geometry);
-		destroyGeometry(chunk->swap);
-		delete chunk;
+		recycleGeometry(chunk->swap);
+		freeChunk(chunk);
 		return true;
 	}
+	++m_cancelled; // Deleted by FoliageSystem once its jobs are done
 	return false;
 }
 
@@ -326,20 +647,256 @@ void FoliageLayer::shift(const vec3& offset) {
 // ===================================================================================================== //
 
 FoliageInstanceLayer::FoliageInstanceLayer(float cs, float r) : FoliageLayer(cs,r), m_mesh(0), m_alignMode(VERTICAL) {}
+FoliageInstanceLayer::~FoliageInstanceLayer() {
+	clear();
+	clearPool();
+	delete m_impostorMesh;
+}
 void FoliageInstanceLayer::setMesh(Mesh* mesh) { m_mesh = mesh; }
 void FoliageInstanceLayer::setAlignment(OrientaionMode m, const Rangef& r) { m_alignMode = m; m_alignRange = r; }
+
+// ----------------------------------------------------------------------------------------------------- //
+
+struct FoliageLayer::LodData {
+	std::vector<DrawableMesh*>         drawables;	// One per band
+	std::vector<HardwareVertexBuffer*> buffers;		// Instance lists used when a chunk spans several bands
+	std::vector<size_t>                capacity;
+	BoundingBox bounds;		// Instance positions
+	vec3  context;			// Context when band lists were built
+	float slack = -1;		// Distance context can move before lists need rebuilding
+	int   version = -1;
+};
+
+void FoliageInstanceLayer::addLod(Mesh* mesh, float distance, Material* material) {
+	if(m_lods.empty()) m_lods.push_back(LodBand{nullptr, nullptr, 0}); // Band 0 uses layer mesh and material
+	m_lods.push_back(LodBand{mesh, material, distance});
+	std::sort(m_lods.begin()+1, m_lods.end(), [](const LodBand& a, const LodBand& b) { return a.distance < b.distance; });
+	setLodFade(m_lodFade);
+}
+
+void FoliageInstanceLayer::setImpostor(Material* material, float distance, const vec2& size) {
+	for(size_t i=0; m_impostorMesh && i<m_lods.size(); ++i) {
+		if(m_lods[i].mesh == m_impostorMesh) {
+			m_lods.erase(m_lods.begin() + i);
+			break;
+		}
+	}
+	Mesh* old = m_impostorMesh;
+	m_impostorMesh = createPlane(size);
+	addLod(m_impostorMesh, distance, material);
+	for(auto& c: m_chunks) releaseChunk(*c.chunk); // Drawables may reference the old mesh
+	delete old;
+}
+
+void FoliageInstanceLayer::setLodFade(float range) {
+	m_lodFade = range;
+	for(size_t i=0; i<m_lods.size(); ++i) {
+		float* custom = m_lods[i].custom;
+		custom[0] = m_lods[i].distance;
+		custom[1] = i+1<m_lods.size()? m_lods[i+1].distance: 1e8f;
+		custom[2] = range;
+		custom[3] = i;
+	}
+	++m_lodVersion;
+}
+
+void FoliageInstanceLayer::releaseChunk(Chunk& chunk) {
+	if(!chunk.lod) return;
+	for(DrawableMesh* d: chunk.lod->drawables) {
+		if(d) detach(d);
+		delete d;
+	}
+	for(HardwareVertexBuffer* b: chunk.lod->buffers) {
+		if(b && b->dropReference() == 0) delete b;
+	}
+	delete chunk.lod;
+	chunk.lod = nullptr;
+}
+
+void FoliageInstanceLayer::updateChunk(Chunk& chunk, bool changed, const vec3& context) {
+	if(changed) applyRemoved(chunk); // Items may have been removed while it was generating
+	if(m_lods.empty()) return;
+	if(chunk.lod && chunk.lod->version != m_lodVersion) releaseChunk(chunk);
+	if(!chunk.lod) {
+		chunk.lod = new LodData();
+		chunk.lod->drawables.resize(m_lods.size(), nullptr);
+		chunk.lod->buffers.resize(m_lods.size(), nullptr);
+		chunk.lod->capacity.resize(m_lods.size(), 0);
+		chunk.lod->version = m_lodVersion;
+		changed = true;
+	}
+	LodData& lod = *chunk.lod;
+	if(chunk.drawable) chunk.drawable->setVisible(false);
+	if(changed && chunk.geometry.instances) {
+		const HardwareVertexBuffer* instances = chunk.geometry.instances;
+		lod.bounds = BoundingBox(vec3(instances->getVertex(0)), vec3(instances->getVertex(0)));
+		for(size_t i=1; i<chunk.geometry.count; ++i) lod.bounds.include(vec3(instances->getVertex(i)));
+		lod.slack = -1;
+	}
+	// Distances change by at most how far the context moved
+	if(changed || lod.slack < 0 || context.distance2(lod.context) >= lod.slack * lod.slack) {
+		buildBands(chunk, context);
+	}
+}
+
+void FoliageInstanceLayer::buildBands(Chunk& chunk, const vec3& context) {
+	LodData& lod = *chunk.lod;
+	const Geometry& geometry = chunk.geometry;
+	const int bands = m_lods.size();
+	const float half = m_lodFade * 0.5f;
+	lod.context = context;
+	for(DrawableMesh* d: lod.drawables) if(d) d->setVisible(false);
+	if(!geometry.instances || geometry.count == 0) {
+		lod.slack = 1e8f;
+		return;
+	}
+
+	auto getDrawable = [this, &lod](int band) {
+		DrawableMesh*& d = lod.drawables[band];
+		if(!d) {
+			const LodBand& b = m_lods[band];
+			d = new DrawableMesh(b.mesh? b.mesh: m_mesh, b.material? b.material: m_material);
+			d->setCustom(m_lods[band].custom);
+			attach(d);
+		}
+		d->setVisible(true);
+		return d;
+	};
+	auto start = [&](int band) { return band>0? m_lods[band].distance: -1e8f; };
+	auto end = [&](int band) { return band+1<bands? m_lods[band+1].distance: 1e8f; };
+
+	// Whole chunk in one band: draw the chunk instance buffer directly
+	vec3 nearest, farthest;
+	for(int i=0; i<3; ++i) {
+		nearest[i] = fmax(lod.bounds.min[i], fmin(context[i], lod.bounds.max[i]));
+		farthest[i] = context[i] - lod.bounds.min[i] > lod.bounds.max[i] - context[i]? lod.bounds.min[i]: lod.bounds.max[i];
+	}
+	float nearDistance = nearest.distance(context);
+	float farDistance = farthest.distance(context);
+	for(int band=0; band<bands; ++band) {
+		if(nearDistance >= start(band) + half && farDistance < end(band) - half) {
+			DrawableMesh* d = getDrawable(band);
+			d->setInstanceBuffer(geometry.instances);
+			d->setInstanceCount(geometry.count);
+			lod.slack = fmin(nearDistance - start(band) - half, end(band) - half - farDistance);
+			return;
+		}
+	}
+
+	// Split instances between bands. Instances within fade range of an edge go in both bands
+	std::vector<float> distance(geometry.count);
+	float slack = 1e8f;
+	for(size_t i=0; i<geometry.count; ++i) {
+		distance[i] = vec3(geometry.instances->getVertex(i)).distance(context);
+		for(int band=1; band<bands; ++band) {
+			slack = fmin(slack, fabs(distance[i] - start(band) + half));
+			slack = fmin(slack, fabs(distance[i] - start(band) - half));
+		}
+	}
+	lod.slack = slack;
+
+	for(int band=0; band<bands; ++band) {
+		const float min = start(band) - half;
+		const float max = end(band) + half;
+		HardwareVertexBuffer*& buffer = lod.buffers[band];
+		size_t count = 0;
+		for(float d: distance) count += d >= min && d < max;
+		if(count == 0) continue;
+		if(!buffer || lod.capacity[band] < count) {
+			if(!buffer) {
+				buffer = new HardwareVertexBuffer(HardwareBuffer::DYNAMIC_DRAW);
+				buffer->attributes = geometry.instances->attributes;
+				buffer->addReference();
+			}
+			lod.capacity[band] = geometry.capacity;
+			buffer->setData(new float[geometry.capacity * 8], geometry.capacity, 32, true);
+			buffer->reserve(geometry.capacity * 32);
+		}
+		buffer->setVertexCount(count);
+		float* out = buffer->getVertex(0);
+		for(size_t i=0; i<geometry.count; ++i) {
+			if(distance[i] >= min && distance[i] < max) {
+				memcpy(out, geometry.instances->getVertex(i), 32);
+				out += 8;
+			}
+		}
+		uploadBuffer(buffer);
+		DrawableMesh* d = getDrawable(band);
+		d->setInstanceBuffer(buffer);
+		d->setInstanceCount(count);
+	}
+}
+
+FrameBuffer* FoliageInstanceLayer::createImpostorAtlas(Mesh* mesh, Material* material, int views, int resolution) {
+	// Views are laid out in rows of ceil(sqrt(views)). View i looks from angle i*2pi/views around the y axis.
+	int columns = (int)ceil(sqrt((float)views));
+	int rows = (views + columns - 1) / columns;
+	FrameBuffer* atlas = new FrameBuffer(columns * resolution, rows * resolution, Texture::RGBA8, Texture::D24);
+	mesh->getVertexBuffer()->createBuffer();
+	if(mesh->getIndexBuffer()) mesh->getIndexBuffer()->createBuffer();
+	const BoundingBox& box = mesh->calculateBounds();
+	const vec3 centre = box.centre();
+	const float radius = box.size().length() * 0.5f;
+
+	Camera camera;
+	camera.setOrthographic(radius * 2, radius * 2, 0, radius * 4);
+	DrawableMesh drawable(mesh, material);
+	Renderer renderer;
+	renderer.add(&drawable);
+	RenderState& state = renderer.getState();
+	state.setTarget(atlas);
+	atlas->clear();
+	for(int i=0; i<views; ++i) {
+		float angle = i * TWOPI / views;
+		camera.lookat(centre + vec3(sin(angle), 0, cos(angle)) * radius * 2, centre);
+		state.setCamera(&camera);
+		state.setTarget(atlas, Rect(i % columns * resolution, i / columns * resolution, resolution, resolution));
+		renderer.render();
+	}
+	state.setTarget(&FrameBuffer::Screen);
+	return atlas;
+}
 FoliageLayer::Geometry FoliageInstanceLayer::generateGeometry(const Index& index) const {
 	if(!m_mesh || !m_material) return Geometry{0,0,0};
 	vec3 up;
 	PointList points;
 	generatePoints(index, points, up);
 	if(points.empty()) return Geometry{0,0,0};
+	if(points.size() > ItemIndex::NONE) points.resize(ItemIndex::NONE); // Item ids are 16 bit
 	static const vec3 unitY(0,1,0);
 	Quaternion q, a, rot = Quaternion::arc(unitY, up);
 
+	std::vector<uint32> removed;
+	getRemoved(index, removed);
+	size_t count = 0;
+	for(size_t i=0; i<points.size(); ++i) count += !isRemoved(removed, i);
+	std::vector<ItemIndex::Item> items;
+	items.reserve(points.size());
+
+	Geometry geometry;
+	if(count == 0) {
+		for(size_t i=0; i<points.size(); ++i) items.push_back({points[i].position, 0, (uint16)i, ItemIndex::NONE});
+		geometry.items = new ItemIndex(index, items, 0);
+		return geometry;
+	}
+
+	// Instance buffer
+	if(!acquireGeometry(count, geometry)) {
+		geometry.instances = new HardwareVertexBuffer();
+		geometry.instances->setData(new float[geometry.capacity * 8], geometry.capacity, 32, true);
+		geometry.instances->reserve(geometry.capacity * 32); // Pooled buffers are refilled with up to capacity items
+		geometry.instances->attributes.add(base::VA_CUSTOM, base::VA_FLOAT4, 0, "loc", 1);
+		geometry.instances->attributes.add(base::VA_CUSTOM, base::VA_FLOAT4, 16, "rot", 1);
+		geometry.instances->addReference(); // Held by layer so drawables don't free it
+	}
+	geometry.instances->setVertexCount(count);
+	geometry.mesh = m_mesh;
+	geometry.count = count;
+
+	// Removed items still use their random values so the others do not change
 	RNG rng(0);
-	float* data = new float[ points.size() * 8 ]; // Instance buffer data
-	float* vx = data;
+	float* vx = geometry.instances->getVertex(0);
+	uint16 instance = 0;
 	for(GenPoint& point: points) {
 		float angle = rng.randf() * PI;
 		a.w = cos(angle);
@@ -353,8 +910,16 @@ FoliageLayer::Geometry FoliageInstanceLayer::generateGeometry(const Index& index
 		}
 		q *= a;
 
+		float scale = rng.randf(m_scaleRange);
+		uint16 id = items.size();
+		if(isRemoved(removed, id)) {
+			items.push_back({point.position, scale, id, ItemIndex::NONE});
+			continue;
+		}
+		items.push_back({point.position, scale, id, instance++});
+
 		memcpy(vx+0, point.position, sizeof(vec3));
-		vx[3] = rng.randf(m_scaleRange);
+		vx[3] = scale;
 		vx[4] = q.x;
 		vx[5] = q.y;
 		vx[6] = q.z;
@@ -362,64 +927,125 @@ FoliageLayer::Geometry FoliageInstanceLayer::generateGeometry(const Index& index
 		vx += 8;
 	}
 
-	// Create instance buffer
-	HardwareVertexBuffer* buffer = new HardwareVertexBuffer();
-	buffer->setData(data, points.size(), 32, true);
-	buffer->attributes.add(base::VA_CUSTOM, base::VA_FLOAT4, 0, "loc", 1);
-	buffer->attributes.add(base::VA_CUSTOM, base::VA_FLOAT4, 16, "rot", 1);
-
-	return Geometry{m_mesh, buffer, points.size()};
+	geometry.items = new ItemIndex(index, items, count);
+	return geometry;
 }
 
 // ----------------------------------------------------------------------------------------------------- //
 
+void FoliageInstanceLayer::getRemoved(const Index& cell, std::vector<uint32>& out) const {
+	MutexLock lock(m_removedMutex);
+	auto it = m_removedItems.find(cell);
+	if(it != m_removedItems.end()) out = it->second;
+	else out.clear();
+}
+
+void FoliageInstanceLayer::removeInstances(Chunk& chunk, const uint16* ids, size_t count) {
+	ItemIndex* index = chunk.geometry.items;
+	HardwareVertexBuffer* buffer = chunk.geometry.instances;
+	if(!index || !buffer) return;
+	// Move the last instance into the gap so the buffer stays packed
+	size_t instances = chunk.geometry.count;
+	const size_t stride = buffer->getVertexSize() * sizeof(float);
+	for(size_t i=0; i<count; ++i) {
+		if(ids[i] >= index->slots.size()) continue;
+		ItemIndex::Item& item = index->items[ index->slots[ids[i]] ];
+		if(item.instance == ItemIndex::NONE) continue;
+		uint16 last = --instances;
+		if(item.instance != last) {
+			uint16 moved = index->instances[last];
+			memcpy(buffer->getVertex(item.instance), buffer->getVertex(last), stride);
+			index->items[moved].instance = item.instance;
+			index->instances[item.instance] = moved;
+		}
+		index->instances[last] = ItemIndex::NONE;
+		item.instance = ItemIndex::NONE;
+	}
+	if(instances == chunk.geometry.count) return;
+	chunk.geometry.count = instances;
+	buffer->setVertexCount(instances);
+	uploadBuffer(buffer);
+	if(chunk.drawable) chunk.drawable->setInstanceCount(instances);
+	if(chunk.lod) chunk.lod->slack = -1;
+}
+
+void FoliageInstanceLayer::applyRemoved(Chunk& chunk) {
+	if(!chunk.geometry.items) return;
+	std::vector<uint32> bits;
+	getRemoved(chunk.geometry.items->cell, bits);
+	std::vector<uint16> ids;
+	for(size_t i=0; i<bits.size(); ++i) {
+		for(uint32 b=bits[i]; b; b&=b-1) {
+			int bit = 0;
+			while(!(b>>bit & 1)) ++bit;
+			ids.push_back(i*32 + bit);
+		}
+	}
+	if(!ids.empty()) removeInstances(chunk, ids.data(), ids.size());
+}
+
 void FoliageInstanceLayer::removeItem(const FoliageItemRef& ref) {
-	m_removedItems[ref.cell].push_back(ref.index);
-	// flag changed
+	removeItems(ref.cell, std::vector<uint16>(1, ref.index));
 }
+
 void FoliageInstanceLayer::removeItems(const Point& cell, const std::vector<uint16>& indices) {
-	std::vector<uint16>& rm = m_removedItems[cell];
-	rm.insert(rm.end(), indices.begin(), indices.end());
-	// flag changed
+	if(indices.empty()) return;
+	{
+		MutexLock lock(m_removedMutex);
+		std::vector<uint32>& bits = m_removedItems[cell];
+		for(uint16 i: indices) {
+			if(i/32u >= bits.size()) bits.resize(i/32 + 1, 0);
+			bits[i/32] |= 1u << (i&31);
+		}
+	}
+	// Pending geometry is updated when it completes
+	if(Chunk* chunk = m_chunks.find(cell)) removeInstances(*chunk, indices.data(), indices.size());
 }
+
 void FoliageInstanceLayer::restoreItem(const FoliageItemRef& ref) {
-	auto it = m_removedItems.find(ref.cell);
-	if(it == m_removedItems.end()) return;
-	for(size_t i=0; i<it->second.size(); ++i) {
-		if(it->second[i] == ref.index) {
-			it->second.erase(it->second.begin() + i);
-			// flag changed
-			break;
-		}
+	{
+		MutexLock lock(m_removedMutex);
+		auto it = m_removedItems.find(ref.cell);
+		if(it == m_removedItems.end() || !isRemoved(it->second, ref.index)) return;
+		std::vector<uint32>& bits = it->second;
+		bits[ref.index/32] &= ~(1u << (ref.index&31));
+		while(!bits.empty() && bits.back() == 0) bits.pop_back();
+		if(bits.empty()) m_removedItems.erase(it);
 	}
+	// Instance data is not kept for removed items, so regenerate the chunk
+	Chunk* chunk = m_chunks.find(ref.cell);
+	if(chunk && chunk->state != EMPTY) m_parent->queueChunk(this, ref.cell, chunk);
 }
 
 const std::vector<FoliageItemRef> FoliageInstanceLayer::getItems(const vec3& point, float radius, bool includeUnloaded) const {
 	std::vector<FoliageItemRef> result;
 	IndexList cells;
 	PointList points;
+	std::vector<uint32> removed;
 	vec3 up;
+	const float r2 = radius * radius;
 	m_parent->getActive(point, m_chunkSize, radius, cells);
 	for(const Index& cellIndex: cells) {
-		auto it = m_chunks.find(cellIndex);
-		if(it!=m_chunks.end() && it->second->state == COMPLETE) {
-			result.reserve(result.size() + it->second->geometry.count);
-			for(size_t i=0; i<it->second->geometry.count; ++i) {
-				const float* vx = it->second->geometry.instances->getVertex(i);
-				result.push_back({cellIndex, (uint16)i, vx, vx[3]});
-				// FIXME: adjust index for removed items
-			}
+		const Chunk* chunk = m_chunks.find(cellIndex);
+		if(chunk && chunk->geometry.items) {
+			chunk->geometry.items->query(point, radius, [&](const ItemIndex::Item& item) {
+				result.push_back({cellIndex, item.id, item.position, item.scale});
+			});
 		}
 		else if(includeUnloaded) {
+			// Positions only. Random values must match generateGeometry to get scales
 			points.clear();
 			generatePoints(cellIndex, points, up);
-			result.reserve(result.size() + points.size());
-			RNG rng(0); // Match generateGeometry to get scales
-			for(size_t i=0; i<points.size(); ++i) {
+			getRemoved(cellIndex, removed);
+			size_t count = std::min(points.size(), (size_t)ItemIndex::NONE);
+			RNG rng(0);
+			for(size_t i=0; i<count; ++i) {
 				rng.rand();
 				if(m_alignMode >= ABSOLUTE) rng.randf();
 				float scale = rng.randf(m_scaleRange);
-				result.push_back({cellIndex, (uint16)i, points[i].position, scale});
+				if(points[i].position.distance2(point) <= r2 && !isRemoved(removed, i)) {
+					result.push_back({cellIndex, (uint16)i, points[i].position, scale});
+				}
 			}
 		}
 	}
@@ -428,19 +1054,20 @@ const std::vector<FoliageItemRef> FoliageInstanceLayer::getItems(const vec3& poi
 
 
 void FoliageInstanceLayer::destroyGeometry(Geometry& geometry) const {
-	if(geometry.mesh) {
-		delete geometry.instances;
-		geometry.mesh = nullptr;
-		geometry.instances = nullptr;
-		geometry.count = 0;
-	}
+	delete geometry.items;
+	if(geometry.instances && geometry.instances->dropReference() == 0) delete geometry.instances;
+	geometry = Geometry();
 }
 
 
 // ===================================================================================================== //
 
 GrassLayer::GrassLayer(float cs, float r): FoliageLayer(cs,r), m_size(1,1), m_tiles(1), m_scaleMap(0) {}
-GrassLayer::~GrassLayer() { deleteMap(m_scaleMap); }
+GrassLayer::~GrassLayer() {
+	clear();
+	clearPool();
+	deleteMap(m_scaleMap);
+}
 void GrassLayer::setSpriteSize(float w, float h, int tile) {
 	m_size.set(w,h);
 	m_tiles = tile<1? 1: tile;
@@ -456,24 +1083,59 @@ FoliageLayer::Geometry GrassLayer::generateGeometry(const Index& index) const {
 	PointList points;
 	generatePoints(index, points, up);
 	if(points.empty()) return Geometry{0,0,0};
+	if(points.size() > 16384) points.resize(16384); // 16 bit indices
 	Quaternion rot = Quaternion::arc( vec3(0,1,0), up );
 	float hw = m_size.x / 2;
 	float lean = 0.4;
 	up *= m_size.y;
 
+	std::vector<float> mapScale;
+	if(m_scaleMap) {
+		std::vector<vec3> positions(points.size());
+		for(size_t i=0; i<points.size(); ++i) positions[i] = points[i].position;
+		mapScale.resize(points.size());
+		m_parent->getMapValues(m_scaleMap, m_mapBounds, positions.data(), positions.size(), mapScale.data());
+	}
+
+	// Get a mesh. Index data is fixed, so is only built for new meshes
+	Geometry geometry;
+	if(!acquireGeometry(points.size(), geometry)) {
+		size_t capacity = geometry.capacity;
+		HardwareVertexBuffer* vbuffer = new HardwareVertexBuffer();
+		vbuffer->attributes.add(VA_VERTEX, VA_FLOAT3);
+		vbuffer->attributes.add(VA_NORMAL, VA_FLOAT3);
+		vbuffer->attributes.add(VA_TANGENT, VA_FLOAT3);
+		vbuffer->attributes.add(VA_TEXCOORD, VA_FLOAT2);
+		vbuffer->setData(new float[capacity * 4 * 11], capacity*4, vbuffer->attributes.getStride(), true);
+
+		unsigned short* idata = new unsigned short[capacity * 6];
+		unsigned short* ix = idata;
+		for(size_t k=0; k<capacity*4; k+=4, ix+=6) {
+			ix[0] = ix[3] = k;
+			ix[1] = k+1;
+			ix[2] = ix[4] = k+2;
+			ix[5] = k+3;
+		}
+		HardwareIndexBuffer* ibuffer = new HardwareIndexBuffer();
+		ibuffer->setData(idata, capacity*6, true);
+
+		geometry.mesh = new Mesh();
+		geometry.mesh->setPolygonMode(base::PolygonMode::TRIANGLES);
+		geometry.mesh->setVertexBuffer(vbuffer);
+		geometry.mesh->setIndexBuffer(ibuffer);
+	}
+	geometry.mesh->getVertexBuffer()->setVertexCount(points.size()*4);
+	geometry.mesh->getIndexBuffer()->setIndexCount(points.size()*6);
+
 	RNG rng(0);
 	vec3 direction;
-	float* vdata = new float[ points.size() * 4 * 11 ];
-	unsigned short* idata = new unsigned short[ points.size() * 6 ];
-	float* vx = vdata;
-	unsigned short* ix = idata;
-	unsigned short k = 0;
+	float* vx = geometry.mesh->getVertexBuffer()->getVertex(0);
 	for(GenPoint& point: points) {
 		// Random direction
 		float angle = rng.randf() * TWOPI;
 		float s = rng.randf(m_scaleRange);
 		if(m_scaleMap) {
-			float ms = getMapValue(m_scaleMap, point.position);
+			float ms = mapScale[&point - points.data()];
 			s *= m_scaleMapRange.min + ms * m_scaleMapRange.size();
 		}
 
@@ -498,58 +1160,36 @@ FoliageLayer::Geometry GrassLayer::generateGeometry(const Index& index) const {
 		// UVs
 		vx[9]  = vx[20] = vx[21] = vx[32] = 0;
 		vx[10] = vx[31] = vx[42] = vx[43] = 1;
-		// Index
-		ix[0] = ix[3] = k;
-		ix[1] = k+1;
-		ix[2] = ix[4] = k+2;
-		ix[5] = k+3;
-		// Next
-		k += 4;
-		ix += 6;
 		vx += 44;
 	}
-
-	// Build buffer objects
-	HardwareVertexBuffer* vbuffer = new HardwareVertexBuffer();
-	vbuffer->attributes.add(VA_VERTEX, VA_FLOAT3);
-	vbuffer->attributes.add(VA_NORMAL, VA_FLOAT3);
-	vbuffer->attributes.add(VA_TANGENT, VA_FLOAT3);
-	vbuffer->attributes.add(VA_TEXCOORD, VA_FLOAT2);
-	vbuffer->setData(vdata, points.size()*4, vbuffer->attributes.getStride(), true);
-
-	HardwareIndexBuffer* ibuffer = new HardwareIndexBuffer();
-	ibuffer->setData(idata, points.size()*6, true);
-
-	// Drawable
-	Mesh* mesh = new Mesh();
-	mesh->setPolygonMode(base::PolygonMode::TRIANGLES);
-	mesh->setVertexBuffer(vbuffer);
-	mesh->setIndexBuffer(ibuffer);
-	return Geometry{ mesh, nullptr, 0 };
+	geometry.count = points.size();
+	return geometry;
 }
 
 void GrassLayer::destroyGeometry(Geometry& geometry) const {
-	if(geometry.mesh) {
-		delete geometry.mesh;
-		geometry.mesh = nullptr;
-		geometry.count = 0;
-	}
+	delete geometry.mesh;
+	geometry = Geometry();
 }
 
 
 // ===================================================================================================== //
 
 
-FoliageSystem::FoliageSystem(int threads) : m_threads(0), m_threadCount(threads), m_running(true) {
+FoliageSystem::FoliageSystem(int threads) : m_threads(0), m_threadCount(threads), m_running(true), m_completed(nullptr) {
 	if(threads) m_threads = new Thread[threads];
 	for(int i=0; i<threads; ++i) m_threads[i].begin(this, &FoliageSystem::threadFunc, i);
 }
 FoliageSystem::~FoliageSystem() {
+	m_mutex.lock();
 	m_running = false;
+	m_condition.notifyAll();
+	m_mutex.unlock();
 	for(int i=0; i<m_threadCount; ++i) m_threads[i].join();
+	processCompleted();
 	for(FoliageLayer* layer: m_layers) {
 		delete layer;
 	}
+	for(GenChunk* job: m_queue) delete job;
 	delete [] m_threads;
 }
 void FoliageSystem::addLayer(FoliageLayer* l) {
@@ -560,6 +1200,7 @@ void FoliageSystem::addLayer(FoliageLayer* l) {
 
 void FoliageSystem::removeLayer(FoliageLayer* l) {
 	removeChild(l);
+	l->clear(); // Chunks need the system to cancel their jobs
 	l->m_parent = nullptr;
 	for(size_t i=0; i<m_layers.size(); ++i) {
 		if(m_layers[i] == l) {
@@ -571,21 +1212,22 @@ void FoliageSystem::removeLayer(FoliageLayer* l) {
 }
 
 void FoliageSystem::update(const vec3& context) {
-	if(!m_sorted) {
-		MutexLock scopedLock(m_mutex);
-		std::sort(m_queue.begin(), m_queue.end(), [context](const GenChunk& a, const GenChunk& b) { return a.centre.distance2(context) > b.centre.distance2(context); });
-		m_sorted = true;
-	}
+	processCompleted();
+
 	// Single thread version
 	if(!m_threads) {
 		for(int i=0; i<10 && !m_queue.empty(); ++i) {
-			m_queue.back().chunk->swap = m_queue.back().layer->generateGeometry(m_queue.back().index);
-			m_queue.back().chunk->state = FoliageLayer::GENERATED;
+			GenChunk* job = m_queue.back();
 			m_queue.pop_back();
+			job->geometry = job->layer->generateGeometry(job->index);
+			job->next = m_completed;
+			m_completed = job;
 		}
+		processCompleted();
 	}
 
 	for(FoliageLayer* layer : m_layers) layer->update(context);
+	prioritise(context);
 }
 
 
@@ -594,47 +1236,83 @@ void FoliageSystem::update(const vec3& context) {
 void FoliageSystem::queueChunk(FoliageLayer* layer, const Index& index, FoliageLayer::Chunk* chunk) {
 	static vec3 corners[5];
 	getCorners(index, layer->m_chunkSize, corners, corners[4]);
-	vec3 centre = (corners[0] + corners[2]) * 0.5;
+	vec3 centre = (corners[0] + corners[3]) * 0.5;
+	if(chunk->state == FoliageLayer::EMPTY) chunk->state = FoliageLayer::GENERATING;
+	++chunk->jobs;
+	GenChunk* job = new GenChunk{ layer, index, chunk, centre, 0, {}, nullptr };
 	MutexLock scopedLock(m_mutex);
-	m_queue.push_back( GenChunk { layer, index, chunk, centre } );
-	m_sorted = false;
+	m_queue.push_back(job);
+	m_condition.notify();
 }
+
 bool FoliageSystem::cancelChunk(FoliageLayer::Chunk* chunk) {
-	if(chunk->state > FoliageLayer::GENERATING) return true;
-	if(chunk->state == FoliageLayer::GENERATING) return false;
-	MutexLock scopedLock(m_mutex);
-	for(size_t i=0; i<m_queue.size(); ++i) {
-		if(m_queue[i].chunk == chunk) {
-			m_queue[i] = m_queue.back();
-			m_queue.pop_back();
-			return true;
+	// Queued jobs are dropped in prioritise(), running ones are discarded when they complete
+	chunk->cancelled = true;
+	return chunk->jobs == 0;
+}
+
+void FoliageSystem::prioritise(const vec3& context) {
+	std::vector<GenChunk*> cancelled;
+	{
+		MutexLock scopedLock(m_mutex);
+		size_t count = 0;
+		for(GenChunk* job: m_queue) {
+			if(job->chunk->cancelled) cancelled.push_back(job);
+			else {
+				vec3 local = job->layer->getDerivedTransform().untransform(context);
+				job->priority = job->centre.distance2(local);
+				m_queue[count++] = job;
+			}
 		}
+		m_queue.resize(count);
+		std::sort(m_queue.begin(), m_queue.end(), [](const GenChunk* a, const GenChunk* b) { return a->priority > b->priority; });
 	}
-	return true;
+	for(GenChunk* job: cancelled) releaseJob(job);
 }
-void FoliageSystem::threadFunc(int index) {
-	GenChunk current{0,Index(),0};
-	while(m_running) {
-		m_mutex.lock();
-		if(m_queue.empty()) current.chunk = 0;
+
+void FoliageSystem::processCompleted() {
+	GenChunk* job = m_completed.exchange(nullptr, std::memory_order_acquire);
+	while(job) {
+		GenChunk* next = job->next;
+		FoliageLayer::Chunk* chunk = job->chunk;
+		if(chunk->cancelled) job->layer->recycleGeometry(job->geometry);
 		else {
-			current = m_queue.back();
-			m_queue.pop_back();
-			current.chunk->state = FoliageLayer::GENERATING;
+			job->layer->recycleGeometry(chunk->swap);
+			chunk->swap = job->geometry;
+			chunk->state = FoliageLayer::GENERATED;
 		}
-		m_mutex.unlock();
+		releaseJob(job);
+		job = next;
+	}
+}
+
+void FoliageSystem::releaseJob(GenChunk* job) {
+	FoliageLayer::Chunk* chunk = job->chunk;
+	if(--chunk->jobs == 0 && chunk->cancelled) {
+		job->layer->recycleGeometry(chunk->swap);
+		--job->layer->m_cancelled;
+		job->layer->freeChunk(chunk);
+	}
+	delete job;
+}
 
-		// Generate this chunk
-		if(current.chunk) {
-			FoliageLayer::Geometry g = current.layer->generateGeometry(current.index);
-				
-			m_mutex.lock();
-			current.layer->destroyGeometry(current.chunk->swap);
-			current.chunk->swap = g;
-			current.chunk->state = FoliageLayer::GENERATED;
+void FoliageSystem::threadFunc(int index) {
+	while(true) {
+		m_mutex.lock();
+		while(m_running && m_queue.empty()) m_condition.wait(m_mutex);
+		if(!m_running) {
 			m_mutex.unlock();
+			break;
 		}
-		else Thread::sleep(1);
+		GenChunk* job = m_queue.back();
+		m_queue.pop_back();
+		m_mutex.unlock();
+
+		job->geometry = job->layer->generateGeometry(job->index);
+
+		// Push to completed list
+		job->next = m_completed.load(std::memory_order_relaxed);
+		while(!m_completed.compare_exchange_weak(job->next, job, std::memory_order_release, std::memory_order_relaxed));
 	}
 }
 
@@ -657,8 +1335,27 @@ void FoliageSystem::getCorners(const Index& ix, float cs, vec3* out, vec3& up) c
 }
 
 float FoliageSystem::getMapValue(const FoliageMap* map, const BoundingBox2D& bounds, const vec3& pos) const {
-	vec2 p = (pos.xz() - bounds.min) / bounds.size();
-	return map->getValue(p.x, p.y);
+	float value;
+	getMapValues(map, bounds, &pos, 1, &value);
+	return value;
+}
+
+void FoliageSystem::getMapValues(const FoliageMap* map, const BoundingBox2D& bounds, const vec3* pos, size_t count, float* out) const {
+	vec2 coords[256];
+	const vec2 scale = vec2(1,1) / bounds.size();
+	for(size_t first=0; first<count; first+=256) {
+		size_t n = std::min<size_t>(256, count - first);
+		for(size_t i=0; i<n; ++i) coords[i] = (pos[first+i].xz() - bounds.min) * scale;
+		map->getValues(coords, n, out + first);
+	}
+}
+
+void FoliageSystem::resolvePositions(const vec3* points, size_t count, vec3* positions, float* heights) const {
+	for(size_t i=0; i<count; ++i) resolvePosition(points[i], positions[i], heights[i]);
+}
+
+void FoliageSystem::resolveNormals(const vec3* points, size_t count, vec3* normals) const {
+	for(size_t i=0; i<count; ++i) resolveNormal(points[i], normals[i]);
 }
 
 unsigned FoliageSystem::getSeed(const Point& index, float size) const {
@@ -6,6 +6,7 @@
 #include <base/material.h>
 #include <base/model.h>
 #include <base/mesh.h>
+#include <base/primitives.h>
 
 using namespace base;
 using namespace particle;
@@ -39,7 +40,17 @@ void* ParticleInstance::createDrawable(const RenderData* data) {
 	tag->buffer->setData(nullptr, 0, tag->buffer->attributes.getStride(), false); // set stride
 	tag->stride = data->getVertexAttributes().calculateStride();
 
-	if(data->getDataType() == RenderData::INSTANCE) {
+	if(data->getDataType() == RenderData::INSTANCE && !data->getInstancedMesh()) {
+		// GPU expanded sprites. Quad corners are vertex.xz
+		tag->instanced = true;
+		tag->mesh = createPlane(vec2(2,2));
+		tag->drawable = new DrawableMesh(tag->mesh);
+		tag->drawable->setMaterial(Resources::getInstance()->materials.get("particlesprite.mat"));
+		tag->drawable->setInstanceBuffer(tag->buffer);
+		tag->drawable->setInstanceCount(0);
+		tag->drawable->setRenderQueue(m_renderQueue);
+	}
+	else if(data->getDataType() == RenderData::INSTANCE) {
 		tag->instanced = true;
 		Model* model = Resources::getInstance()->models.get(data->getInstancedMesh());
 		if(model) {
@@ -77,7 +88,8 @@ void ParticleInstance::createMaterial(const RenderData* data) {
 		Resources& res = *Resources::getInstance();
 		Material* mat = res.materials.getIfExists(name);
 		if(!mat) {
-			Material* base = res.materials.get(tag->instanced? "particleinst.mat": "particle.mat");
+			const char* baseName = !tag->instanced? "particle.mat": tag->mesh? "particlesprite.mat": "particleinst.mat";
+			Material* base = res.materials.get(baseName);
 			Texture* tex = res.textures.get(name);
 			if(tex && base) {
 				mat = base->clone();
@@ -95,7 +107,7 @@ void ParticleInstance::destroyDrawables() {
 	for(RenderInstance& r : m_renderers) {
 		if(TagData* a = (TagData*)r.drawable) {
 			if(a->instanced) delete a->buffer;
-			else delete a->mesh;
+			delete a->mesh;
 			r.drawable = 0;
 			delete a;
 		}
@@ -28,6 +28,27 @@ void TerrainFoliage::resolveNormal(const vec3& point, vec3& normal) const {
 	normal = b.cross(a).normalised();
 }
 
+void TerrainFoliage::resolvePositions(const vec3* points, size_t count, vec3* pos, float* heights) const {
+	const vec3 offset = &m_terrain->getTransform()[12];
+	const Landscape& land = *m_terrain->getLandscape();
+	for(size_t i=0; i<count; ++i) {
+		heights[i] = land.getHeight(points[i].x - offset.x, points[i].z - offset.z, true);
+		pos[i].set(points[i].x, heights[i], points[i].z);
+	}
+}
+
+void TerrainFoliage::resolveNormals(const vec3* points, size_t count, vec3* normals) const {
+	const vec3 offset = &m_terrain->getTransform()[12];
+	const Landscape& land = *m_terrain->getLandscape();
+	for(size_t i=0; i<count; ++i) {
+		float x = points[i].x - offset.x;
+		float z = points[i].z - offset.z;
+		vec3 a(2, land.getHeight(x+1, z, true) - land.getHeight(x-1, z, true), 0);
+		vec3 b(0, land.getHeight(x, z+1, true) - land.getHeight(x, z-1, true), 2);
+		normals[i] = b.cross(a).normalised();
+	}
+}
+
 int TerrainFoliage::getActive(const vec3& p, float cellSize, float rangeLimit, IndexList& out) const {
 	Point a( floor((p.x-rangeLimit)/cellSize), floor((p.z-rangeLimit)/cellSize) );
 	Point b( ceil((p.x+rangeLimit)/cellSize), ceil((p.z+rangeLimit)/cellSize) );